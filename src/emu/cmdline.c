@@ -433,6 +433,17 @@ static struct cli_commandset default_cmdset = {
 	default_cmds,
 };
 
+/* add default commands once, a script may be run before cli_main_entry() */
+static void cli_add_default_cmdset(void)
+{
+	static BOOL added = FALSE;
+
+	if (!added) {
+		cli_add_commandset(&default_cmdset);
+		added = TRUE;
+	}
+}
+
 static BOOL match_cmd(const char *src, int start, int end, const char *des)
 {
 	while (src[start] == ' ' && start < end) 
@@ -561,6 +572,7 @@ int cli_interpret(const char *line)
 	const struct cli_command *cmd;
 	int ret = -1;
 
+	cli_add_default_cmdset();
 	cli_parse_args(line, &arg);
 
 	if (arg.argc > 0) {
@@ -597,7 +609,7 @@ void cli_main_entry()
 	char *p;
 
 	MSG("$ ");
-	cli_add_commandset(&default_cmdset);
+	cli_add_default_cmdset();
 
 	while (!m_exit) {
 		char ch;
@@ -46,6 +46,7 @@
 #include "uffs/uffs_core.h"
 #include "uffs/uffs_mtb.h"
 #include "uffs/uffs_find.h"
+#include "uffs/uffs_timing.h"
 #include "cmdline.h"
 #include "uffs/uffs_fd.h"
 #include "uffs/uffs_mtb.h"
@@ -167,9 +168,10 @@ static int cmd_cd(int argc, char *argv[])
 static int cmd_ls(int argc, char *argv[])
 {
 	uffs_DIR *dirp;
+	struct uffs_direntplus ents[8];
 	struct uffs_dirent *ent;
-	struct uffs_stat stat_buf;
 	int count = 0;
+	int i, n;
 	char buf[MAX_PATH_LENGTH+2];
 	const char *name = "/";
 	char *sub;
@@ -187,25 +189,25 @@ static int cmd_ls(int argc, char *argv[])
 	}
 	else {
 		MSG("------name-----------size---------serial-----" TENDSTR);
-		ent = uffs_readdir(dirp);
-		while (ent) {
-			MSG("%9s", ent->d_name);
-			strcpy(buf, name);
-			sub = buf;
-			if (name[strlen(name)-1] != '/')
-				sub = strcat(buf, "/");
-			sub = strcat(sub, ent->d_name);
-			if (ent->d_type & FILE_ATTR_DIR) {
-				sub = strcat(sub, "/");
-				MSG("/  \t<%8d>", CountObjectUnder(sub));
+		while ((n = uffs_readdirplus(dirp, ents, ARRAY_SIZE(ents))) > 0) {
+			for (i = 0; i < n; i++) {
+				ent = &ents[i].d;
+				MSG("%9s", ent->d_name);
+				if (ent->d_type & FILE_ATTR_DIR) {
+					strcpy(buf, name);
+					sub = buf;
+					if (name[strlen(name)-1] != '/')
+						sub = strcat(buf, "/");
+					sub = strcat(sub, ent->d_name);
+					sub = strcat(sub, "/");
+					MSG("/  \t<%8d>", CountObjectUnder(sub));
+				}
+				else {
+					MSG("   \t %8d ", ents[i].st.st_size);
+				}
+				MSG("\t%6d" TENDSTR, ent->d_ino);
+				count++;
 			}
-			else {
-				uffs_stat(sub, &stat_buf);
-				MSG("   \t %8d ", stat_buf.st_size);
-			}
-			MSG("\t%6d" TENDSTR, ent->d_ino);
-			count++;
-			ent = uffs_readdir(dirp);
 		}
 		
 		uffs_closedir(dirp);
@@ -321,7 +323,13 @@ static int cmd_st(int argc, char *argv[])
 	uffs_Device *dev;
 	const char *mount = "/";
 	uffs_FlashStat *s;
+	uffs_CacheStat *c;
+	uffs_WriteStat *w;
 	TreeNode *node;
+#ifdef CONFIG_ENABLE_TIMING_STAT
+	uffs_TimingHist hist;
+	int i;
+#endif
 
 	if (argc > 1) {
 		mount = argv[1];
@@ -334,6 +342,8 @@ static int cmd_st(int argc, char *argv[])
 	}
 
 	s = &(dev->st);
+	c = &(dev->cache_st);
+	w = &(dev->write_st);
 
 	MSG("----------- basic info -----------" TENDSTR);
 	MSG("TreeNode size:         %d" TENDSTR, sizeof(TreeNode));
@@ -341,6 +351,7 @@ static int cmd_st(int argc, char *argv[])
 	MSG("MaxCachedBlockInfo:    %d" TENDSTR, dev->cfg.bc_caches);
 	MSG("MaxPageBuffers:        %d" TENDSTR, dev->cfg.page_buffers);
 	MSG("MaxDirtyPagesPerBlock: %d" TENDSTR, dev->cfg.dirty_pages);
+	MSG("MaxCachedFileInfo:     %d" TENDSTR, dev->cfg.fi_caches);
 	MSG("MaxPathLength:         %d" TENDSTR, MAX_PATH_LENGTH);
 	MSG("MaxObjectHandles:      %d" TENDSTR, MAX_OBJECT_HANDLE);
 	MSG("FreeObjectHandles:     %d" TENDSTR, uffs_GetFreeObjectHandlers());
@@ -358,6 +369,22 @@ static int cmd_st(int argc, char *argv[])
 	MSG("I/O Read:              %lu" TENDSTR, s->io_read);
 	MSG("I/O Write:             %lu" TENDSTR, s->io_write);
 
+	MSG("----------- cache statistics for '%s' -----------" TENDSTR, mount);
+	MSG("Buffer Get Hit/Miss:    %d / %d" TENDSTR, c->buf_get_hit, c->buf_get_miss);
+	MSG("Buffer New Hit/Miss:    %d / %d" TENDSTR, c->buf_new_hit, c->buf_new_miss);
+	MSG("Buffer Evicted:         %d" TENDSTR, c->buf_evict);
+	MSG("Forced Group Flush:     %d" TENDSTR, c->buf_forced_flush);
+	MSG("BlockInfo Hit/Miss:     %d / %d" TENDSTR, c->bc_hit, c->bc_miss);
+	MSG("BlockInfo Insufficient: %d" TENDSTR, c->bc_insufficient);
+	MSG("Tag Load/Avoided:       %d / %d" TENDSTR, c->tag_load, c->tag_load_avoided);
+	MSG("FileInfo Hit/Miss:      %d / %d" TENDSTR, c->fi_hit, c->fi_miss);
+
+	MSG("----------- write statistics for '%s' -----------" TENDSTR, mount);
+	MSG("Bytes Written:          %u" TENDSTR, w->bytes_written);
+	MSG("Pages Programmed:       %u" TENDSTR, w->pages_programmed);
+	MSG("Pages Copied:           %u" TENDSTR, w->pages_copied);
+	MSG("Blocks Erased:          %u" TENDSTR, w->blocks_erased);
+
 	MSG("--------- partition info for '%s' ---------" TENDSTR, mount);
 	MSG("Space total:           %d" TENDSTR, uffs_GetDeviceTotal(dev));
 	MSG("Space used:            %d" TENDSTR, uffs_GetDeviceUsed(dev));
@@ -377,6 +404,19 @@ static int cmd_st(int argc, char *argv[])
 		MSG(TENDSTR);
 	}
 
+#ifdef CONFIG_ENABLE_TIMING_STAT
+	MSG("----------- timing statistics (us) -----------" TENDSTR);
+	MSG("%-18s %8s %8s %8s %8s %8s %8s" TENDSTR, "", "count", "avg", "p50", "p90", "p99", "max");
+	for (i = 0; i < UFFS_TM_MAX; i++) {
+		if (uffs_TimingGet(i, &hist) == U_SUCC && hist.count > 0) {
+			MSG("%-18s %8u %8u %8u %8u %8u %8u" TENDSTR, uffs_TimingName(i),
+				hist.count, hist.total / hist.count,
+				uffs_TimingPercentile(&hist, 50), uffs_TimingPercentile(&hist, 90),
+				uffs_TimingPercentile(&hist, 99), hist.max);
+		}
+	}
+#endif
+
 	uffs_PutDevice(dev);
 
 	return 0;
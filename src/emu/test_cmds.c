@@ -49,6 +49,7 @@
 #include "uffs/uffs_tree.h"
 #include "cmdline.h"
 #include "api_test.h"
+#include "uffs_fileem.h"
 
 #define PFX "test: "
 
@@ -637,7 +638,7 @@ static int cmd_TestPageReadWrite(int argc, char *argv[])
 	uffs_Tags local_tag;
 	uffs_Tags *tag = &local_tag;
 	int ret;
-	u16 block;
+	uffs_BlockNum block;
 	u16 page;
 	uffs_Buf *buf = NULL;
 
@@ -667,9 +668,9 @@ static int cmd_TestPageReadWrite(int argc, char *argv[])
 
 	TAG_DIRTY_BIT(tag) = TAG_DIRTY;
 	TAG_VALID_BIT(tag) = TAG_VALID;
-	TAG_DATA_LEN(tag) = dev->com.pg_data_size;
+	TAG_SET_DATA_LEN(tag, dev->com.pg_data_size);
 	TAG_TYPE(tag) = UFFS_TYPE_DATA;
-	TAG_PAGE_ID(tag) = 3;
+	TAG_SET_PAGE_ID(dev, tag, 3);
 	TAG_PARENT(tag) = 100;
 	TAG_SERIAL(tag) = 10;
 	TAG_BLOCK_TS(tag) = 1;
@@ -1043,6 +1044,57 @@ static int cmd_tclose(int argc, char *argv[])
 		return -1;
 }
 
+/**
+ * flush file
+ *	t_flush <fd>
+ */
+static int cmd_tflush(int argc, char *argv[])
+{
+	int fd;
+
+	CHK_ARGC(2, 2);
+
+	if (sscanf(argv[1], "%d", &fd) == 1) {
+		return uffs_flush(fd);
+	}
+	else
+		return -1;
+}
+
+/**
+ * show write statistic of opened file
+ *	t_wstat <fd>
+ * if success, $1 = bytes written, $2 = pages programmed,
+ *			   $3 = pages copied, $4 = blocks erased
+ */
+static int cmd_twstat(int argc, char *argv[])
+{
+	int fd;
+	struct uffs_wstat ws;
+
+	CHK_ARGC(2, 2);
+
+	if (sscanf(argv[1], "%d", &fd) != 1)
+		return -1;
+
+	if (uffs_fwstat(fd, &ws) < 0)
+		return -1;
+
+	MSGLN("fd %d: wrote %lu bytes, programmed %lu pages (copied %lu), erased %lu blocks",
+			fd, ws.ws_bytes, ws.ws_programmed, ws.ws_copied, ws.ws_erased);
+	if (ws.ws_bytes > 0)
+		MSGLN("write amplification: %lu.%02lu",
+				ws.ws_programmed * ws.ws_page_size / ws.ws_bytes,
+				ws.ws_programmed * ws.ws_page_size * 100 / ws.ws_bytes % 100);
+
+	cli_env_set('1', ws.ws_bytes);
+	cli_env_set('2', ws.ws_programmed);
+	cli_env_set('3', ws.ws_copied);
+	cli_env_set('4', ws.ws_erased);
+
+	return 0;
+}
+
 /**
  * write file
  *	t_write <fd> <txt> [..]
@@ -1147,6 +1199,159 @@ static int cmd_truncate(int argc, char *argv[])
 	return (ret < 0 ? -1 : 0);
 }
 
+/**
+ * list <dir> by readdirplus, <n> entries per call, check against uffs_stat()
+ *	t_dirplus <dir> <n>
+ * if success, $1 = number of entries
+ */
+static int cmd_tdirplus(int argc, char *argv[])
+{
+	uffs_DIR *dirp;
+	struct uffs_direntplus ents[16];
+	struct uffs_stat st;
+	char name[256 + 256];
+	const char *dir;
+	int n, i, got, count = 0;
+	int ret = 0;
+
+	CHK_ARGC(3, 3);
+
+	dir = argv[1];
+	if (sscanf(argv[2], "%d", &n) != 1 || n <= 0 || n > ARRAY_SIZE(ents))
+		return -1;
+
+	dirp = uffs_opendir(dir);
+	if (dirp == NULL) {
+		MSGLN("Can't open dir %s", dir);
+		return -1;
+	}
+
+	while (ret == 0 && (got = uffs_readdirplus(dirp, ents, n)) > 0) {
+		for (i = 0; i < got; i++) {
+			sprintf(name, "%s%s%s%s", dir, dir[strlen(dir) - 1] == '/' ? "" : "/",
+					ents[i].d.d_name, ents[i].d.d_type & FILE_ATTR_DIR ? "/" : "");
+			if (uffs_stat(name, &st) < 0) {
+				MSGLN("stat %s failed", name);
+				ret = -1;
+				break;
+			}
+			if (st.st_ino != ents[i].st.st_ino || st.st_ino != ents[i].d.d_ino ||
+				st.st_size != ents[i].st.st_size || st.st_mode != ents[i].st.st_mode ||
+				st.st_mtime != ents[i].st.st_mtime || st.st_ctime != ents[i].st.st_ctime) {
+				MSGLN("%s attributes mismatched", name);
+				ret = -1;
+				break;
+			}
+			count++;
+		}
+	}
+	uffs_closedir(dirp);
+
+	if (ret == 0)
+		cli_env_set('1', count);
+
+	return ret;
+}
+
+/**
+ * skip <size> bytes from file pointer
+ *	t_skip <fd> <size>
+ * if success, $1 = bytes skipped
+ */
+static int cmd_tskip(int argc, char *argv[])
+{
+	int fd, size, ret;
+
+	CHK_ARGC(3, 3);
+
+	if (sscanf(argv[1], "%d", &fd) != 1 || sscanf(argv[2], "%d", &size) != 1)
+		return -1;
+
+	ret = uffs_skip(fd, size);
+	if (ret < 0)
+		return -1;
+
+	cli_env_set('1', ret);
+
+	return 0;
+}
+
+/**
+ * check file data are all '\0'
+ *	t_check_zero <fd> <ofs> <size>
+ */
+static int cmd_tcheck_zero(int argc, char *argv[])
+{
+	int fd, size, n, i;
+	long ofs;
+	u8 buf[MAX_TEST_BUF_LEN];
+
+	CHK_ARGC(4, 4);
+
+	if (sscanf(argv[1], "%d", &fd) != 1 || sscanf(argv[2], "%ld", &ofs) != 1 ||
+		sscanf(argv[3], "%d", &size) != 1)
+		return -1;
+
+	while (size > 0) {
+		n = (size < sizeof(buf) ? size : sizeof(buf));
+		if (uffs_pread(fd, buf, n, ofs) != n) {
+			MSGLN("read fail! fd = %d, ofs = %ld, size = %d", fd, ofs, n);
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			if (buf[i] != 0) {
+				MSGLN("not zero at %ld", ofs + i);
+				return -1;
+			}
+		}
+		ofs += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+/**
+ * reserve erased blocks for <fd> up to <len> bytes
+ *	t_fallocate <fd> <len>
+ */
+static int cmd_tfallocate(int argc, char *argv[])
+{
+	int fd;
+	long len;
+
+	CHK_ARGC(3, 3);
+
+	if (sscanf(argv[1], "%d", &fd) != 1 || sscanf(argv[2], "%ld", &len) != 1)
+		return -1;
+
+	return (uffs_fallocate(fd, len) < 0 ? -1 : 0);
+}
+
+/**
+ * get free space of <mount> (default: "/")
+ *	t_free [<mount>]
+ * $1 = free space in bytes
+ */
+static int cmd_tfree(int argc, char *argv[])
+{
+	const char *mount = "/";
+	long n;
+
+	CHK_ARGC(1, 2);
+
+	if (argc > 1)
+		mount = argv[1];
+
+	n = uffs_space_free(mount);
+	if (n < 0)
+		return -1;
+
+	cli_env_set('1', (int)n);
+
+	return 0;
+}
+
 /**
  * write random seq to file
  *	t_write_seq <fd> <size>
@@ -1224,6 +1429,153 @@ static int cmd_tread(int argc, char *argv[])
 	return ret;
 }
 
+/**
+ * positional read and check file, file pointer not changed
+ *	t_pread <fd> <offset> <txt>
+ */
+static int cmd_tpread(int argc, char *argv[])
+{
+	int fd;
+	long ofs;
+	int len;
+	char buf[64];
+
+	CHK_ARGC(4, 4);
+
+	if (sscanf(argv[1], "%d", &fd) != 1 || sscanf(argv[2], "%ld", &ofs) != 1)
+		return -1;
+
+	len = strlen(argv[3]);
+	if (len > sizeof(buf))
+		return -1;
+
+	if (uffs_pread(fd, buf, len, ofs) != len || memcmp(buf, argv[3], len) != 0)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * positional write file, file pointer not changed
+ *	t_pwrite <fd> <offset> <txt>
+ */
+static int cmd_tpwrite(int argc, char *argv[])
+{
+	int fd;
+	long ofs;
+	int len;
+
+	CHK_ARGC(4, 4);
+
+	if (sscanf(argv[1], "%d", &fd) != 1 || sscanf(argv[2], "%ld", &ofs) != 1)
+		return -1;
+
+	len = strlen(argv[3]);
+	if (uffs_pwrite(fd, argv[3], len, ofs) != len)
+		return -1;
+
+	cli_env_set('1', len);
+
+	return 0;
+}
+
+/**
+ * atomic write <txt>s to <fd> at <ofs>s, see uffs_pwrite_atomic()
+ *	t_pwatomic <fd> <ofs> <txt> [<ofs> <txt> ...]
+ * if fail, $1 = error number
+ */
+static int cmd_tpwatomic(int argc, char *argv[])
+{
+	int fd;
+	int i, n;
+	long ofs[8];
+	struct uffs_iovec iov[8];
+
+	CHK_ARGC(4, 2 + 8 * 2);
+
+	if (sscanf(argv[1], "%d", &fd) != 1 || (argc % 2) != 0)
+		return -1;
+
+	for (i = 2, n = 0; i < argc; i += 2, n++) {
+		if (sscanf(argv[i], "%ld", &ofs[n]) != 1)
+			return -1;
+		iov[n].iov_base = argv[i + 1];
+		iov[n].iov_len = strlen(argv[i + 1]);
+	}
+
+	if (uffs_pwrite_atomic(fd, iov, ofs, n) < 0) {
+		cli_env_set('1', uffs_get_error());
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * vectored write, each <txt> is an element of I/O vector
+ *	t_writev <fd> <txt> [...]
+ * if success, $1 = bytes wrote
+ */
+static int cmd_twritev(int argc, char *argv[])
+{
+	int fd;
+	int i, n, len = 0;
+	struct uffs_iovec iov[8];
+
+	CHK_ARGC(3, 2 + 8);
+
+	if (sscanf(argv[1], "%d", &fd) != 1)
+		return -1;
+
+	for (i = 2, n = 0; i < argc; i++, n++) {
+		iov[n].iov_base = argv[i];
+		iov[n].iov_len = strlen(argv[i]);
+		len += iov[n].iov_len;
+	}
+
+	if (uffs_writev(fd, iov, n) != len)
+		return -1;
+
+	cli_env_set('1', len);
+
+	return 0;
+}
+
+/**
+ * vectored read, read to elements sized as each <txt> and check against <txt>
+ *	t_readv <fd> <txt> [...]
+ */
+static int cmd_treadv(int argc, char *argv[])
+{
+	int fd;
+	int i, n, len = 0;
+	char buf[8][64];
+	struct uffs_iovec iov[8];
+
+	CHK_ARGC(3, 2 + 8);
+
+	if (sscanf(argv[1], "%d", &fd) != 1)
+		return -1;
+
+	for (i = 2, n = 0; i < argc; i++, n++) {
+		iov[n].iov_base = buf[n];
+		iov[n].iov_len = strlen(argv[i]);
+		if (iov[n].iov_len > sizeof(buf[n]))
+			return -1;
+		len += iov[n].iov_len;
+	}
+
+	if (uffs_readv(fd, iov, n) != len)
+		return -1;
+
+	for (i = 2, n = 0; i < argc; i++, n++) {
+		if (memcmp(buf[n], argv[i], iov[n].iov_len) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 
 static void do_dump_page(uffs_Device *dev, uffs_Buf *buf)
 {
@@ -1325,11 +1677,410 @@ static int cmd_dump(int argc, char *argv[])
 	return 0;
 }
 
+#ifdef UFFS_FEMU_ENABLE_INJECTION
+
+#define PLT_BASE_LEN	3000	// committed file length before power cut
+#define PLT_EXTRA_LEN	20000	// data written after power cut armed
+
+/**
+ * RAM does not survive a power loss: forget open handles, page buffers,
+ * block info references and pending bad blocks of the device, so that
+ * unmount has nothing left to write back.
+ */
+static void do_drop_device_ram(uffs_Device *dev)
+{
+	uffs_Buf *buf;
+	uffs_BlockInfo *bc;
+	int slot;
+
+	uffs_GlobalFsLockLock();
+	uffs_DeviceLock(dev);
+
+	uffs_GlobalTableLock();
+	uffs_DirEntryBufPutAll(dev);
+	uffs_PutAllObjectBuf(dev);
+	uffs_FdSignatureIncrease();
+	uffs_GlobalTableUnlock();
+
+	for (slot = 0; slot < dev->cfg.dirty_groups; slot++) {
+		dev->buf.dirtyGroup[slot].dirty = NULL;
+		dev->buf.dirtyGroup[slot].count = 0;
+		dev->buf.dirtyGroup[slot].lock = 0;
+	}
+
+	for (buf = dev->buf.head; buf; buf = buf->next) {
+		buf->mark = UFFS_BUF_EMPTY;
+		buf->ref_count = 0;
+		buf->next_dirty = buf->prev_dirty = NULL;
+	}
+
+	for (bc = dev->bc.head; bc; bc = bc->next)
+		bc->ref_count = 0;
+
+	uffs_BadBlockInit(dev);
+
+	dev->ref_count = 1;	// only the caller's reference left
+
+	uffs_DeviceUnLock(dev);
+	uffs_GlobalFsLockUnlock();
+}
+
+/**
+ * emulate reboot after power loss: drop RAM, remount partition.
+ * \return remount time in microseconds, or -1 if failed.
+ */
+static int do_power_restore(const char *mount)
+{
+	uffs_Device *dev;
+	unsigned int t;
+
+	dev = uffs_GetDeviceFromMountPoint(mount);
+	if (dev == NULL) {
+		MSGLN("Can't get device from mount point %s", mount);
+		return -1;
+	}
+
+	if (femu_IsPowerLost(dev))
+		do_drop_device_ram(dev);
+
+	uffs_PutDevice(dev);
+
+	if (uffs_UnMount(mount) < 0) {
+		MSGLN("Can't unmount %s", mount);
+		return -1;
+	}
+
+	femu_RestorePower(dev);
+
+	t = uffs_GetCurTimeUs();
+	if (uffs_Mount(mount) < 0) {
+		MSGLN("Can't mount %s", mount);
+		return -1;
+	}
+	t = uffs_GetCurTimeUs() - t;
+
+	MSGLN("Remount %s in %u us", mount, t);
+
+	return (int)t;
+}
+
+/**
+ * arm power cut on <mount>, cut power at <n>th program/erase operation
+ *	t_pwcut <n> [half] [<mount>]
+ */
+static int cmd_tpwcut(int argc, char *argv[])
+{
+	int n;
+	UBOOL half = U_FALSE;
+	const char *mount = "/";
+	uffs_Device *dev;
+
+	CHK_ARGC(2, 4);
+
+	if (sscanf(argv[1], "%d", &n) != 1 || n < 0)
+		return CLI_INVALID_ARG;
+
+	if (argc > 2) {
+		if (strcmp(argv[2], "half") == 0) {
+			half = U_TRUE;
+			if (argc > 3)
+				mount = argv[3];
+		}
+		else {
+			mount = argv[2];
+		}
+	}
+
+	dev = uffs_GetDeviceFromMountPoint(mount);
+	if (dev == NULL) {
+		MSGLN("Can't get device from mount point %s", mount);
+		return -1;
+	}
+	femu_SetPowerCut(dev, n, half);
+	uffs_PutDevice(dev);
+
+	return 0;
+}
+
+/**
+ * power on after power cut and remount, $1 = remount time (us)
+ *	t_pwrestore [<mount>]
+ */
+static int cmd_tpwrestore(int argc, char *argv[])
+{
+	const char *mount = "/";
+	int t;
+
+	CHK_ARGC(1, 2);
+
+	if (argc > 1)
+		mount = argv[1];
+
+	t = do_power_restore(mount);
+	if (t < 0)
+		return -1;
+
+	cli_env_set('1', t);
+
+	return 0;
+}
+
+/**
+ * power loss test, $1 = remount time (us)
+ *	t_plt <file> <n> [half]
+ *
+ * This test case performs:
+ *   1) create <file> with seq data (committed)
+ *   2) arm power cut at <n>th program/erase operation,
+ *		append and overwrite <file> with the same seq data
+ *   3) emulate reboot: drop RAM, remount and measure the recovery time
+ *   4) <file> must survive with committed length at least, and all seq data
+ */
+static int cmd_TestPowerLoss(int argc, char *argv[])
+{
+	const char *name;
+	char mount[MAX_FILENAME_LENGTH];
+	int n, len, t;
+	int fd;
+	UBOOL half = U_FALSE;
+	UBOOL cut;
+	uffs_Device *dev;
+	struct uffs_stat sb;
+
+	CHK_ARGC(3, 4);
+
+	name = argv[1];
+	if (sscanf(argv[2], "%d", &n) != 1 || n <= 0)
+		return CLI_INVALID_ARG;
+	if (argc > 3 && strcmp(argv[3], "half") == 0)
+		half = U_TRUE;
+
+	len = uffs_GetMatchedMountPointSize(name);
+	if (len <= 0 || len >= sizeof(mount)) {
+		MSGLN("Can't find mount point for %s", name);
+		return -1;
+	}
+	memcpy(mount, name, len);
+	mount[len] = '\0';
+
+	uffs_remove(name);
+	if (test_append_file(name, PLT_BASE_LEN) != U_SUCC) {
+		MSGLN("Create file %s failed.", name);
+		return -1;
+	}
+
+	dev = uffs_GetDeviceFromMountPoint(mount);
+	if (dev == NULL)
+		return -1;
+	femu_SetPowerCut(dev, n, half);
+
+	// errors are expected from now on
+	fd = uffs_open(name, UO_RDWR|UO_APPEND);
+	if (fd >= 0) {
+		do_write_test_file(fd, PLT_EXTRA_LEN);
+		uffs_close(fd);
+	}
+	if (!femu_IsPowerLost(dev))
+		test_write_file(name, PLT_BASE_LEN / 2, PLT_EXTRA_LEN);
+
+	cut = femu_IsPowerLost(dev);
+	uffs_PutDevice(dev);
+
+	t = do_power_restore(mount);
+	if (t < 0)
+		return -1;
+	cli_env_set('1', t);
+
+	if (uffs_stat(name, &sb) < 0) {
+		MSGLN("File %s lost after power cut at op %d !", name, n);
+		return -1;
+	}
+
+	if (sb.st_size < PLT_BASE_LEN || sb.st_size > PLT_BASE_LEN + PLT_EXTRA_LEN) {
+		MSGLN("File %s has wrong length %d after power cut at op %d !", name, sb.st_size, n);
+		return -1;
+	}
+
+	if (test_verify_file(name, U_FALSE) != U_SUCC) {
+		MSGLN("File %s corrupted after power cut at op %d !", name, n);
+		return -1;
+	}
+
+	MSGLN("Power loss test at op %d%s: %s, file length %d, remount %d us",
+			n, half ? " (half page)" : "", cut ? "recovered" : "no cut", sb.st_size, t);
+
+	return 0;
+}
+
+#define PLT_ATOMIC_LEN		4000	// committed file length before power cut
+#define PLT_ATOMIC_PIECES	3
+#define PLT_ATOMIC_PIECE_LEN	300
+
+/**
+ * check file data after atomic write power loss test: either all old
+ * data ('A') or all pieces written ('B' in pieces).
+ * \return 0 if old, 1 if new, -1 if broken.
+ */
+static int check_atomic_file(const char *name, const long *ofs)
+{
+	int fd, i, len, ret = -1;
+	UBOOL is_new;
+	char *buf;
+	char expect;
+
+	buf = malloc(PLT_ATOMIC_LEN + PLT_ATOMIC_PIECE_LEN);
+	if (buf == NULL)
+		return -1;
+
+	fd = uffs_open(name, UO_RDONLY);
+	if (fd < 0)
+		goto ext;
+
+	len = uffs_read(fd, buf, PLT_ATOMIC_LEN + PLT_ATOMIC_PIECE_LEN);
+	uffs_close(fd);
+
+	is_new = (len == ofs[PLT_ATOMIC_PIECES - 1] + PLT_ATOMIC_PIECE_LEN);
+	if (!is_new && len != PLT_ATOMIC_LEN) {
+		MSGLN("File %s has wrong length %d", name, len);
+		goto ext;
+	}
+
+	for (i = 0; i < len; i++) {
+		expect = 'A';
+		if (is_new && ((i >= ofs[0] && i < ofs[0] + PLT_ATOMIC_PIECE_LEN) ||
+				(i >= ofs[1] && i < ofs[1] + PLT_ATOMIC_PIECE_LEN) ||
+				(i >= ofs[2] && i < ofs[2] + PLT_ATOMIC_PIECE_LEN)))
+			expect = 'B';
+		if (buf[i] != expect) {
+			MSGLN("File %s (%s) has '%c' at %d, expect '%c'",
+					name, is_new ? "new" : "old", buf[i], i, expect);
+			goto ext;
+		}
+	}
+
+	ret = (is_new ? 1 : 0);
+ext:
+	free(buf);
+	return ret;
+}
+
+/**
+ * atomic write power loss test, $1 = remount time (us)
+ *	t_plt_atomic <file> <n> [half]
+ *
+ * This test case performs:
+ *   1) create <file> with 'A's (committed)
+ *   2) arm power cut at <n>th program/erase operation,
+ *		write pieces of 'B's by uffs_pwrite_atomic(), the last one extends the file
+ *   3) emulate reboot: drop RAM, remount
+ *   4) <file> must have either none or all of the pieces
+ */
+static int cmd_TestAtomicPowerLoss(int argc, char *argv[])
+{
+	const char *name;
+	char mount[MAX_FILENAME_LENGTH];
+	int n, len, t, fd, i, result;
+	UBOOL half = U_FALSE;
+	UBOOL cut;
+	uffs_Device *dev;
+	char *buf;
+	long ofs[PLT_ATOMIC_PIECES] = { 0, 1500, PLT_ATOMIC_LEN - PLT_ATOMIC_PIECE_LEN / 2 };
+	struct uffs_iovec iov[PLT_ATOMIC_PIECES];
+
+	CHK_ARGC(3, 4);
+
+	name = argv[1];
+	if (sscanf(argv[2], "%d", &n) != 1 || n <= 0)
+		return CLI_INVALID_ARG;
+	if (argc > 3 && strcmp(argv[3], "half") == 0)
+		half = U_TRUE;
+
+	len = uffs_GetMatchedMountPointSize(name);
+	if (len <= 0 || len >= sizeof(mount)) {
+		MSGLN("Can't find mount point for %s", name);
+		return -1;
+	}
+	memcpy(mount, name, len);
+	mount[len] = '\0';
+
+	buf = malloc(PLT_ATOMIC_LEN);
+	if (buf == NULL)
+		return -1;
+
+	memset(buf, 'A', PLT_ATOMIC_LEN);
+	fd = uffs_open(name, UO_RDWR|UO_CREATE|UO_TRUNC);
+	if (fd < 0 || uffs_write(fd, buf, PLT_ATOMIC_LEN) != PLT_ATOMIC_LEN) {
+		MSGLN("Create file %s failed.", name);
+		if (fd >= 0)
+			uffs_close(fd);
+		free(buf);
+		return -1;
+	}
+	uffs_close(fd);
+
+	memset(buf, 'B', PLT_ATOMIC_PIECE_LEN);
+	for (i = 0; i < PLT_ATOMIC_PIECES; i++) {
+		iov[i].iov_base = buf;
+		iov[i].iov_len = PLT_ATOMIC_PIECE_LEN;
+	}
+
+	dev = uffs_GetDeviceFromMountPoint(mount);
+	if (dev == NULL) {
+		free(buf);
+		return -1;
+	}
+	femu_SetPowerCut(dev, n, half);
+
+	// errors are expected from now on
+	fd = uffs_open(name, UO_RDWR);
+	if (fd >= 0) {
+		uffs_pwrite_atomic(fd, iov, ofs, PLT_ATOMIC_PIECES);
+		uffs_close(fd);
+	}
+	free(buf);
+
+	cut = femu_IsPowerLost(dev);
+	uffs_PutDevice(dev);
+
+	t = do_power_restore(mount);
+	if (t < 0)
+		return -1;
+	cli_env_set('1', t);
+
+	result = check_atomic_file(name, ofs);
+	if (result < 0) {
+		MSGLN("File %s partially written after power cut at op %d !", name, n);
+		return -1;
+	}
+
+	MSGLN("Atomic write power loss test at op %d%s: %s, %s data",
+			n, half ? " (half page)" : "", cut ? "recovered" : "no cut", result ? "new" : "old");
+
+	return 0;
+}
+
+#endif
+
 static int cmd_apisrv(int argc, char *argv[])
 {
 	return api_server_start();
 }
 
+/** record API calls served by apisrv to a trace file
+ *	apitrace <file>|off
+ */
+static int cmd_apitrace(int argc, char *argv[])
+{
+	CHK_ARGC(2, 2);
+
+	if (strcmp(argv[1], "off") == 0) {
+		apisrv_trace_stop();
+		return 0;
+	}
+
+	return apisrv_trace_start(argv[1]) == 0 ? 0 : -1;
+}
+
 static const struct cli_command test_cmds[] = 
 {
     { cmd_t1,					"t1",			"<name>",			"test 1" },
@@ -1347,12 +2098,31 @@ static const struct cli_command test_cmds[] =
 	{ cmd_tcheck_seq,			"t_check_seq",	"<fd> <size>",		"read seq file <fd> and check", },
 	{ cmd_twrite,				"t_write",		"<fd> <txt> [...]",	"write <fd>", },
 	{ cmd_twrite_seq,			"t_write_seq",	"<fd> <size>",	"write seq file <fd>", },
+	{ cmd_tpread,				"t_pread",		"<fd> <ofs> <txt>",	"read <fd> at <ofs> and check against <txt>", },
+	{ cmd_tpwrite,				"t_pwrite",		"<fd> <ofs> <txt>",	"write <txt> to <fd> at <ofs>", },
+	{ cmd_treadv,				"t_readv",		"<fd> <txt> [...]",	"vectored read <fd> and check against <txt>s", },
+	{ cmd_twritev,				"t_writev",		"<fd> <txt> [...]",	"vectored write <txt>s to <fd>", },
+	{ cmd_tpwatomic,			"t_pwatomic",	"<fd> <ofs> <txt> [...]",	"write <txt>s to <fd> at <ofs>s all or nothing", },
 	{ cmd_tseek,				"t_seek",		"<fd> <offset> [<origin>]",	"seek <fd> file pointer to <offset> from <origin>", },
 	{ cmd_tclose,				"t_close",		"<fd>",				"close <fd>", },
+	{ cmd_tflush,				"t_flush",		"<fd>",				"flush <fd>", },
+	{ cmd_twstat,				"t_wstat",		"<fd>",				"show write statistic of <fd>", },
 	{ cmd_truncate,				"t_truncate",	"<fd> <remain>",	"change <fd> size to <remain>", },
+	{ cmd_tdirplus,				"t_dirplus",	"<dir> <n>",		"list <dir> by readdirplus and check, entries save to $1", },
+	{ cmd_tskip,				"t_skip",		"<fd> <size>",		"skip <size> bytes of <fd>, bytes skipped save to $1", },
+	{ cmd_tcheck_zero,			"t_check_zero",	"<fd> <ofs> <size>",	"check <fd> data from <ofs> are all '\\0'", },
+	{ cmd_tfallocate,			"t_fallocate",	"<fd> <len>",		"reserve blocks for <fd> up to <len> bytes", },
+	{ cmd_tfree,				"t_free",		"[<mount>]",		"free space of <mount>, save to $1", },
 	{ cmd_dump,					"dump",			"<mount>",			"dump <mount>", },
+#ifdef UFFS_FEMU_ENABLE_INJECTION
+	{ cmd_tpwcut,				"t_pwcut",		"<n> [half] [<mount>]",	"cut power at <n>th program/erase op, 0: disarm", },
+	{ cmd_tpwrestore,			"t_pwrestore",	"[<mount>]",		"power on and remount, remount time (us) save to $1", },
+	{ cmd_TestPowerLoss,		"t_plt",		"<file> <n> [half]",	"power loss test, cut power at <n>th program/erase op", },
+	{ cmd_TestAtomicPowerLoss,	"t_plt_atomic",	"<file> <n> [half]",	"atomic write power loss test, cut power at <n>th program/erase op", },
+#endif
 
 	{ cmd_apisrv,				"apisrv",		NULL,				"start API test server", },
+	{ cmd_apitrace,				"apitrace",		"<file>|off",		"record API calls served by apisrv to <file>, or stop", },
 
 	{ cmd_t_dede97b1,           "t_dede97b1",	NULL,				"verify bug fixed by commit dede97b1", },
 
@@ -67,12 +67,19 @@ struct uffs_FileEmuSt *femu_GetPrivate()
 
 URET femu_InitDevice(uffs_Device *dev)
 {
-	uffs_FileEmu *emu = femu_GetPrivate();
-
-	// setup device storage attr and private data structure.
 	// all femu partition share one storage attribute
+	femu_SetupDevice(dev, femu_GetStorage(), femu_GetPrivate());
 
-	dev->attr = femu_GetStorage();
+	return U_SUCC;
+}
+
+/**
+ * setup device storage attr, private data structure and flash driver operations.
+ * each emulator has its own host file, set emu->emu_filename before mounting.
+ */
+void femu_SetupDevice(uffs_Device *dev, struct uffs_StorageAttrSt *attr, uffs_FileEmu *emu)
+{
+	dev->attr = attr;
 	dev->attr->_private = (void *) emu;
 
 	// setup flash driver operations, according to the ecc option.
@@ -99,8 +106,6 @@ URET femu_InitDevice(uffs_Device *dev)
 		emu->wrap_inited = U_TRUE;
 	}
 #endif
-
-	return U_SUCC;
 }
 
 /* Nothing to do here */
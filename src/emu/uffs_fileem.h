@@ -43,7 +43,11 @@
 
 #define UFFS_FEMU_FILE_NAME		"uffsemfile.bin"
 
-#define UFFS_FEMU_MAX_BLOCKS	(1024 * 16)		// maximum 16K blocks
+#ifdef CONFIG_UFFS_WIDE_BLOCK_ADDRESS
+#define UFFS_FEMU_MAX_BLOCKS	(1024 * 1024)	// maximum 1M blocks
+#else
+#define UFFS_FEMU_MAX_BLOCKS	(1024 * 64 - 2)	// maximum 64K blocks, block 0xfffe and 0xffff are reserved
+#endif
 
 #define UFFS_FEMU_ENABLE_INJECTION		// enable bad block & ecc error injection
 
@@ -61,10 +65,15 @@ typedef struct uffs_FileEmuSt {
 	u8 *em_monitor_page;		// page write monitor
 	u8 * em_monitor_spare;		// spare write monitor
 	u32 *em_monitor_block;		// block erease monitor
+	u8 *em_page_buf;			// page buffer, data + spare
 	const char *emu_filename;
 #ifdef UFFS_FEMU_ENABLE_INJECTION
 	struct uffs_FlashOpsSt ops_orig;
 	UBOOL wrap_inited;
+	int power_cut_at;			// cut power at this program/erase operation, 0: disabled
+	UBOOL power_cut_half_page;	// leave the interrupted page half programmed
+	UBOOL power_lost;			// power is off, program/erase operations are dropped
+	u32 flash_ops;				// program/erase operations since power cut armed
 #endif
 } uffs_FileEmu;
 
@@ -72,11 +81,19 @@ typedef struct uffs_FileEmuSt {
 URET femu_InitDevice(uffs_Device *dev);
 URET femu_ReleaseDevice(uffs_Device *dev);
 
+/* setup device on its own storage attribute and emulator, for devices not sharing one chip */
+void femu_SetupDevice(uffs_Device *dev, struct uffs_StorageAttrSt *attr, struct uffs_FileEmuSt *emu);
+
 struct uffs_StorageAttrSt * femu_GetStorage(void);
 struct uffs_FileEmuSt * femu_GetPrivate(void);
 
 #ifdef UFFS_FEMU_ENABLE_INJECTION
 void femu_setup_wrapper_functions(uffs_Device *dev);
+
+/* power loss injection */
+void femu_SetPowerCut(uffs_Device *dev, int n, UBOOL half_page);
+void femu_RestorePower(uffs_Device *dev);
+UBOOL femu_IsPowerLost(uffs_Device *dev);
 #endif
 
 /* internal used functions, shared by all ecc option implementations */
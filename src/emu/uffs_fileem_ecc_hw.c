@@ -61,8 +61,8 @@ static int femu_hw_WritePageWithLayout(uffs_Device *dev, u32 block, u32 page,
 	int full_page_size;
 	uffs_FileEmu *emu;
 	struct uffs_StorageAttrSt *attr = dev->attr;
-	u8 spare[UFFS_MAX_SPARE_SIZE];
-	u8 ecc_buf[UFFS_MAX_ECC_SIZE];
+	u8 *spare;
+	u8 *ecc_buf;
 	int spare_len;
 
 
@@ -72,6 +72,11 @@ static int femu_hw_WritePageWithLayout(uffs_Device *dev, u32 block, u32 page,
 		goto err;
 	}
 
+	// build ECC and spare in the emulator page buffer instead of stack,
+	// they can be large with large page
+	ecc_buf = emu->em_page_buf;
+	spare = emu->em_page_buf + attr->page_data_size;
+
 	abs_page = attr->pages_per_block * block + page;
 	full_page_size = attr->page_data_size + attr->spare_size;
 
@@ -85,7 +90,7 @@ static int femu_hw_WritePageWithLayout(uffs_Device *dev, u32 block, u32 page,
 			goto err;
 		}
 		
-		fseek(emu->fp, abs_page * full_page_size, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size, SEEK_SET);
 
 		written = fwrite(data, 1, data_len, emu->fp);
 		
@@ -114,7 +119,7 @@ static int femu_hw_WritePageWithLayout(uffs_Device *dev, u32 block, u32 page,
 		uffs_FlashMakeSpare(dev, ts, ecc_buf, spare);
 		spare_len = dev->mem.spare_data_size;
 		
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size + attr->page_data_size, SEEK_SET);
 		written = fwrite(spare, 1, spare_len, emu->fp);
 		if (written != spare_len) {
 			MSG("write spare I/O error ?");
@@ -127,7 +132,7 @@ static int femu_hw_WritePageWithLayout(uffs_Device *dev, u32 block, u32 page,
 
 	if (data == NULL && ts == NULL) {
 		// mark bad block
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
 		written = fwrite("\0", 1, 1, emu->fp);
 		if (written != 1) {
 			MSG("write bad block mark I/O error ?");
@@ -153,7 +158,7 @@ static URET femu_hw_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8
 	int full_page_size;
 	struct uffs_StorageAttrSt *attr = dev->attr;
 	unsigned char status;
-	u8 spare[UFFS_MAX_SPARE_SIZE];
+	u8 *spare;
 	int spare_len;
 
 	emu = (uffs_FileEmu *)(dev->attr->_private);
@@ -161,6 +166,7 @@ static URET femu_hw_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8
 	if (!emu || !(emu->fp)) {
 		goto err;
 	}
+	spare = emu->em_page_buf + attr->page_data_size;
 
 	abs_page = attr->pages_per_block * block + page;
 	full_page_size = attr->page_data_size + attr->spare_size;
@@ -169,7 +175,7 @@ static URET femu_hw_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8
 		if (data_len > attr->page_data_size)
 			goto err;
 
-		fseek(emu->fp, abs_page * full_page_size, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size, SEEK_SET);
 		nread = fread(data, 1, data_len, emu->fp);
 
 		if (nread != data_len) {
@@ -188,7 +194,7 @@ static URET femu_hw_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8
 	if (ts) {
 
 		spare_len = dev->mem.spare_data_size;
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size + attr->page_data_size, SEEK_SET);
 		nread = fread(spare, 1, spare_len, emu->fp);
 
 		if (nread != spare_len) {
@@ -205,7 +211,7 @@ static URET femu_hw_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8
 
 	if (data == NULL && ts == NULL) {
 		// read bad block mark
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
 		nread = fread(&status, 1, 1, emu->fp);
 
 		if (nread != 1) {
@@ -77,7 +77,7 @@ static int femu_WritePage(uffs_Device *dev, u32 block, u32 page_num,
 			goto err;
 		}
 		
-		fseek(emu->fp, abs_page * full_page_size, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size, SEEK_SET);
 
 		written = fwrite(data, 1, data_len, emu->fp);
 		
@@ -100,7 +100,7 @@ static int femu_WritePage(uffs_Device *dev, u32 block, u32 page_num,
 			goto err;
 		}
 		
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size + attr->page_data_size, SEEK_SET);
 		written = fwrite(spare, 1, spare_len, emu->fp);
 		if (written != spare_len) {
 			MSGLN("write spare I/O error ?");
@@ -113,7 +113,7 @@ static int femu_WritePage(uffs_Device *dev, u32 block, u32 page_num,
 
 	if (data == NULL && spare == NULL) {
 		// mark bad block
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
 		written = fwrite("\0", 1, 1, emu->fp);
 		if (written != 1) {
 			MSGLN("write bad block mark I/O error ?");
@@ -153,7 +153,7 @@ static URET femu_ReadPage(uffs_Device *dev, u32 block, u32 page_num, u8 *data, i
 		if (data_len > attr->page_data_size)
 			goto err;
 
-		fseek(emu->fp, abs_page * full_page_size, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size, SEEK_SET);
 		nread = fread(data, 1, data_len, emu->fp);
 
 		if (nread != data_len) {
@@ -168,7 +168,7 @@ static URET femu_ReadPage(uffs_Device *dev, u32 block, u32 page_num, u8 *data, i
 		if (spare_len > attr->spare_size)
 			goto err;
 
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size + attr->page_data_size, SEEK_SET);
 		nread = fread(spare, 1, spare_len, emu->fp);
 
 		if (nread != spare_len) {
@@ -181,7 +181,7 @@ static URET femu_ReadPage(uffs_Device *dev, u32 block, u32 page_num, u8 *data, i
 
 	if (data == NULL && spare == NULL) {
 		// read bad block mark
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
+		fseek(emu->fp, (long)abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
 		nread = fread(&status, 1, 1, emu->fp);
 
 		if (nread != 1) {
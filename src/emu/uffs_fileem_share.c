@@ -54,8 +54,6 @@
 /*                                                              */
 /****************************************************************/
 
-static u8 g_page_buf[UFFS_MAX_PAGE_SIZE + UFFS_MAX_SPARE_SIZE];
-
 /*
  * Create emulator disk, initialise monitors, inject manufacture bad blocks, etc.
  *
@@ -63,9 +61,9 @@ static u8 g_page_buf[UFFS_MAX_PAGE_SIZE + UFFS_MAX_SPARE_SIZE];
 int femu_InitFlash(uffs_Device *dev)
 {
 	int i;
-	int fSize;
+	long fSize;
 	int written;
-	u8 * p = g_page_buf;
+	u8 * p;
 	uffs_FileEmu *emu;
 
 	struct uffs_StorageAttrSt *attr = dev->attr;
@@ -96,6 +94,12 @@ int femu_InitFlash(uffs_Device *dev)
 	if (!emu->em_monitor_block)
 		return -1;
 
+	// page buffer is per emulator, so emulators of different devices can work in parallel
+	emu->em_page_buf = (u8 *) malloc(full_page_size);
+	if (!emu->em_page_buf)
+		return -1;
+	p = emu->em_page_buf;
+
 	//clear monitor
 	memset(emu->em_monitor_page, 0, sizeof(emu->em_monitor_page[0]) * total_pages);
 	memset(emu->em_monitor_spare, 0, sizeof(emu->em_monitor_spare[0]) * total_pages);
@@ -112,7 +116,7 @@ int femu_InitFlash(uffs_Device *dev)
 		fseek(emu->fp, 0, SEEK_END);
 		fSize = ftell(emu->fp);
 		
-		if (fSize < total_pages * full_page_size)	{
+		if (fSize < (long)total_pages * full_page_size)	{
 			printf("Creating uffs emulation file\n");
 			fseek(emu->fp, 0, SEEK_SET);
 			memset(p, 0xff, full_page_size);
@@ -168,9 +172,12 @@ int femu_ReleaseFlash(uffs_Device *dev)
 			free(emu->em_monitor_spare);
 		if (emu->em_monitor_block)
 			free(emu->em_monitor_block);
+		if (emu->em_page_buf)
+			free(emu->em_page_buf);
 		emu->em_monitor_page = NULL;
 		emu->em_monitor_spare = NULL;
 		emu->em_monitor_block = NULL;
+		emu->em_page_buf = NULL;
 	}
 
 	return 0;
@@ -180,12 +187,13 @@ int femu_EraseBlock(uffs_Device *dev, u32 blockNumber)
 {
 
 	int i;
-	u8 * pg = g_page_buf;
+	u8 * pg;
 	int pgd_size, sp_size, blks, blk_pgs;
 	uffs_FileEmu *emu;
 	emu = (uffs_FileEmu *)(dev->attr->_private);
 	if (!emu || !(emu->fp))
 		goto err;
+	pg = emu->em_page_buf;
 
 	pgd_size = dev->attr->page_data_size;
 	sp_size = dev->attr->spare_size;
@@ -212,7 +220,7 @@ int femu_EraseBlock(uffs_Device *dev, u32 blockNumber)
 		
 		memset(pg, 0xff, (pgd_size + sp_size));
 		
-		fseek(emu->fp, blockNumber * blk_pgs * (pgd_size + sp_size), SEEK_SET);
+		fseek(emu->fp, (long)blockNumber * blk_pgs * (pgd_size + sp_size), SEEK_SET);
 		
 		for (i = 0; i < blk_pgs; i++)	{
 			fwrite(pg, 1, (pgd_size + sp_size), emu->fp);
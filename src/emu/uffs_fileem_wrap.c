@@ -33,7 +33,7 @@
 /**
  * \file uffs_fileem_wrap.c
  *
- * \brief file emulator wrapper functions for injecting bad blocks or ECC errors.
+ * \brief file emulator wrapper functions for injecting bad blocks, ECC errors or power loss.
  *
  * \author Ricky Zheng, created Nov, 2010
  */
@@ -93,6 +93,43 @@ static int femu_EraseBlock_wrap(uffs_Device *dev, u32 blockNumber);
 
 /////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Arm power loss injection: the <n>th program/erase operation from now on
+ * will be interrupted, and all program/erase operations after it are dropped
+ * until femu_RestorePower() is called.
+ *
+ * \param[in] dev uffs device
+ * \param[in] n cut power at the <n>th operation, 0 to disarm.
+ * \param[in] half_page if U_TRUE, the interrupted page program leaves
+ *				the first half of page data on flash, otherwise nothing.
+ */
+void femu_SetPowerCut(uffs_Device *dev, int n, UBOOL half_page)
+{
+	uffs_FileEmu *emu = (uffs_FileEmu *)(dev->attr->_private);
+
+	emu->power_cut_at = n;
+	emu->power_cut_half_page = half_page;
+	emu->power_lost = U_FALSE;
+	emu->flash_ops = 0;
+}
+
+/** power on again, program/erase operations go to flash as normal */
+void femu_RestorePower(uffs_Device *dev)
+{
+	uffs_FileEmu *emu = (uffs_FileEmu *)(dev->attr->_private);
+
+	emu->power_cut_at = 0;
+	emu->power_lost = U_FALSE;
+}
+
+/** has the armed power cut happened ? */
+UBOOL femu_IsPowerLost(uffs_Device *dev)
+{
+	uffs_FileEmu *emu = (uffs_FileEmu *)(dev->attr->_private);
+
+	return emu->power_lost;
+}
+
 void femu_setup_wrapper_functions(uffs_Device *dev)
 {
 	uffs_FileEmu *emu;
@@ -137,7 +174,7 @@ static int femu_InitFlash_wrap(uffs_Device *dev)
 			for (j = 0; j < ARRAY_SIZE(bad_blocks); j++) {
 				if (bad_blocks[j] < dev->attr->total_blocks) {
 					printf(" --- manufacture bad block %d ---\n", bad_blocks[j]);
-					fseek(emu->fp, bad_blocks[j] * blk_size + attr->page_data_size + dev->attr->block_status_offs, SEEK_SET);
+					fseek(emu->fp, (long)bad_blocks[j] * blk_size + attr->page_data_size + dev->attr->block_status_offs, SEEK_SET);
 					fwrite(&x, 1, 1, emu->fp);
 				}
 			}
@@ -190,22 +227,72 @@ static int femu_ReadPageWithLayout_wrap(uffs_Device *dev, u32 block, u32 page, u
 
 ////////////////////// wraper functions ///////////////////////////
 
+static void WriteHalfPage(uffs_Device *dev, u32 block, u32 page, const u8 *data, int data_len)
+{
+	uffs_FileEmu *emu = (uffs_FileEmu *)(dev->attr->_private);
+	int full_page_size = dev->attr->page_data_size + dev->attr->spare_size;
+	int blk_size = full_page_size * dev->attr->pages_per_block;
+
+	if (data_len > dev->attr->page_data_size)
+		data_len = dev->attr->page_data_size;
+
+	fseek(emu->fp, (long)block * blk_size + full_page_size * page, SEEK_SET);
+	fwrite(data, 1, data_len / 2, emu->fp);
+	fflush(emu->fp);
+}
+
+/**
+ * count program/erase operation and check for power loss.
+ * \return U_TRUE if the operation should be dropped.
+ */
+static UBOOL PowerCutCheck(uffs_Device *dev, u32 block, u32 page, const u8 *data, int data_len)
+{
+	uffs_FileEmu *emu = (uffs_FileEmu *)(dev->attr->_private);
+
+	if (emu->power_lost)
+		return U_TRUE;
+
+	if (emu->power_cut_at <= 0)
+		return U_FALSE;
+
+	if (++emu->flash_ops < (u32)emu->power_cut_at)
+		return U_FALSE;
+
+	emu->power_lost = U_TRUE;
+
+	if (data) {
+		printf(" --- Power cut at op %d, block %d page %d%s --- \n", emu->flash_ops, block, page,
+					emu->power_cut_half_page ? " (half programmed)" : "");
+		if (emu->power_cut_half_page)
+			WriteHalfPage(dev, block, page, data, data_len);
+	}
+	else {
+		printf(" --- Power cut at op %d, block %d --- \n", emu->flash_ops, block);
+	}
+
+	return U_TRUE;
+}
+
 static void InjectBitFlip(uffs_Device *dev, u32 block, u32 page)
 {
 #ifdef FILEEMU_WRITE_BIT_FLIP
 	uffs_FileEmu *emu = (uffs_FileEmu *)(dev->attr->_private);
 	struct uffs_FileEmuBitFlip flips[] = FILEEMU_WRITE_BIT_FLIP;
 	struct uffs_FileEmuBitFlip *x;
-	u8 buf[UFFS_MAX_PAGE_SIZE + UFFS_MAX_SPARE_SIZE];
+	u8 *buf = emu->em_page_buf;		// not in use, the page is written already
 	u8 *data = buf;
 	u8 *spare = buf + dev->attr->page_data_size;
 	int full_page_size = dev->attr->page_data_size + dev->attr->spare_size;
 	int blk_size = full_page_size * dev->attr->pages_per_block;
-	int page_offset = block * blk_size + full_page_size * page;
+	long page_offset = (long)block * blk_size + full_page_size * page;
 
 	int i;
 	u8 *p;
 
+	// don't mix bit flips with power loss test, data loss should be blamed on power loss only.
+	if (emu->power_cut_at > 0)
+		return;
+
 	fseek(emu->fp, page_offset, SEEK_SET);
 	fread(buf, 1, full_page_size, emu->fp);
 
@@ -248,6 +335,9 @@ static int femu_WritePage_wrap(uffs_Device *dev, u32 block, u32 page,
 		MSG(TENDSTR);
 	}
 #endif
+
+	if (PowerCutCheck(dev, block, page, data, data_len))
+		return UFFS_FLASH_IO_ERR;
 	
 	ret = emu->ops_orig.WritePage(dev, block, page, data, data_len, spare, spare_len);
 
@@ -273,6 +363,9 @@ static int femu_WritePageWithLayout_wrap(uffs_Device *dev, u32 block, u32 page,
 	}
 #endif
 
+	if (PowerCutCheck(dev, block, page, data, data_len))
+		return UFFS_FLASH_IO_ERR;
+
 	ret = emu->ops_orig.WritePageWithLayout(dev, block, page, data, data_len, ecc, ts);
 
 	InjectBitFlip(dev, block, page);
@@ -289,6 +382,10 @@ static int femu_EraseBlock_wrap(uffs_Device *dev, u32 blockNumber)
 	int blocks[] = FILEEMU_ERASE_BAD_BLOCKS;
 	int i;
 	URET ret;
+
+	if (PowerCutCheck(dev, blockNumber, 0, NULL, 0))
+		return UFFS_FLASH_IO_ERR;
+
 	ret = emu->ops_orig.EraseBlock(dev, blockNumber);
 
 	for (i = 0; i < ARRAY_SIZE(blocks); i++) {
@@ -302,6 +399,9 @@ static int femu_EraseBlock_wrap(uffs_Device *dev, u32 blockNumber)
 
 #else
 
+	if (PowerCutCheck(dev, blockNumber, 0, NULL, 0))
+		return UFFS_FLASH_IO_ERR;
+
 	return emu->ops_orig.EraseBlock(dev, blockNumber);
 
 #endif
@@ -78,6 +78,7 @@ extern "C"{
 #define UEIOERR	11		/** I/O error from lower level flash operation */
 #define UENOTDIR 12		/** Not a directory */
 #define UEISDIR 13		/** Is a directory */    
+#define UENOSPC 14		/** No enough free blocks */
 
 #define UEUNKNOWN_ERR	100	/** unknown error */
 
@@ -92,6 +93,13 @@ extern "C"{
 #define USEEK_END		_SEEK_END
 
 
+/** I/O vector element, for vectored read/write */
+struct uffs_iovec {
+	void *iov_base;		/** buffer address */
+	int iov_len;		/** buffer length */
+};
+
+
 #ifdef __cplusplus
 }
 #endif
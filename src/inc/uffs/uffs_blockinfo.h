@@ -51,7 +51,6 @@ extern "C"{
  */
 struct uffs_PageSpareSt {
 	uffs_Tags tag;			//!< page tag
-	int expired:1;
 };
 
 /** 
@@ -62,8 +61,9 @@ struct uffs_PageSpareSt {
 struct uffs_BlockInfoSt {
 	struct uffs_BlockInfoSt *next;
 	struct uffs_BlockInfoSt *prev;
-	u16 block;							//!< block number
+	uffs_BlockNum block;				//!< block number
 	struct uffs_PageSpareSt *spares;	//!< page spare info array
+	u32 *expired_map;					//!< page spare expired bitmap, one bit per page
 	int expired_count;					//!< how many pages expired in this block ? 
 	int ref_count;						//!< reference counter, it's safe to reuse this block memory when the counter is 0.
 };
@@ -71,6 +71,17 @@ struct uffs_BlockInfoSt {
 /** get tag from block info */
 #define GET_TAG(bc, page) (&(bc)->spares[page].tag)
 
+/** u32 words of expired bitmap for a block */
+#define BC_EXPIRED_MAP_WORDS(n_pages_per_block) (((n_pages_per_block) + 31) / 32)
+
+/** page spare in block info is expired (need to be loaded from flash) ? */
+#define BC_PAGE_EXPIRED(bc, page) \
+	(((bc)->expired_map[(page) >> 5] >> ((page) & 31)) & 1)
+#define BC_SET_PAGE_EXPIRED(bc, page) \
+	do { (bc)->expired_map[(page) >> 5] |= (1UL << ((page) & 31)); } while (0)
+#define BC_CLR_PAGE_EXPIRED(bc, page) \
+	do { (bc)->expired_map[(page) >> 5] &= ~(1UL << ((page) & 31)); } while (0)
+
 
 /** initialize block info caches */
 URET uffs_BlockInfoInitCache(uffs_Device *dev, int maxCachedBlocks);
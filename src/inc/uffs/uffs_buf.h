@@ -40,6 +40,7 @@
 #define UFFS_BUF_H
 
 #include "uffs/uffs_types.h"
+#include "uffs/uffs.h"
 #include "uffs/uffs_device.h"
 #include "uffs/uffs_tree.h"
 #include "uffs/uffs_core.h"
@@ -79,6 +80,20 @@ struct uffs_BufSt{
 
 #define uffs_BufIsFree(buf) (buf->ref_count == 0 ? U_TRUE : U_FALSE)
 
+/** position in an I/O vector, advanced by #uffs_BufWriteV and #uffs_BufReadV */
+typedef struct uffs_IoCursorSt {
+	const struct uffs_iovec *iov;		//!< I/O vector, NULL to fill '\0' when write
+	int iovcnt;							//!< elements in iov
+	int idx;							//!< current element
+	u32 ofs;							//!< offset in current element
+} uffs_IoCursor;
+
+/** init I/O cursor at the start of iov */
+void uffs_IoCursorInit(uffs_IoCursor *cur, const struct uffs_iovec *iov, int iovcnt);
+
+/** fill 'len' bytes of '\0' to I/O cursor, advance the cursor */
+void uffs_IoCursorZero(uffs_IoCursor *cur, u32 len);
+
 /** initialize page buffers */
 URET uffs_BufInit(struct uffs_DeviceSt *dev, int buf_max, int dirty_buf_max);
 
@@ -89,6 +104,9 @@ URET uffs_BufReleaseAll(struct uffs_DeviceSt *dev);
 uffs_Buf * uffs_BufGet(struct uffs_DeviceSt *dev, u16 parent, u16 serial, u16 page_id);
 uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev, u8 type, TreeNode *node, u16 page_id, int oflag);
 
+/** get the page buffer only if it's in buffer list, never load from flash */
+uffs_Buf *uffs_BufGetCached(struct uffs_DeviceSt *dev, u8 type, TreeNode *node, u16 page_id);
+
 /** alloc a new page buffer */
 uffs_Buf *uffs_BufNew(struct uffs_DeviceSt *dev, u8 type, u16 parent, u16 serial, u16 page_id);
 
@@ -102,6 +120,9 @@ uffs_Buf * uffs_BufFindFrom(uffs_Device *dev, uffs_Buf *start,
 /** put page buffer back to pool, called in pair with #uffs_Get,#uffs_GetEx or #uffs_BufNew */
 URET uffs_BufPut(uffs_Device *dev, uffs_Buf *buf);
 
+/** put page buffer back to pool, and let it be reused first */
+URET uffs_BufPutCold(uffs_Device *dev, uffs_Buf *buf);
+
 /** increase buffer references */
 void uffs_BufIncRef(uffs_Buf *buf);
 
@@ -114,6 +135,12 @@ URET uffs_BufWrite(struct uffs_DeviceSt *dev, uffs_Buf *buf, void *data, u32 ofs
 /** read data from a page buffer */
 URET uffs_BufRead(struct uffs_DeviceSt *dev, uffs_Buf *buf, void *data, u32 ofs, u32 len);
 
+/** write data gathered from I/O cursor to a page buffer, the cursor is advanced */
+URET uffs_BufWriteV(struct uffs_DeviceSt *dev, uffs_Buf *buf, uffs_IoCursor *src, u32 ofs, u32 len);
+
+/** read data from a page buffer and scatter to I/O cursor, the cursor is advanced */
+URET uffs_BufReadV(struct uffs_DeviceSt *dev, uffs_Buf *buf, uffs_IoCursor *dst, u32 ofs, u32 len);
+
 /** mark buffer as #UFFS_BUF_EMPTY if ref_count == 0, and discard all data it holds */
 void uffs_BufMarkEmpty(uffs_Device *dev, uffs_Buf *buf);
 
@@ -137,6 +164,9 @@ URET uffs_BufLockGroup(struct uffs_DeviceSt *dev, int slot);
 /** unlock dirty group */
 URET uffs_BufUnLockGroup(struct uffs_DeviceSt *dev, int slot);
 
+/** discard all dirty buffers in group, data on flash is not changed */
+URET uffs_BufDiscardGroup(struct uffs_DeviceSt *dev, int slot);
+
 /** flush most dirty group */
 URET uffs_BufFlushMostDirtyGroup(struct uffs_DeviceSt *dev);
 
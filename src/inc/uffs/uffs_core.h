@@ -33,6 +33,9 @@
 #ifndef _UFFS_CORE_H_
 #define _UFFS_CORE_H_
 
+#include "uffs_config.h"
+#include "uffs/uffs_types.h"
+
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -49,6 +52,32 @@ typedef struct uffs_TagStoreSt      uffs_TagStore;  //!< UFFS page tags physical
 
 typedef struct uffs_BufSt uffs_Buf;
 
+/**
+ * \typedef uffs_BlockNum
+ * \brief block number
+ * \typedef uffs_NodeIdx
+ * \brief tree node index, the tree has one node per block
+ */
+#ifdef CONFIG_UFFS_WIDE_BLOCK_ADDRESS
+typedef u32 uffs_BlockNum;
+typedef u32 uffs_NodeIdx;
+#else
+typedef u16 uffs_BlockNum;
+typedef u16 uffs_NodeIdx;
+#endif
+
+/**
+ * \struct uffs_WriteStatSt
+ * \typedef uffs_WriteStat
+ * \brief write amplification statistic, for device and opened object
+ */
+typedef struct uffs_WriteStatSt {
+	u32 bytes_written;		//!< logical bytes written by application
+	u32 pages_programmed;	//!< pages programmed, include copied pages
+	u32 pages_copied;		//!< valid pages copied by block recover
+	u32 blocks_erased;		//!< blocks erased by block recover or truncate
+} uffs_WriteStat;
+
 
 #ifdef __cplusplus
 }
@@ -69,13 +69,43 @@ struct uffs_BlockInfoCacheSt {
 	void *mem_pool;					//!< internal memory pool, used for release whole buffer
 };
 
+/**
+ * \def FILE_INFO_HASH_LEN
+ * \note hash table length of file info cache, must be power of 2
+ */
+#define FILE_INFO_HASH_LEN		16
+
+/** 
+ * \struct uffs_FileInfoEntrySt
+ * \brief a cached copy of uffs_FileInfo (page 0 of dir/file block).
+ */
+struct uffs_FileInfoEntrySt {
+	struct uffs_FileInfoEntrySt *next;		//!< LRU list, tail is the most recently used
+	struct uffs_FileInfoEntrySt *prev;
+	struct uffs_FileInfoEntrySt *hash_next;	//!< next entry in the same hash slot
+	u16 serial;								//!< serial num of dir/file, INVALID_UFFS_SERIAL if not used
+	u16 sum;								//!< sum of name
+	uffs_FileInfo info;						//!< file info
+};
+
+/** 
+ * \struct uffs_FileInfoCacheSt
+ * \brief file info cache, keep recently used uffs_FileInfo out of page buffers
+ */
+struct uffs_FileInfoCacheSt {
+	struct uffs_FileInfoEntrySt *head;			//!< LRU list head, least recently used
+	struct uffs_FileInfoEntrySt *tail;			//!< LRU list tail
+	struct uffs_FileInfoEntrySt *hash[FILE_INFO_HASH_LEN];	//!< hash table, indexed by serial (see FILE_INFO_HASH())
+	void *mem_pool;								//!< internal memory pool, used for release whole buffer
+};
+
 /** 
  * \struct uffs_PartitionSt
  * \brief partition basic information
  */
 struct uffs_PartitionSt {
-	u16 start;		//!< start block number of partition
-	u16 end;		//!< end block number of partition
+	uffs_BlockNum start;		//!< start block number of partition
+	uffs_BlockNum end;		//!< end block number of partition
 };
 
 /** 
@@ -83,9 +113,9 @@ struct uffs_PartitionSt {
  * \brief lock stuffs
  */
 struct uffs_LockSt {
-	OSSEM sem;
+	OSRWLOCK rwlock;	//!< readers share it, writers own it exclusively
 	int task_id;
-	int counter;
+	int counter;		//!< exclusive lock nesting counter
 };
 
 /** 
@@ -123,6 +153,7 @@ struct uffs_PageCommInfoSt {
 	u16 pg_data_size;			//!< page data size
 	u16 header_size;			//!< header size
 	u16 pg_size;				//!< page size
+	u8 id_layout;				//!< page id layout of tags to be written, #TAG_ID_LAYOUT_WIDE or #TAG_ID_LAYOUT_NARROW
 };
 
 /**
@@ -141,6 +172,27 @@ typedef struct uffs_FlashStatSt {
 	unsigned long io_write;
 } uffs_FlashStat;
 
+/**
+ * \struct uffs_CacheStatSt
+ * \typedef uffs_CacheStat
+ * \brief statistic data of page buffers and block info cache
+ */
+typedef struct uffs_CacheStatSt {
+	int buf_get_hit;		//!< uffs_BufGetEx() found page in buffers
+	int buf_get_miss;		//!< uffs_BufGetEx() has to load page from flash
+	int buf_new_hit;		//!< uffs_BufNew() reused an existing buffer
+	int buf_new_miss;		//!< uffs_BufNew() has to take a free buffer
+	int buf_evict;			//!< valid page buffer dropped for reuse
+	int buf_forced_flush;	//!< dirty group flushed by uffs_BufFlushMostDirtyGroup()
+	int bc_hit;				//!< uffs_BlockInfoGet() found block in cache
+	int bc_miss;			//!< uffs_BlockInfoGet() has to take a free cache
+	int bc_insufficient;	//!< uffs_BlockInfoGet() failed, all caches are in use
+	int tag_load;			//!< page tags loaded by uffs_BlockInfoLoad()
+	int tag_load_avoided;	//!< page tags already cached, no need to load
+	int fi_hit;				//!< uffs_FileInfoLoad() found file info in cache
+	int fi_miss;			//!< uffs_FileInfoLoad() has to load file info from page
+} uffs_CacheStat;
+
 
 /**
  * \struct uffs_ConfigSt
@@ -153,6 +205,8 @@ typedef struct uffs_ConfigSt {
 	int dirty_pages;
 	int dirty_groups;
 	int reserved_free_blocks;
+	int fi_caches;			//!< file info cache entries, 0: default, < 0: disabled
+	int wide_page_id;		//!< format with #TAG_ID_LAYOUT_WIDE tags even if pages per block <= 64
 } uffs_Config;
 
 
@@ -167,7 +221,7 @@ typedef struct uffs_ConfigSt {
  * \brief Pending block descriptor
  */
 typedef struct uffs_PendingBlockSt {
-	u16 block;			//!< pending block number
+	uffs_BlockNum block;	//!< pending block number
 	u8 mark;			//!< pending block mark
 } uffs_PendingBlock;
 
@@ -178,7 +232,7 @@ typedef struct uffs_PendingBlockSt {
 struct uffs_PendingListSt {
 	int count;											//!< pending block counter
 	uffs_PendingBlock list[CONFIG_MAX_PENDING_BLOCKS];	//!< pending block list
-	u16 block_in_recovery;                              //!< pending block being recovered
+	uffs_BlockNum block_in_recovery;                    //!< pending block being recovered
 };
 
 /** 
@@ -195,12 +249,15 @@ struct uffs_DeviceSt {
 	struct uffs_PartitionSt			par;		//!< partition information
 	struct uffs_FlashOpsSt			*ops;		//!< flash operations
 	struct uffs_BlockInfoCacheSt	bc;			//!< block info cache
+	struct uffs_FileInfoCacheSt		fc;			//!< file info cache
 	struct uffs_LockSt				lock;		//!< lock data structure
 	struct uffs_PageBufDescSt		buf;		//!< page buffers
 	struct uffs_PageCommInfoSt		com;		//!< common information
 	struct uffs_TreeSt				tree;		//!< tree list of block
 	struct uffs_PendingListSt		pending;	//!< pending block list, to be recover/mark 'bad'/refresh
 	struct uffs_FlashStatSt			st;			//!< statistic (counters)
+	struct uffs_CacheStatSt			cache_st;	//!< cache statistic (counters)
+	struct uffs_WriteStatSt			write_st;	//!< write amplification statistic
 	struct uffs_memAllocatorSt		mem;		//!< uffs memory allocator
 	struct uffs_ConfigSt			cfg;		//!< uffs config
 	u32	ref_count;								//!< device reference count
@@ -214,12 +271,18 @@ void uffs_DeviceInitLock(uffs_Device *dev);
 /** delete the lock of uffs device */
 void uffs_DeviceReleaseLock(uffs_Device *dev);
 
-/** lock uffs device */
+/** lock uffs device (exclusive) */
 void uffs_DeviceLock(uffs_Device *dev);
 
-/** unlock uffs device */
+/** unlock uffs device (exclusive) */
 void uffs_DeviceUnLock(uffs_Device *dev);
 
+/** lock uffs device for read only access, shared with other readers */
+void uffs_DeviceLockShared(uffs_Device *dev);
+
+/** unlock uffs device locked by uffs_DeviceLockShared() */
+void uffs_DeviceUnLockShared(uffs_Device *dev);
+
 
 #ifdef __cplusplus
 }
@@ -102,13 +102,57 @@ struct uffs_stat {
     unsigned int	st_ctime;   /* time of last status change */
 };
 
+/**
+ * \brief dirent with attributes of the object, see uffs_readdirplus()
+ */
+struct uffs_direntplus {
+    struct uffs_dirent	d;		/* dirent */
+    struct uffs_stat	st;		/* attributes, as uffs_stat() */
+};
+
+/**
+ * \brief write amplification statistic, see uffs_fwstat() and uffs_wstat()
+ */
+struct uffs_wstat {
+    unsigned long	ws_bytes;		/* logical bytes written */
+    unsigned long	ws_programmed;	/* pages programmed, include copied pages */
+    unsigned long	ws_copied;		/* pages copied by block recover */
+    unsigned long	ws_erased;		/* blocks erased by block recover or truncate */
+    int				ws_page_size;	/* page data size, in bytes */
+};
+
 /* POSIX complaint file system APIs */
 
 int uffs_open(const char *name, int oflag, ...);
 int uffs_close(int fd);
 int uffs_read(int fd, void *data, int len);
 int uffs_write(int fd, const void *data, int len);
+
+/* positional read/write: access file at 'offset', file position is not changed.
+ * uffs_pwrite() appends data to the end of file if opened with UO_APPEND.
+ */
+int uffs_pread(int fd, void *data, int len, long offset);
+int uffs_pwrite(int fd, const void *data, int len, long offset);
+
+/* vectored read/write: data are scattered to/gathered from 'iov' in one pass */
+int uffs_readv(int fd, const struct uffs_iovec *iov, int iovcnt);
+int uffs_writev(int fd, const struct uffs_iovec *iov, int iovcnt);
+
+/* write 'n' pieces iov[i] at offset[i] all or nothing, in case of power loss.
+ * return 0 on success. fails with UEINVAL and writes nothing if the pieces
+ * are not in one existing block of the file or too many pages for a dirty group,
+ * see uffs_WriteObjectAtomic().
+ */
+int uffs_pwrite_atomic(int fd, const struct uffs_iovec *iov, const long *offset, int n);
+
 long uffs_seek(int fd, long offset, int origin);
+
+/* move file pointer forward by 'size' bytes, return bytes skipped.
+ * if opened for writing, skip over the end of file extends the file,
+ * the gap reads as '\0' (holes for whole data blocks, see CONFIG_SPARSE_FILE).
+ */
+int uffs_skip(int fd, int size);
+
 long uffs_tell(int fd);
 int uffs_eof(int fd);
 int uffs_flush(int fd);
@@ -116,6 +160,11 @@ int uffs_rename(const char *old_name, const char *new_name);
 int uffs_remove(const char *name);
 int uffs_ftruncate(int fd, long remain);
 
+/* reserve erased blocks for writing the file up to 'len' bytes, file length
+ * is not changed. reserved blocks are released on close or truncate.
+ */
+int uffs_fallocate(int fd, long len);
+
 int uffs_mkdir(const char *name, ...);
 int uffs_rmdir(const char *name);
 
@@ -123,16 +172,57 @@ int uffs_stat(const char *name, struct uffs_stat *buf);
 int uffs_lstat(const char *name, struct uffs_stat *buf);
 int uffs_fstat(int fd, struct uffs_stat *buf);
 
+/* write statistic of an opened file (since opened) or a mounted partition */
+int uffs_fwstat(int fd, struct uffs_wstat *buf);
+int uffs_wstat(const char *mount_point, struct uffs_wstat *buf);
+
 int uffs_closedir(uffs_DIR *dirp);
 uffs_DIR * uffs_opendir(const char *path);
 struct uffs_dirent * uffs_readdir(uffs_DIR *dirp);
 
+/* read up to 'n' entries with attributes in one call,
+ * return number of entries read, 0 at the end of dir, or -1 if error.
+ */
+int uffs_readdirplus(uffs_DIR *dirp, struct uffs_direntplus *ents, int n);
+
 void uffs_rewinddir(uffs_DIR *dirp);
 
 
+/* error number is kept per task with CONFIG_USE_PER_TASK_ERRNO and
+ * platform support, see uffs_OSGetErrnoSlot()
+ */
 int uffs_get_error(void);
 int uffs_set_error(int err);
 
+/* reentrant variants, return error number of the call via 'err' */
+int uffs_open_r(const char *name, int oflag, int *err);
+int uffs_close_r(int fd, int *err);
+int uffs_read_r(int fd, void *data, int len, int *err);
+int uffs_write_r(int fd, const void *data, int len, int *err);
+int uffs_pread_r(int fd, void *data, int len, long offset, int *err);
+int uffs_pwrite_r(int fd, const void *data, int len, long offset, int *err);
+int uffs_readv_r(int fd, const struct uffs_iovec *iov, int iovcnt, int *err);
+int uffs_writev_r(int fd, const struct uffs_iovec *iov, int iovcnt, int *err);
+int uffs_pwrite_atomic_r(int fd, const struct uffs_iovec *iov, const long *offset, int n, int *err);
+long uffs_seek_r(int fd, long offset, int origin, int *err);
+int uffs_skip_r(int fd, int size, int *err);
+long uffs_tell_r(int fd, int *err);
+int uffs_eof_r(int fd, int *err);
+int uffs_flush_r(int fd, int *err);
+int uffs_rename_r(const char *old_name, const char *new_name, int *err);
+int uffs_remove_r(const char *name, int *err);
+int uffs_ftruncate_r(int fd, long remain, int *err);
+int uffs_fallocate_r(int fd, long len, int *err);
+int uffs_mkdir_r(const char *name, int *err);
+int uffs_rmdir_r(const char *name, int *err);
+int uffs_stat_r(const char *name, struct uffs_stat *buf, int *err);
+int uffs_lstat_r(const char *name, struct uffs_stat *buf, int *err);
+int uffs_fstat_r(int fd, struct uffs_stat *buf, int *err);
+uffs_DIR * uffs_opendir_r(const char *path, int *err);
+int uffs_closedir_r(uffs_DIR *dirp, int *err);
+struct uffs_dirent * uffs_readdir_r(uffs_DIR *dirp, int *err);
+int uffs_readdirplus_r(uffs_DIR *dirp, struct uffs_direntplus *ents, int n, int *err);
+
 int uffs_version(void);
 int uffs_format(const char *mount_point);
 
@@ -142,6 +232,17 @@ long uffs_space_free(const char *mount_point);
 
 void uffs_flush_all(const char *mount_point);
 
+/* hold the global file system lock across several APIs calls of current task,
+ * e.g. a batch of operations, so other tasks can't interleave.
+ * fd APIs called while holding it nest in the lock, which needs a non-zero
+ * task id from uffs_OSGetTaskId(); on ports returning 0 it fails with UEINVAL
+ * and the lock is not taken. call uffs_fs_unlock() only if it returns 0.
+ * no effect with CONFIG_USE_PER_DEVICE_LOCK, operations are locked per device.
+ * \note don't block on other tasks using UFFS while holding it.
+ */
+int uffs_fs_lock(void);
+void uffs_fs_unlock(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,77 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+/** 
+ * \file uffs_fileinfo.h
+ * \brief file/dir info cache, keep uffs_FileInfo of recently used objects in RAM
+ * \author Ricky Zheng
+ */
+
+#ifndef _UFFS_FILEINFO_H_
+#define _UFFS_FILEINFO_H_
+
+#include "uffs/uffs_types.h"
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_core.h"
+#include "uffs/uffs_tree.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/** hash slot of dir/file 'serial' in file info cache */
+#define FILE_INFO_HASH(serial)	((serial) & (FILE_INFO_HASH_LEN - 1))
+
+/** initialize file info cache, 'max_entries' <= 0 disables the cache */
+URET uffs_FileInfoInitCache(uffs_Device *dev, int max_entries);
+
+/** release file info cache */
+URET uffs_FileInfoReleaseCache(uffs_Device *dev);
+
+/**
+ * load file info of a dir/file node, from the cache if possible.
+ * page buffer is only used when there is a cache miss.
+ */
+URET uffs_FileInfoLoad(uffs_Device *dev, int type, TreeNode *node,
+					   uffs_FileInfo *fi, u16 *sum);
+
+/** drop the cached file info of dir/file 'serial' */
+void uffs_FileInfoExpire(uffs_Device *dev, u16 serial);
+
+/** drop all cached file info */
+void uffs_FileInfoExpireAll(uffs_Device *dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
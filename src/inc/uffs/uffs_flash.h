@@ -62,7 +62,7 @@ extern "C"{
 #define UFFS_LAYOUT_UFFS	0	//!< do layout by dev->attr information
 #define UFFS_LAYOUT_FLASH	1	//!< flash driver do the layout
 
-#define UFFS_SPARE_LAYOUT_SIZE	6	//!< maximum spare layout array size, 2 segments
+#define UFFS_SPARE_LAYOUT_SIZE	8	//!< maximum spare layout array size, 3 segments
 
 /** flash operation return code */
 #define UFFS_FLASH_NO_ERR		0		//!< no error
@@ -100,7 +100,7 @@ struct uffs_StorageAttrSt {
 	u32 total_blocks;		//!< total blocks in this chip
 	u16 page_data_size;		//!< page data size (physical page data size, e.g. 512)
 	u16 pages_per_block;	//!< pages per block
-	u8 spare_size;			//!< page spare size (physical page spare size, e.g. 16)
+	u16 spare_size;			//!< page spare size (physical page spare size, e.g. 16)
 	u8 block_status_offs;	//!< block status byte offset in spare
 	int ecc_opt;			//!< ecc option ( #UFFS_ECC_[NONE|SOFT|HW|HW_AUTO] )
 	int layout_opt;			//!< layout option (#UFFS_LAYOUT_UFFS or #UFFS_LAYOUT_FLASH)
@@ -182,6 +182,9 @@ struct uffs_FlashOpsSt {
 	 * \note if data is NULL, do not return data; if ts is NULL, do not read tag; if both data and ts are NULL,
 	 *       then read bad block mark and return UFFS_FLASH_BAD_BLK if bad block mark is not 0xFF.
 	 *
+	 * \note ts is the store of a uffs_Tags, if page data size > #TAG_DATA_LEN_MAX,
+	 *       unpack it with uffs_FlashUnloadSpare() so that uffs_TagsSt.data_len_hi is loaded.
+	 *
 	 * \note flash driver DO NOT need to do ecc correction for tag,
 	 *		UFFS will take care of tag ecc.
 	 */
@@ -216,6 +219,9 @@ struct uffs_FlashOpsSt {
 	 *
 	 * \note If data == NULL && ts == NULL, driver should mark this block as a 'bad block'.
 	 *
+	 * \note ts is the store of a uffs_Tags, if page data size > #TAG_DATA_LEN_MAX,
+	 *       pack it with uffs_FlashMakeSpare() so that uffs_TagsSt.data_len_hi goes along.
+	 *
 	 * \return	#UFFS_FLASH_NO_ERR: success
 	 *			#UFFS_FLASH_IO_ERR: I/O error, expect retry ?
 	 *			#UFFS_FLASH_BAD_BLK: a bad block detected.
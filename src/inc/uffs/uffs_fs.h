@@ -53,6 +53,7 @@ struct uffs_ObjectSt {
 	/******* objects manager ********/
 	int dev_lock_count;
 	int dev_get_count;
+	struct uffs_ObjectSt *open_next;	//!< next object in the same open table slot
 
 	/******** init level 0 ********/
 	const char * name;					//!< pointer to the start of name, for open or create
@@ -78,6 +79,9 @@ struct uffs_ObjectSt {
 	UBOOL attr_loaded;					//!< attributes loaded ?
 	UBOOL open_succ;					//!< U_TRUE or U_FALSE
 
+	uffs_WriteStat write_st;			//!< write statistic since opened
+
+	struct uffs_BlockReserveSt resv;	//!< erased blocks reserved by uffs_FallocateObject()
 };
 
 typedef struct uffs_ObjectSt uffs_Object;
@@ -89,6 +93,10 @@ typedef struct uffs_ObjectSt uffs_Object;
 
 uffs_Pool * uffs_GetObjectPool(void);
 
+URET uffs_HandlePoolInit(uffs_Pool *pool, void *mem, u32 mem_size, u32 buf_size, u32 num_bufs);
+URET uffs_HandlePoolRelease(uffs_Pool *pool);
+void * uffs_HandlePoolGet(uffs_Pool *pool);
+
 URET uffs_InitObjectBuf(void);
 URET uffs_ReleaseObjectBuf(void);
 int uffs_PutAllObjectBuf(uffs_Device *dev);
@@ -118,6 +126,13 @@ URET uffs_CreateObject(uffs_Object *obj, const char *fullname, int oflag);
 URET uffs_CloseObject(uffs_Object *obj);
 int uffs_WriteObject(uffs_Object *obj, const void *data, int len);
 int uffs_ReadObject(uffs_Object *obj, void *data, int len);
+int uffs_WriteObjectAt(uffs_Object *obj, const void *data, int len, u32 ofs);
+int uffs_ReadObjectAt(uffs_Object *obj, void *data, int len, u32 ofs);
+int uffs_WriteObjectV(uffs_Object *obj, const struct uffs_iovec *iov, int iovcnt);
+URET uffs_WriteObjectAtomic(uffs_Object *obj, const struct uffs_iovec *iov, const long *ofs, int n);
+int uffs_ReadObjectV(uffs_Object *obj, const struct uffs_iovec *iov, int iovcnt);
+URET uffs_FallocateObject(uffs_Object *obj, u32 len);
+int uffs_SkipObject(uffs_Object *obj, int size);
 long uffs_SeekObject(uffs_Object *obj, long offset, int origin);
 int uffs_GetCurOffset(uffs_Object *obj);
 int uffs_EndOfFile(uffs_Object *obj);
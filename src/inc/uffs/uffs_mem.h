@@ -51,11 +51,13 @@ typedef struct uffs_memAllocatorSt {
 	void * pagebuf_pool_buf;			//!< page buffers
 	void * tree_nodes_pool_buf;			//!< tree nodes buffer
 	void * spare_pool_buf;				//!< spare buffers
+	void * fileinfo_pool_buf;			//!< file info cache buffers
 
 	int blockinfo_pool_size;			//!< block info cache buffers size
 	int pagebuf_pool_size;				//!< page buffers size
 	int tree_nodes_pool_size;			//!< tree nodes buffer size
 	int spare_pool_size;				//!< spare buffer pool size
+	int fileinfo_pool_size;				//!< file info cache buffers size
 
 	uffs_Pool tree_pool;
 	uffs_Pool spare_pool;
@@ -44,6 +44,9 @@ extern "C"{
 typedef void * OSSEM;
 #define OSSEM_NOT_INITED	(NULL)
 
+typedef void * OSRWLOCK;
+#define OSRWLOCK_NOT_INITED	(NULL)
+
 struct uffs_DebugMsgOutputSt {
 	void (*output)(const char *msg);
 	void (*vprintf)(const char *fmt, va_list args);
@@ -57,9 +60,47 @@ int uffs_SemWait(OSSEM sem);
 int uffs_SemSignal(OSSEM sem);
 int uffs_SemDelete(OSSEM *sem);
 
-int uffs_OSGetTaskId(void);	//get current task id
+/* reader-writer lock, only needed with CONFIG_USE_PER_DEVICE_LOCK */
+int uffs_RwLockCreate(OSRWLOCK *lock);
+int uffs_RwLockRead(OSRWLOCK lock);		//acquire shared (reader) lock
+int uffs_RwLockWrite(OSRWLOCK lock);	//acquire exclusive (writer) lock
+int uffs_RwUnlockRead(OSRWLOCK lock);
+int uffs_RwUnlockWrite(OSRWLOCK lock);
+int uffs_RwLockDelete(OSRWLOCK *lock);
+
+/* atomic operations, only needed with CONFIG_USE_PER_DEVICE_LOCK (counters
+ * updated while holding a shared lock, all of them) or with
+ * CONFIG_USE_LOCK_FREE_POOL (the int versions).
+ * uffs_AtomicAdd(), uffs_AtomicInc16() and uffs_AtomicDec16() return the
+ * new value, uffs_AtomicCas() returns non-zero if *p was swapped.
+ */
+int uffs_AtomicGet(volatile int *p);
+void uffs_AtomicSet(volatile int *p, int val);
+int uffs_AtomicAdd(volatile int *p, int n);
+int uffs_AtomicCas(volatile int *p, int expected, int desired);
+unsigned short uffs_AtomicGet16(volatile unsigned short *p);
+unsigned short uffs_AtomicInc16(volatile unsigned short *p);
+unsigned short uffs_AtomicDec16(volatile unsigned short *p);
+
+/* get current task id. ids must be unique among running tasks and non-zero,
+ * the global file system lock uses it to let the holding task nest calls.
+ * a port returning 0 still gets mutual exclusion, but without nesting.
+ */
+int uffs_OSGetTaskId(void);
+
+/* per-task storage for the error number of uffs_get_error()/uffs_set_error(),
+ * only needed with CONFIG_USE_PER_TASK_ERRNO. return NULL if the platform
+ * has no task local storage, then a single global error number is shared
+ * by all tasks.
+ */
+int * uffs_OSGetErrnoSlot(void);
 unsigned int uffs_GetCurDateTime(void);
 
+/* free running clock in microseconds, for measurement only.
+ * only needed with CONFIG_ENABLE_TIMING_STAT (and by the test tools).
+ */
+unsigned int uffs_GetCurTimeUs(void);
+
 #ifdef __cplusplus
 }
 #endif
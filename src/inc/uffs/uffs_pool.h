@@ -40,6 +40,7 @@
 #define _UFFS_POOL_H_
 
 
+#include "uffs_config.h"
 #include "uffs/uffs_types.h"
 #include "uffs/uffs_os.h"
 
@@ -55,6 +56,9 @@ typedef struct uffs_PoolEntrySt {
     struct uffs_PoolEntrySt *next;
 } uffs_PoolEntry;
 
+/** max memory segments of a lock free pool */
+#define UFFS_POOL_MAX_SEGS		8
+
 /**
  * \struct uffs_PoolSt
  * \brief Memory pool.
@@ -62,12 +66,26 @@ typedef struct uffs_PoolEntrySt {
 typedef struct uffs_PoolSt {
 	u8 *mem;					//!< memory pool
 	u32 buf_size;				//!< size of a buffer
-	u32 num_bufs;				//!< number of buffers in the pool
+	u32 num_bufs;				//!< number of buffers in the pool (per segment for lock free pool)
 	uffs_PoolEntry *free_list;	//!< linked list of free buffers
-	OSSEM sem;					//!< buffer lock
+	OSSEM sem;					//!< buffer lock (grow lock for lock free pool)
+
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	/* lock free pool, see uffs_PoolInitLockFree() */
+	UBOOL lock_free;			//!< U_TRUE if it's a lock free pool
+	volatile int lf_head;		//!< free list head: (ABA tag << 16) | (index + 1), 0 for empty
+	volatile int lf_free;		//!< free buffers count
+	volatile int num_segs;		//!< memory segments in use
+	int max_segs;				//!< max memory segments, up to #UFFS_POOL_MAX_SEGS
+	u8 *seg[UFFS_POOL_MAX_SEGS];	//!< memory segments, seg[0] is mem
+#endif
 } uffs_Pool;
 
 URET uffs_PoolInit(uffs_Pool *pool, void *mem, u32 mem_size, u32 buf_size, u32 num_bufs, UBOOL lock);
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+URET uffs_PoolInitLockFree(uffs_Pool *pool, void *mem, u32 mem_size, u32 buf_size, u32 num_bufs, int max_segs);
+URET uffs_PoolGrow(uffs_Pool *pool, void *mem, u32 mem_size);
+#endif
 URET uffs_PoolRelease(uffs_Pool *pool);
 
 UBOOL uffs_PoolVerify(uffs_Pool *pool, void *p);
@@ -78,6 +96,7 @@ void *uffs_PoolGetLocked(uffs_Pool *pool);
 int uffs_PoolPut(uffs_Pool *pool, void *p);
 int uffs_PoolPutLocked(uffs_Pool *pool, void *p);
 
+u32 uffs_PoolGetBufCount(uffs_Pool *pool);
 void *uffs_PoolGetBufByIndex(uffs_Pool *pool, u32 index);
 u32 uffs_PoolGetIndex(uffs_Pool *pool, void *p);
 UBOOL uffs_PoolCheckFreeList(uffs_Pool *pool, void *p);
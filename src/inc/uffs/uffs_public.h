@@ -112,17 +112,34 @@ struct uffs_TagStoreSt {
 	u32 valid:1;		//!< 0: valid, 1: invalid
 	u32 type:2;			//!< block type: #UFFS_TYPE_DIR, #UFFS_TYPE_FILE, #UFFS_TYPE_DATA
 	u32 block_ts:2;		//!< time stamp of block;
-	u32 data_len:12;	//!< length of page data
+	u32 data_len:12;	//!< length of page data (bit 0 ~ 11)
 	u32 serial:14;		//!< serial number
 
 	u32 parent:10;		//!< parent's serial number
-	u32 page_id:6;		//!< page id
-	u32 reserved:4;		//!< reserved, for UFFS2
+	u32 page_id:6;		//!< page id (bit 0 ~ 5)
+	u32 page_id_hi:2;	//!< page id bit 6 ~ 7, #TAG_ID_LAYOUT_WIDE only
+	u32 id_layout:1;	//!< page id layout: #TAG_ID_LAYOUT_WIDE or #TAG_ID_LAYOUT_NARROW
+	u32 reserved:1;		//!< reserved, for UFFS2
 	u32 tag_ecc:12;		//!< tag ECC
 };
 
 #define TAG_ECC_DEFAULT (0xFFF)	//!< 12-bit '1'
 
+/** uffs_TagStoreSt.id_layout */
+#define TAG_ID_LAYOUT_WIDE		0	//!< 8-bit page id, up to 256 pages per block
+#define TAG_ID_LAYOUT_NARROW	1	//!< 6-bit page id, up to 64 pages per block, page_id_hi and id_layout are left erased
+
+#define UFFS_NARROW_ID_MAX_PAGES	64		//!< max pages per block of #TAG_ID_LAYOUT_NARROW
+#define UFFS_MAX_PAGES_PER_BLOCK	256		//!< max pages per block of #TAG_ID_LAYOUT_WIDE
+
+/**
+ * uffs_TagStoreSt.data_len holds up to 4095 bytes. Larger page data length
+ * has bit 12 ~ 15 in uffs_TagsSt.data_len_hi, which is stored in spare
+ * right after the tag store (see uffs_FlashMakeSpare()).
+ */
+#define TAG_DATA_LEN_MAX		0xFFF
+#define TAG_DATA_LEN_HI_BAD		0xFF	//!< uffs_TagsSt.data_len_hi loaded from a corrupted spare
+
 
 /** 
  * \struct uffs_TagsSt
@@ -135,6 +152,8 @@ struct uffs_TagsSt {
 
 	/** internal used */
 	u8 seal_byte;			//!< seal byte.
+
+	u8 data_len_hi;			//!< data length bit 12 ~ 15, page data size > #TAG_DATA_LEN_MAX only
 };
 
 /** 
@@ -166,8 +185,28 @@ struct uffs_MiniHeaderSt {
 #define TAG_DIRTY_BIT(tag) (tag)->s.dirty
 #define TAG_SERIAL(tag) (tag)->s.serial
 #define TAG_PARENT(tag) (tag)->s.parent
-#define TAG_PAGE_ID(tag) (tag)->s.page_id
-#define TAG_DATA_LEN(tag) (tag)->s.data_len
+#define TAG_PAGE_ID(tag) \
+	((tag)->s.id_layout == TAG_ID_LAYOUT_WIDE ? \
+		(u16)(((tag)->s.page_id_hi << 6) | (tag)->s.page_id) : (u16)((tag)->s.page_id))
+#define TAG_SET_PAGE_ID(dev, tag, id) \
+	do { \
+		(tag)->s.page_id = (id) & 0x3F; \
+		if ((dev)->com.id_layout == TAG_ID_LAYOUT_WIDE) { \
+			(tag)->s.page_id_hi = ((id) >> 6) & 0x3; \
+			(tag)->s.id_layout = TAG_ID_LAYOUT_WIDE; \
+		} \
+		else { \
+			(tag)->s.page_id_hi = 0x3; \
+			(tag)->s.id_layout = TAG_ID_LAYOUT_NARROW; \
+		} \
+	} while (0)
+#define TAG_DATA_LEN(tag) \
+	((u16)((tag)->s.data_len | (((tag)->data_len_hi & 0xF) << 12)))
+#define TAG_SET_DATA_LEN(tag, len) \
+	do { \
+		(tag)->s.data_len = (len) & TAG_DATA_LEN_MAX; \
+		(tag)->data_len_hi = (u8)(((len) >> 12) & 0xF); \
+	} while (0)
 #define TAG_TYPE(tag) (tag)->s.type
 #define TAG_BLOCK_TS(tag) (tag)->s.block_ts
 #define SEAL_TAG(tag) (tag)->seal_byte = 0
@@ -245,11 +284,11 @@ UBOOL uffs_IsBlockBad(uffs_Device *dev, uffs_BlockInfo *bc);
  * \def UFFS_INVALID_BLOCK
  * \brief macro for invalid block number
  */
-#define UFFS_INVALID_BLOCK	(0xfffe)
+#define UFFS_INVALID_BLOCK	((uffs_BlockNum)~1)
 
 
-URET uffs_NewBlock(uffs_Device *dev, u16 block, uffs_Tags *tag, uffs_Buf *buf);
-URET uffs_BlockRecover(uffs_Device *dev, uffs_BlockInfo *old, u16 newBlock);
+URET uffs_NewBlock(uffs_Device *dev, uffs_BlockNum block, uffs_Tags *tag, uffs_Buf *buf);
+URET uffs_BlockRecover(uffs_Device *dev, uffs_BlockInfo *old, uffs_BlockNum newBlock);
 URET uffs_PageRecover(uffs_Device *dev, 
 					  uffs_BlockInfo *bc, 
 					  u16 oldPage, 
@@ -286,6 +325,10 @@ URET uffs_DirEntryBufRelease(void);
 uffs_Pool * uffs_DirEntryBufGetPool(void);
 int uffs_DirEntryBufPutAll(uffs_Device *dev);
 
+/* some functions from uffs_fs.c */
+void uffs_ObjectWriteStatAdd(uffs_Device *dev, u16 serial,
+							 int programmed, int copied, int erased);
+
 
 /************************************************************************/
 /*  init functions                                                                     */
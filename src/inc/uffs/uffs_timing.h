@@ -0,0 +1,123 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_timing.h
+ * \brief latency histograms for fd APIs and internal stages
+ * \author Ricky Zheng
+ */
+
+#ifndef _UFFS_TIMING_H_
+#define _UFFS_TIMING_H_
+
+#include "uffs_config.h"
+#include "uffs/uffs_types.h"
+#include "uffs/uffs_os.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * \def UFFS_TIMING_BUCKETS
+ * \brief number of log2 buckets, bucket n counts samples in [2^(n-1), 2^n) us,
+ *        bucket 0 counts samples less than 1 us, the last one takes all the rest.
+ */
+#define UFFS_TIMING_BUCKETS		24
+
+/** measured points */
+enum {
+	/* fd APIs */
+	UFFS_TM_OPEN = 0,
+	UFFS_TM_CLOSE,
+	UFFS_TM_READ,
+	UFFS_TM_WRITE,
+	UFFS_TM_SEEK,
+	UFFS_TM_FLUSH,
+	UFFS_TM_FTRUNCATE,
+	UFFS_TM_FALLOCATE,
+	UFFS_TM_RENAME,
+	UFFS_TM_REMOVE,
+	UFFS_TM_STAT,
+	UFFS_TM_MKDIR,
+	UFFS_TM_RMDIR,
+	UFFS_TM_OPENDIR,
+	UFFS_TM_READDIR,
+
+	/* internal stages */
+	UFFS_TM_BUF_GET_HIT,		//!< uffs_BufGetEx(), found in buffer
+	UFFS_TM_BUF_GET_MISS,		//!< uffs_BufGetEx(), load from flash
+	UFFS_TM_BUF_FLUSH,			//!< _BufFlush()
+	UFFS_TM_BUF_FLUSH_RECOVER,	//!< uffs_BufFlush_Exist_With_BlockRecover()
+	UFFS_TM_FLASH_READ_PAGE,	//!< uffs_FlashReadPage()
+	UFFS_TM_FLASH_WRITE_PAGE,	//!< uffs_FlashWritePageCombine()
+	UFFS_TM_FLASH_ERASE_BLOCK,	//!< uffs_FlashEraseBlock()
+
+	UFFS_TM_MAX
+};
+
+/**
+ * \struct uffs_TimingHistSt
+ * \brief latency histogram of one measured point
+ */
+typedef struct uffs_TimingHistSt {
+	u32 count;							//!< number of samples
+	u32 total;							//!< sum of samples (us)
+	u32 max;							//!< max sample (us)
+	u32 bucket[UFFS_TIMING_BUCKETS];	//!< log2 buckets
+} uffs_TimingHist;
+
+#ifdef CONFIG_ENABLE_TIMING_STAT
+
+/** start measuring, must be placed at the end of declarations */
+#define UFFS_TIMING_BEGIN(t)		u32 t = uffs_GetCurTimeUs()
+/** stop measuring and put the sample to histogram #id */
+#define UFFS_TIMING_END(id, t)		uffs_TimingRecord(id, uffs_GetCurTimeUs() - (t))
+
+void uffs_TimingRecord(int id, u32 us);
+URET uffs_TimingGet(int id, uffs_TimingHist *hist);
+void uffs_TimingReset(void);
+const char * uffs_TimingName(int id);
+u32 uffs_TimingPercentile(const uffs_TimingHist *hist, int pct);
+
+#else
+
+#define UFFS_TIMING_BEGIN(t)
+#define UFFS_TIMING_END(id, t)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
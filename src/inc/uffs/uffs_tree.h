@@ -64,7 +64,7 @@ struct uffs_NodeTypeNameMapSt {
 struct BlockListSt {	/* 12 bytes */
 	struct uffs_TreeNodeSt * next;
 	struct uffs_TreeNodeSt * prev;
-	u16 block;
+	uffs_BlockNum block;
 	union {
 		u16 serial;			/* for suspended block list */
 		u8 need_check;		/* for erased block list */
@@ -72,7 +72,7 @@ struct BlockListSt {	/* 12 bytes */
 };
 
 struct DirhSt {		/* 8 bytes */
-	u16 block;
+	uffs_BlockNum block;
 	u16 checksum;	/* check sum of dir name */
 	u16 parent;
 	u16 serial;
@@ -80,7 +80,7 @@ struct DirhSt {		/* 8 bytes */
 
 
 struct FilehSt {	/* 12 bytes */
-	u16 block;
+	uffs_BlockNum block;
 	u16 checksum;	/* check sum of file name */
 	u16 parent;
 	u16 serial;
@@ -88,7 +88,7 @@ struct FilehSt {	/* 12 bytes */
 };
 
 struct FdataSt {	/* 10 bytes */
-	u16 block;
+	uffs_BlockNum block;
 	u16 parent;
 	u32 len;		/* file data length on this block */
 	u16 serial;
@@ -102,8 +102,8 @@ typedef struct uffs_TreeNodeSt {
 		struct FilehSt file;
 		struct FdataSt data;
 	} u;
-	u16 hash_next;		
-	u16 hash_prev;			
+	uffs_NodeIdx hash_next;
+	uffs_NodeIdx hash_prev;
 } TreeNode;
 
 
@@ -140,7 +140,7 @@ typedef struct uffs_TreeNodeSt {
 */
 
 
-#define EMPTY_NODE 0xffff				//!< special index num of empty node.
+#define EMPTY_NODE ((uffs_NodeIdx)~0)	//!< special index num of empty node.
 
 #define ROOT_DIR_SERIAL	0				//!< serial num of root dir
 #define MAX_UFFS_FSN			0x3ff	//!< maximum dir|file serial number (uffs_TagStore#parent: 10 bits)
@@ -157,7 +157,7 @@ typedef struct uffs_TreeNodeSt {
 #define DATA_NODE_HASH_MASK		0x1ff
 #define DATA_NODE_ENTRY_LEN		(DATA_NODE_HASH_MASK + 1)
 #define FROM_IDX(idx, pool)		((TreeNode *)uffs_PoolGetBufByIndex(pool, idx))
-#define TO_IDX(p, pool)			((u16)uffs_PoolGetIndex(pool, (void *) p))
+#define TO_IDX(p, pool)			((uffs_NodeIdx)uffs_PoolGetIndex(pool, (void *) p))
 
 
 #define GET_FILE_HASH(serial)			(serial & FILE_NODE_HASH_MASK)
@@ -165,6 +165,14 @@ typedef struct uffs_TreeNodeSt {
 #define GET_DATA_HASH(parent, serial)	((parent + serial) & DATA_NODE_HASH_MASK)
 
 
+/** erased blocks reserved for a file, see uffs_FallocateObject() */
+struct uffs_BlockReserveSt {
+	u16 serial;							//!< serial of the file
+	int count;							//!< reserved blocks
+	TreeNode *head;						//!< reserved blocks, linked by u.list.next
+	struct uffs_BlockReserveSt *next;	//!< next reservation on the same device
+};
+
 struct uffs_TreeSt {
 	TreeNode *erased;					//!< erased block list head
 	TreeNode *erased_tail;				//!< erased block list tail
@@ -175,9 +183,11 @@ struct uffs_TreeSt {
 	TreeNode *bad;						//!< bad block list
 	int bad_count;						//!< bad block counter
 
-	u16 dir_entry[DIR_NODE_ENTRY_LEN];
-	u16 file_entry[FILE_NODE_ENTRY_LEN];
-	u16 data_entry[DATA_NODE_ENTRY_LEN];
+	struct uffs_BlockReserveSt *reserve;	//!< erased block reservations of opened files
+
+	uffs_NodeIdx dir_entry[DIR_NODE_ENTRY_LEN];
+	uffs_NodeIdx file_entry[FILE_NODE_ENTRY_LEN];
+	uffs_NodeIdx data_entry[DATA_NODE_ENTRY_LEN];
 	u16 max_serial;
 };
 
@@ -195,11 +205,11 @@ TreeNode * uffs_TreeFindDirNodeByName(uffs_Device *dev, const char *name, u32 le
 TreeNode * uffs_TreeFindDataNode(uffs_Device *dev, u16 parent, u16 serial);
 
 
-TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, u16 block);
-TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, u16 block);
-TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, u16 block);
-TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, u16 block);
-TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, u16 block);
+TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, uffs_BlockNum block);
+TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, uffs_BlockNum block);
+TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, uffs_BlockNum block);
+TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, uffs_BlockNum block);
+TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, uffs_BlockNum block);
 
 void uffs_TreeSuspendAdd(uffs_Device *dev, TreeNode *node);
 TreeNode * uffs_TreeFindSuspendNode(uffs_Device *dev, u16 serial);
@@ -210,13 +220,18 @@ void uffs_TreeRemoveSuspendNode(uffs_Device *dev, TreeNode *node);
 #define SEARCH_REGION_DATA		4
 #define SEARCH_REGION_BAD		8
 #define SEARCH_REGION_ERASED	16
-TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, u16 block, int *region);
+TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, uffs_BlockNum block, int *region);
 
 
 
 UBOOL uffs_TreeCompareFileName(uffs_Device *dev, const char *name, u32 len, u16 sum, TreeNode *node, int type);
 
 TreeNode * uffs_TreeGetErasedNode(uffs_Device *dev);
+TreeNode * uffs_TreeGetErasedNodeFor(uffs_Device *dev, u8 type, u16 parent, u16 serial);
+void uffs_TreePutErasedNodeFor(uffs_Device *dev, u8 type, u16 parent, u16 serial, TreeNode *node);
+
+URET uffs_TreeReserveAdd(uffs_Device *dev, struct uffs_BlockReserveSt *resv, int count);
+void uffs_TreeReserveRelease(uffs_Device *dev, struct uffs_BlockReserveSt *resv);
 URET uffs_TreeEraseNode(uffs_Device *dev, TreeNode *node);
 
 void uffs_InsertNodeToTree(uffs_Device *dev, u8 type, TreeNode *node);
@@ -227,7 +242,7 @@ void uffs_TreeInsertToBadBlockList(uffs_Device *dev, TreeNode *node);
 
 void uffs_BreakFromEntry(uffs_Device *dev, u8 type, TreeNode *node);
 
-void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, u16 block);
+void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, uffs_BlockNum block);
 
 
 #ifdef __cplusplus
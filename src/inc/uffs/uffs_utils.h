@@ -49,6 +49,8 @@ void uffs_InitGlobalFsLock(void);
 void uffs_ReleaseGlobalFsLock(void);
 void uffs_GlobalFsLockLock(void);
 void uffs_GlobalFsLockUnlock(void);
+void uffs_GlobalTableLock(void);
+void uffs_GlobalTableUnlock(void);
 
 URET uffs_FormatDevice(uffs_Device *dev, UBOOL force);
 
@@ -41,19 +41,39 @@
 
 /**
  * \def UFFS_MAX_PAGE_SIZE
- * \note maximum page size UFFS support
+ * \note maximum page size UFFS support, the page size of a device
+ *       (uffs_StorageAttrSt.page_data_size) can be any size up to this.
  */
-#define UFFS_MAX_PAGE_SIZE		2048
+#define UFFS_MAX_PAGE_SIZE		16384
+
+/**
+ * \def UFFS_SPARE_SIZE_OF
+ * \note maximum spare size for the given page size
+ */
+#define UFFS_SPARE_SIZE_OF(n_page_size) (((n_page_size) / 256) * 8)
+
+/**
+ * \def UFFS_ECC_SIZE_OF
+ * \note maximum ECC size for the given page size
+ */
+#define UFFS_ECC_SIZE_OF(n_page_size) (((n_page_size) / 256) * 5)
 
 /**
  * \def UFFS_MAX_SPARE_SIZE
  */
-#define UFFS_MAX_SPARE_SIZE ((UFFS_MAX_PAGE_SIZE / 256) * 8)
+#define UFFS_MAX_SPARE_SIZE UFFS_SPARE_SIZE_OF(UFFS_MAX_PAGE_SIZE)
 
 /**
  * \def UFFS_MAX_ECC_SIZE
  */
-#define UFFS_MAX_ECC_SIZE  ((UFFS_MAX_PAGE_SIZE / 256) * 5)
+#define UFFS_MAX_ECC_SIZE  UFFS_ECC_SIZE_OF(UFFS_MAX_PAGE_SIZE)
+
+/**
+ * \def CONFIG_UFFS_WIDE_BLOCK_ADDRESS
+ * \note use 32-bit block number and tree node index (uffs_BlockNum, uffs_NodeIdx),
+ *       for partitions beyond 65534 blocks. Tree node takes 8 more bytes per block (32-bit CPU).
+ */
+//#define CONFIG_UFFS_WIDE_BLOCK_ADDRESS
 
 /**
  * \def MAX_CACHED_BLOCK_INFO
@@ -62,6 +82,15 @@
  */
 #define MAX_CACHED_BLOCK_INFO	50
 
+/**
+ * \def MAX_CACHED_FILE_INFO
+ * \note uffs cache uffs_FileInfo (name, attributes and time stamps) of
+ *       recently used dirs and files, so stat, readdir and name lookup
+ *       don't need to load the info page into page buffers. each entry
+ *       costs about sizeof(uffs_FileInfo) + 16 bytes. 0 to disable it.
+ */
+#define MAX_CACHED_FILE_INFO	32
+
 /** 
  * \def MAX_PAGE_BUFFERS
  * \note the bigger value will bring better read/write performance.
@@ -123,10 +152,37 @@
  * \def CONFIG_USE_PER_DEVICE_LOCK
  * \note use per-device lock.
  *		 this is required if you use fs APIs in multi-thread environment.
+ *		 file system operations on different devices (partitions) can run
+ *		 in parallel, the global lock is then only held for short operations
+ *		 on shared tables (fd/object pool, dir handle pool and mount table).
+ *		 your flash driver should serialize accesses to the chip by itself
+ *		 if partitions are on the same chip.
+ *		 the port needs to provide reader-writer lock and atomic
+ *		 operations, see uffs_os.h.
  */
 //#define CONFIG_USE_PER_DEVICE_LOCK
 
 
+/**
+ * \def CONFIG_USE_LOCK_FREE_POOL
+ * \note take object and dir handles from lock free pools, opening and
+ *		 closing files never wait on other tasks. handle pools can grow,
+ *		 see CONFIG_HANDLE_POOL_SEGMENTS.
+ *		 the port needs to provide uffs_AtomicGet/Set/Add/Cas().
+ *		 if not defined, handle pools are protected by a semaphore.
+ */
+//#define CONFIG_USE_LOCK_FREE_POOL
+
+
+/**
+ * \def CONFIG_USE_PER_TASK_ERRNO
+ * \note keep the error number of uffs_get_error() per task.
+ *		 the port needs to provide uffs_OSGetErrnoSlot().
+ *		 if not defined, all tasks share one error number.
+ */
+#define CONFIG_USE_PER_TASK_ERRNO
+
+
 
 /**
  * \def CONFIG_USE_STATIC_MEMORY_ALLOCATOR
@@ -157,6 +213,17 @@
 //#define CONFIG_FLUSH_BUF_AFTER_WRITE
 
 
+/**
+ * \def CONFIG_SPARSE_FILE
+ * \note If defined, extending a file (seek and write over the end of file,
+ *       truncate to a larger size or uffs_SkipObject()) doesn't write the
+ *       whole data blocks in the gap, they are recorded as holes and read
+ *       as '\0'. Files with holes can't be mounted correctly by UFFS
+ *       versions without sparse file support.
+ */
+//#define CONFIG_SPARSE_FILE
+
+
 /**
  * \def CONFIG_UFFS_AUTO_LAYOUT_MTD_COMP
  * \note Use Linux MTD compatiable spare placement for UFFS_LAYOUT_AUTO,
@@ -170,7 +237,7 @@
  * maximum number of object handle 
  */
 #define MAX_OBJECT_HANDLE	50
-#define FD_SIGNATURE_SHIFT	6
+#define FD_SIGNATURE_SHIFT	8
 
 
 /**
@@ -179,6 +246,17 @@
  */
 #define MAX_DIR_HANDLE	10
 
+
+/**
+ * \def CONFIG_HANDLE_POOL_SEGMENTS
+ * \note object and dir handle pools start with MAX_OBJECT_HANDLE and
+ *       MAX_DIR_HANDLE handles. When all handles are in use, a pool grows
+ *       by the same number of handles, up to CONFIG_HANDLE_POOL_SEGMENTS
+ *       times of the initial size. Growing needs system memory allocator
+ *       and CONFIG_USE_LOCK_FREE_POOL, set it to 1 to disable growing.
+ */
+#define CONFIG_HANDLE_POOL_SEGMENTS	4
+
 /**
  * \def MINIMUN_ERASED_BLOCK
  *  UFFS will not allow appending or creating new files when the free/erased block
@@ -246,6 +324,14 @@
  */
 //#define CONFIG_ENABLE_PAGE_DATA_CRC
 
+/**
+ * \def CONFIG_ENABLE_TIMING_STAT
+ * \note Collect latency histograms of fd APIs and internal buffer/flash
+ *       operations, see uffs_timing.h. Costs two uffs_GetCurTimeUs() calls
+ *       per measured operation, so leave it off for production build.
+ */
+//#define CONFIG_ENABLE_TIMING_STAT
+
 
 /** micros for calculating buffer sizes */
 
@@ -257,7 +343,8 @@
 			(											\
 				(										\
 					sizeof(uffs_BlockInfo) +			\
-					sizeof(uffs_PageSpare) * n_pages_per_block \
+					sizeof(uffs_PageSpare) * n_pages_per_block + \
+					sizeof(u32) * BC_EXPIRED_MAP_WORDS(n_pages_per_block) \
 				 ) * MAX_CACHED_BLOCK_INFO				\
 			)
 
@@ -279,7 +366,25 @@
 #define UFFS_TREE_BUFFER_SIZE(n_blocks) (sizeof(TreeNode) * n_blocks)
 
 
-#define UFFS_SPARE_BUFFER_SIZE (MAX_SPARE_BUFFERS * UFFS_MAX_SPARE_SIZE)
+/**
+ *	\def UFFS_SPARE_BUFFER_SIZE
+ *	\brief calculate memory bytes for spare buffers, each holds
+ *		   a spare and two ECC buffers of a page
+ */
+#define UFFS_SPARE_BUFFER_SIZE(n_page_size) \
+			(								\
+				(							\
+					((UFFS_SPARE_SIZE_OF(n_page_size) + 3) & ~3) + \
+					((UFFS_ECC_SIZE_OF(n_page_size) + 3) & ~3) * 2 \
+				) * MAX_SPARE_BUFFERS		\
+			)
+
+/**
+ *	\def UFFS_FILE_INFO_BUFFER_SIZE
+ *	\brief calculate memory bytes for file info caches
+ */
+#define UFFS_FILE_INFO_BUFFER_SIZE	\
+			(sizeof(struct uffs_FileInfoEntrySt) * MAX_CACHED_FILE_INFO)
 
 
 /**
@@ -291,7 +396,8 @@
 				UFFS_BLOCK_INFO_BUFFER_SIZE(n_pages_per_block) + \
 				UFFS_PAGE_BUFFER_SIZE(n_page_size) + \
 				UFFS_TREE_BUFFER_SIZE(n_blocks) + \
-				UFFS_SPARE_BUFFER_SIZE \
+				UFFS_SPARE_BUFFER_SIZE(n_page_size) + \
+				UFFS_FILE_INFO_BUFFER_SIZE \
 			 )
 
 
@@ -301,6 +407,10 @@
 #error "MAX_PAGE_BUFFERS is too small"
 #endif
 
+#if (MAX_CACHED_FILE_INFO < 0)
+#error "MAX_CACHED_FILE_INFO should >= 0"
+#endif
+
 #if (MAX_DIRTY_PAGES_IN_A_BLOCK < 2)
 #error "MAX_DIRTY_PAGES_IN_A_BLOCK should >= 2"
 #endif
@@ -325,10 +435,14 @@
 #error "enable either CONFIG_USE_GLOBAL_FS_LOCK or CONFIG_USE_PER_DEVICE_LOCK, not both"
 #endif
 
-#if (MAX_OBJECT_HANDLE > (1 << FD_SIGNATURE_SHIFT))
+#if (MAX_OBJECT_HANDLE * CONFIG_HANDLE_POOL_SEGMENTS > (1 << FD_SIGNATURE_SHIFT))
 #error "Please increase FD_SIGNATURE_SHIFT !"
 #endif
 
+#if CONFIG_HANDLE_POOL_SEGMENTS < 1 || CONFIG_HANDLE_POOL_SEGMENTS > 8
+#error "CONFIG_HANDLE_POOL_SEGMENTS should be 1 ~ 8 (UFFS_POOL_MAX_SEGS)"
+#endif
+
 #if CONFIG_MAX_PENDING_BLOCKS < 2
 #error "Please increase CONFIG_MAX_PENDING_BLOCKS, normally 4"
 #endif
@@ -36,6 +36,8 @@
  * \author Ricky Zheng
  */
 
+#define _GNU_SOURCE		/* for pthread_rwlockattr_setkind_np() */
+
 #include "uffs_config.h"
 #include "uffs/uffs_os.h"
 #include "uffs/uffs_public.h"
@@ -90,10 +92,121 @@ int uffs_SemDelete(OSSEM *sem)
 	return ret;
 }
 
+int uffs_RwLockCreate(OSRWLOCK *lock)
+{
+	pthread_rwlock_t *rwlock = (pthread_rwlock_t *) malloc(sizeof(pthread_rwlock_t));
+	pthread_rwlockattr_t attr;
+	int ret = -1;
+
+	if (rwlock) {
+		pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+		// glibc prefers readers by default, writers would starve under
+		// steady read traffic.
+		pthread_rwlockattr_setkind_np(&attr,
+						PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+		ret = pthread_rwlock_init(rwlock, &attr);
+		pthread_rwlockattr_destroy(&attr);
+		if (ret == 0) {
+			*lock = (OSRWLOCK)rwlock;
+		}
+		else {
+			free(rwlock);
+		}
+	}
+
+	return ret;
+}
+
+int uffs_RwLockRead(OSRWLOCK lock)
+{
+	return pthread_rwlock_rdlock((pthread_rwlock_t *)lock);
+}
+
+int uffs_RwLockWrite(OSRWLOCK lock)
+{
+	return pthread_rwlock_wrlock((pthread_rwlock_t *)lock);
+}
+
+int uffs_RwUnlockRead(OSRWLOCK lock)
+{
+	return pthread_rwlock_unlock((pthread_rwlock_t *)lock);
+}
+
+int uffs_RwUnlockWrite(OSRWLOCK lock)
+{
+	return pthread_rwlock_unlock((pthread_rwlock_t *)lock);
+}
+
+int uffs_RwLockDelete(OSRWLOCK *lock)
+{
+	pthread_rwlock_t *rwlock = (pthread_rwlock_t *) (*lock);
+	int ret = -1;
+
+	if (rwlock) {
+		ret = pthread_rwlock_destroy(rwlock);
+		if (ret == 0) {
+			free(rwlock);
+			*lock = 0;
+		}
+	}
+	return ret;
+}
+
+int uffs_AtomicGet(volatile int *p)
+{
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+void uffs_AtomicSet(volatile int *p, int val)
+{
+	__atomic_store_n(p, val, __ATOMIC_SEQ_CST);
+}
+
+int uffs_AtomicAdd(volatile int *p, int n)
+{
+	return __atomic_add_fetch(p, n, __ATOMIC_SEQ_CST);
+}
+
+int uffs_AtomicCas(volatile int *p, int expected, int desired)
+{
+	return __atomic_compare_exchange_n(p, &expected, desired, 0,
+						__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+unsigned short uffs_AtomicGet16(volatile unsigned short *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+unsigned short uffs_AtomicInc16(volatile unsigned short *p)
+{
+	return __atomic_add_fetch(p, 1, __ATOMIC_ACQ_REL);
+}
+
+unsigned short uffs_AtomicDec16(volatile unsigned short *p)
+{
+	return __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL);
+}
+
 int uffs_OSGetTaskId(void)
 {
-	//TODO: ... return current task ID ...
-	return 0;
+	static volatile int next_id = 0;
+	static __thread int task_id = 0;
+
+	// assign ids on first call of each thread, start from 1
+	if (task_id == 0)
+		task_id = uffs_AtomicAdd(&next_id, 1);
+
+	return task_id;
+}
+
+int * uffs_OSGetErrnoSlot(void)
+{
+	static __thread int err_slot = 0;
+
+	return &err_slot;
 }
 
 unsigned int uffs_GetCurDateTime(void)
@@ -107,6 +220,15 @@ unsigned int uffs_GetCurDateTime(void)
 	return (unsigned int)tvalue;
 }
 
+unsigned int uffs_GetCurTimeUs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned int)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
 #if CONFIG_USE_SYSTEM_MEMORY_ALLOCATOR > 0
 static void * sys_malloc(struct uffs_DeviceSt *dev, unsigned int size)
 {
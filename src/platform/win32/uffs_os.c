@@ -91,11 +91,104 @@ int uffs_SemDelete(OSSEM *sem)
 		return -1;
 }
 
-int uffs_OSGetTaskId(void)
+int uffs_RwLockCreate(OSRWLOCK *lock)
+{
+	PSRWLOCK rwlock = (PSRWLOCK) malloc(sizeof(SRWLOCK));
+
+	if (rwlock == NULL) {
+		printf("Create rwlock failed !\n");
+		return -1;
+	}
+
+	InitializeSRWLock(rwlock);
+	*lock = (OSRWLOCK)rwlock;
+
+	return 0;
+}
+
+int uffs_RwLockRead(OSRWLOCK lock)
+{
+	AcquireSRWLockShared((PSRWLOCK)lock);
+	return 0;
+}
+
+int uffs_RwLockWrite(OSRWLOCK lock)
+{
+	AcquireSRWLockExclusive((PSRWLOCK)lock);
+	return 0;
+}
+
+int uffs_RwUnlockRead(OSRWLOCK lock)
+{
+	ReleaseSRWLockShared((PSRWLOCK)lock);
+	return 0;
+}
+
+int uffs_RwUnlockWrite(OSRWLOCK lock)
 {
+	ReleaseSRWLockExclusive((PSRWLOCK)lock);
 	return 0;
 }
 
+int uffs_RwLockDelete(OSRWLOCK *lock)
+{
+	if (*lock) {
+		free(*lock);
+		*lock = 0;
+		return 0;
+	}
+	else
+		return -1;
+}
+
+int uffs_AtomicGet(volatile int *p)
+{
+	return (int)InterlockedCompareExchange((volatile LONG *)p, 0, 0);
+}
+
+void uffs_AtomicSet(volatile int *p, int val)
+{
+	InterlockedExchange((volatile LONG *)p, (LONG)val);
+}
+
+int uffs_AtomicAdd(volatile int *p, int n)
+{
+	return (int)InterlockedExchangeAdd((volatile LONG *)p, (LONG)n) + n;
+}
+
+int uffs_AtomicCas(volatile int *p, int expected, int desired)
+{
+	return InterlockedCompareExchange((volatile LONG *)p,
+						(LONG)desired, (LONG)expected) == (LONG)expected;
+}
+
+unsigned short uffs_AtomicGet16(volatile unsigned short *p)
+{
+	return *p;	// aligned 16 bits read is atomic
+}
+
+unsigned short uffs_AtomicInc16(volatile unsigned short *p)
+{
+	return (unsigned short)InterlockedIncrement16((volatile SHORT *)p);
+}
+
+unsigned short uffs_AtomicDec16(volatile unsigned short *p)
+{
+	return (unsigned short)InterlockedDecrement16((volatile SHORT *)p);
+}
+
+int uffs_OSGetTaskId(void)
+{
+	return (int)GetCurrentThreadId();
+}
+
+int * uffs_OSGetErrnoSlot(void)
+{
+	static __declspec(thread) int err_slot = 0;
+
+	return &err_slot;
+}
+
 unsigned int uffs_GetCurDateTime(void)
 {
 	// FIXME: return system time, please modify this for your platform ! 
@@ -107,6 +200,17 @@ unsigned int uffs_GetCurDateTime(void)
 	return (unsigned int)tvalue;
 }
 
+unsigned int uffs_GetCurTimeUs(void)
+{
+	LARGE_INTEGER freq, cnt;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+
+	return (unsigned int)((cnt.QuadPart / freq.QuadPart) * 1000000 +
+						  (cnt.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+}
+
 #if CONFIG_USE_SYSTEM_MEMORY_ALLOCATOR > 0
 static void * sys_malloc(struct uffs_DeviceSt *dev, unsigned int size)
 {
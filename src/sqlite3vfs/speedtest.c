@@ -0,0 +1,637 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file speedtest.c
+ * \brief sqlite3 speed test on UFFS file emulator through UFFS VFS,
+ *        reports results as JSON.
+ * \author Ricky Zheng
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+#include "uffs_config.h"
+#include "uffs/uffs_os.h"
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_fs.h"
+#include "uffs/uffs_fd.h"
+#include "uffs/uffs_utils.h"
+#include "uffs/uffs_mtb.h"
+
+#include "uffs_fileem.h"
+#include "uffs_sqlite3vfs.h"
+
+#define PFX "sqlt: "
+#define MSG(msg,...) uffs_PerrorRaw(UFFS_MSG_SERIOUS, msg, ## __VA_ARGS__)
+#define MSGLN(msg,...) uffs_Perror(UFFS_MSG_SERIOUS, msg, ## __VA_ARGS__)
+
+#if CONFIG_USE_STATIC_MEMORY_ALLOCATOR > 0
+int main()
+{
+	MSGLN("Static memory allocator is not supported.");
+	return 0;
+}
+#else
+
+#define DEFAULT_EMU_FILENAME	"uffs_sqlite3.bin"
+#define DEFAULT_JSON_FILENAME	"uffs_sqlite3.json"
+#define DB_FILENAME				"/speedtest.db"
+#define ATOMIC_FILENAME			"/atomic.bin"
+
+/* default geometry of the NAND device */
+#define PAGES_PER_BLOCK_DEFAULT			32
+#define PAGE_DATA_SIZE_DEFAULT			512
+#define PAGE_SPARE_SIZE_DEFAULT			16
+#define STATUS_BYTE_OFFSET_DEFAULT		5
+#define TOTAL_BLOCKS_DEFAULT			1024
+#define ECC_OPTION_DEFAULT				UFFS_ECC_SOFT
+
+#define ROWS_DEFAULT			1000
+#define ATOMIC_COMMITS			200
+
+static const char *conf_emu_filename = DEFAULT_EMU_FILENAME;
+static const char *conf_json_filename = DEFAULT_JSON_FILENAME;
+static int conf_pages_per_block = PAGES_PER_BLOCK_DEFAULT;
+static int conf_page_data_size = PAGE_DATA_SIZE_DEFAULT;
+static int conf_page_spare_size = PAGE_SPARE_SIZE_DEFAULT;
+static int conf_total_blocks = TOTAL_BLOCKS_DEFAULT;
+static int conf_rows = ROWS_DEFAULT;
+static int conf_db_page_size = 0;
+static const char *conf_journal_mode = "delete";
+static int conf_vfs_flags = 0;
+
+static struct uffs_MountTableEntrySt m_mount = {
+	NULL,
+	0,
+	-1,
+	"/",
+	NULL,
+	NULL,
+};
+static uffs_Device m_dev = {0};
+
+static FILE *m_json = NULL;
+static int m_result_count = 0;
+static sqlite3 *m_db = NULL;
+static u32 m_seed = 1;
+
+/** one test measurement */
+struct test_st {
+	const char *name;
+	u32 ops;				//!< operations done
+	u32 t_start;			//!< test start time
+	u32 elapsed;			//!< test elapsed time (us)
+	uffs_FlashStat st0;		//!< flash statistic at start
+	struct uffs_wstat ws0;	//!< write statistic at start
+};
+
+static u32 test_rand(void)
+{
+	m_seed = m_seed * 1103515245 + 12345;
+	return (m_seed >> 16) & 0x7FFF;
+}
+
+static void test_begin(struct test_st *t, const char *name)
+{
+	memset(t, 0, sizeof(struct test_st));
+	t->name = name;
+	memcpy(&t->st0, &m_dev.st, sizeof(uffs_FlashStat));
+	uffs_wstat("/", &t->ws0);
+	uffs_sqlite3vfs_get_stat(NULL, 1);
+	t->t_start = uffs_GetCurTimeUs();
+}
+
+/** write result of test <t> to JSON file and console */
+static void test_end(struct test_st *t)
+{
+	struct uffs_sqlite3vfs_stat vs;
+	struct uffs_wstat ws;
+	uffs_FlashStat *s = &m_dev.st;
+	int page_write, block_erase;
+	unsigned long bytes;
+	double sec, wa;
+
+	t->elapsed = uffs_GetCurTimeUs() - t->t_start;
+	uffs_sqlite3vfs_get_stat(&vs, 0);
+	uffs_wstat("/", &ws);
+
+	page_write = s->page_write_count - t->st0.page_write_count;
+	block_erase = s->block_erase_count - t->st0.block_erase_count;
+	bytes = ws.ws_bytes - t->ws0.ws_bytes;
+
+	sec = (t->elapsed > 0 ? t->elapsed / 1000000.0 : 1e-6);
+	wa = (bytes > 0 ? (double)page_write * m_dev.attr->page_data_size / bytes : 0);
+
+	fprintf(m_json, "%s\n    {\n", m_result_count++ > 0 ? "," : "");
+	fprintf(m_json, "      \"name\": \"%s\",\n", t->name);
+	fprintf(m_json, "      \"ops\": %u,\n", t->ops);
+	fprintf(m_json, "      \"elapsed_us\": %u,\n", t->elapsed);
+	fprintf(m_json, "      \"ops_per_sec\": %.1f,\n", t->ops / sec);
+	fprintf(m_json, "      \"syncs\": %lu,\n", vs.syncs);
+	fprintf(m_json, "      \"atomic_commits\": %lu,\n", vs.atomic_commits);
+	fprintf(m_json, "      \"atomic_fallbacks\": %lu,\n", vs.atomic_fallbacks);
+	fprintf(m_json, "      \"flash\": { \"bytes_written\": %lu, \"page_write\": %d, "
+			"\"block_erase\": %d, \"write_amp\": %.2f }\n",
+			bytes, page_write, block_erase, wa);
+	fprintf(m_json, "    }");
+
+	MSG("%-20s ops %7u  %9.1f ops/s  syncs %6lu  pages %7d  erases %5d  WA %6.2f" TENDSTR,
+			t->name, t->ops, t->ops / sec, vs.syncs, page_write, block_erase, wa);
+}
+
+static int exec_sql(const char *sql)
+{
+	char *err = NULL;
+
+	if (sqlite3_exec(m_db, sql, NULL, NULL, &err) != SQLITE_OK) {
+		MSGLN("SQL \"%s\" failed: %s", sql, err ? err : "?");
+		sqlite3_free(err);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** execute prepared statement 'stmt' with (a, b, c), reset it for next call */
+static int step_stmt(sqlite3_stmt *stmt, int a, int b, const char *c)
+{
+	int rc;
+
+	if (a >= 0)
+		sqlite3_bind_int(stmt, 1, a);
+	if (b >= 0)
+		sqlite3_bind_int(stmt, 2, b);
+	if (c)
+		sqlite3_bind_text(stmt, 3, c, -1, SQLITE_STATIC);
+
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		;
+	sqlite3_reset(stmt);
+
+	if (rc != SQLITE_DONE) {
+		MSGLN("Step failed: %s", sqlite3_errmsg(m_db));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void make_text(char *buf, int n)
+{
+	sprintf(buf, "row %d text %08x padding to make it longer", n, n * 2654435761u);
+}
+
+/** insert rows, all in one transaction or each in its own transaction */
+static int test_insert(const char *name, const char *table, int rows, UBOOL one_txn)
+{
+	struct test_st t;
+	sqlite3_stmt *stmt = NULL;
+	char sql[128];
+	char text[64];
+	int i, ret = -1;
+
+	sprintf(sql, "CREATE TABLE %s(a INTEGER PRIMARY KEY, b INTEGER, c TEXT)", table);
+	if (exec_sql(sql) < 0)
+		return -1;
+
+	sprintf(sql, "INSERT INTO %s VALUES(?1, ?2, ?3)", table);
+	if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, NULL) != SQLITE_OK)
+		return -1;
+
+	test_begin(&t, name);
+	if (one_txn && exec_sql("BEGIN") < 0)
+		goto ext;
+	for (i = 0; i < rows; i++) {
+		make_text(text, i);
+		if (step_stmt(stmt, i + 1, test_rand(), text) < 0)
+			goto ext;
+		t.ops++;
+	}
+	if (one_txn && exec_sql("COMMIT") < 0)
+		goto ext;
+	test_end(&t);
+	ret = 0;
+
+ext:
+	sqlite3_finalize(stmt);
+	return ret;
+}
+
+/** update random rows, each in its own transaction */
+static int test_update(const char *name, const char *table, int rows, int n)
+{
+	struct test_st t;
+	sqlite3_stmt *stmt = NULL;
+	char sql[128];
+	int i, ret = -1;
+
+	sprintf(sql, "UPDATE %s SET b = ?2 WHERE a = ?1", table);
+	if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, NULL) != SQLITE_OK)
+		return -1;
+
+	test_begin(&t, name);
+	for (i = 0; i < n; i++) {
+		if (step_stmt(stmt, test_rand() % rows + 1, test_rand(), NULL) < 0)
+			goto ext;
+		t.ops++;
+	}
+	test_end(&t);
+	ret = 0;
+
+ext:
+	sqlite3_finalize(stmt);
+	return ret;
+}
+
+/** select random rows by primary key */
+static int test_select(const char *name, const char *table, int rows, int n)
+{
+	struct test_st t;
+	sqlite3_stmt *stmt = NULL;
+	char sql[128];
+	int i, ret = -1;
+
+	sprintf(sql, "SELECT b, c FROM %s WHERE a = ?1", table);
+	if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, NULL) != SQLITE_OK)
+		return -1;
+
+	test_begin(&t, name);
+	for (i = 0; i < n; i++) {
+		if (step_stmt(stmt, test_rand() % rows + 1, -1, NULL) < 0)
+			goto ext;
+		t.ops++;
+	}
+	test_end(&t);
+	ret = 0;
+
+ext:
+	sqlite3_finalize(stmt);
+	return ret;
+}
+
+/** full table scans */
+static int test_scan(const char *name, const char *table, int n)
+{
+	struct test_st t;
+	char sql[128];
+	int i;
+
+	sprintf(sql, "SELECT count(*) FROM %s WHERE c LIKE '%%1%%'", table);
+
+	test_begin(&t, name);
+	for (i = 0; i < n; i++) {
+		if (exec_sql(sql) < 0)
+			return -1;
+		t.ops++;
+	}
+	test_end(&t);
+
+	return 0;
+}
+
+/** delete half of rows in one transaction */
+static int test_delete(const char *name, const char *table)
+{
+	struct test_st t;
+	char sql[128];
+
+	sprintf(sql, "DELETE FROM %s WHERE (a %% 2) = 0", table);
+
+	test_begin(&t, name);
+	if (exec_sql(sql) < 0)
+		return -1;
+	t.ops = sqlite3_changes(m_db);
+	test_end(&t);
+
+	return 0;
+}
+
+/**
+ * commit small transactions by VFS batch atomic write directly,
+ * as sqlite3 does when built with SQLITE_ENABLE_BATCH_ATOMIC_WRITE.
+ */
+static int test_atomic(const char *name)
+{
+	struct test_st t;
+	sqlite3_vfs *vfs;
+	sqlite3_file *file;
+	int sector, i, k, flags, ret = -1;
+	char *buf, *chk;
+	sqlite3_int64 ofs;
+
+	vfs = sqlite3_vfs_find(UFFS_SQLITE3VFS_NAME);
+	file = (sqlite3_file *)sqlite3_malloc(vfs->szOsFile);
+	if (file == NULL)
+		return -1;
+
+	flags = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	if (vfs->xOpen(vfs, ATOMIC_FILENAME, file, flags, NULL) != SQLITE_OK) {
+		sqlite3_free(file);
+		return -1;
+	}
+
+	sector = file->pMethods->xSectorSize(file);
+	buf = (char *)sqlite3_malloc(sector * 2);
+	chk = buf + sector;
+
+	// a small "database" in the first block, 4 sectors
+	memset(buf, 0, sector);
+	for (i = 0; i < 4; i++) {
+		if (file->pMethods->xWrite(file, buf, sector, (sqlite3_int64)i * sector) != SQLITE_OK)
+			goto ext;
+	}
+	file->pMethods->xSync(file, SQLITE_SYNC_NORMAL);
+
+	test_begin(&t, name);
+	for (i = 0; i < ATOMIC_COMMITS; i++) {
+		// each transaction updates two sectors
+		if (file->pMethods->xFileControl(file, SQLITE_FCNTL_BEGIN_ATOMIC_WRITE, NULL) != SQLITE_OK) {
+			MSGLN("Batch atomic write is not enabled");
+			goto ext;
+		}
+		for (k = 0; k < 2; k++) {
+			memset(buf, i & 0xFF, sector);
+			ofs = (sqlite3_int64)((i + k) % 4) * sector;
+			file->pMethods->xWrite(file, buf, sector, ofs);
+		}
+		if (file->pMethods->xFileControl(file, SQLITE_FCNTL_COMMIT_ATOMIC_WRITE, NULL) != SQLITE_OK) {
+			MSGLN("Atomic commit %d failed", i);
+			goto ext;
+		}
+		if (file->pMethods->xRead(file, chk, sector, ofs) != SQLITE_OK ||
+				memcmp(buf, chk, sector) != 0) {
+			MSGLN("Data mismatch after atomic commit %d", i);
+			goto ext;
+		}
+		t.ops++;
+	}
+	test_end(&t);
+	ret = 0;
+
+ext:
+	file->pMethods->xClose(file);
+	vfs->xDelete(vfs, ATOMIC_FILENAME, 0);
+	sqlite3_free(buf);
+	sqlite3_free(file);
+	return ret;
+}
+
+static int open_db(void)
+{
+	char sql[64];
+
+	if (sqlite3_open_v2(DB_FILENAME, &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+			UFFS_SQLITE3VFS_NAME) != SQLITE_OK) {
+		MSGLN("Can't open %s: %s", DB_FILENAME, sqlite3_errmsg(m_db));
+		return -1;
+	}
+
+	if (conf_db_page_size > 0) {
+		sprintf(sql, "PRAGMA page_size = %d", conf_db_page_size);
+		if (exec_sql(sql) < 0)
+			return -1;
+	}
+
+	sprintf(sql, "PRAGMA journal_mode = %s", conf_journal_mode);
+	return exec_sql(sql);
+}
+
+static void setup_storage(struct uffs_StorageAttrSt *attr)
+{
+	attr->total_blocks = conf_total_blocks;
+	attr->page_data_size = conf_page_data_size;
+	attr->spare_size = conf_page_spare_size;
+	attr->pages_per_block = conf_pages_per_block;
+	attr->block_status_offs = STATUS_BYTE_OFFSET_DEFAULT;
+	attr->ecc_opt = ECC_OPTION_DEFAULT;
+	attr->ecc_size = 0;
+	attr->layout_opt = UFFS_LAYOUT_UFFS;
+}
+
+static int init_uffs_fs(void)
+{
+	uffs_FileEmu *emu = femu_GetPrivate();
+
+	memset(emu, 0, sizeof(uffs_FileEmu));
+	emu->emu_filename = conf_emu_filename;
+	remove(conf_emu_filename);	// always start from a blank flash
+#ifdef UFFS_FEMU_ENABLE_INJECTION
+	emu->wrap_inited = U_TRUE;	// no fault injection, keep results comparable
+#endif
+
+	setup_storage(femu_GetStorage());
+
+	m_mount.dev = &m_dev;
+#if CONFIG_USE_SYSTEM_MEMORY_ALLOCATOR > 0
+	uffs_MemSetupSystemAllocator(&m_dev.mem);
+#endif
+	m_dev.Init = femu_InitDevice;
+	m_dev.Release = femu_ReleaseDevice;
+	m_dev.attr = femu_GetStorage();
+
+	uffs_RegisterMountTable(&m_mount);
+	if (uffs_Mount("/") < 0)
+		return -1;
+
+	return uffs_InitFileSystemObjects() == U_SUCC ? 0 : -1;
+}
+
+static void release_uffs_fs(void)
+{
+	uffs_UnMount("/");
+	uffs_ReleaseFileSystemObjects();
+}
+
+static int parse_options(int argc, char *argv[])
+{
+	int iarg;
+	int usage = 0;
+
+	for (iarg = 1; iarg < argc && !usage; iarg++) {
+		const char *arg = argv[iarg];
+
+		if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+			usage++;
+		}
+		else if (!strcmp(arg, "-f") || !strcmp(arg, "--file")) {
+			if (++iarg >= argc)
+				usage++;
+			else
+				conf_emu_filename = argv[iarg];
+		}
+		else if (!strcmp(arg, "-o") || !strcmp(arg, "--output")) {
+			if (++iarg >= argc)
+				usage++;
+			else
+				conf_json_filename = argv[iarg];
+		}
+		else if (!strcmp(arg, "-p") || !strcmp(arg, "--page-size")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_page_data_size) < 1)
+				usage++;
+			else if (conf_page_data_size <= 0 || conf_page_data_size > UFFS_MAX_PAGE_SIZE)
+				usage++;
+		}
+		else if (!strcmp(arg, "-s") || !strcmp(arg, "--spare-size")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_page_spare_size) < 1)
+				usage++;
+			else if (conf_page_spare_size < sizeof(struct uffs_TagStoreSt) + 1 ||
+				(conf_page_spare_size % 4) != 0 || conf_page_spare_size > UFFS_MAX_SPARE_SIZE)
+				usage++;
+		}
+		else if (!strcmp(arg, "-b") || !strcmp(arg, "--block-pages")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_pages_per_block) < 1)
+				usage++;
+			else if (conf_pages_per_block < 2 || conf_pages_per_block > UFFS_MAX_PAGES_PER_BLOCK)
+				usage++;
+		}
+		else if (!strcmp(arg, "-t") || !strcmp(arg, "--total-blocks")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_total_blocks) < 1)
+				usage++;
+			else if (conf_total_blocks < 2 || conf_total_blocks > UFFS_FEMU_MAX_BLOCKS)
+				usage++;
+		}
+		else if (!strcmp(arg, "-n") || !strcmp(arg, "--rows")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_rows) < 1)
+				usage++;
+			else if (conf_rows < 10)
+				usage++;
+		}
+		else if (!strcmp(arg, "-P") || !strcmp(arg, "--db-page-size")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_db_page_size) < 1)
+				usage++;
+		}
+		else if (!strcmp(arg, "-j") || !strcmp(arg, "--journal")) {
+			if (++iarg >= argc)
+				usage++;
+			else
+				conf_journal_mode = argv[iarg];
+		}
+		else if (!strcmp(arg, "-a") || !strcmp(arg, "--batch-atomic")) {
+			conf_vfs_flags |= UFFS_SQLITE3VFS_BATCH_ATOMIC;
+		}
+		else {
+			MSGLN("Unknown option: %s, try %s --help", arg, argv[0]);
+			return -1;
+		}
+	}
+
+	if (usage) {
+		MSGLN("Usage: %s [options]", argv[0]);
+		MSGLN("  -h  --help                                show usage");
+		MSGLN("  -f  --file           <file>               uffs image file, default=%s", DEFAULT_EMU_FILENAME);
+		MSGLN("  -o  --output         <file>               JSON result file, default=%s", DEFAULT_JSON_FILENAME);
+		MSGLN("  -p  --page-size      <n>                  page data size, default=%d", PAGE_DATA_SIZE_DEFAULT);
+		MSGLN("  -s  --spare-size     <n>                  page spare size, default=%d", PAGE_SPARE_SIZE_DEFAULT);
+		MSGLN("  -b  --block-pages    <n>                  pages per block, default=%d", PAGES_PER_BLOCK_DEFAULT);
+		MSGLN("  -t  --total-blocks   <n>                  total blocks, default=%d", TOTAL_BLOCKS_DEFAULT);
+		MSGLN("  -n  --rows           <n>                  rows to insert, default=%d", ROWS_DEFAULT);
+		MSGLN("  -P  --db-page-size   <n>                  sqlite3 page size, default: sqlite3 default");
+		MSGLN("  -j  --journal        <mode>               sqlite3 journal mode, default=delete");
+		MSGLN("  -a  --batch-atomic                        enable VFS batch atomic write");
+		MSGLN("");
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	int rows;
+
+	uffs_SetupDebugOutput();
+	uffs_DebugSetMessageLevel(UFFS_MSG_SERIOUS);
+
+	if (parse_options(argc, argv) < 0)
+		return -1;
+
+	if (init_uffs_fs() < 0) {
+		MSGLN("Init file system fail.");
+		return -1;
+	}
+
+	if (uffs_sqlite3vfs_register(conf_vfs_flags, 0) != SQLITE_OK || open_db() < 0) {
+		release_uffs_fs();
+		return -1;
+	}
+
+	m_json = fopen(conf_json_filename, "w");
+	if (m_json == NULL) {
+		MSGLN("Can't create %s", conf_json_filename);
+		sqlite3_close(m_db);
+		release_uffs_fs();
+		return -1;
+	}
+
+	if ((conf_vfs_flags & UFFS_SQLITE3VFS_BATCH_ATOMIC) &&
+			!sqlite3_compileoption_used("ENABLE_BATCH_ATOMIC_WRITE"))
+		MSGLN("sqlite3 %s is built without SQLITE_ENABLE_BATCH_ATOMIC_WRITE, "
+				"batch atomic write is only used by 'atomic' test", sqlite3_libversion());
+
+	fprintf(m_json, "{\n");
+	fprintf(m_json, "  \"version\": \"%x\",\n", uffs_version());
+	fprintf(m_json, "  \"sqlite\": \"%s\",\n", sqlite3_libversion());
+	fprintf(m_json, "  \"geometry\": { \"page_size\": %d, \"spare_size\": %d, \"pages_per_block\": %d, \"total_blocks\": %d },\n",
+			conf_page_data_size, conf_page_spare_size, conf_pages_per_block, conf_total_blocks);
+	fprintf(m_json, "  \"config\": { \"rows\": %d, \"db_page_size\": %d, \"journal_mode\": \"%s\", "
+			"\"batch_atomic\": %s },\n",
+			conf_rows, conf_db_page_size, conf_journal_mode,
+			(conf_vfs_flags & UFFS_SQLITE3VFS_BATCH_ATOMIC) ? "true" : "false");
+	fprintf(m_json, "  \"results\": [");
+
+	rows = conf_rows;
+	if (ret == 0) ret = test_insert("insert_one_txn", "t1", rows, U_TRUE);
+	if (ret == 0) ret = test_insert("insert_autocommit", "t2", rows / 10, U_FALSE);
+	if (ret == 0) ret = test_select("select_by_key", "t1", rows, rows);
+	if (ret == 0) ret = test_update("update_autocommit", "t1", rows, rows / 10);
+	if (ret == 0) ret = test_scan("select_scan", "t1", 10);
+	if (ret == 0) ret = test_delete("delete_one_txn", "t1");
+	if (ret == 0 && (conf_vfs_flags & UFFS_SQLITE3VFS_BATCH_ATOMIC))
+		ret = test_atomic("atomic");
+
+	fprintf(m_json, "\n  ],\n");
+	fprintf(m_json, "  \"status\": \"%s\"\n}\n", ret == 0 ? "succ" : "failed");
+	fclose(m_json);
+
+	if (ret != 0)
+		MSGLN("Speed test failed, results are incomplete.");
+
+	sqlite3_close(m_db);
+	uffs_sqlite3vfs_unregister();
+	release_uffs_fs();
+
+	return ret == 0 ? 0 : -1;
+}
+#endif
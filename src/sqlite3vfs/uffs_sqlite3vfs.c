@@ -0,0 +1,580 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_sqlite3vfs.c
+ * \brief sqlite3 VFS on top of UFFS POSIX APIs (uffs_fd.h)
+ *
+ * - xSectorSize() is the page data size of the device
+ * - reads/writes are positional (uffs_pread()/uffs_pwrite())
+ * - SQLITE_FCNTL_SIZE_HINT reserves erased blocks by uffs_fallocate()
+ * - optional batch atomic write, see UFFS_SQLITE3VFS_BATCH_ATOMIC
+ *
+ * Locks are no-op (like sqlite3 "unix-none" VFS): a database file should
+ * only be opened by one connection at a time.
+ *
+ * \author Ricky Zheng
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sqlite3.h>
+
+#include "uffs/uffs_types.h"
+#include "uffs/uffs_fd.h"
+#include "uffs_sqlite3vfs.h"
+
+/* for sqlite3 older than 3.21 */
+#ifndef SQLITE_IOCAP_BATCH_ATOMIC
+#define SQLITE_IOCAP_BATCH_ATOMIC			0x00004000
+#endif
+#ifndef SQLITE_FCNTL_BEGIN_ATOMIC_WRITE
+#define SQLITE_FCNTL_BEGIN_ATOMIC_WRITE		31
+#define SQLITE_FCNTL_COMMIT_ATOMIC_WRITE	32
+#define SQLITE_FCNTL_ROLLBACK_ATOMIC_WRITE	33
+#endif
+#ifndef SQLITE_IOERR_COMMIT_ATOMIC
+#define SQLITE_IOERR_COMMIT_ATOMIC			(SQLITE_IOERR | (30<<8))
+#endif
+
+#define VFS_MAX_PATHNAME	256
+#define TEMP_FILE_PREFIX	"/etilqs_"
+
+/** a write held in batch atomic mode */
+struct vfs_write {
+	sqlite3_int64 ofs;
+	int len;
+	void *data;
+};
+
+/** opened file */
+struct vfs_file {
+	sqlite3_file base;				//!< must be the first
+	int fd;							//!< UFFS fd
+	int sector_size;				//!< page data size of the device
+	int devchar;					//!< device characteristics
+	char *delete_name;				//!< delete on close
+	int batch;						//!< in batch atomic write ?
+	struct vfs_write *writes;		//!< writes held in batch atomic mode
+	int nwrites;
+	int max_writes;
+};
+
+static int m_flags = 0;
+static struct uffs_sqlite3vfs_stat m_stat = {0};
+static unsigned int m_temp_seq = 0;
+
+static int map_error(int ioerr)
+{
+	switch (-uffs_get_error()) {
+	case UENOSPC:
+		return SQLITE_FULL;
+	case UENOMEM:
+		return SQLITE_IOERR_NOMEM;
+	default:
+		return ioerr;
+	}
+}
+
+static void batch_drop(struct vfs_file *p)
+{
+	int i;
+
+	for (i = 0; i < p->nwrites; i++)
+		sqlite3_free(p->writes[i].data);
+	p->nwrites = 0;
+	p->batch = 0;
+}
+
+/* add a write to batch, return SQLITE_OK or SQLITE_NOMEM */
+static int batch_add(struct vfs_file *p, const void *data, int len, sqlite3_int64 ofs)
+{
+	struct vfs_write *w;
+
+	if (p->nwrites == p->max_writes) {
+		w = sqlite3_realloc(p->writes, (p->max_writes * 2 + 8) * sizeof(struct vfs_write));
+		if (w == NULL)
+			return SQLITE_NOMEM;
+		p->writes = w;
+		p->max_writes = p->max_writes * 2 + 8;
+	}
+
+	w = &p->writes[p->nwrites];
+	w->data = sqlite3_malloc(len);
+	if (w->data == NULL)
+		return SQLITE_NOMEM;
+	memcpy(w->data, data, len);
+	w->ofs = ofs;
+	w->len = len;
+	p->nwrites++;
+
+	return SQLITE_OK;
+}
+
+/* write all batched writes by one uffs_pwrite_atomic() */
+static int batch_commit(struct vfs_file *p)
+{
+	struct uffs_iovec *iov;
+	long *ofs;
+	int i, rc = SQLITE_OK;
+
+	if (p->nwrites == 0)
+		goto ext;
+
+	iov = sqlite3_malloc(p->nwrites * (sizeof(struct uffs_iovec) + sizeof(long)));
+	if (iov == NULL) {
+		rc = SQLITE_IOERR_NOMEM;
+		goto ext;
+	}
+	ofs = (long *)(iov + p->nwrites);
+
+	for (i = 0; i < p->nwrites; i++) {
+		iov[i].iov_base = p->writes[i].data;
+		iov[i].iov_len = p->writes[i].len;
+		ofs[i] = (long)p->writes[i].ofs;
+	}
+
+	if (uffs_pwrite_atomic(p->fd, iov, ofs, p->nwrites) == 0) {
+		m_stat.atomic_commits++;
+	}
+	else {
+		// sqlite3 rolls back and writes the transaction again with journal
+		m_stat.atomic_fallbacks++;
+		rc = (-uffs_get_error() == UEINVAL ? SQLITE_IOERR_COMMIT_ATOMIC : map_error(SQLITE_IOERR_WRITE));
+	}
+
+	sqlite3_free(iov);
+ext:
+	batch_drop(p);
+	return rc;
+}
+
+static int vfsClose(sqlite3_file *file)
+{
+	struct vfs_file *p = (struct vfs_file *)file;
+	int rc = SQLITE_OK;
+
+	batch_drop(p);
+	sqlite3_free(p->writes);
+	p->writes = NULL;
+
+	if (uffs_close(p->fd) < 0)
+		rc = SQLITE_IOERR_CLOSE;
+
+	if (p->delete_name) {
+		uffs_remove(p->delete_name);
+		sqlite3_free(p->delete_name);
+		p->delete_name = NULL;
+	}
+
+	return rc;
+}
+
+static int vfsRead(sqlite3_file *file, void *buf, int amt, sqlite3_int64 ofst)
+{
+	struct vfs_file *p = (struct vfs_file *)file;
+	struct vfs_write *w;
+	int i, got;
+	sqlite3_int64 a, b;
+
+	got = uffs_pread(p->fd, buf, amt, (long)ofst);
+	if (got < 0)
+		return map_error(SQLITE_IOERR_READ);
+
+	if (got < amt)
+		memset((char *)buf + got, 0, amt - got);
+
+	// writes held by batch are newer
+	for (i = 0; i < p->nwrites; i++) {
+		w = &p->writes[i];
+		a = (w->ofs > ofst ? w->ofs : ofst);
+		b = (w->ofs + w->len < ofst + amt ? w->ofs + w->len : ofst + amt);
+		if (a < b) {
+			memcpy((char *)buf + (a - ofst), (char *)w->data + (a - w->ofs), (size_t)(b - a));
+			if (b - ofst > got)
+				got = (int)(b - ofst);
+		}
+	}
+
+	return (got < amt ? SQLITE_IOERR_SHORT_READ : SQLITE_OK);
+}
+
+static int vfsWrite(sqlite3_file *file, const void *buf, int amt, sqlite3_int64 ofst)
+{
+	struct vfs_file *p = (struct vfs_file *)file;
+
+	if (p->batch)
+		return batch_add(p, buf, amt, ofst) == SQLITE_OK ? SQLITE_OK : SQLITE_IOERR_NOMEM;
+
+	if (uffs_pwrite(p->fd, buf, amt, (long)ofst) != amt)
+		return map_error(SQLITE_IOERR_WRITE);
+
+	return SQLITE_OK;
+}
+
+static int vfsTruncate(sqlite3_file *file, sqlite3_int64 size)
+{
+	struct vfs_file *p = (struct vfs_file *)file;
+
+	if (p->batch)
+		return SQLITE_IOERR_TRUNCATE;
+
+	if (uffs_ftruncate(p->fd, (long)size) < 0)
+		return map_error(SQLITE_IOERR_TRUNCATE);
+
+	return SQLITE_OK;
+}
+
+static int vfsSync(sqlite3_file *file, int flags)
+{
+	struct vfs_file *p = (struct vfs_file *)file;
+
+	m_stat.syncs++;
+	if (uffs_flush(p->fd) < 0)
+		return map_error(SQLITE_IOERR_FSYNC);
+
+	return SQLITE_OK;
+}
+
+static int vfsFileSize(sqlite3_file *file, sqlite3_int64 *size)
+{
+	struct vfs_file *p = (struct vfs_file *)file;
+	struct uffs_stat st;
+	int i;
+
+	if (uffs_fstat(p->fd, &st) < 0)
+		return SQLITE_IOERR_FSTAT;
+
+	*size = st.st_size;
+	for (i = 0; i < p->nwrites; i++) {
+		if (p->writes[i].ofs + p->writes[i].len > *size)
+			*size = p->writes[i].ofs + p->writes[i].len;
+	}
+
+	return SQLITE_OK;
+}
+
+static int vfsLock(sqlite3_file *file, int lock)
+{
+	return SQLITE_OK;
+}
+
+static int vfsUnlock(sqlite3_file *file, int lock)
+{
+	return SQLITE_OK;
+}
+
+static int vfsCheckReservedLock(sqlite3_file *file, int *out)
+{
+	*out = 0;
+	return SQLITE_OK;
+}
+
+static int vfsFileControl(sqlite3_file *file, int op, void *arg)
+{
+	struct vfs_file *p = (struct vfs_file *)file;
+
+	switch (op) {
+	case SQLITE_FCNTL_SIZE_HINT:
+		// reserve erased blocks, so that the writes won't fail in the middle.
+		if (uffs_fallocate(p->fd, (long)(*(sqlite3_int64 *)arg)) < 0)
+			return map_error(SQLITE_IOERR_TRUNCATE);
+		return SQLITE_OK;
+	case SQLITE_FCNTL_BEGIN_ATOMIC_WRITE:
+		if (!(p->devchar & SQLITE_IOCAP_BATCH_ATOMIC))
+			return SQLITE_NOTFOUND;
+		batch_drop(p);
+		p->batch = 1;
+		return SQLITE_OK;
+	case SQLITE_FCNTL_COMMIT_ATOMIC_WRITE:
+		if (!p->batch)
+			return SQLITE_NOTFOUND;
+		return batch_commit(p);
+	case SQLITE_FCNTL_ROLLBACK_ATOMIC_WRITE:
+		batch_drop(p);
+		return SQLITE_OK;
+	default:
+		return SQLITE_NOTFOUND;
+	}
+}
+
+static int vfsSectorSize(sqlite3_file *file)
+{
+	return ((struct vfs_file *)file)->sector_size;
+}
+
+static int vfsDeviceCharacteristics(sqlite3_file *file)
+{
+	return ((struct vfs_file *)file)->devchar;
+}
+
+static const sqlite3_io_methods m_io_methods = {
+	1,								/* iVersion */
+	vfsClose,
+	vfsRead,
+	vfsWrite,
+	vfsTruncate,
+	vfsSync,
+	vfsFileSize,
+	vfsLock,
+	vfsUnlock,
+	vfsCheckReservedLock,
+	vfsFileControl,
+	vfsSectorSize,
+	vfsDeviceCharacteristics,
+};
+
+/**
+ * device characteristics of UFFS:
+ *	- data is never overwritten in place, a page is programmed with
+ *	  its tag at once: page sized writes are atomic, power loss don't
+ *	  damage data out of the written range, appending is safe.
+ *	- opened file can't be deleted.
+ *	- writes are buffered and dirty groups are flushed in any order,
+ *	  so writes are NOT sequential.
+ */
+static int get_devchar(int page_size, int flags)
+{
+	int devchar = SQLITE_IOCAP_SAFE_APPEND | SQLITE_IOCAP_UNDELETABLE_WHEN_OPEN;
+	int atomic;
+
+#ifdef SQLITE_IOCAP_POWERSAFE_OVERWRITE
+	devchar |= SQLITE_IOCAP_POWERSAFE_OVERWRITE;
+#endif
+
+	// SQLITE_IOCAP_ATOMIC512 ... SQLITE_IOCAP_ATOMIC64K
+	for (atomic = SQLITE_IOCAP_ATOMIC512; atomic <= SQLITE_IOCAP_ATOMIC64K; atomic <<= 1) {
+		if ((512 * atomic / SQLITE_IOCAP_ATOMIC512) == page_size) {
+			devchar |= atomic;
+			break;
+		}
+	}
+
+	if (flags & UFFS_SQLITE3VFS_BATCH_ATOMIC)
+		devchar |= SQLITE_IOCAP_BATCH_ATOMIC;
+
+	return devchar;
+}
+
+static int vfsOpen(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, int flags, int *out_flags)
+{
+	struct vfs_file *p = (struct vfs_file *)file;
+	char temp_name[sizeof(TEMP_FILE_PREFIX) + 16];
+	struct uffs_stat st;
+	int oflag;
+
+	memset(p, 0, sizeof(struct vfs_file));
+	p->fd = -1;
+
+	if (name == NULL) {
+		// temp file, delete on close
+		sqlite3_snprintf(sizeof(temp_name), temp_name, "%s%08x", TEMP_FILE_PREFIX, ++m_temp_seq);
+		name = temp_name;
+		flags |= SQLITE_OPEN_DELETEONCLOSE | SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE;
+	}
+
+	oflag = (flags & SQLITE_OPEN_READWRITE) ? UO_RDWR : UO_RDONLY;
+	if (flags & SQLITE_OPEN_CREATE)
+		oflag |= UO_CREATE;
+	if (flags & SQLITE_OPEN_EXCLUSIVE)
+		oflag |= UO_EXCL;
+
+	p->fd = uffs_open(name, oflag);
+	if (p->fd < 0)
+		return SQLITE_CANTOPEN;
+
+	if (uffs_fstat(p->fd, &st) < 0) {
+		uffs_close(p->fd);
+		return SQLITE_CANTOPEN;
+	}
+
+	if (flags & SQLITE_OPEN_DELETEONCLOSE) {
+		p->delete_name = sqlite3_mprintf("%s", name);
+		if (p->delete_name == NULL) {
+			uffs_close(p->fd);
+			uffs_remove(name);
+			return SQLITE_NOMEM;
+		}
+	}
+
+	p->sector_size = st.st_blksize;
+	// only the main database commits by batch atomic write, journals are plain files
+	p->devchar = get_devchar(st.st_blksize, (flags & SQLITE_OPEN_MAIN_DB) ? m_flags : 0);
+	p->base.pMethods = &m_io_methods;
+
+	if (out_flags)
+		*out_flags = flags;
+
+	return SQLITE_OK;
+}
+
+static int vfsDelete(sqlite3_vfs *vfs, const char *name, int sync_dir)
+{
+	if (uffs_remove(name) < 0)
+		return (-uffs_get_error() == UENOENT ? SQLITE_IOERR_DELETE_NOENT : SQLITE_IOERR_DELETE);
+
+	return SQLITE_OK;
+}
+
+static int vfsAccess(sqlite3_vfs *vfs, const char *name, int flags, int *out)
+{
+	struct uffs_stat st;
+
+	if (uffs_stat(name, &st) < 0)
+		*out = 0;
+	else if (flags == SQLITE_ACCESS_READWRITE)
+		*out = (st.st_mode & US_IWRITE) ? 1 : 0;
+	else
+		*out = 1;
+
+	return SQLITE_OK;
+}
+
+static int vfsFullPathname(sqlite3_vfs *vfs, const char *name, int n, char *out)
+{
+	if (name[0] == '/')
+		sqlite3_snprintf(n, out, "%s", name);
+	else
+		sqlite3_snprintf(n, out, "/%s", name);
+
+	return SQLITE_OK;
+}
+
+/* loadable extensions are not supported */
+static void * vfsDlOpen(sqlite3_vfs *vfs, const char *name)
+{
+	return NULL;
+}
+
+static void vfsDlError(sqlite3_vfs *vfs, int n, char *msg)
+{
+	sqlite3_snprintf(n, msg, "loadable extensions are not supported");
+}
+
+static void (* vfsDlSym(sqlite3_vfs *vfs, void *handle, const char *sym))(void)
+{
+	return NULL;
+}
+
+static void vfsDlClose(sqlite3_vfs *vfs, void *handle)
+{
+}
+
+/* randomness, sleep and time are from the system default VFS */
+static int vfsRandomness(sqlite3_vfs *vfs, int n, char *out)
+{
+	sqlite3_vfs *sys = (sqlite3_vfs *)vfs->pAppData;
+	int i;
+
+	if (sys)
+		return sys->xRandomness(sys, n, out);
+
+	for (i = 0; i < n; i++)
+		out[i] = (char)(++m_temp_seq * 1103515245 + 12345);
+
+	return n;
+}
+
+static int vfsSleep(sqlite3_vfs *vfs, int us)
+{
+	sqlite3_vfs *sys = (sqlite3_vfs *)vfs->pAppData;
+
+	return sys ? sys->xSleep(sys, us) : 0;
+}
+
+static int vfsCurrentTime(sqlite3_vfs *vfs, double *t)
+{
+	sqlite3_vfs *sys = (sqlite3_vfs *)vfs->pAppData;
+
+	if (sys)
+		return sys->xCurrentTime(sys, t);
+
+	*t = 2440587.5;	// 1970-01-01
+	return SQLITE_OK;
+}
+
+static int vfsGetLastError(sqlite3_vfs *vfs, int n, char *msg)
+{
+	int err = -uffs_get_error();
+
+	if (n > 0)
+		sqlite3_snprintf(n, msg, "uffs error %d", err);
+
+	return err;
+}
+
+static sqlite3_vfs m_vfs = {
+	1,								/* iVersion */
+	sizeof(struct vfs_file),		/* szOsFile */
+	VFS_MAX_PATHNAME,				/* mxPathname */
+	NULL,							/* pNext */
+	UFFS_SQLITE3VFS_NAME,			/* zName */
+	NULL,							/* pAppData: system default VFS */
+	vfsOpen,
+	vfsDelete,
+	vfsAccess,
+	vfsFullPathname,
+	vfsDlOpen,
+	vfsDlError,
+	vfsDlSym,
+	vfsDlClose,
+	vfsRandomness,
+	vfsSleep,
+	vfsCurrentTime,
+	vfsGetLastError,
+};
+
+int uffs_sqlite3vfs_register(int flags, int make_default)
+{
+	sqlite3_vfs *sys;
+
+	sys = sqlite3_vfs_find(NULL);
+	if (sys != &m_vfs)
+		m_vfs.pAppData = sys;
+
+	m_flags = flags;
+
+	return sqlite3_vfs_register(&m_vfs, make_default);
+}
+
+int uffs_sqlite3vfs_unregister(void)
+{
+	return sqlite3_vfs_unregister(&m_vfs);
+}
+
+void uffs_sqlite3vfs_get_stat(struct uffs_sqlite3vfs_stat *st, int reset)
+{
+	if (st)
+		*st = m_stat;
+	if (reset)
+		memset(&m_stat, 0, sizeof(m_stat));
+}
@@ -0,0 +1,85 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_sqlite3vfs.h
+ * \brief sqlite3 VFS on top of UFFS POSIX APIs (uffs_fd.h)
+ * \author Ricky Zheng
+ */
+
+#ifndef _UFFS_SQLITE3VFS_H_
+#define _UFFS_SQLITE3VFS_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/** name of the VFS, for sqlite3_open_v2() */
+#define UFFS_SQLITE3VFS_NAME		"uffs"
+
+/**
+ * \def UFFS_SQLITE3VFS_BATCH_ATOMIC
+ * \brief report SQLITE_IOCAP_BATCH_ATOMIC for database files.
+ *		writes of a transaction are held by the VFS and written by uffs_pwrite_atomic()
+ *		on commit. transactions that don't fit in one block fall back to the journal.
+ *		sqlite3 uses it only if built with SQLITE_ENABLE_BATCH_ATOMIC_WRITE.
+ */
+#define UFFS_SQLITE3VFS_BATCH_ATOMIC	(1 << 0)
+
+/** VFS statistic */
+struct uffs_sqlite3vfs_stat {
+	unsigned long atomic_commits;		//!< transactions written by uffs_pwrite_atomic()
+	unsigned long atomic_fallbacks;		//!< transactions can't be written atomically
+	unsigned long syncs;				//!< xSync() calls
+};
+
+/**
+ * register UFFS VFS to sqlite3.
+ * file names are UFFS path names, UFFS should be mounted before opening database.
+ *
+ * \param[in] flags UFFS_SQLITE3VFS_xxx
+ * \param[in] make_default if non-zero, the VFS is the default VFS
+ * \return SQLITE_OK or sqlite3 error code
+ */
+int uffs_sqlite3vfs_register(int flags, int make_default);
+
+/** unregister UFFS VFS */
+int uffs_sqlite3vfs_unregister(void);
+
+/** get VFS statistic, reset it if 'reset' is non-zero */
+void uffs_sqlite3vfs_get_stat(struct uffs_sqlite3vfs_stat *st, int reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -51,8 +51,28 @@ on this file might be covered by the GNU General Public License.
 #define DBG(...)
 #endif
 
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 static struct uffs_ApiSrvIoSt *m_io = NULL;
 static int m_api_stat[UFFS_API_CMD_LAST + 1] = {0};
+static struct uffs_ApiSrvTraceSt *m_trace = NULL;
+
+static const char *m_cmd_names[UFFS_API_CMD_LAST + 1] = {
+	"version", "open", "close", "read", "write", "flush", "seek", "tell", "eof",
+	"rename", "remove", "ftruncate", "mkdir", "rmdir", "stat", "lstat", "fstat",
+	"opendir", "closedir", "readdir", "rewinddir", "get_error", "set_error", "format",
+	"space_total", "space_free", "space_used", "flush_all", "pread", "pwrite",
+	"readv", "writev", "fallocate", "readdirplus", "batch",
+};
+
+// client side states are per thread: each client thread keeps its own connection.
+static THREAD_LOCAL int m_client_err = UENOERR;	// error of last remote call, see _uffs_get_error()
+static THREAD_LOCAL int m_conn_fd = -1;			// persistent connection to server
+static THREAD_LOCAL u32 m_next_req_id = 1;		// request id of next call
 
 int apisrv_setup_io(struct uffs_ApiSrvIoSt *io)
 {
@@ -60,6 +80,22 @@ int apisrv_setup_io(struct uffs_ApiSrvIoSt *io)
 	return 0;
 }
 
+/**
+ * set server side trace hook, NULL to remove it.
+ */
+void apisrv_set_trace(struct uffs_ApiSrvTraceSt *trace)
+{
+	m_trace = trace;
+}
+
+/**
+ * name of API command 'cmd', NULL if unknown.
+ */
+const char * apisrv_cmd_name(int cmd)
+{
+	return (cmd >= 0 && cmd <= UFFS_API_CMD_LAST ? m_cmd_names[cmd] : NULL);
+}
+
 //
 // unload parameters from message.
 // parameters list:
@@ -110,80 +146,89 @@ static int apisrv_unload_params(struct uffs_ApiSrvMsgSt *msg, ...)
     return ret;
 }
 
-// load response data. the parameter list: (&param1, size1, &param2, size2, .... NULL)
-static int apisrv_make_message(struct uffs_ApiSrvMsgSt *msg, ...)
+// calculate crc, send header (iov[0]) and data pieces (iov[1] ... iov[iovcnt - 1]).
+// pieces are sent directly from where they are, without being copied into one buffer.
+// CRC is skipped (left 0) on trusted transport.
+static int apisrv_send_iov(struct uffs_ApiSrvIoSt *io, int fd, struct uffs_ApiSrvHeaderSt *header,
+							struct uffs_iovec *iov, int iovcnt)
+{
+	int i, ret = 0;
+	u16 crc = 0xFFFF;
+
+	if (io->flags & APISRV_IO_NO_CRC) {
+		header->data_crc = 0;
+		header->header_crc = 0;
+	}
+	else {
+		for (i = 1; i < iovcnt; i++)
+			crc = uffs_crc16update(iov[i].iov_base, iov[i].iov_len, crc);
+		header->data_crc = crc;
+		header->header_crc = uffs_crc16sum(header, sizeof(struct uffs_ApiSrvHeaderSt));
+	}
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(struct uffs_ApiSrvHeaderSt);
+
+	if (io->writev) {
+		ret = io->writev(fd, iov, iovcnt);
+		if (ret < 0)
+			perror("Sending message failed");
+	}
+	else {
+		for (i = 0; i < iovcnt && ret >= 0; i++) {
+			if (iov[i].iov_len > 0)
+				ret = io->write(fd, iov[i].iov_base, iov[i].iov_len);
+		}
+		if (ret < 0)
+			perror("Sending message failed");
+	}
+
+	return ret;
+}
+
+// send response. the parameter list: (&param1, size1, &param2, size2, .... NULL)
+static int apisrv_send_response(int fd, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt *api, ...)
 {
-    int ret = 0;
     u32 n;
     u32 len, size;
     struct uffs_ApiSrvHeaderSt *header = &msg->header;
     u8 *p;
-    u8 * params[UFFS_API_MAX_PARAMS];
+	struct uffs_iovec iov[UFFS_API_MAX_PARAMS + 1];
 
     va_list args;
 
-    va_start(args, msg);
+    va_start(args, api);
 
     for (n = 0, len = 0; n < UFFS_API_MAX_PARAMS; n++) {
         p = va_arg(args, u8 *);
         if (p == NULL)  // terminator
             break;
-        params[n] = p;
 		size = va_arg(args, size_t);
 		if (size > header->return_size[n]) {
 			printf("WARNING: cmd %d make message param %d expect %d but %d, truncated.\n", header->cmd, n, header->return_size[n], size);
 			size = header->return_size[n];
 		}
 	    header->param_size[n] = size;
-        len += header->param_size[n];
+		iov[n + 1].iov_base = p;
+		iov[n + 1].iov_len = size;
+        len += size;
     }
     header->n_params = n;
-
-    va_end(args);
-
-	// free buffer if already allocated.
-	if (msg->data)
-		free(msg->data);
-
-	msg->data = (u8 *)malloc(len);
-	if (msg->data == NULL) {
-		printf("Fail to malloc %d bytes\n", len);
-		ret = -1;
-		goto ext;
-	}
 	header->data_len = len;
 
-    for (n = 0, p = msg->data; n < header->n_params; n++) {
-        memcpy(p, params[n], header->param_size[n]);
-        p += header->param_size[n];
-    }
-
-ext:
-
-    return ret;
-}
-
-
-// calculate crc, send message.
-static int apisrv_send_message(int fd, struct uffs_ApiSrvMsgSt *msg)
-{
-    int ret;
+    va_end(args);
 
-    msg->header.data_crc = uffs_crc16sum(msg->data, msg->header.data_len);
-    msg->header.header_crc = uffs_crc16sum(&msg->header, sizeof(struct uffs_ApiSrvHeaderSt));
+	// return value is the first parameter, if it has one
+	if (n > 0 && iov[1].iov_len == sizeof(i32))
+		msg->ret = *(i32 *)iov[1].iov_base;
+	else if (n > 0 && iov[1].iov_len == sizeof(long))
+		msg->ret = (i32)(*(long *)iov[1].iov_base);
+	else
+		msg->ret = 0;
 
-    ret = m_io->write(fd, &msg->header, sizeof(struct uffs_ApiSrvHeaderSt));
-    if (ret < 0) {
-        perror("Sending header failed");
-    }
-    else {
-        ret = m_io->write(fd, msg->data, msg->header.data_len);
-        if (ret < 0) {
-            perror("Sending data failed");
-        }
-    }
+	header->err = api->uffs_get_error();
 
-    return ret;
+	return (apisrv_send_iov(msg->io ? msg->io : m_io, fd, header, iov, n + 1) < 0 ? -1 : 0);
 }
 
 static int check_apisrv_header(struct uffs_ApiSrvHeaderSt *header)
@@ -196,16 +241,23 @@ static int check_apisrv_msg(struct uffs_ApiSrvMsgSt *msg)
     return 0;
 }
 
-static int apisrv_read_message(int fd, struct uffs_ApiSrvMsgSt *msg)
+// read a message, return 0 if succ, APISRV_EOF if peer closed connection, or -1 if error.
+static int apisrv_read_message(struct uffs_ApiSrvIoSt *io, int fd, struct uffs_ApiSrvMsgSt *msg)
 {
 	int ret = -1;
 	struct uffs_ApiSrvHeaderSt *header = &msg->header;
 	u8 *data = NULL;
 
 	memset(msg, 0, sizeof(struct uffs_ApiSrvMsgSt));
-	ret = m_io->read(fd, header, sizeof(struct uffs_ApiSrvHeaderSt));
-	if (ret < 0) {
+	msg->io = io;
+	ret = io->read(fd, header, sizeof(struct uffs_ApiSrvHeaderSt));
+	if (ret == 0) {
+		ret = APISRV_EOF;
+		goto ext;
+	}
+	if (ret != sizeof(struct uffs_ApiSrvHeaderSt)) {
 		printf("Read header failed!\n");
+		ret = -1;
 		goto ext;
 	}
 
@@ -217,13 +269,15 @@ static int apisrv_read_message(int fd, struct uffs_ApiSrvMsgSt *msg)
 		data = (u8 *)malloc(header->data_len);
 		if (data == NULL) {
 			printf("malloc %d bytes failed\n", header->data_len);
+			ret = -1;
 			goto ext;
 		}
 
 		msg->data = data;
-		ret = m_io->read(fd, data, header->data_len);
-		if (ret < 0) {
+		ret = io->read(fd, data, header->data_len);
+		if (ret != (int)header->data_len) {
 			printf("read data failed\n");
+			ret = -1;
 			goto ext;
 		}
 	}
@@ -248,21 +302,204 @@ static int apisrv_free_message(struct uffs_ApiSrvMsgSt *msg)
 	return 0;
 }
 
+// check that input data of op holds 'n' '\0' terminated names.
+static int batch_check_names(const struct uffs_ApiBatchOpSt *op, const u8 *in, int n)
+{
+	u32 i;
+
+	for (i = 0; i < op->in_len && n > 0; i++) {
+		if (in[i] == '\0')
+			n--;
+	}
+
+	return (n == 0 ? 0 : -1);
+}
+
+// execute an op of batch, output data goes to 'out'. return value and error are put in 'res'.
+static void batch_exec_op(struct uffs_ApiSt *api, const struct uffs_ApiBatchOpSt *op, int fd,
+							const u8 *in, u8 *out, struct uffs_ApiBatchResultSt *res)
+{
+	const char *name = (const char *)in;
+	struct uffs_stat st;
+	int r = -1;
+
+	switch (op->cmd) {
+	case UFFS_API_OPEN_CMD:
+	case UFFS_API_STAT_CMD:
+	case UFFS_API_LSTAT_CMD:
+	case UFFS_API_REMOVE_CMD:
+	case UFFS_API_MKDIR_CMD:
+	case UFFS_API_RMDIR_CMD:
+		if (batch_check_names(op, in, 1) < 0)
+			goto inval;
+		break;
+	case UFFS_API_RENAME_CMD:
+		if (batch_check_names(op, in, 2) < 0)
+			goto inval;
+		break;
+	default:
+		break;
+	}
+
+	switch (op->cmd) {
+	case UFFS_API_OPEN_CMD:
+		r = api->uffs_open(name, op->arg[0]);
+		break;
+	case UFFS_API_CLOSE_CMD:
+		r = api->uffs_close(fd);
+		break;
+	case UFFS_API_FLUSH_CMD:
+		r = api->uffs_flush(fd);
+		break;
+	case UFFS_API_READ_CMD:
+		r = api->uffs_read(fd, out, op->out_len);
+		break;
+	case UFFS_API_WRITE_CMD:
+		r = api->uffs_write(fd, in, op->in_len);
+		break;
+	case UFFS_API_PREAD_CMD:
+		r = api->uffs_pread(fd, out, op->out_len, (long)op->arg[0]);
+		break;
+	case UFFS_API_PWRITE_CMD:
+		r = api->uffs_pwrite(fd, in, op->in_len, (long)op->arg[0]);
+		break;
+	case UFFS_API_SEEK_CMD:
+		r = (int)api->uffs_seek(fd, (long)op->arg[0], op->arg[1]);
+		break;
+	case UFFS_API_FTRUNCATE_CMD:
+		r = api->uffs_ftruncate(fd, (long)op->arg[0]);
+		break;
+	case UFFS_API_STAT_CMD:
+	case UFFS_API_LSTAT_CMD:
+	case UFFS_API_FSTAT_CMD:
+		if (op->out_len < sizeof(struct uffs_stat))
+			goto inval;
+		if (op->cmd == UFFS_API_STAT_CMD)
+			r = api->uffs_stat(name, &st);
+		else if (op->cmd == UFFS_API_LSTAT_CMD)
+			r = api->uffs_lstat(name, &st);
+		else
+			r = api->uffs_fstat(fd, &st);
+		if (r == 0) {
+			memcpy(out, &st, sizeof(struct uffs_stat));
+			res->out_len = sizeof(struct uffs_stat);
+		}
+		break;
+	case UFFS_API_REMOVE_CMD:
+		r = api->uffs_remove(name);
+		break;
+	case UFFS_API_MKDIR_CMD:
+		r = api->uffs_mkdir(name);
+		break;
+	case UFFS_API_RMDIR_CMD:
+		r = api->uffs_rmdir(name);
+		break;
+	case UFFS_API_RENAME_CMD:
+		r = api->uffs_rename(name, name + strlen(name) + 1);
+		break;
+	default:
+		printf("batch: unsupported sub-command %d\n", op->cmd);
+		goto inval;
+	}
+
+	if ((op->cmd == UFFS_API_READ_CMD || op->cmd == UFFS_API_PREAD_CMD) && r > 0)
+		res->out_len = r;
+
+	res->ret = r;
+	res->err = api->uffs_get_error();
+	return;
+
+inval:
+	api->uffs_set_error(-UEINVAL);
+	res->ret = -1;
+	res->err = -UEINVAL;
+}
+
+/**
+ * execute ops of batch in order, under one file system lock if the server has it.
+ * output data of ops are put to 'out' back to back, total length returns via 'out_len'.
+ * return number of ops executed.
+ */
+static int apisrv_exec_batch(struct uffs_ApiSt *api, const struct uffs_ApiBatchOpSt *ops, int n,
+							const u8 *in, u32 in_len, struct uffs_ApiBatchResultSt *results,
+							u8 *out, u32 out_size, u32 *out_len)
+{
+	const struct uffs_ApiBatchOpSt *op;
+	struct uffs_ApiBatchResultSt *res;
+	u32 in_ofs = 0, out_ofs = 0;
+	int i, ref, fd;
+	UBOOL locked = U_FALSE;
+
+	// ops still run if the lock is not available, only not as a whole
+	if (api->uffs_fs_lock && api->uffs_fs_lock() == 0)
+		locked = U_TRUE;
+
+	for (i = 0; i < n; i++) {
+		op = &ops[i];
+		res = &results[i];
+		memset(res, 0, sizeof(struct uffs_ApiBatchResultSt));
+		api->uffs_set_error(UENOERR);
+
+		if (op->in_len > in_len - in_ofs || op->out_len > out_size - out_ofs) {
+			printf("batch: op %d data overflow\n", i);
+			api->uffs_set_error(-UEINVAL);
+			res->ret = -1;
+			res->err = -UEINVAL;
+			break;
+		}
+
+		fd = op->fd;
+		if (op->flags & UFFS_API_BATCH_FD_REF) {
+			// use fd returned by an earlier open
+			ref = op->fd;
+			if (ref < 0 || ref >= i || ops[ref].cmd != UFFS_API_OPEN_CMD || results[ref].ret < 0) {
+				res->ret = -1;
+				res->err = -UEBADF;
+				goto next;
+			}
+			fd = results[ref].ret;
+		}
+
+		batch_exec_op(api, op, fd, in + in_ofs, out ? out + out_ofs : NULL, res);
+		DBG("batch op %d: cmd %d, fd %d = %d, err %d\n", i, op->cmd, fd, res->ret, res->err);
+next:
+		in_ofs += op->in_len;
+		out_ofs += res->out_len;
+	}
+
+	if (locked)
+		api->uffs_fs_unlock();
+
+	*out_len = out_ofs;
+
+	return i;
+}
+
 static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt *api)
 {
     struct uffs_ApiSrvHeaderSt *header = &msg->header;
+    struct uffs_ApiSrvTraceSt *trace = m_trace;
     int ret = 0;
     char name[256];
 
+	if (trace)
+		trace->begin(sock, msg);
+
     //DBG("Received cmd = %d, params %d, data_len = %d\n", UFFS_API_CMD(header), header->n_params, header->data_len);
 
+	// error number is per-thread on server side, clear it so that the
+	// error of this call can be returned within the response.
+	if (UFFS_API_CMD(header) != UFFS_API_GET_ERR_CMD &&
+		UFFS_API_CMD(header) != UFFS_API_SET_ERR_CMD)
+		api->uffs_set_error(UENOERR);
+
     switch(UFFS_API_CMD(header)) {
     case UFFS_API_GET_VER_CMD:
     {
         int val;
         val = api->uffs_version();
 		DBG("uffs_version() = 0x%08x\n", val);
-        ret = apisrv_make_message(msg, &val, sizeof(val), NULL);
+        ret = apisrv_send_response(sock, msg, api, &val, sizeof(val), NULL);
         break;
     }
     case UFFS_API_OPEN_CMD:
@@ -273,7 +510,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			fd = api->uffs_open(name, open_mode);
 			DBG("uffs_open(name = \"%s\", open_mode = 0x%x) = %d\n", name, open_mode, fd);
-			ret = apisrv_make_message(msg, &fd, sizeof(fd), -1, 0, -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &fd, sizeof(fd), -1, 0, -1, 0, NULL);
 		}
         break;
     }
@@ -284,7 +521,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_close(fd);
 			DBG("uffs_close(fd = %d) = %d\n", fd, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -306,7 +543,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 			if (ret == 0) {
 				r = api->uffs_read(fd, buf, len);
 				DBG("uffs_read(fd = %d, buf = {...}, len = %d) = %d\n", fd, len, r);
-				ret = apisrv_make_message(msg, &r, sizeof(r),
+				ret = apisrv_send_response(sock, msg, api, &r, sizeof(r),
 											-1, 0,	/* fd */
 											buf ? buf : (void *)-1, buf ? len : 0,	/* buf */
 											-1, 0,	/* len */
@@ -334,7 +571,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 			if (ret == 0) {
 				r = api->uffs_write(fd, buf, len);
 				DBG("uffs_write(fd = %d, buf = {...}, len = %d) = %d\n", fd, len, r);
-				ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, -1, 0, -1, 0, NULL);
+				ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, -1, 0, -1, 0, NULL);
 			}
 			free(buf);
 		}
@@ -349,7 +586,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_flush(fd);
 			DBG("uffs_flush(fd = %d) = %d\n", fd, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
 
         break;
@@ -363,7 +600,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = (i32) api->uffs_seek(fd, (long)offset, origin);
 			DBG("uffs_seek(fd = %d, offset = %d, origin = %d) = %d\n", fd, offset, origin, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, -1, 0, -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, -1, 0, -1, 0, NULL);
 		}
 
         break;
@@ -377,7 +614,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = (i32) api->uffs_tell(fd);
 			DBG("uffs_tell(fd = %d) = %d\n", fd, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -389,7 +626,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_eof(fd);
 			DBG("uffs_eof(fd = %d) = %d\n", fd, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -407,7 +644,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 			if (ret == 0) {
 				r = api->uffs_rename(oldname, newname);
 				DBG("uffs_rename(old = \"%s\", new = \"%s\") = %d\n", oldname, newname, r);
-				ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, -1, 0, NULL);
+				ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, -1, 0, NULL);
 			}
 		}
 		else {
@@ -430,7 +667,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_remove(name);
 			DBG("uffs_remove(name = \"%s\") = %d\n", name, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -443,7 +680,20 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_ftruncate(fd, (long)remain);
 			DBG("uffs_ftruncate(fd = %d, remain = %d) = %d\n", fd, remain, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, -1, 0, NULL);
+		}
+        break;
+	}
+    case UFFS_API_FALLOCATE_CMD:
+	{
+		int fd, r;
+		i32 len;
+
+		ret = apisrv_unload_params(msg, -1, 0, &fd, sizeof(fd), &len, sizeof(len), NULL);
+		if (ret == 0) {
+			r = api->uffs_fallocate(fd, (long)len);
+			DBG("uffs_fallocate(fd = %d, len = %d) = %d\n", fd, len, r);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, -1, 0, NULL);
 		}
         break;
 	}
@@ -455,7 +705,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_mkdir(name);
 			DBG("uffs_mkdir(name = \"%s\") = %d\n", name, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -467,7 +717,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_rmdir(name);
 			DBG("uffs_rmdir(name= \"%s\") = %d\n", name, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -481,7 +731,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_stat(name, &buf);
 			DBG("uffs_stat(name = \"%s\", buf = {...}) = %d\n", name, r); 
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, &buf, sizeof(struct uffs_stat), NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, &buf, sizeof(struct uffs_stat), NULL);
 		}
         break;
 	}
@@ -494,7 +744,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_fstat(fd, &buf);
 			DBG("uffs_fstat(fd = %d, buf = {...}) = %d\n", fd, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, &buf, sizeof(struct uffs_stat), NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, &buf, sizeof(struct uffs_stat), NULL);
 		}
         break;
 	}
@@ -506,7 +756,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			dirp = api->uffs_opendir(name);
 			DBG("uffs_opendir(name = \"%s\") = %p\n", name, dirp);
-			ret = apisrv_make_message(msg, &dirp, sizeof(uffs_DIR *), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &dirp, sizeof(uffs_DIR *), -1, 0, NULL);
 		}
         break;
 	}
@@ -519,7 +769,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_closedir(dirp);
 			DBG("uffs_closedir(dirp = %p) = %d\n", dirp, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -532,10 +782,44 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			dent = api->uffs_readdir(dirp);
 			DBG("uffs_readdir(dirp = %p) = %s\n", dirp, dent ? "{...}" : "NULL");
-			ret = apisrv_make_message(msg, dent, sizeof(struct uffs_dirent), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, dent, sizeof(struct uffs_dirent), -1, 0, NULL);
 		}
         break;
 	}
+    case UFFS_API_READDIRPLUS_CMD:
+	{
+		// request: dirp, n. response: r, r entries.
+		uffs_DIR *dirp;
+		int n, r;
+		struct uffs_direntplus *ents = NULL;
+
+		ret = apisrv_unload_params(msg, -1, 0, &dirp, sizeof(uffs_DIR *), &n, sizeof(n), -1, 0, NULL);
+		if (ret == 0 && (n <= 0 || n > UFFS_API_MAX_DIRENTS)) {
+			printf("readdirplus: invalid n %d\n", n);
+			ret = -1;
+		}
+		if (ret == 0) {
+			ents = (struct uffs_direntplus *)malloc(n * sizeof(struct uffs_direntplus));
+			if (ents == NULL) {
+				printf("malloc %d entries failed.\n", n);
+				ret = -1;
+			}
+		}
+		if (ret == 0) {
+			r = api->uffs_readdirplus(dirp, ents, n);
+			DBG("uffs_readdirplus(dirp = %p, ents = {...}, n = %d) = %d\n", dirp, n, r);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r),
+										-1, 0,	/* dirp */
+										-1, 0,	/* n */
+										ents, r > 0 ? r * sizeof(struct uffs_direntplus) : 0,
+										NULL);
+		}
+
+		if (ents)
+			free(ents);
+
+        break;
+	}
     case UFFS_API_REWIND_DIR_CMD:
 	{
 		uffs_DIR *dirp;
@@ -544,7 +828,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			api->uffs_rewinddir(dirp);
 			DBG("uffs_rewinddir(dirp = %p)\n", dirp);
-			ret = apisrv_make_message(msg, 0, -1, 0, -1, NULL);
+			ret = apisrv_send_response(sock, msg, api, 0, -1, 0, -1, NULL);
 		}
         break;
 	}
@@ -554,7 +838,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 
 		r = api->uffs_get_error();
 		DBG("uffs_get_error() = %d\n", r);
-		ret = apisrv_make_message(msg, &r, sizeof(r), NULL);
+		ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), NULL);
 
         break;
 	}
@@ -566,7 +850,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_set_error(err);
 			DBG("uffs_set_error(err = %d) = %d\n", err, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -578,7 +862,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = api->uffs_format(name);
 			DBG("uffs_format(mount = \"%s\") = %d\n", name, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -590,7 +874,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = (i32) api->uffs_space_total(name);
 			DBG("uffs_space_total(mount = \"%s\") = %d\n", name, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -602,7 +886,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = (i32) api->uffs_space_free(name);
 			DBG("uffs_space_free(mount = \"%s\") = %d\n", name, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -614,7 +898,7 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			r = (i32) api->uffs_space_used(name);
 			DBG("uffs_space_used(mount = \"%s\") = %d\n", name, r);
-			ret = apisrv_make_message(msg, &r, sizeof(r), -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, NULL);
 		}
         break;
 	}
@@ -624,8 +908,199 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		if (ret == 0) {
 			api->uffs_flush_all(name);
 			DBG("uffs_flush_all(mount = \"%s\")\n", name);
-			ret = apisrv_make_message(msg, -1, 0, -1, 0, NULL);
+			ret = apisrv_send_response(sock, msg, api, -1, 0, -1, 0, NULL);
+		}
+		break;
+	}
+	case UFFS_API_PREAD_CMD:
+	{
+		int fd, r, len;
+		i32 offset;
+		void *buf = NULL;
+
+		ret = apisrv_unload_params(msg, -1, 0, &fd, sizeof(fd), -1, 0, &len, sizeof(len), &offset, sizeof(offset), NULL);
+		if (ret == 0) {
+			if (len > 0) {
+				buf = malloc(len);
+				if (buf == NULL) {
+					printf("malloc %d bytes failed.\n", len);
+					ret = -1;
+				}
+			}
+
+			if (ret == 0) {
+				r = api->uffs_pread(fd, buf, len, (long)offset);
+				DBG("uffs_pread(fd = %d, buf = {...}, len = %d, offset = %d) = %d\n", fd, len, offset, r);
+				ret = apisrv_send_response(sock, msg, api, &r, sizeof(r),
+											-1, 0,	/* fd */
+											buf ? buf : (void *)-1, buf ? len : 0,	/* buf */
+											-1, 0,	/* len */
+											-1, 0,	/* offset */
+											NULL);
+			}
+		}
+
+		if (buf)
+			free(buf);
+
+		break;
+	}
+	case UFFS_API_PWRITE_CMD:
+	{
+		int fd, r, len;
+		i32 offset;
+		void *buf = NULL;
+
+		buf = malloc(header->data_len);
+		if (buf == NULL) {
+			printf("malloc %d failed.\n", header->data_len);
+			ret = -1;
+		}
+		else {
+			ret = apisrv_unload_params(msg, -1, 0, &fd, sizeof(fd), buf, header->data_len, &len, sizeof(len), &offset, sizeof(offset), NULL);
+			if (ret == 0) {
+				r = api->uffs_pwrite(fd, buf, len, (long)offset);
+				DBG("uffs_pwrite(fd = %d, buf = {...}, len = %d, offset = %d) = %d\n", fd, len, offset, r);
+				ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, -1, 0, -1, 0, -1, 0, NULL);
+			}
+			free(buf);
+		}
+
+		break;
+	}
+	case UFFS_API_READV_CMD:
+	{
+		// request: fd, iovcnt, lengths of iov elements.
+		// response: r, data of all elements back to back.
+		int fd, r, iovcnt, i, total;
+		int lens[UFFS_API_MAX_IOV];
+		struct uffs_iovec iov[UFFS_API_MAX_IOV];
+		u8 *buf = NULL;
+
+		ret = apisrv_unload_params(msg, -1, 0, &fd, sizeof(fd), &iovcnt, sizeof(iovcnt), lens, sizeof(lens), -1, 0, NULL);
+		if (ret == 0 && (iovcnt < 0 || iovcnt > UFFS_API_MAX_IOV || header->param_size[3] != iovcnt * sizeof(int))) {
+			printf("readv: invalid iovcnt %d\n", iovcnt);
+			ret = -1;
+		}
+		if (ret == 0) {
+			for (i = 0, total = 0; i < iovcnt; i++)
+				total += lens[i];
+			if (total > 0) {
+				buf = (u8 *)malloc(total);
+				if (buf == NULL) {
+					printf("malloc %d bytes failed.\n", total);
+					ret = -1;
+				}
+			}
+		}
+		if (ret == 0) {
+			for (i = 0, total = 0; i < iovcnt; i++) {
+				iov[i].iov_base = buf + total;
+				iov[i].iov_len = lens[i];
+				total += lens[i];
+			}
+			r = api->uffs_readv(fd, iov, iovcnt);
+			DBG("uffs_readv(fd = %d, iov = {...}, iovcnt = %d) = %d\n", fd, iovcnt, r);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r),
+										-1, 0,	/* fd */
+										-1, 0,	/* iovcnt */
+										-1, 0,	/* lens */
+										buf ? buf : (u8 *)-1, buf && r > 0 ? r : 0,	/* data */
+										NULL);
+		}
+
+		if (buf)
+			free(buf);
+
+		break;
+	}
+	case UFFS_API_WRITEV_CMD:
+	{
+		// request: fd, iovcnt, lengths of iov elements, data of all elements back to back.
+		int fd, r, iovcnt, i, total;
+		int lens[UFFS_API_MAX_IOV];
+		struct uffs_iovec iov[UFFS_API_MAX_IOV];
+		u8 *buf = NULL;
+
+		buf = (u8 *)malloc(header->data_len);
+		if (buf == NULL) {
+			printf("malloc %d failed.\n", header->data_len);
+			ret = -1;
+		}
+		else {
+			ret = apisrv_unload_params(msg, -1, 0, &fd, sizeof(fd), &iovcnt, sizeof(iovcnt), lens, sizeof(lens), buf, header->data_len, NULL);
+			if (ret == 0 && (iovcnt < 0 || iovcnt > UFFS_API_MAX_IOV || header->param_size[3] != iovcnt * sizeof(int))) {
+				printf("writev: invalid iovcnt %d\n", iovcnt);
+				ret = -1;
+			}
+			if (ret == 0) {
+				for (i = 0, total = 0; i < iovcnt; i++) {
+					iov[i].iov_base = buf + total;
+					iov[i].iov_len = lens[i];
+					total += lens[i];
+				}
+				if (total != header->param_size[4]) {
+					printf("writev: data length mismatched, expect %d but %d\n", total, header->param_size[4]);
+					ret = -1;
+				}
+			}
+			if (ret == 0) {
+				r = api->uffs_writev(fd, iov, iovcnt);
+				DBG("uffs_writev(fd = %d, iov = {...}, iovcnt = %d) = %d\n", fd, iovcnt, r);
+				ret = apisrv_send_response(sock, msg, api, &r, sizeof(r), -1, 0, -1, 0, -1, 0, -1, 0, NULL);
+			}
+			free(buf);
+		}
+
+		break;
+	}
+	case UFFS_API_BATCH_CMD:
+	{
+		// request: n, ops, input data. response: r, results, output data.
+		int n, r;
+		struct uffs_ApiBatchOpSt ops[UFFS_API_MAX_BATCH_OPS];
+		struct uffs_ApiBatchResultSt results[UFFS_API_MAX_BATCH_OPS];
+		u8 *in = NULL, *out = NULL;
+		u32 out_size = header->return_size[5];
+		u32 out_len = 0;
+
+		in = (u8 *)malloc(header->data_len);
+		if (in == NULL) {
+			printf("malloc %d failed.\n", header->data_len);
+			ret = -1;
+		}
+		if (ret == 0) {
+			ret = apisrv_unload_params(msg, -1, 0, &n, sizeof(n), ops, sizeof(ops), in, header->data_len,
+										-1, 0, -1, 0, NULL);
+		}
+		if (ret == 0 && (n <= 0 || n > UFFS_API_MAX_BATCH_OPS || header->param_size[2] != n * sizeof(struct uffs_ApiBatchOpSt))) {
+			printf("batch: invalid ops number %d\n", n);
+			ret = -1;
+		}
+		if (ret == 0 && out_size > 0) {
+			out = (u8 *)malloc(out_size);
+			if (out == NULL) {
+				printf("malloc %d bytes failed.\n", out_size);
+				ret = -1;
+			}
+		}
+		if (ret == 0) {
+			r = apisrv_exec_batch(api, ops, n, in, header->param_size[3], results, out, out_size, &out_len);
+			DBG("batch(n = %d) = %d\n", n, r);
+			ret = apisrv_send_response(sock, msg, api, &r, sizeof(r),
+										-1, 0,	/* n */
+										-1, 0,	/* ops */
+										-1, 0,	/* input data */
+										results, r * sizeof(struct uffs_ApiBatchResultSt),
+										out ? out : (u8 *)-1, out_len,
+										NULL);
 		}
+
+		if (in)
+			free(in);
+		if (out)
+			free(out);
+
 		break;
 	}
     default:
@@ -638,27 +1113,60 @@ static int process_cmd(int sock, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt
 		// we might need a mutex here if we using multi-thread server,
 		// but this probably ok since it just for statistic purpose.
 		m_api_stat[UFFS_API_CMD(header)]++;
+		if (trace)
+			trace->end(sock, msg);
 	}
 
-	if (ret == 0)
-		ret = apisrv_send_message(sock, msg);
-
     return ret;
 }
 
-int apisrv_serve(int fd, struct uffs_ApiSt *api)
+/**
+ * process a request message already received by platform code (e.g. an event loop),
+ * the response is sent to 'fd' and the message data is freed.
+ * return 0 if succ, or -1 if error, the connection should be closed then.
+ */
+int apisrv_process_message(int fd, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt *api)
+{
+	int ret;
+
+	ret = check_apisrv_msg(msg);
+	if (ret < 0)
+		printf("check data CRC failed!\n");
+	else
+		ret = process_cmd(fd, msg, api);
+
+	apisrv_free_message(msg);
+
+	return ret;
+}
+
+/**
+ * serve requests on connection 'fd' of transport 'io' one by one until the client closes it.
+ * return 0 if the connection is closed by client, or -1 if error.
+ */
+int apisrv_serve_io(int fd, struct uffs_ApiSrvIoSt *io, struct uffs_ApiSt *api)
 {
     int ret = 0;
     struct uffs_ApiSrvMsgSt msg;
 
-	ret = apisrv_read_message(fd, &msg);
+	do {
+		ret = apisrv_read_message(io, fd, &msg);
 
-    if (ret == 0)
-        ret = process_cmd(fd, &msg, api);
+		if (ret == 0)
+			ret = process_cmd(fd, &msg, api);
 
-	apisrv_free_message(&msg);
+		apisrv_free_message(&msg);
+	} while (ret == 0);
 
-    return ret;
+    return (ret == APISRV_EOF ? 0 : ret);
+}
+
+/**
+ * serve requests on connection 'fd' of the transport set by apisrv_setup_io().
+ */
+int apisrv_serve(int fd, struct uffs_ApiSt *api)
+{
+	return apisrv_serve_io(fd, m_io, api);
 }
 
 void apisrv_print_stat(void)
@@ -671,80 +1179,139 @@ void apisrv_print_stat(void)
 	printf("--- END ---\n");
 }
 
+static int get_connection(void)
+{
+	if (m_conn_fd < 0)
+		m_conn_fd = m_io->open(m_io->addr);
+
+	return m_conn_fd;
+}
+
 /**
- * variable parameters list:
- *  &ret, size_ret, return_size_ret, &param1, size_param1, return_size_param1, &param2, size_param2, return_size_param2... NULL
- **/
-static int call_remote(int cmd, ...)
+ * close the connection of current client thread,
+ * a new connection will be made on next call.
+ */
+void apisrv_client_disconnect(void)
 {
-	struct uffs_ApiSrvMsgSt msg;
-	struct uffs_ApiSrvHeaderSt *header = &msg.header;
-	int ret = -1, fd = -1;
+	if (m_conn_fd >= 0) {
+		m_io->close(m_conn_fd);
+		m_conn_fd = -1;
+	}
+}
+
+static int call_send_v(struct uffs_ApiCallSt *call, int cmd, va_list args)
+{
+	struct uffs_ApiSrvHeaderSt header;
+	struct uffs_iovec iov[UFFS_API_MAX_PARAMS + 1];
+	int ret = -1, fd;
 	u32 n = 0;
 	u8 *p;
 	u32 len, size;
-	u8 * params[UFFS_API_MAX_PARAMS];
-	u32 return_size[UFFS_API_MAX_PARAMS];
-	u32 n_params = 0;
-	va_list args;
 
-	memset(&msg, 0, sizeof(struct uffs_ApiSrvMsgSt));
+	memset(&header, 0, sizeof(struct uffs_ApiSrvHeaderSt));
+	memset(call, 0, sizeof(struct uffs_ApiCallSt));
 
-	fd = m_io->open(m_io->addr);
+	fd = get_connection();
 	if (fd < 0) 
 		goto ext;
 
-	header->cmd = cmd;
+	header.cmd = cmd;
+	header.req_id = m_next_req_id++;
 
-	// parse tparameter list
-	va_start(args, cmd);
+	// parse tparameter list, parameters are sent from where they are.
 	for (n = 0, len = 0; n < UFFS_API_MAX_PARAMS; n++) {
 		p = va_arg(args, u8 *);
 		if (p == NULL)
 			break;
-		params[n] = p;
+		call->params[n] = p;
 		size = va_arg(args, int);
-		header->param_size[n] = size;
-		header->return_size[n] = va_arg(args, int);
-		return_size[n] = header->return_size[n];
+		header.param_size[n] = size;
+		header.return_size[n] = va_arg(args, int);
+		call->return_size[n] = header.return_size[n];
+		iov[n + 1].iov_base = p;
+		iov[n + 1].iov_len = size;
 		len += size;
 	}
-	va_end(args);
 
-	n_params = n;
-	header->n_params = n;
+	call->cmd = cmd;
+	call->req_id = header.req_id;
+	call->n_params = n;
+	header.n_params = n;
+	header.data_len = len;
 	//DBG("C: cmd %d, params %d, data_len %d\n", cmd, n, len);
 
-	msg.data = (u8 *) malloc(len);
-	if (msg.data == NULL) {
-		printf("Fail to malloc %d bytes\n", len);
-		goto ext;
-	}
-	header->data_len = len;
-
-	// now, load parameters
-	for (n = 0, len = 0; n < n_params; n++) {
-		if (header->param_size[n] > 0) {
-			memcpy(msg.data + len, params[n], header->param_size[n]);
-			len += header->param_size[n];
-		}
-	}
-
 	// send
-	ret = apisrv_send_message(fd, &msg);
+	ret = apisrv_send_iov(m_io, fd, &header, iov, n + 1);
 	if (ret < 0)
-		goto ext;
+		apisrv_client_disconnect();
+	else
+		ret = 0;
 
-	// free data pointer
-	apisrv_free_message(&msg);
+ext:
+	return ret;
+}
+
+/**
+ * send a remote call request without waiting for the response,
+ * so that more requests can be sent on the same connection (pipelining).
+ *
+ * variable parameters list:
+ *  &ret, size_ret, return_size_ret, &param1, size_param1, return_size_param1, &param2, size_param2, return_size_param2... NULL
+ *
+ * \note returned parameters are unloaded by apisrv_call_recv(), the buffers
+ *		 must be kept until then. responses come back in the order of requests.
+ */
+int apisrv_call_send(struct uffs_ApiCallSt *call, int cmd, ...)
+{
+	va_list args;
+	int ret;
+
+	va_start(args, cmd);
+	ret = call_send_v(call, cmd, args);
+	va_end(args);
+
+	return ret;
+}
+
+/**
+ * wait for the response of a call sent by apisrv_call_send(),
+ * and unload returned parameters.
+ */
+int apisrv_call_recv(struct uffs_ApiCallSt *call)
+{
+	struct uffs_ApiSrvMsgSt msg;
+	struct uffs_ApiSrvHeaderSt *header = &msg.header;
+	int ret = -1;
+	u32 n = 0;
+	u8 *p;
+	u32 size;
+
+	memset(&msg, 0, sizeof(struct uffs_ApiSrvMsgSt));
+
+	if (m_conn_fd < 0)
+		goto ext;
 
 	// receive response
-	ret = apisrv_read_message(fd, &msg);
-	if (ret < 0)
+	ret = apisrv_read_message(m_io, m_conn_fd, &msg);
+	if (ret != 0) {
+		printf("Read response of request %u failed\n", call->req_id);
+		ret = -1;
+		apisrv_client_disconnect();
 		goto ext;
+	}
+
+	if (header->req_id != call->req_id) {
+		printf("Response to request %u but expect %u\n", header->req_id, call->req_id);
+		ret = -1;
+		apisrv_client_disconnect();
+		goto ext;
+	}
+
+	call->err = header->err;
+	m_client_err = header->err;
 
-	if (header->n_params != n_params) {
-		printf("Response %d parameters but expect %d\n", header->n_params, n_params);
+	if (header->n_params != call->n_params) {
+		printf("Response %d parameters but expect %d\n", header->n_params, call->n_params);
 		ret = -1;
 		goto ext;
 	}
@@ -752,23 +1319,40 @@ static int call_remote(int cmd, ...)
 	// now, unload return parameters
 	for (n = 0, p = msg.data; n < header->n_params; n++) {
 		size = header->param_size[n];
-		if (return_size[n] != header->return_size[n]) {
-			printf("WARNING: cmd %d param %d return size not kept ? expect %d but %d\n", header->cmd, n, return_size[n], header->return_size[n]);
+		if (call->return_size[n] != header->return_size[n]) {
+			printf("WARNING: cmd %d param %d return size not kept ? expect %d but %d\n", header->cmd, n, call->return_size[n], header->return_size[n]);
 		}
-		memcpy(params[n], p, size > return_size[n] ? return_size[n] : size);
-		if (size > return_size[n]) {
-			printf("WARNING: cmd %d return param %d overflow, expect %d but %d\n", header->cmd, n, return_size[n], size);
+		memcpy(call->params[n], p, size > call->return_size[n] ? call->return_size[n] : size);
+		if (size > call->return_size[n]) {
+			printf("WARNING: cmd %d return param %d overflow, expect %d but %d\n", header->cmd, n, call->return_size[n], size);
 		}
 		p += size;
 	}
 	
 ext:
 	apisrv_free_message(&msg);
-	if (fd >= 0)
-		m_io->close(fd);
 
 	return ret;
+}
+
+/**
+ * variable parameters list:
+ *  &ret, size_ret, return_size_ret, &param1, size_param1, return_size_param1, &param2, size_param2, return_size_param2... NULL
+ **/
+static int call_remote(int cmd, ...)
+{
+	struct uffs_ApiCallSt call;
+	va_list args;
+	int ret;
+
+	va_start(args, cmd);
+	ret = call_send_v(&call, cmd, args);
+	va_end(args);
+
+	if (ret == 0)
+		ret = apisrv_call_recv(&call);
 
+	return ret;
 }
 
 static int _uffs_version(void)
@@ -845,6 +1429,119 @@ static int _uffs_flush(int fd)
 	return ret < 0 ? ret : r;
 }
 
+static int _uffs_pread(int fd, void *buf, int len, long offset)
+{
+	int r = -1, ret = -1;
+	i32 offset_32bit = (i32)offset;
+
+	if (buf) {
+		ret = call_remote(UFFS_API_PREAD_CMD, &r, 0, sizeof(r),
+						&fd, sizeof(fd), 0,
+						buf, 0, len,
+						&len, sizeof(len), 0,
+						&offset_32bit, sizeof(offset_32bit), 0,	// only send 32bit over the network
+						NULL);
+	}
+
+	return ret < 0 ? ret : r;
+}
+
+static int _uffs_pwrite(int fd, const void *buf, int len, long offset)
+{
+	int r = -1, ret = -1;
+	i32 offset_32bit = (i32)offset;
+
+	if (buf) {
+		ret = call_remote(UFFS_API_PWRITE_CMD, &r, 0, sizeof(r),
+						&fd, sizeof(fd), 0,
+						buf, len, 0,
+						&len, sizeof(len), 0,
+						&offset_32bit, sizeof(offset_32bit), 0,
+						NULL);
+	}
+
+	return ret < 0 ? ret : r;
+}
+
+/** total length of iov, -1 if invalid */
+static int iov_total_len(const struct uffs_iovec *iov, int iovcnt, int *lens)
+{
+	int i, total = 0;
+
+	if (iov == NULL || iovcnt < 0 || iovcnt > UFFS_API_MAX_IOV)
+		return -1;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len < 0)
+			return -1;
+		lens[i] = iov[i].iov_len;
+		total += iov[i].iov_len;
+	}
+
+	return total;
+}
+
+static int _uffs_readv(int fd, const struct uffs_iovec *iov, int iovcnt)
+{
+	int r = -1, ret = -1;
+	int i, n, total;
+	int lens[UFFS_API_MAX_IOV];
+	u8 *buf = NULL;
+
+	total = iov_total_len(iov, iovcnt, lens);
+	if (total < 0)
+		return -1;
+
+	buf = (u8 *)malloc(total > 0 ? total : 1);
+	if (buf) {
+		ret = call_remote(UFFS_API_READV_CMD, &r, 0, sizeof(r),
+							&fd, sizeof(fd), 0,
+							&iovcnt, sizeof(iovcnt), 0,
+							lens, iovcnt * sizeof(int), 0,
+							buf, 0, total,
+							NULL);
+		// scatter received data to iov
+		for (i = 0, total = 0; ret >= 0 && i < iovcnt && total < r; i++) {
+			n = (r - total > iov[i].iov_len ? iov[i].iov_len : r - total);
+			memcpy(iov[i].iov_base, buf + total, n);
+			total += n;
+		}
+		free(buf);
+	}
+
+	return ret < 0 ? ret : r;
+}
+
+static int _uffs_writev(int fd, const struct uffs_iovec *iov, int iovcnt)
+{
+	int r = -1, ret = -1;
+	int i, total;
+	int lens[UFFS_API_MAX_IOV];
+	u8 *buf = NULL;
+
+	total = iov_total_len(iov, iovcnt, lens);
+	if (total < 0)
+		return -1;
+
+	// gather all elements, send them in one message
+	buf = (u8 *)malloc(total > 0 ? total : 1);
+	if (buf) {
+		for (i = 0, total = 0; i < iovcnt; i++) {
+			memcpy(buf + total, iov[i].iov_base, iov[i].iov_len);
+			total += iov[i].iov_len;
+		}
+		ret = call_remote(UFFS_API_WRITEV_CMD, &r, 0, sizeof(r),
+							&fd, sizeof(fd), 0,
+							&iovcnt, sizeof(iovcnt), 0,
+							lens, iovcnt * sizeof(int), 0,
+							buf, total, 0,
+							NULL);
+		free(buf);
+	}
+
+	return ret < 0 ? ret : r;
+}
+
 static long _uffs_seek(int fd, long offset, int origin)
 {
 	i32 r_32bit = -1;
@@ -924,6 +1621,19 @@ static int _uffs_ftruncate(int fd, long remain)
 	return ret < 0 ? ret : r;
 }
 
+static int _uffs_fallocate(int fd, long len)
+{
+	int r = -1, ret = -1;
+	i32 len_32bit = (i32)len;
+
+	ret = call_remote(UFFS_API_FALLOCATE_CMD, &r, 0, sizeof(r),
+						&fd, sizeof(fd), 0,
+						&len_32bit, sizeof(len_32bit), 0,
+						NULL);
+
+	return ret < 0 ? ret : r;
+}
+
 static int _uffs_mkdir(const char *name, ...)
 {
 	int r = -1, ret = -1;
@@ -1040,6 +1750,24 @@ static struct uffs_dirent * _uffs_readdir(uffs_DIR *dirp)
 	return ret < 0 ? NULL : dent;
 }
 
+static int _uffs_readdirplus(uffs_DIR *dirp, struct uffs_direntplus *ents, int n)
+{
+	int r = -1, ret = -1;
+
+	if (dirp && ents && n > 0) {
+		// fewer entries per call is fine, caller keeps reading until 0.
+		if (n > UFFS_API_MAX_DIRENTS)
+			n = UFFS_API_MAX_DIRENTS;
+		ret = call_remote(UFFS_API_READDIRPLUS_CMD, &r, 0, sizeof(r),
+							&dirp, sizeof(uffs_DIR *), 0,
+							&n, sizeof(n), 0,
+							ents, 0, n * sizeof(struct uffs_direntplus),
+							NULL);
+	}
+
+	return ret < 0 ? ret : r;
+}
+
 static void _uffs_rewinddir(uffs_DIR *dirp)
 {
 	if (dirp) {
@@ -1049,24 +1777,18 @@ static void _uffs_rewinddir(uffs_DIR *dirp)
 	}
 }
 
+/**
+ * Every response carries the error number of that call, so there is no need
+ * to ask the server (the server side error number is per worker thread anyway).
+ */
 static int _uffs_get_error(void)
 {
-	int r = -1, ret = -1;
-
-	ret = call_remote(UFFS_API_GET_ERR_CMD, &r, 0, sizeof(r), NULL);
-
-	return ret < 0 ? ret : r;
+	return m_client_err;
 }
 
 static int _uffs_set_error(int err)
 {
-	int r = -1, ret = -1;
-
-	ret = call_remote(UFFS_API_SET_ERR_CMD, &r, 0, sizeof(r),
-						&err, sizeof(err), 0,
-						NULL);
-
-	return ret < 0 ? ret : r;
+	return (m_client_err = err);
 }
 
 static int _uffs_format(const char *mount)
@@ -1159,6 +1881,12 @@ static struct uffs_ApiSt m_client_api = {
 	_uffs_space_used,
 	_uffs_space_free,
 	_uffs_flush_all,
+	_uffs_pread,
+	_uffs_pwrite,
+	_uffs_readv,
+	_uffs_writev,
+	_uffs_fallocate,
+	_uffs_readdirplus,
 };
 
 struct uffs_ApiSt * apisrv_get_client(void)
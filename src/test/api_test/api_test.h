@@ -71,22 +71,34 @@
 #define UFFS_API_SPACE_FREE_CMD         25
 #define UFFS_API_SPACE_USED_CMD         26
 #define UFFS_API_FLUSH_ALL_CMD          27
+#define UFFS_API_PREAD_CMD              28
+#define UFFS_API_PWRITE_CMD             29
+#define UFFS_API_READV_CMD              30
+#define UFFS_API_WRITEV_CMD             31
+#define UFFS_API_FALLOCATE_CMD          32
+#define UFFS_API_READDIRPLUS_CMD        33
+#define UFFS_API_BATCH_CMD              34
 
-#define UFFS_API_CMD_LAST				27		// last test command id
+#define UFFS_API_CMD_LAST				34		// last test command id
 
 #define UFFS_API_CMD(header)            ((header)->cmd & 0xFF)
 #define UFFS_API_ACK_BIT                (1 << 31)
 
 #define UFFS_API_MAX_PARAMS             8
+#define UFFS_API_MAX_IOV                64		// max iovcnt of readv/writev over RPC
+#define UFFS_API_MAX_DIRENTS            32		// max entries of readdirplus over RPC
+#define UFFS_API_MAX_BATCH_OPS          32		// max operations in a batch
 
 struct uffs_ApiSrvMsgSt;
 
 struct uffs_ApiSrvHeaderSt {
 	u32 cmd;                // command
+	u32 req_id;             // request id, response carries the same id
 	u32 data_len;           // data length
 	u32 n_params;           // parameter numbers
 	u32 param_size[UFFS_API_MAX_PARAMS];    // parameter list
 	u32 return_size[UFFS_API_MAX_PARAMS];	// return parameter list
+	i32 err;                // response: uffs error number of this call
 	u16 data_crc;           // data CRC16
 	u16 header_crc;         // header CRC16
 };
@@ -97,8 +109,12 @@ struct uffs_ApiSrvIoSt {
 	int (*write)(int fd, const void *buf, int len);
 	int (*close)(int fd);
 	void *addr;
+	int (*writev)(int fd, const struct uffs_iovec *iov, int iovcnt);	// optional, gather write all or fail
+	u32 flags;		// APISRV_IO_xxx
 };
 
+#define APISRV_IO_NO_CRC	(1 << 0)	// trusted transport, don't calculate CRC of messages
+
 struct uffs_ApiSt {
 	int (*uffs_version)(void);
 	int (*uffs_open)(const char *name, int oflag, ...);
@@ -128,23 +144,159 @@ struct uffs_ApiSt {
 	long (*uffs_space_used)(const char *mount_point);
 	long (*uffs_space_free)(const char *mount_point);
 	void (*uffs_flush_all)(const char *mount_point);
+	int (*uffs_pread)(int fd, void *data, int len, long offset);
+	int (*uffs_pwrite)(int fd, const void *data, int len, long offset);
+	int (*uffs_readv)(int fd, const struct uffs_iovec *iov, int iovcnt);
+	int (*uffs_writev)(int fd, const struct uffs_iovec *iov, int iovcnt);
+	int (*uffs_fallocate)(int fd, long len);
+	int (*uffs_readdirplus)(uffs_DIR *dirp, struct uffs_direntplus *ents, int n);
+	int (*uffs_fs_lock)(void);			// optional, server holds it for a batch
+	void (*uffs_fs_unlock)(void);
 };
 
 struct uffs_ApiSrvMsgSt {
     struct uffs_ApiSrvHeaderSt header;
     u8 *data;
+    struct uffs_ApiSrvIoSt *io;		// transport the message comes from, NULL for the one of apisrv_setup_io()
+    i32 ret;						// response: return value of the call, for trace
+};
+
+// server side trace hook, called by process_cmd() around serving a call on the same thread.
+struct uffs_ApiSrvTraceSt {
+	void (*begin)(int fd, const struct uffs_ApiSrvMsgSt *msg);	// 'msg' is the request
+	void (*end)(int fd, const struct uffs_ApiSrvMsgSt *msg);	// response is sent, 'msg->header' is the response
+};
+
+#define APISRV_EOF			1		// connection closed by peer
+
+// a remote call sent but response not yet received
+struct uffs_ApiCallSt {
+	u32 req_id;                             // request id
+	u32 cmd;                                // command
+	u32 n_params;                           // parameter numbers
+	u8 *params[UFFS_API_MAX_PARAMS];        // where to unload returned parameters
+	u32 return_size[UFFS_API_MAX_PARAMS];   // max returned size of parameters
+	i32 err;                                // uffs error number of this call
+};
+
+/*
+ * batch: an ordered list of operations executed by one UFFS_API_BATCH_CMD call.
+ * request params: n_ops, ops[n_ops], input data of ops back to back.
+ * response params: r (ops executed), results[n_ops], output data of ops back to back.
+ *
+ * supported sub-commands and their use of op fields:
+ *  OPEN:       in = name, arg[0] = oflag, ret = fd
+ *  CLOSE, FLUSH: fd
+ *  READ:       fd, out_len = len, out = data read
+ *  WRITE:      fd, in = data
+ *  PREAD:      fd, arg[0] = offset, out_len = len, out = data read
+ *  PWRITE:     fd, arg[0] = offset, in = data
+ *  SEEK:       fd, arg[0] = offset, arg[1] = origin
+ *  FTRUNCATE:  fd, arg[0] = remain
+ *  STAT, LSTAT: in = name, out = struct uffs_stat
+ *  FSTAT:      fd, out = struct uffs_stat
+ *  REMOVE, MKDIR, RMDIR: in = name
+ *  RENAME:     in = old name and new name
+ * names are '\0' terminated.
+ */
+#define UFFS_API_BATCH_FD_REF			(1 << 0)	// 'fd' is index of an earlier OPEN op, use the fd it returned
+
+struct uffs_ApiBatchOpSt {
+	u32 cmd;				// sub-command, UFFS_API_xxx_CMD
+	u32 flags;				// UFFS_API_BATCH_xxx
+	i32 fd;
+	i32 arg[2];
+	u32 in_len;				// bytes of input data
+	u32 out_len;			// max bytes of output data
+};
+
+struct uffs_ApiBatchResultSt {
+	i32 ret;				// return value of the operation
+	i32 err;				// uffs error number of the operation
+	u32 out_len;			// bytes of output data
+};
+
+// batch builder on client side, see uffs_batch_xxx()
+struct uffs_BatchSt {
+	int n_ops;
+	struct uffs_ApiBatchOpSt ops[UFFS_API_MAX_BATCH_OPS];
+	struct uffs_ApiBatchResultSt results[UFFS_API_MAX_BATCH_OPS];
+	void *out[UFFS_API_MAX_BATCH_OPS];	// where to unload output data of ops
+	u8 *in_buf;							// input data of all ops
+	u32 in_len;
+	u32 in_size;						// allocated size of 'in_buf'
+	int err;							// -1 if failed to add an op
 };
 
+// fd placeholder: the fd returned by the op 'idx' of the batch
+#define UFFS_BATCH_FD(idx)				(-2 - (idx))
+
 int apisrv_setup_io(struct uffs_ApiSrvIoSt *io);
 int apisrv_serve(int fd, struct uffs_ApiSt *api);
+int apisrv_serve_io(int fd, struct uffs_ApiSrvIoSt *io, struct uffs_ApiSt *api);
+int apisrv_process_message(int fd, struct uffs_ApiSrvMsgSt *msg, struct uffs_ApiSt *api);
 void apisrv_print_stat(void);
+void apisrv_set_trace(struct uffs_ApiSrvTraceSt *trace);
+const char * apisrv_cmd_name(int cmd);
 struct uffs_ApiSt * apisrv_get_client(void);
 
+/* pipelined remote calls on the connection of current client thread */
+int apisrv_call_send(struct uffs_ApiCallSt *call, int cmd, ...);
+int apisrv_call_recv(struct uffs_ApiCallSt *call);
+void apisrv_client_disconnect(void);
+
+/* batch builder, from api_test_client_wrapper.c.
+ * uffs_batch_xxx() add an op and return its index, or -1 if failed.
+ * uffs_batch_run() returns number of ops executed, or -1 if failed,
+ * results are in batch->results[].
+ */
+void uffs_batch_init(struct uffs_BatchSt *batch);
+void uffs_batch_free(struct uffs_BatchSt *batch);
+int uffs_batch_run(struct uffs_BatchSt *batch);
+int uffs_batch_open(struct uffs_BatchSt *batch, const char *name, int oflag);
+int uffs_batch_close(struct uffs_BatchSt *batch, int fd);
+int uffs_batch_read(struct uffs_BatchSt *batch, int fd, void *data, int len);
+int uffs_batch_write(struct uffs_BatchSt *batch, int fd, const void *data, int len);
+int uffs_batch_pread(struct uffs_BatchSt *batch, int fd, void *data, int len, long offset);
+int uffs_batch_pwrite(struct uffs_BatchSt *batch, int fd, const void *data, int len, long offset);
+int uffs_batch_seek(struct uffs_BatchSt *batch, int fd, long offset, int origin);
+int uffs_batch_flush(struct uffs_BatchSt *batch, int fd);
+int uffs_batch_ftruncate(struct uffs_BatchSt *batch, int fd, long remain);
+int uffs_batch_stat(struct uffs_BatchSt *batch, const char *name, struct uffs_stat *buf);
+int uffs_batch_lstat(struct uffs_BatchSt *batch, const char *name, struct uffs_stat *buf);
+int uffs_batch_fstat(struct uffs_BatchSt *batch, int fd, struct uffs_stat *buf);
+int uffs_batch_remove(struct uffs_BatchSt *batch, const char *name);
+int uffs_batch_mkdir(struct uffs_BatchSt *batch, const char *name);
+int uffs_batch_rmdir(struct uffs_BatchSt *batch, const char *name);
+int uffs_batch_rename(struct uffs_BatchSt *batch, const char *old_name, const char *new_name);
+
+/*
+ * API call trace, from api_test_trace.c. one call per line:
+ *   <start (us)> <connection> <call> [<args> ...] = <ret> <err> <latency (us)>
+ * args of calls:
+ *   open <name> <oflag>, read/write <fd> <len>, pread/pwrite <fd> <len> <offset>,
+ *   seek <fd> <offset> <origin>, ftruncate/fallocate <fd> <len>, readv/writev <fd> <total len>,
+ *   rename <old name> <new name>, remove/mkdir/rmdir/stat/lstat <name>,
+ *   close/flush/tell/eof/fstat <fd>, batch <n ops>.
+ * white spaces in names are replaced by '?'.
+ */
+int apisrv_trace_start(const char *file);
+void apisrv_trace_stop(void);
+
 /* from api_test_server_{platform}.c */
 int api_server_start(void);
 
-/* from api_test_client_{platform}.c */
+/* from api_test_client_{platform}.c.
+ * server_addr: host name or IP address of TCP server, or "shm" for
+ * shared memory transport to the server on the same host.
+ */
 int api_client_init(const char *server_addr);
 
+/* shared memory transport, from api_test_shm_{platform}.c */
+#define APISRV_SHM_ADDR		"shm"
+int apisrv_shm_server_start(struct uffs_ApiSt *api);
+void apisrv_shm_print_stat(void);
+struct uffs_ApiSrvIoSt * apisrv_shm_client_io(void);
+
 #endif
 
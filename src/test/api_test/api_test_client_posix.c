@@ -38,7 +38,9 @@ on this file might be covered by the GNU General Public License.
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -57,7 +59,54 @@ static int _io_read(int fd, void *buf, int len)
 
 static int _io_write(int fd, const void *buf, int len)
 {
-    return send(fd, buf, len, 0);
+	const char *p = (const char *)buf;
+	int ret, sent = 0;
+
+	while (sent < len) {
+		ret = send(fd, p + sent, len - sent, 0);
+		if (ret < 0)
+			return ret;
+		sent += ret;
+	}
+
+	return sent;
+}
+
+static int _io_writev(int fd, const struct uffs_iovec *uiov, int iovcnt)
+{
+	struct iovec iov[UFFS_API_MAX_PARAMS + 1];
+	struct iovec *cur = iov;
+	int i, n, ret, sent = 0;
+
+	if (iovcnt > UFFS_API_MAX_PARAMS + 1)
+		return -1;
+
+	for (i = 0, n = 0; i < iovcnt; i++) {
+		if (uiov[i].iov_len > 0) {
+			iov[n].iov_base = uiov[i].iov_base;
+			iov[n].iov_len = uiov[i].iov_len;
+			n++;
+		}
+	}
+
+	while (n > 0) {
+		ret = writev(fd, cur, n);
+		if (ret < 0)
+			return ret;
+		sent += ret;
+		// skip what has been sent
+		while (n > 0 && (size_t)ret >= cur->iov_len) {
+			ret -= cur->iov_len;
+			cur++;
+			n--;
+		}
+		if (n > 0) {
+			cur->iov_base = (char *)cur->iov_base + ret;
+			cur->iov_len -= ret;
+		}
+	}
+
+	return sent;
 }
 
 static int _io_open(void *addr)
@@ -66,6 +115,7 @@ static int _io_open(void *addr)
     struct hostent *host;
     struct sockaddr_in server_addr;
 	int port = SRV_PORT;
+	int yes = 1;
 
     host = gethostbyname((const char *)addr);
 
@@ -87,9 +137,13 @@ static int _io_open(void *addr)
                 sizeof(struct sockaddr)) == -1)
     {
         perror("Connect");
+        close(sock);
         return -1;
     }
 
+	// connection is kept for the following calls, send small requests immediately
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+
     return sock;
 }
 
@@ -104,6 +158,7 @@ static struct uffs_ApiSrvIoSt m_io = {
     .write = _io_write,
     .close = _io_close,
     .addr = (void *)"127.0.0.1",
+    .writev = _io_writev,
 };
 
 int api_client_init(const char *server_addr)
@@ -114,6 +169,11 @@ int api_client_init(const char *server_addr)
 	if (server_addr == NULL)
 		server_addr = getenv("UFFS_TEST_SRV_ADDR");
 
+	if (server_addr && strcmp(server_addr, APISRV_SHM_ADDR) == 0) {
+		// server on the same host, use shared memory transport
+		return apisrv_setup_io(apisrv_shm_client_io());
+	}
+
 	if (server_addr && strlen(server_addr) < sizeof(addr)) {
 		strcpy(addr, server_addr);
 		m_io.addr = (void *)addr;
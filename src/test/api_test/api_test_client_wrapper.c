@@ -36,6 +36,8 @@
  * \author Ricky Zheng, created at 20 Dec, 2011
  */
 
+#include <string.h>
+#include <stdlib.h>
 #include "uffs/uffs_fd.h"
 #include "api_test.h"
 
@@ -79,3 +81,246 @@ W(long, uffs_space_total, (const char *mount), (mount))
 W(long, uffs_space_used, (const char *mount), (mount))
 W(long, uffs_space_free, (const char *mount), (mount))
 VW(uffs_flush_all, (const char *mount), (mount))
+W(int, uffs_pread, (int fd, void *data, int len, long offset), (fd, data, len, offset))
+W(int, uffs_pwrite, (int fd, const void *data, int len, long offset), (fd, data, len, offset))
+W(int, uffs_readv, (int fd, const struct uffs_iovec *iov, int iovcnt), (fd, iov, iovcnt))
+W(int, uffs_writev, (int fd, const struct uffs_iovec *iov, int iovcnt), (fd, iov, iovcnt))
+W(int, uffs_fallocate, (int fd, long len), (fd, len))
+W(int, uffs_readdirplus, (uffs_DIR *dirp, struct uffs_direntplus *ents, int n), (dirp, ents, n))
+
+
+/*
+ * batch builder: collect ops, then send them with one UFFS_API_BATCH_CMD call.
+ *
+ *   uffs_batch_init(&b);
+ *   op = uffs_batch_open(&b, "/file", UO_CREATE | UO_WRONLY);
+ *   uffs_batch_write(&b, UFFS_BATCH_FD(op), data, len);
+ *   uffs_batch_close(&b, UFFS_BATCH_FD(op));
+ *   uffs_batch_run(&b);    // check b.results[]
+ *   uffs_batch_free(&b);
+ */
+
+void uffs_batch_init(struct uffs_BatchSt *batch)
+{
+	memset(batch, 0, sizeof(struct uffs_BatchSt));
+}
+
+void uffs_batch_free(struct uffs_BatchSt *batch)
+{
+	if (batch->in_buf)
+		free(batch->in_buf);
+	memset(batch, 0, sizeof(struct uffs_BatchSt));
+}
+
+static int batch_append(struct uffs_BatchSt *batch, const void *data, int len)
+{
+	u32 size;
+	u8 *p;
+
+	if (len <= 0)
+		return 0;
+
+	if (batch->in_len + len > batch->in_size) {
+		size = batch->in_size ? batch->in_size : 256;
+		while (size < batch->in_len + len)
+			size *= 2;
+		p = (u8 *)realloc(batch->in_buf, size);
+		if (p == NULL)
+			return -1;
+		batch->in_buf = p;
+		batch->in_size = size;
+	}
+	memcpy(batch->in_buf + batch->in_len, data, len);
+	batch->in_len += len;
+
+	return 0;
+}
+
+// add an op, 'fd' may be UFFS_BATCH_FD(idx). return index of the op, or -1 if failed.
+static int batch_add(struct uffs_BatchSt *batch, int cmd, int fd,
+						const void *in, int in_len, const void *in2, int in2_len,
+						void *out, int out_len)
+{
+	struct uffs_ApiBatchOpSt *op;
+	int idx = batch->n_ops;
+
+	if (batch->err < 0)
+		return -1;
+
+	if (idx >= UFFS_API_MAX_BATCH_OPS || in_len < 0 || out_len < 0 ||
+		batch_append(batch, in, in_len) < 0 ||
+		batch_append(batch, in2, in2_len) < 0) {
+		// ops after it are not added either, so that UFFS_BATCH_FD() indexes are kept
+		batch->err = -1;
+		return -1;
+	}
+
+	op = &batch->ops[idx];
+	memset(op, 0, sizeof(struct uffs_ApiBatchOpSt));
+	op->cmd = cmd;
+	if (fd <= UFFS_BATCH_FD(0)) {
+		op->flags |= UFFS_API_BATCH_FD_REF;
+		op->fd = UFFS_BATCH_FD(0) - fd;
+	}
+	else {
+		op->fd = fd;
+	}
+	op->in_len = in_len + in2_len;
+	op->out_len = out_len;
+	batch->out[idx] = out;
+	batch->n_ops++;
+
+	return idx;
+}
+
+#define NAME_LEN(name) ((name) ? (int)strlen(name) + 1 : -1)
+
+int uffs_batch_open(struct uffs_BatchSt *batch, const char *name, int oflag)
+{
+	int idx = batch_add(batch, UFFS_API_OPEN_CMD, -1, name, NAME_LEN(name), NULL, 0, NULL, 0);
+	if (idx >= 0)
+		batch->ops[idx].arg[0] = oflag;
+	return idx;
+}
+
+int uffs_batch_close(struct uffs_BatchSt *batch, int fd)
+{
+	return batch_add(batch, UFFS_API_CLOSE_CMD, fd, NULL, 0, NULL, 0, NULL, 0);
+}
+
+int uffs_batch_read(struct uffs_BatchSt *batch, int fd, void *data, int len)
+{
+	return batch_add(batch, UFFS_API_READ_CMD, fd, NULL, 0, NULL, 0, data, len);
+}
+
+int uffs_batch_write(struct uffs_BatchSt *batch, int fd, const void *data, int len)
+{
+	return batch_add(batch, UFFS_API_WRITE_CMD, fd, data, len, NULL, 0, NULL, 0);
+}
+
+int uffs_batch_pread(struct uffs_BatchSt *batch, int fd, void *data, int len, long offset)
+{
+	int idx = batch_add(batch, UFFS_API_PREAD_CMD, fd, NULL, 0, NULL, 0, data, len);
+	if (idx >= 0)
+		batch->ops[idx].arg[0] = (i32)offset;
+	return idx;
+}
+
+int uffs_batch_pwrite(struct uffs_BatchSt *batch, int fd, const void *data, int len, long offset)
+{
+	int idx = batch_add(batch, UFFS_API_PWRITE_CMD, fd, data, len, NULL, 0, NULL, 0);
+	if (idx >= 0)
+		batch->ops[idx].arg[0] = (i32)offset;
+	return idx;
+}
+
+int uffs_batch_seek(struct uffs_BatchSt *batch, int fd, long offset, int origin)
+{
+	int idx = batch_add(batch, UFFS_API_SEEK_CMD, fd, NULL, 0, NULL, 0, NULL, 0);
+	if (idx >= 0) {
+		batch->ops[idx].arg[0] = (i32)offset;
+		batch->ops[idx].arg[1] = origin;
+	}
+	return idx;
+}
+
+int uffs_batch_flush(struct uffs_BatchSt *batch, int fd)
+{
+	return batch_add(batch, UFFS_API_FLUSH_CMD, fd, NULL, 0, NULL, 0, NULL, 0);
+}
+
+int uffs_batch_ftruncate(struct uffs_BatchSt *batch, int fd, long remain)
+{
+	int idx = batch_add(batch, UFFS_API_FTRUNCATE_CMD, fd, NULL, 0, NULL, 0, NULL, 0);
+	if (idx >= 0)
+		batch->ops[idx].arg[0] = (i32)remain;
+	return idx;
+}
+
+int uffs_batch_stat(struct uffs_BatchSt *batch, const char *name, struct uffs_stat *buf)
+{
+	return batch_add(batch, UFFS_API_STAT_CMD, -1, name, NAME_LEN(name), NULL, 0, buf, sizeof(struct uffs_stat));
+}
+
+int uffs_batch_lstat(struct uffs_BatchSt *batch, const char *name, struct uffs_stat *buf)
+{
+	return batch_add(batch, UFFS_API_LSTAT_CMD, -1, name, NAME_LEN(name), NULL, 0, buf, sizeof(struct uffs_stat));
+}
+
+int uffs_batch_fstat(struct uffs_BatchSt *batch, int fd, struct uffs_stat *buf)
+{
+	return batch_add(batch, UFFS_API_FSTAT_CMD, fd, NULL, 0, NULL, 0, buf, sizeof(struct uffs_stat));
+}
+
+int uffs_batch_remove(struct uffs_BatchSt *batch, const char *name)
+{
+	return batch_add(batch, UFFS_API_REMOVE_CMD, -1, name, NAME_LEN(name), NULL, 0, NULL, 0);
+}
+
+int uffs_batch_mkdir(struct uffs_BatchSt *batch, const char *name)
+{
+	return batch_add(batch, UFFS_API_MKDIR_CMD, -1, name, NAME_LEN(name), NULL, 0, NULL, 0);
+}
+
+int uffs_batch_rmdir(struct uffs_BatchSt *batch, const char *name)
+{
+	return batch_add(batch, UFFS_API_RMDIR_CMD, -1, name, NAME_LEN(name), NULL, 0, NULL, 0);
+}
+
+int uffs_batch_rename(struct uffs_BatchSt *batch, const char *old_name, const char *new_name)
+{
+	return batch_add(batch, UFFS_API_RENAME_CMD, -1, old_name, NAME_LEN(old_name),
+						new_name, NAME_LEN(new_name), NULL, 0);
+}
+
+int uffs_batch_run(struct uffs_BatchSt *batch)
+{
+	struct uffs_ApiCallSt call;
+	int n = batch->n_ops;
+	int r = -1, i;
+	u32 out_size = 0, ofs, len;
+	u8 *out = NULL;
+	u8 none = 0;
+
+	if (batch->err < 0 || n == 0)
+		return (n == 0 && batch->err == 0 ? 0 : -1);
+
+	for (i = 0; i < n; i++)
+		out_size += batch->ops[i].out_len;
+
+	if (out_size > 0) {
+		out = (u8 *)malloc(out_size);
+		if (out == NULL)
+			return -1;
+	}
+
+	memset(batch->results, 0, sizeof(batch->results));
+
+	// empty input or output data still need a non-NULL place holder
+	if (apisrv_call_send(&call, UFFS_API_BATCH_CMD,
+						&r, 0, sizeof(r),
+						&n, sizeof(n), 0,
+						batch->ops, n * sizeof(struct uffs_ApiBatchOpSt), 0,
+						batch->in_buf ? batch->in_buf : &none, batch->in_len, 0,
+						batch->results, 0, n * sizeof(struct uffs_ApiBatchResultSt),
+						out ? out : &none, 0, out_size,
+						NULL) < 0 ||
+		apisrv_call_recv(&call) < 0) {
+		r = -1;
+	}
+
+	// unload output data of ops
+	for (i = 0, ofs = 0; i < r && i < n; i++) {
+		len = batch->results[i].out_len;
+		if (len > batch->ops[i].out_len || ofs + len > out_size)
+			break;
+		if (len > 0)
+			memcpy(batch->out[i], out + ofs, len);
+		ofs += len;
+	}
+
+	if (out)
+		free(out);
+
+	return r;
+}
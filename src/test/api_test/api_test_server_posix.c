@@ -40,9 +40,15 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <pthread.h>
 
@@ -62,57 +68,111 @@
 
 #define BACKLOGS	100
 
-#define WORKER_THREAD_NUM	10	
+/*
+ * One event loop thread (the server main thread) accepts connections and
+ * receives requests without blocking. Complete requests are queued on their
+ * connection, and a connection having requests is put into the work queue,
+ * served by one of worker threads. A connection is served by one worker at
+ * a time, so responses are sent back in the order of requests.
+ */
+
+#define WORKER_THREAD_NUM	4
+#define MAX_EPOLL_EVENTS	64
+#define MAX_MSG_DATA_LEN	(16 * 1024 * 1024)	// refuse larger request
+#define RX_BUDGET			(64 * 1024)			// max bytes received from one connection per event
+
+struct api_req {
+	struct uffs_ApiSrvMsgSt msg;
+	struct api_req *next;
+};
+
+struct api_conn {
+	int fd;
+	struct uffs_ApiSrvMsgSt rx;			//!< request being received
+	u32 rx_len;							//!< received bytes of 'rx', header and data
+	struct api_req *req_head;			//!< received requests, wait for serving
+	struct api_req *req_tail;
+	int busy;							//!< in work queue or being served by a worker
+	int closed;							//!< closed by event loop, free it when not busy
+	int broken;							//!< send response failed, drop the rest requests
+	struct api_conn *work_next;			//!< next connection in work queue
+};
 
-#define WORKER_FIFO_SIZE	30
-static pthread_mutex_t m_fifo_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t m_fifo_space_avail = PTHREAD_COND_INITIALIZER;
-static pthread_cond_t m_fifo_fd_avail = PTHREAD_COND_INITIALIZER;
-static int m_fifo[WORKER_FIFO_SIZE];
-static int m_fifo_head = 0;
-static int m_fifo_tail = 0;
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;	// protects work queue and requests of connections
+static pthread_cond_t m_work_avail = PTHREAD_COND_INITIALIZER;
+static struct api_conn *m_work_head = NULL;
+static struct api_conn *m_work_tail = NULL;
 
 static int m_thread_stat[WORKER_THREAD_NUM];
+static int m_conn_total = 0;
+static int m_conn_active = 0;
 
-static void push_fifo(int fd)
+static int _io_read(int fd, void *buf, int len)
 {
-	pthread_mutex_lock(&m_fifo_lock);
-	if (((m_fifo_head + 1) % WORKER_FIFO_SIZE) != m_fifo_tail) {
-		m_fifo[m_fifo_head++] = fd;
-		m_fifo_head = m_fifo_head % WORKER_FIFO_SIZE;
-		pthread_cond_signal(&m_fifo_fd_avail);
-	}
-	else {
-		pthread_cond_wait(&m_fifo_space_avail, &m_fifo_lock);
-	}
-	pthread_mutex_unlock(&m_fifo_lock);
+    return recv(fd, buf, len, MSG_WAITALL);
 }
 
-static int pop_fifo(void)
+// send all the pieces. connection socket is non-blocking, wait for it when sending buffer is full.
+static int _io_writev(int fd, const struct uffs_iovec *uiov, int iovcnt)
 {
-	int fd = -1;
-	pthread_mutex_lock(&m_fifo_lock);
-	if (m_fifo_head == m_fifo_tail) {
-		pthread_cond_wait(&m_fifo_fd_avail, &m_fifo_lock);
-	}
-	else {
-		fd = m_fifo[m_fifo_tail++];
-		m_fifo_tail = m_fifo_tail % WORKER_FIFO_SIZE;
-		pthread_cond_signal(&m_fifo_space_avail);
+	struct iovec iov[UFFS_API_MAX_PARAMS + 1];
+	struct msghdr mh;
+	struct pollfd pfd;
+	int i, n, ret, sent = 0;
+
+	if (iovcnt > UFFS_API_MAX_PARAMS + 1)
+		return -1;
+
+	for (i = 0, n = 0; i < iovcnt; i++) {
+		if (uiov[i].iov_len > 0) {
+			iov[n].iov_base = uiov[i].iov_base;
+			iov[n].iov_len = uiov[i].iov_len;
+			n++;
+		}
 	}
-	pthread_mutex_unlock(&m_fifo_lock);
 
-	return fd;
-}
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = iov;
+
+	while (n > 0) {
+		mh.msg_iovlen = n;
+		// sendmsg() is writev() on socket, but don't raise SIGPIPE if client has gone.
+		ret = sendmsg(fd, &mh, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return ret;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+				return -1;
+			continue;
+		}
+		sent += ret;
+		// skip what has been sent
+		while (n > 0 && (size_t)ret >= mh.msg_iov->iov_len) {
+			ret -= mh.msg_iov->iov_len;
+			mh.msg_iov++;
+			n--;
+		}
+		if (n > 0) {
+			mh.msg_iov->iov_base = (char *)mh.msg_iov->iov_base + ret;
+			mh.msg_iov->iov_len -= ret;
+		}
+	}
 
-static int _io_read(int fd, void *buf, int len)
-{
-    return recv(fd, buf, len, MSG_WAITALL);
+	return sent;
 }
 
 static int _io_write(int fd, const void *buf, int len)
 {
-    return send(fd, buf, len, 0);
+	struct uffs_iovec iov;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+
+	return _io_writev(fd, &iov, 1);
 }
 
 static int _io_close(int fd)
@@ -124,6 +184,7 @@ static struct uffs_ApiSrvIoSt m_io = {
     .read = _io_read,
     .write = _io_write,
     .close = _io_close,
+    .writev = _io_writev,
 };
 
 static struct uffs_ApiSt m_api = {
@@ -155,22 +216,193 @@ static struct uffs_ApiSt m_api = {
     uffs_space_used,
     uffs_space_free,
 	uffs_flush_all,
+	uffs_pread,
+	uffs_pwrite,
+	uffs_readv,
+	uffs_writev,
+	uffs_fallocate,
+	uffs_readdirplus,
+	uffs_fs_lock,
+	uffs_fs_unlock,
 };
 
+static void conn_free(struct api_conn *conn)
+{
+	struct api_req *req;
+
+	while (conn->req_head) {
+		req = conn->req_head;
+		conn->req_head = req->next;
+		if (req->msg.data)
+			free(req->msg.data);
+		free(req);
+	}
+	if (conn->rx.data)
+		free(conn->rx.data);
+	close(conn->fd);
+	free(conn);
+}
+
+// called by event loop: stop watching the connection, free it if no worker is serving it.
+static void conn_close(int epfd, struct api_conn *conn)
+{
+	int free_it;
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+
+	pthread_mutex_lock(&m_lock);
+	conn->closed = 1;
+	free_it = !conn->busy;
+	m_conn_active--;
+	pthread_mutex_unlock(&m_lock);
+
+	if (free_it)
+		conn_free(conn);
+}
+
+// a request is completely received, queue it and schedule the connection.
+static int conn_queue_request(struct api_conn *conn)
+{
+	struct api_req *req;
+
+	req = (struct api_req *)malloc(sizeof(struct api_req));
+	if (req == NULL) {
+		printf("malloc request failed\n");
+		return -1;
+	}
+	req->msg = conn->rx;
+	req->next = NULL;
+
+	memset(&conn->rx, 0, sizeof(struct uffs_ApiSrvMsgSt));
+	conn->rx_len = 0;
+
+	pthread_mutex_lock(&m_lock);
+	if (conn->req_tail)
+		conn->req_tail->next = req;
+	else
+		conn->req_head = req;
+	conn->req_tail = req;
+
+	if (!conn->busy) {
+		conn->busy = 1;
+		conn->work_next = NULL;
+		if (m_work_tail)
+			m_work_tail->work_next = conn;
+		else
+			m_work_head = conn;
+		m_work_tail = conn;
+		pthread_cond_signal(&m_work_avail);
+	}
+	pthread_mutex_unlock(&m_lock);
+
+	return 0;
+}
+
+// receive and frame requests without blocking.
+// return 0 if no more data for now, or -1 if the connection is closed by peer or error.
+static int conn_receive(struct api_conn *conn)
+{
+	const u32 hdr_size = sizeof(struct uffs_ApiSrvHeaderSt);
+	struct uffs_ApiSrvHeaderSt *header = &conn->rx.header;
+	int budget = RX_BUDGET;
+	u8 *p;
+	u32 want;
+	int ret;
+
+	while (budget > 0) {
+		if (conn->rx_len < hdr_size) {
+			p = (u8 *)header + conn->rx_len;
+			want = hdr_size - conn->rx_len;
+		}
+		else {
+			p = conn->rx.data + (conn->rx_len - hdr_size);
+			want = header->data_len - (conn->rx_len - hdr_size);
+		}
+
+		ret = recv(conn->fd, p, want, 0);
+		if (ret == 0)
+			return -1;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		conn->rx_len += ret;
+		budget -= ret;
+
+		if (conn->rx_len == hdr_size && header->data_len > 0) {
+			if (header->data_len > MAX_MSG_DATA_LEN) {
+				printf("request data length %u too large\n", header->data_len);
+				return -1;
+			}
+			conn->rx.data = (u8 *)malloc(header->data_len);
+			if (conn->rx.data == NULL) {
+				printf("malloc %d bytes failed\n", header->data_len);
+				return -1;
+			}
+		}
+
+		if (conn->rx_len == hdr_size + header->data_len) {
+			if (conn_queue_request(conn) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
 static void * worker_thread_fn(void *param)
 {
-	int fd;
+	struct api_conn *conn;
+	struct api_req *req;
+	int free_it = 0;
 	size_t id;
 	
 	id = (size_t)param;
 
 	while (1) {
-		fd = pop_fifo();
-		if (fd >= 0) {
-			apisrv_serve(fd, &m_api);
-			close(fd);
-			m_thread_stat[id]++;
+		pthread_mutex_lock(&m_lock);
+		while (m_work_head == NULL)
+			pthread_cond_wait(&m_work_avail, &m_lock);
+		conn = m_work_head;
+		m_work_head = conn->work_next;
+		if (m_work_head == NULL)
+			m_work_tail = NULL;
+		pthread_mutex_unlock(&m_lock);
+
+		// serve requests of this connection in order, until no more requests
+		while (1) {
+			pthread_mutex_lock(&m_lock);
+			req = conn->req_head;
+			if (req) {
+				conn->req_head = req->next;
+				if (conn->req_head == NULL)
+					conn->req_tail = NULL;
+			}
+			else {
+				conn->busy = 0;
+				free_it = conn->closed;
+			}
+			pthread_mutex_unlock(&m_lock);
+
+			if (req == NULL)
+				break;
+
+			if (!conn->broken) {
+				if (apisrv_process_message(conn->fd, &req->msg, &m_api) < 0) {
+					// let event loop see it and close the connection
+					conn->broken = 1;
+					shutdown(conn->fd, SHUT_RDWR);
+				}
+				m_thread_stat[id]++;
+			}
+			if (req->msg.data)
+				free(req->msg.data);
+			free(req);
 		}
+
+		if (free_it)
+			conn_free(conn);
 	}
 
 	return NULL;
@@ -193,17 +425,78 @@ static void print_worker_thread_stat(void)
 	for (i = 0; i < WORKER_THREAD_NUM; i++) {
 		printf("Thread %2d: %d\n", i, m_thread_stat[i]);
 	}
+	printf("Connections: %d active, %d total\n", m_conn_active, m_conn_total);
+	apisrv_shm_print_stat();
 	printf("--- thread stat end --\n");
 }
 
-static void *api_server_main_thread(void *param)
+static int set_nonblock(int fd)
+{
+	int yes = 1;
+
+	return ioctl(fd, FIONBIO, &yes);
+}
+
+// accept all pending connections and watch them.
+static void accept_connections(int epfd, int srv_fd)
 {
-	int srv_fd = -1, new_fd = -1;
-	struct sockaddr_in my_addr;
 	struct sockaddr_in peer_addr;
 	socklen_t sin_size;
+	struct epoll_event ev;
+	struct api_conn *conn;
+	int new_fd;
+	int yes = 1;
+
+	while (1) {
+		sin_size = sizeof(struct sockaddr_in);
+		new_fd = accept(srv_fd, (struct sockaddr *)&peer_addr, &sin_size);
+		if (new_fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				perror("accept() error");
+			break;
+		}
+
+		// small requests are pipelined on the connection, don't delay them
+		setsockopt(new_fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+
+		conn = (struct api_conn *)malloc(sizeof(struct api_conn));
+		if (conn == NULL || set_nonblock(new_fd) < 0) {
+			printf("setup new connection failed\n");
+			if (conn)
+				free(conn);
+			close(new_fd);
+			continue;
+		}
+		memset(conn, 0, sizeof(struct api_conn));
+		conn->fd = new_fd;
+
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = conn;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, new_fd, &ev) < 0) {
+			perror("epoll_ctl() error");
+			close(new_fd);
+			free(conn);
+			continue;
+		}
+
+		pthread_mutex_lock(&m_lock);
+		m_conn_total++;
+		m_conn_active++;
+		pthread_mutex_unlock(&m_lock);
+	}
+}
+
+static void *api_server_main_thread(void *param)
+{
+	int srv_fd = -1, epfd = -1;
+	struct sockaddr_in my_addr;
+	struct epoll_event ev, events[MAX_EPOLL_EVENTS];
+	struct api_conn *conn;
 	int yes = 1;
 	int ret = 0;
+	int i, n;
 	int port = SRV_PORT;
 
 	srv_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -241,20 +534,58 @@ static void *api_server_main_thread(void *param)
 		goto ext;
 	}
 
-	sin_size = sizeof(struct sockaddr_in);
+	ret = set_nonblock(srv_fd);
+	if (ret < 0) {
+		perror("set non-blocking error");
+		goto ext;
+	}
+
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll_create1() error");
+		ret = -1;
+		goto ext;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;		// NULL for listening socket
+	ret = epoll_ctl(epfd, EPOLL_CTL_ADD, srv_fd, &ev);
+	if (ret < 0) {
+		perror("epoll_ctl() error");
+		goto ext;
+	}
 
 	apisrv_setup_io(&m_io);
 
 	create_worker_threads();
 
 	do {
-		new_fd = accept(srv_fd, (struct sockaddr *)&peer_addr, &sin_size);
-		if (new_fd >= 0) {
-			push_fifo(new_fd);
+		n = epoll_wait(epfd, events, MAX_EPOLL_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait() error");
+			ret = -1;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			conn = (struct api_conn *)events[i].data.ptr;
+			if (conn == NULL) {
+				accept_connections(epfd, srv_fd);
+			}
+			else if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+				// read what's available first, then close if peer has gone.
+				if (conn_receive(conn) < 0 ||
+					(events[i].events & (EPOLLHUP | EPOLLERR)))
+					conn_close(epfd, conn);
+			}
 		}
 	} while (ret >= 0);
 
 ext:
+	if (epfd >= 0)
+		close(epfd);
 	if (srv_fd >= 0)
 		close(srv_fd);
 
@@ -263,6 +594,7 @@ ext:
 
 
 int api_server_start(void)
+
 {
 	static int started = 0;
 	pthread_t main_thread;
@@ -271,6 +603,9 @@ int api_server_start(void)
 	if (!started) {
 		started = 1;
 		ret = pthread_create(&main_thread, NULL, api_server_main_thread, NULL);
+		// clients on the same host may also connect via shared memory
+		if (ret == 0 && apisrv_shm_server_start(&m_api) < 0)
+			printf("shared memory transport not available.\n");
 	}
 	else {
 		apisrv_print_stat();
@@ -55,7 +55,7 @@
 
 static int _io_read(int fd, void *buf, int len)
 {
-    return recv((SOCKET)fd, buf, len, 0);
+    return recv((SOCKET)fd, buf, len, MSG_WAITALL);
 }
 
 static int _io_write(int fd, const void *buf, int len)
@@ -106,8 +106,27 @@ static struct uffs_ApiSt m_api = {
     uffs_space_used,
     uffs_space_free,
 	uffs_flush_all,
+	uffs_pread,
+	uffs_pwrite,
+	uffs_readv,
+	uffs_writev,
+	uffs_fallocate,
+	uffs_readdirplus,
+	uffs_fs_lock,
+	uffs_fs_unlock,
 };
 
+static DWORD WINAPI client_thread_fn(LPVOID param)
+{
+	SOCKET sock = (SOCKET)param;
+
+	// serve the connection until client closes it
+	apisrv_serve((int)sock, &m_api);
+	closesocket(sock);
+
+	return 0;
+}
+
 int api_server_start(void)
 {
 	int iResult;
@@ -116,6 +135,7 @@ int api_server_start(void)
 
     SOCKET ListenSocket = INVALID_SOCKET;
     SOCKET ClientSocket = INVALID_SOCKET;
+	HANDLE hThread;
 
     struct addrinfo *result = NULL;
     struct addrinfo hints;
@@ -175,7 +195,7 @@ int api_server_start(void)
 
 	apisrv_setup_io(&m_io);
 
-	ret = -1;
+	ret = 0;
 	do {
 		// Accept a client socket
 		ClientSocket = accept(ListenSocket, NULL, NULL);
@@ -183,8 +203,15 @@ int api_server_start(void)
 			printf("accept failed with error: %d\n", WSAGetLastError());
 			continue;
 		}
-		ret = apisrv_serve((int)ClientSocket, &m_api);
-		closesocket(ClientSocket);
+		// connections are persistent, serve each one in its own thread
+		hThread = CreateThread(NULL, 0, client_thread_fn, (LPVOID)ClientSocket, 0, NULL);
+		if (hThread == NULL) {
+			printf("CreateThread failed with error: %d\n", GetLastError());
+			closesocket(ClientSocket);
+		}
+		else {
+			CloseHandle(hThread);
+		}
 	} while (ret >= 0);
 
 ext:
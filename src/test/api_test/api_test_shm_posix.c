@@ -0,0 +1,524 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file api_test_shm_posix.c
+ * \brief shared memory transport of API test server/client on the same host
+ *
+ * The server creates a shared memory area with a number of connection slots,
+ * each slot has two byte rings: client to server and server to client.
+ * A client claims a free slot and rings the server's doorbell (futex), the
+ * server then serves the slot with a dedicated thread until the client closes it.
+ *
+ * Message pieces are copied straight between caller's buffers and the ring,
+ * no socket buffers in between, and CRC is not calculated (APISRV_IO_NO_CRC).
+ * Ring readers/writers sleep on futex only when the ring is empty/full.
+ */
+
+#include "uffs/uffs_types.h"
+#include "uffs/uffs_fd.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "api_test.h"
+
+#define SHM_NAME_FMT		"/uffs_apisrv_%d"	// with server port
+#define SHM_MAGIC			0x55465353			// "UFSS"
+#define SHM_MAX_CONN		16
+#define SHM_RING_SIZE		(256 * 1024)		// must be power of 2
+#define SHM_WAIT_MS			100					// check if peer is alive every 100ms when waiting
+#define SHM_CONNECT_TIMEOUT	(3000 / SHM_WAIT_MS)
+
+// slot states
+#define SLOT_FREE			0
+#define SLOT_CLAIMED		1	// claimed by client, being set up
+#define SLOT_CONNECT		2	// wait for server to accept
+#define SLOT_OPEN			3
+
+struct shm_ring {
+	volatile u32 head;		// write position, changed by writer only
+	volatile u32 tail;		// read position, changed by reader only
+	volatile u32 rd_wait;	// reader is waiting on 'head'
+	volatile u32 wr_wait;	// writer is waiting on 'tail'
+	u8 data[SHM_RING_SIZE];
+};
+
+struct shm_conn {
+	volatile u32 state;		// SLOT_xxx
+	volatile u32 client_pid;
+	volatile u32 closed;	// number of sides closed, slot is free again when both closed
+	volatile u32 client_closed;
+	volatile u32 server_closed;
+	struct shm_ring c2s;	// client to server
+	struct shm_ring s2c;	// server to client
+};
+
+struct shm_area {
+	u32 magic;
+	volatile u32 server_pid;
+	volatile u32 accept_seq;	// server doorbell, increased by client after claimed a slot
+	struct shm_conn conn[SHM_MAX_CONN];
+};
+
+#define ATOMIC_GET(p)		__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ATOMIC_SET(p, v)	__atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(p, n)	__atomic_add_fetch((p), (n), __ATOMIC_SEQ_CST)
+#define ATOMIC_CAS(p, e, d)	__sync_bool_compare_and_swap((p), (e), (d))
+
+static int shm_port(void)
+{
+	return getenv("UFFS_TEST_SRV_PORT") ? atoi(getenv("UFFS_TEST_SRV_PORT")) : SRV_PORT;
+}
+
+static void futex_wait(volatile u32 *addr, u32 val, int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void futex_wake(volatile u32 *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, 0x7FFFFFFF, NULL, NULL, 0);
+}
+
+static int pid_alive(u32 pid)
+{
+	return (pid != 0 && (kill((pid_t)pid, 0) == 0 || errno != ESRCH));
+}
+
+static struct shm_area * shm_map(int create)
+{
+	char name[64];
+	struct shm_area *area;
+	int fd;
+
+	sprintf(name, SHM_NAME_FMT, shm_port());
+
+	if (create) {
+		shm_unlink(name);	// remove the one left by a dead server
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	}
+	else {
+		fd = shm_open(name, O_RDWR, 0);
+	}
+	if (fd < 0) {
+		perror("shm_open() error");
+		return NULL;
+	}
+
+	if (create && ftruncate(fd, sizeof(struct shm_area)) < 0) {
+		perror("ftruncate() error");
+		close(fd);
+		return NULL;
+	}
+
+	area = (struct shm_area *)mmap(NULL, sizeof(struct shm_area), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (area == MAP_FAILED) {
+		perror("mmap() error");
+		return NULL;
+	}
+
+	if (create) {
+		area->magic = SHM_MAGIC;
+		ATOMIC_SET(&area->server_pid, (u32)getpid());
+	}
+	else if (area->magic != SHM_MAGIC || !pid_alive(ATOMIC_GET(&area->server_pid))) {
+		printf("shm: no server at %s\n", name);
+		munmap(area, sizeof(struct shm_area));
+		return NULL;
+	}
+
+	return area;
+}
+
+/**
+ * read 'len' bytes from ring, wait for data if ring is empty.
+ * return bytes read, less than 'len' (0 for nothing) if the peer closed the connection,
+ * or -1 if the peer is dead.
+ */
+static int ring_read(struct shm_ring *ring, volatile u32 *peer_closed, volatile u32 *peer_pid,
+						void *buf, int len)
+{
+	u8 *p = (u8 *)buf;
+	u32 head, tail, n, ofs;
+	int got = 0;
+
+	tail = ring->tail;
+	while (got < len) {
+		head = ATOMIC_GET(&ring->head);
+		if (head == tail) {
+			if (ATOMIC_GET(peer_closed))
+				break;
+			if (peer_pid && !pid_alive(ATOMIC_GET(peer_pid)))
+				return -1;
+			ATOMIC_SET(&ring->rd_wait, 1);
+			if (ATOMIC_GET(&ring->head) == head)
+				futex_wait(&ring->head, head, SHM_WAIT_MS);
+			ATOMIC_SET(&ring->rd_wait, 0);
+			continue;
+		}
+
+		n = head - tail;
+		if (n > (u32)(len - got))
+			n = len - got;
+		ofs = tail & (SHM_RING_SIZE - 1);
+		if (n > SHM_RING_SIZE - ofs)
+			n = SHM_RING_SIZE - ofs;
+		memcpy(p + got, ring->data + ofs, n);
+		got += n;
+		tail += n;
+
+		ATOMIC_SET(&ring->tail, tail);
+		if (ATOMIC_GET(&ring->wr_wait))
+			futex_wake(&ring->tail);
+	}
+
+	return got;
+}
+
+/**
+ * write all pieces to ring, wait for space if ring is full.
+ * return bytes written, or -1 if the peer closed the connection or is dead.
+ */
+static int ring_writev(struct shm_ring *ring, volatile u32 *peer_closed, volatile u32 *peer_pid,
+						const struct uffs_iovec *iov, int iovcnt)
+{
+	u32 head, tail, n, ofs;
+	int i, done, sent = 0;
+
+	head = ring->head;
+	for (i = 0; i < iovcnt; i++) {
+		done = 0;
+		while (done < iov[i].iov_len) {
+			if (ATOMIC_GET(peer_closed))
+				return -1;
+
+			tail = ATOMIC_GET(&ring->tail);
+			if (head - tail == SHM_RING_SIZE) {
+				// full, publish what we have and wait for reader
+				if (peer_pid && !pid_alive(ATOMIC_GET(peer_pid)))
+					return -1;
+				ATOMIC_SET(&ring->wr_wait, 1);
+				if (ATOMIC_GET(&ring->tail) == tail)
+					futex_wait(&ring->tail, tail, SHM_WAIT_MS);
+				ATOMIC_SET(&ring->wr_wait, 0);
+				continue;
+			}
+
+			n = SHM_RING_SIZE - (head - tail);
+			if (n > (u32)(iov[i].iov_len - done))
+				n = iov[i].iov_len - done;
+			ofs = head & (SHM_RING_SIZE - 1);
+			if (n > SHM_RING_SIZE - ofs)
+				n = SHM_RING_SIZE - ofs;
+			memcpy(ring->data + ofs, (const u8 *)iov[i].iov_base + done, n);
+			done += n;
+			head += n;
+
+			ATOMIC_SET(&ring->head, head);
+			if (ATOMIC_GET(&ring->rd_wait))
+				futex_wake(&ring->head);
+		}
+		sent += done;
+	}
+
+	return sent;
+}
+
+// one side closed the connection, the slot is free again when both sides closed.
+static void conn_close(struct shm_conn *conn, volatile u32 *my_closed)
+{
+	ATOMIC_SET(my_closed, 1);
+
+	// wake up the peer if it's waiting
+	futex_wake(&conn->c2s.head);
+	futex_wake(&conn->c2s.tail);
+	futex_wake(&conn->s2c.head);
+	futex_wake(&conn->s2c.tail);
+
+	if (ATOMIC_ADD(&conn->closed, 1) == 2)
+		ATOMIC_SET(&conn->state, SLOT_FREE);
+}
+
+static void conn_reset(struct shm_conn *conn)
+{
+	conn->c2s.head = conn->c2s.tail = 0;
+	conn->s2c.head = conn->s2c.tail = 0;
+	conn->c2s.rd_wait = conn->c2s.wr_wait = 0;
+	conn->s2c.rd_wait = conn->s2c.wr_wait = 0;
+	conn->client_closed = 0;
+	conn->server_closed = 0;
+	conn->closed = 0;
+}
+
+
+/************************ server side ************************/
+
+static struct shm_area *m_srv_area = NULL;
+static struct uffs_ApiSt *m_srv_api = NULL;
+static int m_srv_conn_total = 0;
+static int m_srv_conn_active = 0;
+
+static int _srv_read(int fd, void *buf, int len)
+{
+	struct shm_conn *conn = &m_srv_area->conn[fd];
+
+	return ring_read(&conn->c2s, &conn->client_closed, &conn->client_pid, buf, len);
+}
+
+static int _srv_writev(int fd, const struct uffs_iovec *iov, int iovcnt)
+{
+	struct shm_conn *conn = &m_srv_area->conn[fd];
+
+	return ring_writev(&conn->s2c, &conn->client_closed, &conn->client_pid, iov, iovcnt);
+}
+
+static int _srv_write(int fd, const void *buf, int len)
+{
+	struct uffs_iovec iov;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+
+	return _srv_writev(fd, &iov, 1);
+}
+
+static int _srv_close(int fd)
+{
+	struct shm_conn *conn = &m_srv_area->conn[fd];
+
+	conn_close(conn, &conn->server_closed);
+
+	return 0;
+}
+
+static struct uffs_ApiSrvIoSt m_srv_io = {
+	.read = _srv_read,
+	.write = _srv_write,
+	.close = _srv_close,
+	.writev = _srv_writev,
+	.flags = APISRV_IO_NO_CRC,
+};
+
+static void * shm_conn_thread_fn(void *param)
+{
+	int fd = (int)(size_t)param;
+	struct shm_conn *conn = &m_srv_area->conn[fd];
+
+	apisrv_serve_io(fd, &m_srv_io, m_srv_api);
+
+	// client is gone without closing the connection
+	if (!ATOMIC_GET(&conn->client_closed) && !pid_alive(ATOMIC_GET(&conn->client_pid)))
+		conn_close(conn, &conn->client_closed);
+
+	_srv_close(fd);
+	ATOMIC_ADD(&m_srv_conn_active, -1);
+
+	return NULL;
+}
+
+static void * shm_accept_thread_fn(void *param)
+{
+	struct shm_area *area = m_srv_area;
+	pthread_t thread;
+	u32 seq;
+	int i;
+
+	while (1) {
+		seq = ATOMIC_GET(&area->accept_seq);
+
+		for (i = 0; i < SHM_MAX_CONN; i++) {
+			if (!ATOMIC_CAS(&area->conn[i].state, SLOT_CONNECT, SLOT_OPEN))
+				continue;
+
+			ATOMIC_ADD(&m_srv_conn_total, 1);
+			ATOMIC_ADD(&m_srv_conn_active, 1);
+			if (pthread_create(&thread, NULL, shm_conn_thread_fn, (void *)(size_t)i) != 0) {
+				perror("create shm connection thread error");
+				ATOMIC_ADD(&m_srv_conn_active, -1);
+				_srv_close(i);
+			}
+			else {
+				pthread_detach(thread);
+			}
+			futex_wake(&area->conn[i].state);
+		}
+
+		futex_wait(&area->accept_seq, seq, 1000);
+	}
+
+	return param;
+}
+
+/**
+ * create shared memory area and start accepting clients on the same host.
+ */
+int apisrv_shm_server_start(struct uffs_ApiSt *api)
+{
+	pthread_t thread;
+
+	m_srv_api = api;
+	m_srv_area = shm_map(1);
+	if (m_srv_area == NULL)
+		return -1;
+
+	if (pthread_create(&thread, NULL, shm_accept_thread_fn, NULL) != 0) {
+		perror("create shm accept thread error");
+		return -1;
+	}
+	pthread_detach(thread);
+
+	return 0;
+}
+
+void apisrv_shm_print_stat(void)
+{
+	if (m_srv_area)
+		printf("Shm connections: %d active, %d total\n",
+				ATOMIC_GET(&m_srv_conn_active), ATOMIC_GET(&m_srv_conn_total));
+}
+
+
+/************************ client side ************************/
+
+static pthread_mutex_t m_cli_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct shm_area *m_cli_area = NULL;
+
+static int _cli_open(void *addr)
+{
+	struct shm_area *area;
+	struct shm_conn *conn;
+	int i, wait;
+
+	pthread_mutex_lock(&m_cli_lock);
+	if (m_cli_area == NULL)
+		m_cli_area = shm_map(0);
+	area = m_cli_area;
+	pthread_mutex_unlock(&m_cli_lock);
+
+	if (area == NULL)
+		return -1;
+
+	for (i = 0; i < SHM_MAX_CONN; i++) {
+		if (ATOMIC_CAS(&area->conn[i].state, SLOT_FREE, SLOT_CLAIMED))
+			break;
+	}
+	if (i == SHM_MAX_CONN) {
+		printf("shm: no free connection slot\n");
+		return -1;
+	}
+
+	conn = &area->conn[i];
+	conn_reset(conn);
+	ATOMIC_SET(&conn->client_pid, (u32)getpid());
+	ATOMIC_SET(&conn->state, SLOT_CONNECT);
+
+	ATOMIC_ADD(&area->accept_seq, 1);
+	futex_wake(&area->accept_seq);
+
+	for (wait = 0; ATOMIC_GET(&conn->state) == SLOT_CONNECT; wait++) {
+		if (wait > SHM_CONNECT_TIMEOUT || !pid_alive(ATOMIC_GET(&area->server_pid))) {
+			printf("shm: server not responding\n");
+			// give the slot back, unless server just accepted it
+			if (ATOMIC_CAS(&conn->state, SLOT_CONNECT, SLOT_FREE))
+				return -1;
+			break;
+		}
+		futex_wait(&conn->state, SLOT_CONNECT, SHM_WAIT_MS);
+	}
+
+	return i;
+}
+
+static int _cli_read(int fd, void *buf, int len)
+{
+	struct shm_conn *conn = &m_cli_area->conn[fd];
+
+	return ring_read(&conn->s2c, &conn->server_closed, &m_cli_area->server_pid, buf, len);
+}
+
+static int _cli_writev(int fd, const struct uffs_iovec *iov, int iovcnt)
+{
+	struct shm_conn *conn = &m_cli_area->conn[fd];
+
+	return ring_writev(&conn->c2s, &conn->server_closed, &m_cli_area->server_pid, iov, iovcnt);
+}
+
+static int _cli_write(int fd, const void *buf, int len)
+{
+	struct uffs_iovec iov;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+
+	return _cli_writev(fd, &iov, 1);
+}
+
+static int _cli_close(int fd)
+{
+	struct shm_conn *conn = &m_cli_area->conn[fd];
+
+	conn_close(conn, &conn->client_closed);
+
+	return 0;
+}
+
+static struct uffs_ApiSrvIoSt m_cli_io = {
+	.open = _cli_open,
+	.read = _cli_read,
+	.write = _cli_write,
+	.close = _cli_close,
+	.addr = (void *)APISRV_SHM_ADDR,
+	.writev = _cli_writev,
+	.flags = APISRV_IO_NO_CRC,
+};
+
+struct uffs_ApiSrvIoSt * apisrv_shm_client_io(void)
+{
+	return &m_cli_io;
+}
@@ -0,0 +1,290 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file api_test_trace.c
+ * \brief record API calls served by API test server to a trace file
+ * \author Ricky Zheng
+ */
+#include <stdio.h>
+#include <string.h>
+#include "uffs/uffs_types.h"
+#include "uffs/uffs_os.h"
+#include "api_test.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+#define TRACE_LINE_MAX		1024
+
+struct trace_call {
+	u32 start;						//!< start time of the call
+	int valid;						//!< 'line' holds the call
+	char line[TRACE_LINE_MAX];		//!< "<start> <connection> <call> [<args> ...]"
+};
+
+static OSSEM m_lock = OSSEM_NOT_INITED;		// protects m_fp
+static FILE *m_fp = NULL;
+static u32 m_start_time = 0;
+static u32 m_calls = 0;
+
+// the call being served by current server thread
+static THREAD_LOCAL struct trace_call m_cur;
+
+// parameter 'n' of request message, NULL if not present or less than 'size' bytes
+static const u8 * req_param(const struct uffs_ApiSrvMsgSt *msg, u32 n, u32 size)
+{
+	const struct uffs_ApiSrvHeaderSt *header = &msg->header;
+	u32 i, ofs;
+
+	if (n >= header->n_params || header->param_size[n] < size)
+		return NULL;
+
+	for (i = 0, ofs = 0; i < n; i++)
+		ofs += header->param_size[i];
+
+	if (ofs + header->param_size[n] > header->data_len)
+		return NULL;
+
+	return msg->data + ofs;
+}
+
+static i32 req_int(const struct uffs_ApiSrvMsgSt *msg, u32 n)
+{
+	const u8 *p = req_param(msg, n, sizeof(i32));
+	i32 val = -1;
+
+	if (p)
+		memcpy(&val, p, sizeof(i32));
+
+	return val;
+}
+
+// append name parameter 'n' to 'buf', white spaces are replaced so that it's one token
+static int put_name(char *buf, int size, const struct uffs_ApiSrvMsgSt *msg, u32 n)
+{
+	const char *p = (const char *)req_param(msg, n, 1);
+	u32 max;
+	int i;
+
+	if (size <= 2)
+		return 0;
+
+	if (p == NULL) {
+		strcpy(buf, " ?");
+		return 2;
+	}
+
+	max = msg->header.param_size[n];
+	buf[0] = ' ';
+	for (i = 1; i < size - 1 && (u32)(i - 1) < max && p[i - 1] != '\0'; i++)
+		buf[i] = (p[i - 1] == ' ' || p[i - 1] == '\t' || p[i - 1] == '\n' || p[i - 1] == '\r') ? '?' : p[i - 1];
+	buf[i] = '\0';
+
+	return i;
+}
+
+static int put_ints(char *buf, int size, const struct uffs_ApiSrvMsgSt *msg, int n, const u32 *params)
+{
+	int i, len = 0;
+
+	for (i = 0; i < n && len < size; i++)
+		len += snprintf(buf + len, size - len, " %d", (int)req_int(msg, params[i]));
+
+	return len < size ? len : size - 1;
+}
+
+static void trace_begin(int fd, const struct uffs_ApiSrvMsgSt *msg)
+{
+	static const u32 p_fd[] = {1};
+	static const u32 p_fd_len[] = {1, 3};
+	static const u32 p_fd_len_ofs[] = {1, 3, 4};
+	static const u32 p_fd_arg2_3[] = {1, 2, 3};
+	static const u32 p_fd_arg2[] = {1, 2};
+	int cmd = UFFS_API_CMD(&msg->header);
+	const char *name = apisrv_cmd_name(cmd);
+	char *buf = m_cur.line;
+	int size = TRACE_LINE_MAX;
+	int len, i, total;
+	const u8 *p;
+
+	m_cur.start = uffs_GetCurTimeUs();
+	m_cur.valid = 1;
+
+	len = snprintf(buf, size, "%u %d %s", m_cur.start - m_start_time, fd, name ? name : "?");
+	if (len >= size) {
+		m_cur.valid = 0;
+		return;
+	}
+
+	// parameter 0 is the place holder of return value, request parameters start from 1
+	switch (cmd) {
+	case UFFS_API_OPEN_CMD:
+		len += put_name(buf + len, size - len, msg, 1);
+		if (len < size)
+			len += snprintf(buf + len, size - len, " 0x%x", (unsigned int)req_int(msg, 2));
+		break;
+	case UFFS_API_RENAME_CMD:
+		len += put_name(buf + len, size - len, msg, 1);
+		len += put_name(buf + len, size - len, msg, 2);
+		break;
+	case UFFS_API_REMOVE_CMD:
+	case UFFS_API_MKDIR_CMD:
+	case UFFS_API_RMDIR_CMD:
+	case UFFS_API_STAT_CMD:
+	case UFFS_API_LSTAT_CMD:
+	case UFFS_API_OPEN_DIR_CMD:
+	case UFFS_API_FORMAT_CMD:
+	case UFFS_API_SPACE_TOTAL_CMD:
+	case UFFS_API_SPACE_FREE_CMD:
+	case UFFS_API_SPACE_USED_CMD:
+	case UFFS_API_FLUSH_ALL_CMD:
+		len += put_name(buf + len, size - len, msg, 1);
+		break;
+	case UFFS_API_CLOSE_CMD:
+	case UFFS_API_FLUSH_CMD:
+	case UFFS_API_TELL_CMD:
+	case UFFS_API_EOF_CMD:
+	case UFFS_API_FSTAT_CMD:
+		len += put_ints(buf + len, size - len, msg, 1, p_fd);
+		break;
+	case UFFS_API_READ_CMD:
+	case UFFS_API_WRITE_CMD:
+		len += put_ints(buf + len, size - len, msg, 2, p_fd_len);
+		break;
+	case UFFS_API_PREAD_CMD:
+	case UFFS_API_PWRITE_CMD:
+		len += put_ints(buf + len, size - len, msg, 3, p_fd_len_ofs);
+		break;
+	case UFFS_API_SEEK_CMD:
+		len += put_ints(buf + len, size - len, msg, 3, p_fd_arg2_3);
+		break;
+	case UFFS_API_FTRUNCATE_CMD:
+	case UFFS_API_FALLOCATE_CMD:
+		len += put_ints(buf + len, size - len, msg, 2, p_fd_arg2);
+		break;
+	case UFFS_API_READV_CMD:
+	case UFFS_API_WRITEV_CMD:
+		// lengths of iov elements are parameter 3
+		p = req_param(msg, 3, 0);
+		for (i = 0, total = 0; p && (u32)(i + 1) * sizeof(i32) <= msg->header.param_size[3]; i++)
+			total += ((const i32 *)p)[i];
+		len += put_ints(buf + len, size - len, msg, 1, p_fd);
+		if (len < size)
+			len += snprintf(buf + len, size - len, " %d", total);
+		break;
+	case UFFS_API_BATCH_CMD:
+		len += put_ints(buf + len, size - len, msg, 1, p_fd);	// n ops
+		break;
+	default:
+		break;
+	}
+
+	if (len >= size)
+		m_cur.valid = 0;	// too long, drop it
+}
+
+static void trace_end(int fd, const struct uffs_ApiSrvMsgSt *msg)
+{
+	u32 elapsed;
+
+	if (!m_cur.valid)
+		return;
+
+	elapsed = uffs_GetCurTimeUs() - m_cur.start;
+	m_cur.valid = 0;
+
+	uffs_SemWait(m_lock);
+	if (m_fp) {
+		fprintf(m_fp, "%s = %d %d %u\n", m_cur.line, (int)msg->ret, (int)msg->header.err, elapsed);
+		m_calls++;
+	}
+	uffs_SemSignal(m_lock);
+}
+
+static struct uffs_ApiSrvTraceSt m_trace = {
+	trace_begin,
+	trace_end,
+};
+
+/**
+ * start recording calls served by API test server to 'file',
+ * a previous trace is stopped first.
+ * return 0 if succ, or -1 if failed to create the file.
+ */
+int apisrv_trace_start(const char *file)
+{
+	FILE *fp;
+
+	if (m_lock == OSSEM_NOT_INITED)
+		uffs_SemCreate(&m_lock);
+
+	apisrv_trace_stop();
+
+	fp = fopen(file, "w");
+	if (fp == NULL) {
+		printf("Can't create trace file %s\n", file);
+		return -1;
+	}
+
+	uffs_SemWait(m_lock);
+	m_fp = fp;
+	m_calls = 0;
+	m_start_time = uffs_GetCurTimeUs();
+	uffs_SemSignal(m_lock);
+
+	apisrv_set_trace(&m_trace);
+
+	return 0;
+}
+
+/**
+ * stop recording calls, close trace file.
+ */
+void apisrv_trace_stop(void)
+{
+	if (m_lock == OSSEM_NOT_INITED)
+		return;
+
+	apisrv_set_trace(NULL);
+
+	uffs_SemWait(m_lock);
+	if (m_fp) {
+		fclose(m_fp);
+		m_fp = NULL;
+		printf("API trace stopped, %u calls recorded.\n", m_calls);
+	}
+	uffs_SemSignal(m_lock);
+}
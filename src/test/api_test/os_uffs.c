@@ -51,22 +51,34 @@ on this file might be covered by the GNU General Public License.
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <sys/stat.h>
 
 #include "api_test.h"
 
+/*
+ * Two modes of operation:
+ *
+ *  - verify mode (UFFS_TEST_VERIFY=1): every operation is done on the unix
+ *    file, on UFFS and on a backup unix file under "bak/", results are
+ *    compared and any difference aborts the test. This is the mode for
+ *    running sqlite3 regression test cases.
+ *
+ *  - fast mode (default): data only goes to UFFS. The unix file is kept
+ *    open (sqlite3 needs the fd for locking and fstat()) and is resized to
+ *    follow the UFFS file, but its content is not written. Use this mode
+ *    for measuring sqlite3 throughput on UFFS.
+ */
+static int m_verify = 0;
 
-#if 1
 #define DBG(args...) \
 	do { \
-		printf(args); \
-		fflush(stdout); \
+		if (m_verify) { \
+			printf(args); \
+			fflush(stdout); \
+		} \
 	} while(0)
 
-#else
-#define DBG(...) do{}while(0)
-#endif
-
 #define ASSERT(cond, fmt, ...) \
 	do { \
 		if (!(cond)) { \
@@ -77,20 +89,22 @@ on this file might be covered by the GNU General Public License.
 		} \
 	} while (0)
 
-#define MAX_OPEN_FDS 50
+/*
+ * fd map, indexed by unix fd. Each entry has its own lock, held while
+ * an operation is in progress on the UFFS fd, so operations on different
+ * files don't serialise each other and close() can't pull the UFFS fd away
+ * from a reader.
+ */
+#define MAX_OPEN_FDS 1024
 struct fdmap_s {
-    int unix_fd;
-    int uffs_fd;
-	int bak_fd;
-	char name[256];
-    int valid;
+	pthread_mutex_t lock;
+	int valid;
+	int uffs_fd;
+	int bak_fd;				//!< backup unix fd, verify mode only
+	long size;				//!< size of the unix file, fast mode only
+	char *name;
 };
 static struct fdmap_s m_fdmap[MAX_OPEN_FDS];
-static struct fdmap_s m_fdmap_ext[MAX_OPEN_FDS];
-static pthread_mutex_t m_fdmap_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-#define LOCK() pthread_mutex_lock(&m_fdmap_mutex)
-#define UNLOCK() pthread_mutex_unlock(&m_fdmap_mutex)
 
 static const char * get_uffs_name(const char *unix_name)
 {
@@ -103,61 +117,60 @@ static const char * get_uffs_name(const char *unix_name)
 	return p;
 }
 
-#define FOR_EACH_FD(s, map, p) \
-	for (p = &map[0], s = &map[MAX_OPEN_FDS]; p < s; p++) \
-		if (p->valid)
+/** get the locked map entry of unix_fd, return NULL if unix_fd is not on UFFS */
+static struct fdmap_s * fdmap_get(int unix_fd)
+{
+	struct fdmap_s *p;
+
+	if (unix_fd < 0 || unix_fd >= MAX_OPEN_FDS)
+		return NULL;
 
+	p = &m_fdmap[unix_fd];
+	pthread_mutex_lock(&p->lock);
+	if (!p->valid) {
+		pthread_mutex_unlock(&p->lock);
+		return NULL;
+	}
 
-static void open_check_fd(int unix_fd, int uffs_fd, const char *unix_name)
+	return p;
+}
+
+static void fdmap_put(struct fdmap_s *p)
 {
-	int n = 0;
-	struct fdmap_s *s, *p;
+	if (p)
+		pthread_mutex_unlock(&p->lock);
+}
 
-	LOCK();
-	FOR_EACH_FD(s, m_fdmap, p) {
-		if (p->unix_fd == unix_fd &&
-				strcmp(p->name, unix_name) == 0)
-			n++;
-	}
-	FOR_EACH_FD(s, m_fdmap_ext, p) {
-		if (p->unix_fd == unix_fd &&
-				strcmp(p->name, unix_name) == 0)
+static void open_check_fd(int unix_fd, int uffs_fd, const char *unix_name)
+{
+	int i, n = 0;
+	struct fdmap_s *p;
+
+	for (i = 0; i < MAX_OPEN_FDS; i++) {
+		p = &m_fdmap[i];
+		pthread_mutex_lock(&p->lock);
+		if (p->valid && p->uffs_fd == uffs_fd &&
+				strcmp(get_uffs_name(p->name), get_uffs_name(unix_name)) == 0)
 			n++;
+		pthread_mutex_unlock(&p->lock);
 	}
-	UNLOCK();
-	ASSERT(n == 1, "unix fd %d (name= %s) have %d entries\n", unix_fd, unix_name, n);
-
-	if (uffs_fd >= 0) {
-		n = 0;
-		LOCK();
-		FOR_EACH_FD(s, m_fdmap, p) {
-			if (p->uffs_fd == uffs_fd &&
-					strcmp(get_uffs_name(p->name), get_uffs_name(unix_name)) == 0)
-				n++;
-		}
-		UNLOCK();
-		ASSERT(n == 1, "uffs fd %d (name = %s) have %d entries\n", uffs_fd, get_uffs_name(unix_name), n);
-	}
+	ASSERT(n == 1, "uffs fd %d (name = %s) have %d entries\n", uffs_fd, get_uffs_name(unix_name), n);
 }
 
 static void unlink_check_fd(const char *unix_name)
 {
-	struct fdmap_s *s, *p;
+	int i;
+	struct fdmap_s *p;
 
-	LOCK();
-	FOR_EACH_FD(s, m_fdmap, p) {
-		if (strcmp(p->name, unix_name) == 0) {
+	for (i = 0; i < MAX_OPEN_FDS; i++) {
+		p = &m_fdmap[i];
+		pthread_mutex_lock(&p->lock);
+		if (p->valid && strcmp(p->name, unix_name) == 0) {
 			// there file already open ? close it ...
 			DBG("WARNING: unlink %s, but file is not closed ?\n", unix_name);
 		}
+		pthread_mutex_unlock(&p->lock);
 	}
-	FOR_EACH_FD(s, m_fdmap_ext, p) {
-		if (strcmp(p->name, unix_name) == 0) {
-			DBG("WARNING: unlink %s, but file is not closed ?\n", unix_name);
-		}
-	}
-	UNLOCK();
-
 }
 
 // return 0 if not in skip table, else return non-zero. 
@@ -176,141 +189,93 @@ static int check_skip_tbl(const char *path)
 	return 0;	
 }
 
-static int unix2uffs(int unix_fd, int *uffs_fd, int *bak_fd)
+static int push_newfd(const char *unix_name, int unix_fd, int uffs_fd, int bak_fd, long size)
 {
-    int ret = -1;
-    struct fdmap_s *s, *p;
-
-    LOCK();
-	FOR_EACH_FD(s, m_fdmap, p) {
-        if (p->unix_fd == unix_fd) {
-			if (*uffs_fd)
-				*uffs_fd = p->uffs_fd;
-			if (bak_fd)
-				*bak_fd = p->bak_fd;
-			ret = 0;
-            break;
-        }
-    }
-    UNLOCK();
-
-    return ret;
-}
+	struct fdmap_s *p;
 
-static int push_newfd(const char *unix_name, int unix_fd, int uffs_fd, int bak_fd)
-{
-    int ret = -1;
-    struct fdmap_s *p, *end;
-
-    if (unix_fd < 0)
-        return -1;
-
-    if (uffs_fd >= 0) {
-        p = &m_fdmap[0];
-        end = &m_fdmap[MAX_OPEN_FDS];
-    }
-    else {
-        p = &m_fdmap_ext[0];
-        end = &m_fdmap_ext[MAX_OPEN_FDS];
-    }
-
-    LOCK();
-    while (p < end) {
-        if (!p->valid) {
-            p->unix_fd = unix_fd;
-            p->uffs_fd = uffs_fd;
-			p->bak_fd = bak_fd;
-			strcpy(p->name, unix_name);
-            p->valid = 1;
-            ret = 0;
-			DBG("push_newfd(unix_fd = %d, uffs_fd = %d, bak_fd = %d)\n", unix_fd, uffs_fd, bak_fd);
-            break;
-        }
-        p++;
-    }
-    UNLOCK();
-
-    return ret;
+	if (unix_fd < 0 || unix_fd >= MAX_OPEN_FDS)
+		return -1;
+
+	p = &m_fdmap[unix_fd];
+	pthread_mutex_lock(&p->lock);
+	ASSERT(!p->valid, "unix fd %d (name = %s) already in map as %s\n", unix_fd, unix_name, p->name);
+	p->uffs_fd = uffs_fd;
+	p->bak_fd = bak_fd;
+	p->size = size;
+	p->name = strdup(unix_name);
+	p->valid = 1;
+	pthread_mutex_unlock(&p->lock);
+
+	DBG("push_newfd(unix_fd = %d, uffs_fd = %d, bak_fd = %d)\n", unix_fd, uffs_fd, bak_fd);
+
+	return 0;
 }
 
-static int remove_fd(int unix_fd)
+/* fast mode: grow the unix file to follow UFFS file, so that fstat() gives the right size */
+static void sync_size(int fd, struct fdmap_s *p, long end)
 {
-    int ret = -1;
-    struct fdmap_s *s, *p;
-
-
-    LOCK();
-	FOR_EACH_FD(s, m_fdmap, p) {
-        if (p->unix_fd == unix_fd) {
-            p->valid = 0;
-            ret = 0;
-			DBG("remove_fd(unix_fd = %d), uffs_fd = %d, bak_fd = %d\n", unix_fd, p->uffs_fd, p->bak_fd);
-            break;
-        }
-    }
-
-    if (ret != 0) {
-		FOR_EACH_FD(s, m_fdmap_ext, p) {
-            if (p->unix_fd == unix_fd) {
-                p->valid = 0;
-                ret = 0;
-				DBG("remove_fd(unix_fd = %d), no uffs_fd\n", unix_fd);
-                break;
-            }
-        }
-    }
-
-    UNLOCK();
-
-    return ret;
+	if (end > p->size) {
+		if (ftruncate(fd, end) == 0)
+			p->size = end;
+	}
 }
 
 int os_open(const char *name, int flags, int mode)
 {
-    int fd = -1;
-    int uffs_fd = -1, uffs_flags = 0;
+	int fd = -1;
+	int uffs_fd = -1, uffs_flags = 0;
 	int bak_fd = -1;
+	long size = 0;
 	const char *p;
 	char bak_name[256] = {0};
+	struct stat sbuf;
 
-    fd = open(name, flags, mode);
+	fd = open(name, flags, mode);
 
-    if (check_skip_tbl(name) == 0 && fd >= 0) {
-        uffs_flags = 0;
-        if (flags & O_WRONLY) uffs_flags |= UO_WRONLY;
-        if (flags & O_RDWR) uffs_flags |= UO_RDWR;
-        if (flags & O_CREAT) uffs_flags |= UO_CREATE;
-        if (flags & O_TRUNC) uffs_flags |= UO_TRUNC;
-        if (flags & O_EXCL) uffs_flags |= UO_EXCL;
+	if (check_skip_tbl(name) == 0 && fd >= 0) {
+		uffs_flags = 0;
+		if (flags & O_WRONLY) uffs_flags |= UO_WRONLY;
+		if (flags & O_RDWR) uffs_flags |= UO_RDWR;
+		if (flags & O_CREAT) uffs_flags |= UO_CREATE;
+		if (flags & O_TRUNC) uffs_flags |= UO_TRUNC;
+		if (flags & O_EXCL) uffs_flags |= UO_EXCL;
 		
 		p = get_uffs_name(name);
 		uffs_fd = uffs_open(p, uffs_flags);
-		if (uffs_fd >= 0) {
+		if (uffs_fd >= 0 && m_verify) {
 			sprintf(bak_name, "bak%s", p);
 			bak_fd = open(bak_name, flags, mode);
 		}
 
 		// sqlite3 testing script might delete test.db file outside the control of sqlite lib, 
 		// so we need to detect that situation.
-		if ( /* strcmp(p, "/test.db") == 0 && */ uffs_fd >= 0 && (flags & O_CREAT)) {
-			ASSERT(bak_fd >= 0, "bak name = %s, bak fd = %d\n", bak_name, bak_fd); 
-			struct stat sbuf;
+		if (uffs_fd >= 0 && (flags & O_CREAT)) {
+			ASSERT(!m_verify || bak_fd >= 0, "bak name = %s, bak fd = %d\n", bak_name, bak_fd); 
 			if (fstat(fd, &sbuf) == 0 && sbuf.st_size == 0) {
 				// "test.db" file just been created, we should also do that on UFFS as well
 				uffs_ftruncate(uffs_fd, 0);
-				ftruncate(bak_fd, 0);
+				if (bak_fd >= 0)
+					ftruncate(bak_fd, 0);
 			}
 		}
-    }
 
-	if (fd > 0) {
-	    ASSERT(!push_newfd(name, fd, uffs_fd, bak_fd), "push_newfd(fd=%d, uffs_fd=%d, bak_fd=%d)\n", fd, uffs_fd, bak_fd);
-		open_check_fd(fd, uffs_fd, name);
+		if (uffs_fd >= 0 && !m_verify) {
+			size = uffs_seek(uffs_fd, 0, USEEK_END);
+			uffs_seek(uffs_fd, 0, USEEK_SET);
+			if (size < 0 || ftruncate(fd, size) != 0)
+				size = 0;
+		}
+	}
+
+	if (fd >= 0 && uffs_fd >= 0) {
+		ASSERT(!push_newfd(name, fd, uffs_fd, bak_fd, size), "push_newfd(fd=%d, uffs_fd=%d, bak_fd=%d)\n", fd, uffs_fd, bak_fd);
+		if (m_verify)
+			open_check_fd(fd, uffs_fd, name);
 	}
 
 	DBG("open(name = \"%s\", flags = 0x%x, mode = 0x%x) = %d %s\n", name, flags, mode, fd, uffs_fd >= 0 ? "U" : "");
 
-    return fd;
+	return fd;
 }
 
 int os_unlink(const char *name)
@@ -320,14 +285,22 @@ int os_unlink(const char *name)
 	char bak_name[256];
 
 	if (name) {
-		unlink_check_fd(name);
+		if (m_verify)
+			unlink_check_fd(name);
 		ret = unlink(name);
 		if (check_skip_tbl(name) == 0) {
 			p = get_uffs_name(name);
 			uffs_ret = uffs_remove(p);
-			sprintf(bak_name, "bak%s", p);
-			bak_ret = unlink(bak_name);
-			ASSERT(uffs_ret == ret && ret == bak_ret, "unlink(\"%s\"), unix return %d, uffs return %d, bak return %d\n", name, ret, uffs_ret, bak_ret);
+			if (m_verify) {
+				sprintf(bak_name, "bak%s", p);
+				bak_ret = unlink(bak_name);
+				ASSERT(uffs_ret == ret && ret == bak_ret, "unlink(\"%s\"), unix return %d, uffs return %d, bak return %d\n", name, ret, uffs_ret, bak_ret);
+			}
+			else {
+				ret = uffs_ret;
+				if (ret < 0)
+					errno = ENOENT;
+			}
 		}
 	}
 	DBG("unlink(name = \"%s\") = %d %s\n", name, ret, p ? "U" : "");
@@ -337,25 +310,29 @@ int os_unlink(const char *name)
 
 int os_close(int fd)
 {
-    int uffs_fd = -1, bak_fd = -1;
-    int ret = -1;
-
-    if (fd >= 0) {
-        unix2uffs(fd, &uffs_fd, &bak_fd);
-        if (uffs_fd >= 0) {
-            uffs_close(uffs_fd);
-        }
-		if (bak_fd >= 0)
-			close(bak_fd);
-
-		remove_fd(fd);
-        //ASSERT(!x, "remove_fd(%d) failed.\n", fd);
-        ret = close(fd);
-    }
+	int uffs_fd = -1;
+	int ret = -1;
+	struct fdmap_s *p;
+
+	if (fd >= 0) {
+		p = fdmap_get(fd);
+		if (p) {
+			uffs_fd = p->uffs_fd;
+			uffs_close(p->uffs_fd);
+			if (p->bak_fd >= 0)
+				close(p->bak_fd);
+			DBG("remove_fd(unix_fd = %d), uffs_fd = %d, bak_fd = %d\n", fd, p->uffs_fd, p->bak_fd);
+			free(p->name);
+			p->name = NULL;
+			p->valid = 0;
+			fdmap_put(p);
+		}
+		ret = close(fd);
+	}
 
 	DBG("close(fd = %d) = %d  %s\n", fd, ret, uffs_fd >= 0 ? "U" : "");
 
-    return ret;
+	return ret;
 }
 
 int os_read(int fd, void *buf, int len)
@@ -366,20 +343,26 @@ int os_read(int fd, void *buf, int len)
 	void *bak_buf = NULL;
 	int i;
 	unsigned char a,b,c;
+	struct fdmap_s *p;
 
 	if (fd >= 0) {
-		unix2uffs(fd, &uffs_fd, &bak_fd);
-		if (uffs_fd >= 0) {
+		p = fdmap_get(fd);
+		if (p && !m_verify) {
+			uffs_fd = p->uffs_fd;
+			ret = uffs_read(uffs_fd, buf, len);
+			if (ret < 0)
+				errno = EIO;
+		}
+		else if (p) {
+			uffs_fd = p->uffs_fd;
+			bak_fd = p->bak_fd;
 			uffs_buf = malloc(len);
 			bak_buf = malloc(len);
-			ASSERT(uffs_buf != NULL || bak_buf == NULL, "malloc(%d) failed.\n", len);
+			ASSERT(uffs_buf != NULL && bak_buf != NULL, "malloc(%d) failed.\n", len);
 			uffs_ret = uffs_read(uffs_fd, uffs_buf, len);
 			bak_ret = read(bak_fd, bak_buf, len);
-		}
-		ret = read(fd, buf, len);
-		if (uffs_fd >= 0) {
+			ret = read(fd, buf, len);
 			ASSERT(ret == uffs_ret && uffs_ret == bak_ret, "read(fd=%d/%d/%d,buf,len=%d), unix return %d, uffs return %d, bak return %d\n", fd, uffs_fd, bak_fd, len, ret, uffs_ret, bak_ret);
-			//assert(memcmp(buf, uffs_buf, len) == 0);	
 			if (ret > 0) {
 				if (memcmp(buf, uffs_buf, ret) != 0) {
 					DBG("ERR: read result different! from fd = %d/%d, len = %d, ret = %d\n", fd, uffs_fd, len, ret);
@@ -395,6 +378,10 @@ int os_read(int fd, void *buf, int len)
 				}
 			}
 		}
+		else {
+			ret = read(fd, buf, len);
+		}
+		fdmap_put(p);
 	}
 
 	if (uffs_buf)
@@ -412,18 +399,31 @@ int os_write(int fd, const void *buf, int len)
 {
 	int uffs_fd = -1, uffs_ret = -1, bak_fd = -1, bak_ret = -1;
 	int ret = -1;
+	struct fdmap_s *p;
 
 	if (fd >= 0) {
-		unix2uffs(fd, &uffs_fd, &bak_fd);
-		if (uffs_fd >= 0) {
+		p = fdmap_get(fd);
+		if (p && !m_verify) {
+			uffs_fd = p->uffs_fd;
+			ret = uffs_write(uffs_fd, buf, len);
+			if (ret < 0)
+				errno = EIO;
+			else
+				sync_size(fd, p, uffs_seek(uffs_fd, 0, USEEK_CUR));
+		}
+		else if (p) {
+			uffs_fd = p->uffs_fd;
+			bak_fd = p->bak_fd;
 			uffs_ret = uffs_write(uffs_fd, buf, len);
 			ASSERT(bak_fd >= 0, "uffs_fd = %d, bak_fd = %d\n", uffs_fd, bak_fd);
 			bak_ret = write(bak_fd, buf, len);
-		}
-		ret = write(fd, buf, len);
-		if (uffs_fd >= 0) {
+			ret = write(fd, buf, len);
 			ASSERT(ret == uffs_ret && ret == bak_ret, "write(fd=%d/%d/%d,buf,len=%d), unix return %d, uffs return %d, bak return %d\n", fd, uffs_fd, bak_fd, len, ret, uffs_ret, bak_ret);
 		}
+		else {
+			ret = write(fd, buf, len);
+		}
+		fdmap_put(p);
 	}
 
 	DBG("write(fd = %d, buf = {...}, len = %d) = %d  %s\n", fd, len, ret, uffs_fd >= 0 ? "U" : "");
@@ -437,10 +437,13 @@ int os_lseek(int fd, long offset, int origin)
 	int uffs_fd = -1, bak_fd = -1;
 	long uffs_ret = -1L, bak_ret = -1L;
 	int uffs_origin = 0;
+	struct fdmap_s *p;
 
 	if (fd >= 0) {
-		unix2uffs(fd, &uffs_fd, &bak_fd);
-		if (uffs_fd >= 0) {
+		p = fdmap_get(fd);
+		if (p) {
+			uffs_fd = p->uffs_fd;
+			bak_fd = p->bak_fd;
 			if (origin == SEEK_CUR)
 				uffs_origin = USEEK_CUR;
 			else if (origin == SEEK_SET)
@@ -449,14 +452,21 @@ int os_lseek(int fd, long offset, int origin)
 				uffs_origin = USEEK_END;
 
 			uffs_ret = uffs_seek(uffs_fd, offset, uffs_origin);
-			bak_ret = lseek(bak_fd, offset, origin);
 		}
 
-		ret = lseek(fd, offset, origin);
-
-		if (uffs_fd >= 0) {
-			ASSERT(ret == uffs_ret && ret == bak_ret, "lseek(fd=%d/%d/%d, offset=%ld, origin=%d), unix return %ld, uffs return %ld, bak return %ld\n", fd, uffs_fd, bak_fd, offset, origin, ret, uffs_ret, bak_ret);
+		if (p && !m_verify) {
+			ret = uffs_ret;
+			if (ret < 0)
+				errno = EINVAL;
 		}
+		else {
+			if (p)
+				bak_ret = lseek(bak_fd, offset, origin);
+			ret = lseek(fd, offset, origin);
+			if (p)
+				ASSERT(ret == uffs_ret && ret == bak_ret, "lseek(fd=%d/%d/%d, offset=%ld, origin=%d), unix return %ld, uffs return %ld, bak return %ld\n", fd, uffs_fd, bak_fd, offset, origin, ret, uffs_ret, bak_ret);
+		}
+		fdmap_put(p);
 	}
 
 	DBG("lseek(fd = %d, offset = %ld, origin = %d) = %ld  %s\n", fd, offset, origin, ret, uffs_fd >= 0 ? "U" : "");
@@ -466,33 +476,115 @@ int os_lseek(int fd, long offset, int origin)
 
 int os_pread(int fd, void *buf, int count, long offset)
 {
-	DBG("pread(fd = %d, buf = {...}, count = %d, offset = %ld)\n", fd, count, offset);
-	assert(0);
-	return pread(fd, buf, count, offset);
+	int uffs_fd = -1, uffs_ret = -1, bak_fd = -1, bak_ret = -1;
+	int ret = -1;
+	void *uffs_buf = NULL;
+	void *bak_buf = NULL;
+	struct fdmap_s *p;
+
+	if (fd >= 0) {
+		p = fdmap_get(fd);
+		if (p && !m_verify) {
+			uffs_fd = p->uffs_fd;
+			ret = uffs_pread(uffs_fd, buf, count, offset);
+			if (ret < 0)
+				errno = EIO;
+		}
+		else if (p) {
+			uffs_fd = p->uffs_fd;
+			bak_fd = p->bak_fd;
+			uffs_buf = malloc(count);
+			bak_buf = malloc(count);
+			ASSERT(uffs_buf != NULL && bak_buf != NULL, "malloc(%d) failed.\n", count);
+			uffs_ret = uffs_pread(uffs_fd, uffs_buf, count, offset);
+			bak_ret = pread(bak_fd, bak_buf, count, offset);
+			ret = pread(fd, buf, count, offset);
+			ASSERT(ret == uffs_ret && uffs_ret == bak_ret, "pread(fd=%d/%d/%d,buf,count=%d,offset=%ld), unix return %d, uffs return %d, bak return %d\n", fd, uffs_fd, bak_fd, count, offset, ret, uffs_ret, bak_ret);
+			if (ret > 0)
+				ASSERT(memcmp(buf, uffs_buf, ret) == 0, "pread result different! from fd = %d/%d, count = %d, offset = %ld\n", fd, uffs_fd, count, offset);
+		}
+		else {
+			ret = pread(fd, buf, count, offset);
+		}
+		fdmap_put(p);
+	}
+
+	if (uffs_buf)
+		free(uffs_buf);
+
+	if (bak_buf)
+		free(bak_buf);
+
+	DBG("pread(fd = %d, buf = {...}, count = %d, offset = %ld) = %d %s\n", fd, count, offset, ret, uffs_fd >= 0 ? "U" : "");
+
+	return ret;
 }
 
 int os_pwrite(int fd, const void *buf, int count, long offset)
 {
-	DBG("pwrite(fd = %d, buf = {..}, count = %d, offset = %ld)\n", fd, count, offset);
-	assert(0);
-	return pwrite(fd, buf, count, offset);
+	int uffs_fd = -1, uffs_ret = -1, bak_fd = -1, bak_ret = -1;
+	int ret = -1;
+	struct fdmap_s *p;
+
+	if (fd >= 0) {
+		p = fdmap_get(fd);
+		if (p && !m_verify) {
+			uffs_fd = p->uffs_fd;
+			ret = uffs_pwrite(uffs_fd, buf, count, offset);
+			if (ret < 0)
+				errno = EIO;
+			else
+				sync_size(fd, p, offset + ret);
+		}
+		else if (p) {
+			uffs_fd = p->uffs_fd;
+			bak_fd = p->bak_fd;
+			uffs_ret = uffs_pwrite(uffs_fd, buf, count, offset);
+			ASSERT(bak_fd >= 0, "uffs_fd = %d, bak_fd = %d\n", uffs_fd, bak_fd);
+			bak_ret = pwrite(bak_fd, buf, count, offset);
+			ret = pwrite(fd, buf, count, offset);
+			ASSERT(ret == uffs_ret && ret == bak_ret, "pwrite(fd=%d/%d/%d,buf,count=%d,offset=%ld), unix return %d, uffs return %d, bak return %d\n", fd, uffs_fd, bak_fd, count, offset, ret, uffs_ret, bak_ret);
+		}
+		else {
+			ret = pwrite(fd, buf, count, offset);
+		}
+		fdmap_put(p);
+	}
+
+	DBG("pwrite(fd = %d, buf = {...}, count = %d, offset = %ld) = %d  %s\n", fd, count, offset, ret, uffs_fd >= 0 ? "U" : "");
+
+	return ret;
 }
 
 int os_ftruncate(int fd, long length)
 {
 	int uffs_fd = -1, uffs_ret = -1, bak_fd = -1, bak_ret = -1;
 	int ret = -1;
+	struct fdmap_s *p;
 
 	if (fd >= 0) {
-		unix2uffs(fd, &uffs_fd, &bak_fd);
+		p = fdmap_get(fd);
 		ret = ftruncate(fd, length);
-		if (uffs_fd >= 0) {
+		if (p) {
+			uffs_fd = p->uffs_fd;
+			bak_fd = p->bak_fd;
 			uffs_ret = uffs_ftruncate(uffs_fd, length);
-			bak_ret = ftruncate(bak_fd, length);
-			ASSERT(ret == uffs_ret && ret == bak_ret,
-					"ftruncate(fd=%d/%d/%d, length=%ld), unix ret %d, uffs ret %d, bak ret %d\n",
-					fd, uffs_fd, bak_fd, length, ret, uffs_ret, bak_ret);
+			if (m_verify) {
+				bak_ret = ftruncate(bak_fd, length);
+				ASSERT(ret == uffs_ret && ret == bak_ret,
+						"ftruncate(fd=%d/%d/%d, length=%ld), unix ret %d, uffs ret %d, bak ret %d\n",
+						fd, uffs_fd, bak_fd, length, ret, uffs_ret, bak_ret);
+			}
+			else {
+				if (ret == 0)
+					p->size = length;
+				if (uffs_ret < 0) {
+					ret = uffs_ret;
+					errno = EIO;
+				}
+			}
 		}
+		fdmap_put(p);
 	}
 	DBG("ftruncate(fd = %d, length = %ld) = %d %s\n", fd, length, ret, uffs_fd >= 0 ? "U" : "");
 
@@ -514,19 +606,28 @@ int os_uffs_init(void)
 {
 	static int inited = 0;
 	const char *apisrv_addr;
+	const char *verify;
+	int i;
 
 	if (!inited) {
 		inited = 1;
-		memset(m_fdmap, 0, sizeof(m_fdmap));
-		memset(m_fdmap_ext, 0, sizeof(m_fdmap_ext));
+		for (i = 0; i < MAX_OPEN_FDS; i++) {
+			memset(&m_fdmap[i], 0, sizeof(m_fdmap[i]));
+			pthread_mutex_init(&m_fdmap[i].lock, NULL);
+		}
+
+		verify = getenv("UFFS_TEST_VERIFY");
+		m_verify = (verify != NULL && atoi(verify) != 0);
 
-		mkdir("bak", 0777);	// for mirroring UFFS 
+		if (m_verify)
+			mkdir("bak", 0777);	// for mirroring UFFS 
 
 		apisrv_addr = getenv("UFFS_TEST_SRV_ADDR");
 		if (apisrv_addr == NULL)
 			apisrv_addr = "127.0.0.1";
 
-		DBG("os_uffs_init() called, server addr: %s\n", apisrv_addr);
+		printf("os_uffs_init() called, server addr: %s, %s mode\n", apisrv_addr, m_verify ? "verify" : "fast");
+		fflush(stdout);
 	
 		return api_client_init(apisrv_addr);
 	}
@@ -0,0 +1,83 @@
+/*
+ * This is a APT test client example, batch of operations in one call
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uffs/uffs_fd.h"
+#include "api_test.h"
+
+
+int main(int argc, char *argv[])
+{
+	struct uffs_BatchSt b;
+	struct uffs_stat st;
+	char buf[128];
+	const char *msg = "Hello, this is batch test\n";
+	int len = strlen(msg);
+	int op_open, op_stat, op_read, op_bad, op_close;
+	int r, i, ok = 1;
+
+	api_client_init(argc > 1 ? argv[1] : "127.0.0.1");
+
+	// mkdir, create and write file, stat it: one round trip
+	uffs_batch_init(&b);
+	uffs_batch_mkdir(&b, "/batch");
+	op_open = uffs_batch_open(&b, "/batch/test.txt", UO_RDWR|UO_CREATE|UO_TRUNC);
+	uffs_batch_write(&b, UFFS_BATCH_FD(op_open), msg, len);
+	op_close = uffs_batch_close(&b, UFFS_BATCH_FD(op_open));
+	op_stat = uffs_batch_stat(&b, "/batch/test.txt", &st);
+	r = uffs_batch_run(&b);
+	if (r != b.n_ops) {
+		printf("batch 1 failed, %d ops executed\n", r);
+		return -1;
+	}
+	for (i = op_open; i <= op_close; i++) {
+		if (b.results[i].ret < 0) {
+			printf("batch 1 op %d failed, err %d\n", i, b.results[i].err);
+			ok = 0;
+		}
+	}
+	if (b.results[op_stat].ret != 0 || st.st_size != len) {
+		printf("batch 1 stat failed, ret %d, size %ld\n", b.results[op_stat].ret, st.st_size);
+		ok = 0;
+	}
+	uffs_batch_free(&b);
+
+	// read back, rename and clean up. an op using fd of a failed open fails with UEBADF.
+	memset(buf, 0, sizeof(buf));
+	uffs_batch_init(&b);
+	op_open = uffs_batch_open(&b, "/batch/test.txt", UO_RDONLY);
+	op_read = uffs_batch_pread(&b, UFFS_BATCH_FD(op_open), buf, sizeof(buf), 7);
+	uffs_batch_close(&b, UFFS_BATCH_FD(op_open));
+	uffs_batch_rename(&b, "/batch/test.txt", "/batch/test2.txt");
+	op_bad = uffs_batch_open(&b, "/batch/test.txt", UO_RDONLY);
+	op_bad = uffs_batch_read(&b, UFFS_BATCH_FD(op_bad), buf, sizeof(buf));
+	uffs_batch_remove(&b, "/batch/test2.txt");
+	uffs_batch_rmdir(&b, "/batch");
+	r = uffs_batch_run(&b);
+	if (r != b.n_ops) {
+		printf("batch 2 failed, %d ops executed\n", r);
+		return -1;
+	}
+	if (b.results[op_read].ret != len - 7 || memcmp(buf, msg + 7, len - 7) != 0) {
+		printf("batch 2 read failed, ret %d\n", b.results[op_read].ret);
+		ok = 0;
+	}
+	if (b.results[op_bad].ret >= 0 || b.results[op_bad].err != -UEBADF) {
+		printf("batch 2 op on failed open should fail, ret %d, err %d\n", b.results[op_bad].ret, b.results[op_bad].err);
+		ok = 0;
+	}
+	for (i = op_bad + 1; i < b.n_ops; i++) {
+		if (b.results[i].ret < 0) {
+			printf("batch 2 op %d failed, err %d\n", i, b.results[i].err);
+			ok = 0;
+		}
+	}
+	uffs_batch_free(&b);
+
+	printf(ok ? "everything is ok.\n" : "batch test failed.\n");
+
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,958 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file loadgen.c
+ * \brief load generator of API test server: concurrent clients running
+ *        a configurable mix of calls, or replaying a recorded trace.
+ * \author Ricky Zheng
+ */
+
+#include "uffs/uffs_fd.h"
+#include "api_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define MAX_CLIENTS			256
+#define MAX_FILES			256
+#define MAX_TRACE_CONNS		256
+#define MAX_FD_MAP			256
+#define NAME_MAX_LEN		256
+#define NUM_CMDS			(UFFS_API_CMD_LAST + 1)
+
+#define DEFAULT_SERVER		"127.0.0.1"
+#define DEFAULT_CLIENTS		4
+#define DEFAULT_DURATION	10
+#define DEFAULT_FILES		4
+#define DEFAULT_FILE_SIZE	(64 * 1024)
+#define DEFAULT_READ_SIZE	4096
+#define DEFAULT_WRITE_SIZE	4096
+#define DEFAULT_READ_PCT	70
+#define DEFAULT_META_PCT	10
+
+static const char *conf_server = DEFAULT_SERVER;
+static int conf_clients = DEFAULT_CLIENTS;
+static int conf_duration = DEFAULT_DURATION;
+static int conf_ops = 0;
+static int conf_files = DEFAULT_FILES;
+static int conf_file_size = DEFAULT_FILE_SIZE;
+static int conf_read_size = DEFAULT_READ_SIZE;
+static int conf_write_size = DEFAULT_WRITE_SIZE;
+static int conf_read_pct = DEFAULT_READ_PCT;
+static int conf_meta_pct = DEFAULT_META_PCT;
+static int conf_think_us = 0;
+static int conf_keep = 0;
+static const char *conf_trace = NULL;
+static double conf_speed = 1.0;
+static const char *conf_json = NULL;
+
+/** statistic of one kind of call */
+struct op_stat {
+	u32 count;
+	u32 errors;				//!< call failed
+	u32 mismatch;			//!< replay: failed or succeeded differently from the trace
+	long long bytes;		//!< bytes read or written
+	u32 *lat;				//!< latency (us) of each call
+	u32 lat_size;			//!< allocated entries of 'lat'
+};
+
+/** one call of a trace */
+struct trace_op {
+	long long start;		//!< start time (us) from beginning of trace
+	int cmd;				//!< UFFS_API_xxx_CMD
+	int args[3];
+	char *name;
+	char *name2;
+	int ret;				//!< recorded return value
+};
+
+/** a client thread */
+struct client {
+	int id;
+	pthread_t thread;
+	struct op_stat stat[NUM_CMDS];
+	u32 skipped;			//!< replay: calls not supported
+	u8 *buf;
+	int buf_size;
+	u32 seed;
+	int failed;
+
+	// replay: calls of one connection of the trace
+	int conn;
+	struct trace_op *ops;
+	int n_ops;
+	int ops_size;
+	int fd_map[MAX_FD_MAP][2];	//!< recorded fd -> fd of this run
+	int fd_map_n;
+};
+
+static struct client *m_clients = NULL;
+static int m_n_clients = 0;
+static long long m_start_time = 0;
+static long long m_elapsed = 0;
+static pthread_barrier_t m_start_barrier;	// clients and main thread
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// all clients start at the same time, after main thread sets 'm_start_time'
+static void wait_for_start(void)
+{
+	pthread_barrier_wait(&m_start_barrier);	// clients are ready
+	pthread_barrier_wait(&m_start_barrier);	// m_start_time is set
+}
+
+static u32 client_rand(struct client *c)
+{
+	c->seed = c->seed * 1103515245 + 12345;
+	return (c->seed >> 16) & 0x7FFF;
+}
+
+static int client_buf(struct client *c, int len)
+{
+	u8 *p;
+
+	if (len > c->buf_size) {
+		p = (u8 *)realloc(c->buf, len);
+		if (p == NULL) {
+			printf("malloc %d bytes failed.\n", len);
+			return -1;
+		}
+		memset(p + c->buf_size, 'L', len - c->buf_size);
+		c->buf = p;
+		c->buf_size = len;
+	}
+
+	return 0;
+}
+
+static void stat_add(struct op_stat *s, u32 lat, int failed, long long bytes)
+{
+	u32 *p;
+	u32 size;
+
+	if (s->count >= s->lat_size) {
+		size = s->lat_size ? s->lat_size * 2 : 1024;
+		p = (u32 *)realloc(s->lat, size * sizeof(u32));
+		if (p == NULL)
+			return;
+		s->lat = p;
+		s->lat_size = size;
+	}
+	s->lat[s->count++] = lat;
+	if (failed)
+		s->errors++;
+	else if (bytes > 0)
+		s->bytes += bytes;
+}
+
+/** perform one call, return value of the call */
+#define TIMED_CALL(c, cmd, bytes_expr, expr) \
+	do { \
+		long long __t = now_us(); \
+		ret = (expr); \
+		stat_add(&(c)->stat[cmd], (u32)(now_us() - __t), ret < 0, (bytes_expr)); \
+	} while (0)
+
+
+/*
+ * mix mode
+ */
+
+static int mix_setup(struct client *c, int *fds)
+{
+	char name[NAME_MAX_LEN];
+	int i, ofs, ret;
+
+	sprintf(name, "/lg%d", c->id);
+	uffs_mkdir(name);
+
+	for (i = 0; i < conf_files; i++) {
+		sprintf(name, "/lg%d/f%d", c->id, i);
+		fds[i] = uffs_open(name, UO_RDWR | UO_CREATE | UO_TRUNC);
+		if (fds[i] < 0) {
+			printf("client %d: can't create %s\n", c->id, name);
+			return -1;
+		}
+		for (ofs = 0; ofs < conf_file_size; ofs += ret) {
+			ret = uffs_write(fds[i], c->buf, conf_write_size < conf_file_size - ofs ?
+								conf_write_size : conf_file_size - ofs);
+			if (ret <= 0) {
+				printf("client %d: write %s failed\n", c->id, name);
+				return -1;
+			}
+		}
+		uffs_flush(fds[i]);
+	}
+
+	return 0;
+}
+
+static void mix_cleanup(struct client *c, int *fds)
+{
+	char name[NAME_MAX_LEN];
+	int i;
+
+	for (i = 0; i < conf_files; i++) {
+		if (fds[i] >= 0)
+			uffs_close(fds[i]);
+		if (!conf_keep) {
+			sprintf(name, "/lg%d/f%d", c->id, i);
+			uffs_remove(name);
+		}
+	}
+
+	if (!conf_keep) {
+		sprintf(name, "/lg%d/tmp", c->id);
+		uffs_remove(name);
+		sprintf(name, "/lg%d/tmp2", c->id);
+		uffs_remove(name);
+		sprintf(name, "/lg%d", c->id);
+		uffs_rmdir(name);
+	}
+}
+
+// metadata call: stat a file, or create/rename/remove the temp file in turn
+static void mix_meta_op(struct client *c, int *tmp_state)
+{
+	char name[NAME_MAX_LEN], name2[NAME_MAX_LEN];
+	struct uffs_stat st;
+	int ret, fd;
+
+	if (client_rand(c) % 2 == 0) {
+		sprintf(name, "/lg%d/f%d", c->id, (int)(client_rand(c) % conf_files));
+		TIMED_CALL(c, UFFS_API_STAT_CMD, 0, uffs_stat(name, &st));
+		return;
+	}
+
+	sprintf(name, "/lg%d/tmp", c->id);
+	sprintf(name2, "/lg%d/tmp2", c->id);
+
+	switch (*tmp_state) {
+	case 0:
+		TIMED_CALL(c, UFFS_API_OPEN_CMD, 0, uffs_open(name, UO_RDWR | UO_CREATE | UO_TRUNC));
+		if (ret >= 0) {
+			fd = ret;
+			TIMED_CALL(c, UFFS_API_CLOSE_CMD, 0, uffs_close(fd));
+		}
+		break;
+	case 1:
+		TIMED_CALL(c, UFFS_API_RENAME_CMD, 0, uffs_rename(name, name2));
+		break;
+	default:
+		TIMED_CALL(c, UFFS_API_REMOVE_CMD, 0, uffs_remove(name2));
+		break;
+	}
+	*tmp_state = (*tmp_state + 1) % 3;
+}
+
+static void mix_data_op(struct client *c, int *fds)
+{
+	int fd = fds[client_rand(c) % conf_files];
+	int ret, len, slots;
+	long ofs;
+
+	if ((int)(client_rand(c) % 100) < conf_read_pct) {
+		len = conf_read_size;
+		slots = conf_file_size > len ? conf_file_size / len : 1;
+		ofs = (long)(client_rand(c) % slots) * len;
+		TIMED_CALL(c, UFFS_API_PREAD_CMD, ret, uffs_pread(fd, c->buf, len, ofs));
+	}
+	else {
+		len = conf_write_size;
+		slots = conf_file_size > len ? conf_file_size / len : 1;
+		ofs = (long)(client_rand(c) % slots) * len;
+		TIMED_CALL(c, UFFS_API_PWRITE_CMD, ret, uffs_pwrite(fd, c->buf, len, ofs));
+	}
+}
+
+static void * mix_client_fn(void *param)
+{
+	struct client *c = (struct client *)param;
+	int fds[MAX_FILES];
+	int i, tmp_state = 0;
+	long long deadline;
+
+	for (i = 0; i < conf_files; i++)
+		fds[i] = -1;
+
+	if (client_buf(c, conf_read_size > conf_write_size ? conf_read_size : conf_write_size) < 0 ||
+		mix_setup(c, fds) < 0)
+		c->failed = 1;
+
+	wait_for_start();
+	if (c->failed)
+		goto ext;
+
+	deadline = m_start_time + (long long)conf_duration * 1000000;
+
+	for (i = 0; conf_ops > 0 ? i < conf_ops : now_us() < deadline; i++) {
+		if ((int)(client_rand(c) % 100) < conf_meta_pct)
+			mix_meta_op(c, &tmp_state);
+		else
+			mix_data_op(c, fds);
+
+		if (conf_think_us > 0)
+			usleep(conf_think_us);
+	}
+
+ext:
+	mix_cleanup(c, fds);
+	apisrv_client_disconnect();
+
+	return NULL;
+}
+
+
+/*
+ * replay mode
+ */
+
+// fds are mapped per connection: a connection only uses fds it opened
+static void fd_map_set(struct client *c, int rec_fd, int fd)
+{
+	int i;
+
+	for (i = 0; i < c->fd_map_n; i++) {
+		if (c->fd_map[i][0] == rec_fd)
+			break;
+	}
+	if (i < MAX_FD_MAP) {
+		c->fd_map[i][0] = rec_fd;
+		c->fd_map[i][1] = fd;
+		if (i == c->fd_map_n)
+			c->fd_map_n++;
+	}
+}
+
+static int fd_map_get(struct client *c, int rec_fd)
+{
+	int i;
+
+	for (i = 0; i < c->fd_map_n; i++) {
+		if (c->fd_map[i][0] == rec_fd)
+			return c->fd_map[i][1];
+	}
+
+	return -1;
+}
+
+static struct client * replay_client_of_conn(int conn)
+{
+	struct client *c;
+	int i;
+
+	for (i = 0; i < m_n_clients; i++) {
+		if (m_clients[i].conn == conn)
+			return &m_clients[i];
+	}
+
+	if (m_n_clients >= MAX_TRACE_CONNS) {
+		printf("Too many connections in trace, max %d\n", MAX_TRACE_CONNS);
+		return NULL;
+	}
+
+	c = &m_clients[m_n_clients];
+	memset(c, 0, sizeof(struct client));
+	c->id = m_n_clients++;
+	c->conn = conn;
+
+	return c;
+}
+
+static int replay_cmd_of_name(const char *name)
+{
+	int cmd;
+	const char *p;
+
+	for (cmd = 0; cmd < NUM_CMDS; cmd++) {
+		p = apisrv_cmd_name(cmd);
+		if (p && strcmp(p, name) == 0)
+			return cmd;
+	}
+
+	return -1;
+}
+
+// parse "<start> <conn> <call> [<args> ...] = <ret> <err> <latency>"
+static int replay_parse_line(char *line, int line_no)
+{
+	char *tok[16];
+	int n = 0, eq = -1, i, nargs;
+	struct client *c;
+	struct trace_op *op;
+	int cmd;
+
+	for (tok[n] = strtok(line, " \t\r\n"); tok[n] && n < 15; tok[n] = strtok(NULL, " \t\r\n")) {
+		if (strcmp(tok[n], "=") == 0 && eq < 0)
+			eq = n;
+		n++;
+	}
+
+	if (n == 0 || tok[0][0] == '#')
+		return 0;
+
+	if (n < 3 || eq < 3 || eq + 1 >= n) {
+		printf("Trace line %d: invalid format\n", line_no);
+		return -1;
+	}
+
+	cmd = replay_cmd_of_name(tok[2]);
+	if (cmd < 0) {
+		printf("Trace line %d: unknown call '%s'\n", line_no, tok[2]);
+		return -1;
+	}
+
+	c = replay_client_of_conn(atoi(tok[1]));
+	if (c == NULL)
+		return -1;
+
+	if (c->n_ops >= c->ops_size) {
+		c->ops_size = c->ops_size ? c->ops_size * 2 : 256;
+		c->ops = (struct trace_op *)realloc(c->ops, c->ops_size * sizeof(struct trace_op));
+		if (c->ops == NULL) {
+			printf("Out of memory\n");
+			return -1;
+		}
+	}
+
+	op = &c->ops[c->n_ops++];
+	memset(op, 0, sizeof(struct trace_op));
+	op->start = atoll(tok[0]);
+	op->cmd = cmd;
+	op->ret = atoi(tok[eq + 1]);
+
+	// arguments are names or integers, see api_test.h
+	nargs = eq - 3;
+	i = 3;
+	switch (cmd) {
+	case UFFS_API_OPEN_CMD:
+		if (nargs >= 2) {
+			op->name = strdup(tok[3]);
+			op->args[0] = (int)strtol(tok[4], NULL, 0);
+		}
+		break;
+	case UFFS_API_RENAME_CMD:
+		if (nargs >= 2) {
+			op->name = strdup(tok[3]);
+			op->name2 = strdup(tok[4]);
+		}
+		break;
+	case UFFS_API_REMOVE_CMD:
+	case UFFS_API_MKDIR_CMD:
+	case UFFS_API_RMDIR_CMD:
+	case UFFS_API_STAT_CMD:
+	case UFFS_API_LSTAT_CMD:
+	case UFFS_API_SPACE_TOTAL_CMD:
+	case UFFS_API_SPACE_FREE_CMD:
+	case UFFS_API_SPACE_USED_CMD:
+		if (nargs >= 1)
+			op->name = strdup(tok[3]);
+		break;
+	default:
+		for (; i < eq && i - 3 < 3; i++)
+			op->args[i - 3] = (int)strtol(tok[i], NULL, 0);
+		break;
+	}
+
+	return 0;
+}
+
+static int replay_load(const char *file)
+{
+	FILE *fp;
+	char line[2048];
+	int line_no = 0, ret = 0, total = 0, i;
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		printf("Can't open trace file %s\n", file);
+		return -1;
+	}
+
+	while (ret == 0 && fgets(line, sizeof(line), fp))
+		ret = replay_parse_line(line, ++line_no);
+
+	fclose(fp);
+
+	for (i = 0; i < m_n_clients; i++)
+		total += m_clients[i].n_ops;
+	printf("Trace %s: %d calls, %d connections\n", file, total, m_n_clients);
+
+	return ret;
+}
+
+// replay one call, return 0 if done, 1 if skipped
+static int replay_op(struct client *c, struct trace_op *op)
+{
+	struct uffs_stat st;
+	int ret = -1, fd = -1, len;
+	int cmd = op->cmd;
+
+	switch (cmd) {
+	case UFFS_API_CLOSE_CMD:
+	case UFFS_API_READ_CMD:
+	case UFFS_API_WRITE_CMD:
+	case UFFS_API_FLUSH_CMD:
+	case UFFS_API_SEEK_CMD:
+	case UFFS_API_TELL_CMD:
+	case UFFS_API_EOF_CMD:
+	case UFFS_API_FTRUNCATE_CMD:
+	case UFFS_API_FSTAT_CMD:
+	case UFFS_API_PREAD_CMD:
+	case UFFS_API_PWRITE_CMD:
+	case UFFS_API_READV_CMD:
+	case UFFS_API_WRITEV_CMD:
+	case UFFS_API_FALLOCATE_CMD:
+		fd = fd_map_get(c, op->args[0]);
+		break;
+	default:
+		break;
+	}
+
+	switch (cmd) {
+	case UFFS_API_READ_CMD:
+	case UFFS_API_WRITE_CMD:
+	case UFFS_API_PREAD_CMD:
+	case UFFS_API_PWRITE_CMD:
+	case UFFS_API_READV_CMD:
+	case UFFS_API_WRITEV_CMD:
+		len = op->args[1] > 0 ? op->args[1] : 0;
+		if (client_buf(c, len > 0 ? len : 1) < 0)
+			return 1;
+		break;
+	default:
+		len = 0;
+		break;
+	}
+
+	switch (cmd) {
+	case UFFS_API_GET_VER_CMD:
+		TIMED_CALL(c, cmd, 0, uffs_version());
+		break;
+	case UFFS_API_OPEN_CMD:
+		if (op->name == NULL)
+			return 1;
+		TIMED_CALL(c, cmd, 0, uffs_open(op->name, op->args[0]));
+		if (ret >= 0 && op->ret >= 0)
+			fd_map_set(c, op->ret, ret);
+		break;
+	case UFFS_API_CLOSE_CMD:
+		TIMED_CALL(c, cmd, 0, uffs_close(fd));
+		break;
+	case UFFS_API_READ_CMD:
+	case UFFS_API_READV_CMD:
+		// readv is replayed as read of the total length
+		TIMED_CALL(c, cmd, ret, uffs_read(fd, c->buf, len));
+		break;
+	case UFFS_API_WRITE_CMD:
+	case UFFS_API_WRITEV_CMD:
+		TIMED_CALL(c, cmd, ret, uffs_write(fd, c->buf, len));
+		break;
+	case UFFS_API_PREAD_CMD:
+		TIMED_CALL(c, cmd, ret, uffs_pread(fd, c->buf, len, op->args[2]));
+		break;
+	case UFFS_API_PWRITE_CMD:
+		TIMED_CALL(c, cmd, ret, uffs_pwrite(fd, c->buf, len, op->args[2]));
+		break;
+	case UFFS_API_FLUSH_CMD:
+		TIMED_CALL(c, cmd, 0, uffs_flush(fd));
+		break;
+	case UFFS_API_SEEK_CMD:
+		TIMED_CALL(c, cmd, 0, (int)uffs_seek(fd, op->args[1], op->args[2]));
+		break;
+	case UFFS_API_TELL_CMD:
+		TIMED_CALL(c, cmd, 0, (int)uffs_tell(fd));
+		break;
+	case UFFS_API_EOF_CMD:
+		TIMED_CALL(c, cmd, 0, uffs_eof(fd));
+		break;
+	case UFFS_API_FTRUNCATE_CMD:
+		TIMED_CALL(c, cmd, 0, uffs_ftruncate(fd, op->args[1]));
+		break;
+	case UFFS_API_FALLOCATE_CMD:
+		TIMED_CALL(c, cmd, 0, uffs_fallocate(fd, op->args[1]));
+		break;
+	case UFFS_API_FSTAT_CMD:
+		TIMED_CALL(c, cmd, 0, uffs_fstat(fd, &st));
+		break;
+	case UFFS_API_RENAME_CMD:
+		if (op->name == NULL || op->name2 == NULL)
+			return 1;
+		TIMED_CALL(c, cmd, 0, uffs_rename(op->name, op->name2));
+		break;
+	case UFFS_API_REMOVE_CMD:
+	case UFFS_API_MKDIR_CMD:
+	case UFFS_API_RMDIR_CMD:
+	case UFFS_API_STAT_CMD:
+	case UFFS_API_LSTAT_CMD:
+		if (op->name == NULL)
+			return 1;
+		if (cmd == UFFS_API_REMOVE_CMD)
+			TIMED_CALL(c, cmd, 0, uffs_remove(op->name));
+		else if (cmd == UFFS_API_MKDIR_CMD)
+			TIMED_CALL(c, cmd, 0, uffs_mkdir(op->name));
+		else if (cmd == UFFS_API_RMDIR_CMD)
+			TIMED_CALL(c, cmd, 0, uffs_rmdir(op->name));
+		else if (cmd == UFFS_API_STAT_CMD)
+			TIMED_CALL(c, cmd, 0, uffs_stat(op->name, &st));
+		else
+			TIMED_CALL(c, cmd, 0, uffs_lstat(op->name, &st));
+		break;
+	case UFFS_API_SPACE_TOTAL_CMD:
+	case UFFS_API_SPACE_FREE_CMD:
+	case UFFS_API_SPACE_USED_CMD:
+		if (op->name == NULL)
+			return 1;
+		if (cmd == UFFS_API_SPACE_TOTAL_CMD)
+			TIMED_CALL(c, cmd, 0, (int)uffs_space_total(op->name));
+		else if (cmd == UFFS_API_SPACE_FREE_CMD)
+			TIMED_CALL(c, cmd, 0, (int)uffs_space_free(op->name));
+		else
+			TIMED_CALL(c, cmd, 0, (int)uffs_space_used(op->name));
+		break;
+	default:
+		// directory handles, error number, format and batch are not replayed
+		return 1;
+	}
+
+	if ((ret < 0) != (op->ret < 0))
+		c->stat[cmd].mismatch++;
+
+	return 0;
+}
+
+static void * replay_client_fn(void *param)
+{
+	struct client *c = (struct client *)param;
+	struct trace_op *op;
+	long long due;
+	int i;
+
+	wait_for_start();
+
+	for (i = 0; i < c->n_ops; i++) {
+		op = &c->ops[i];
+		if (conf_speed > 0) {
+			// keep original timing of the trace, scaled by 'conf_speed'
+			due = m_start_time + (long long)(op->start / conf_speed);
+			while (now_us() < due)
+				usleep((useconds_t)(due - now_us()));
+		}
+		if (replay_op(c, op) != 0)
+			c->skipped++;
+	}
+
+	apisrv_client_disconnect();
+
+	return NULL;
+}
+
+
+/*
+ * report
+ */
+
+static int cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static u32 percentile(const u32 *lat, u32 n, int per_mille)
+{
+	u32 idx;
+
+	if (n == 0)
+		return 0;
+	idx = (u32)(((unsigned long long)n * per_mille + 999) / 1000);
+	return lat[idx > 0 ? idx - 1 : 0];
+}
+
+static void report(void)
+{
+	struct op_stat all;
+	FILE *fp = NULL;
+	u32 *lat, n, skipped = 0;
+	int cmd, i, first = 1;
+	double sec = m_elapsed > 0 ? m_elapsed / 1000000.0 : 1e-6;
+
+	if (conf_json) {
+		fp = fopen(conf_json, "w");
+		if (fp == NULL)
+			printf("Can't create %s\n", conf_json);
+	}
+
+	for (i = 0; i < m_n_clients; i++)
+		skipped += m_clients[i].skipped;
+
+	printf("%-12s %8s %6s %6s %10s %9s %8s %8s %8s %8s %8s\n",
+			"call", "count", "errors", "mism", "ops/s", "MB/s",
+			"p50(us)", "p90", "p99", "p99.9", "max");
+
+	if (fp) {
+		fprintf(fp, "{\n");
+		fprintf(fp, "  \"mode\": \"%s\",\n", conf_trace ? "replay" : "mix");
+		fprintf(fp, "  \"clients\": %d,\n", m_n_clients);
+		fprintf(fp, "  \"elapsed_us\": %lld,\n", m_elapsed);
+		fprintf(fp, "  \"skipped\": %u,\n", skipped);
+		fprintf(fp, "  \"results\": [");
+	}
+
+	for (cmd = 0; cmd < NUM_CMDS; cmd++) {
+		memset(&all, 0, sizeof(all));
+		for (i = 0; i < m_n_clients; i++) {
+			all.count += m_clients[i].stat[cmd].count;
+			all.errors += m_clients[i].stat[cmd].errors;
+			all.mismatch += m_clients[i].stat[cmd].mismatch;
+			all.bytes += m_clients[i].stat[cmd].bytes;
+		}
+		if (all.count == 0)
+			continue;
+
+		lat = (u32 *)malloc(all.count * sizeof(u32));
+		if (lat == NULL)
+			continue;
+		for (i = 0, n = 0; i < m_n_clients; i++) {
+			if (m_clients[i].stat[cmd].lat) {
+				memcpy(lat + n, m_clients[i].stat[cmd].lat, m_clients[i].stat[cmd].count * sizeof(u32));
+				n += m_clients[i].stat[cmd].count;
+			}
+		}
+		qsort(lat, n, sizeof(u32), cmp_u32);
+
+		printf("%-12s %8u %6u %6u %10.1f %9.2f %8u %8u %8u %8u %8u\n",
+				apisrv_cmd_name(cmd), all.count, all.errors, all.mismatch,
+				all.count / sec, all.bytes / sec / (1024 * 1024),
+				percentile(lat, n, 500), percentile(lat, n, 900), percentile(lat, n, 990),
+				percentile(lat, n, 999), n > 0 ? lat[n - 1] : 0);
+
+		if (fp) {
+			fprintf(fp, "%s\n    { \"call\": \"%s\", \"count\": %u, \"errors\": %u, \"mismatch\": %u, "
+					"\"ops_per_sec\": %.1f, \"bytes\": %lld, "
+					"\"latency_us\": { \"p50\": %u, \"p90\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u } }",
+					first ? "" : ",", apisrv_cmd_name(cmd), all.count, all.errors, all.mismatch,
+					all.count / sec, all.bytes,
+					percentile(lat, n, 500), percentile(lat, n, 900), percentile(lat, n, 990),
+					percentile(lat, n, 999), n > 0 ? lat[n - 1] : 0);
+			first = 0;
+		}
+
+		free(lat);
+	}
+
+	printf("%d clients, %.2f seconds", m_n_clients, sec);
+	if (conf_trace)
+		printf(", %u calls skipped", skipped);
+	printf("\n");
+
+	if (fp) {
+		fprintf(fp, "\n  ]\n}\n");
+		fclose(fp);
+	}
+}
+
+static void free_clients(void)
+{
+	struct client *c;
+	int i, cmd, k;
+
+	for (i = 0; i < m_n_clients; i++) {
+		c = &m_clients[i];
+		for (cmd = 0; cmd < NUM_CMDS; cmd++)
+			free(c->stat[cmd].lat);
+		for (k = 0; k < c->n_ops; k++) {
+			free(c->ops[k].name);
+			free(c->ops[k].name2);
+		}
+		free(c->ops);
+		free(c->buf);
+	}
+	free(m_clients);
+}
+
+static int parse_options(int argc, char *argv[])
+{
+	int iarg;
+	int usage = 0;
+
+	for (iarg = 1; iarg < argc && !usage; iarg++) {
+		const char *arg = argv[iarg];
+		const char *val = (iarg + 1 < argc ? argv[iarg + 1] : NULL);
+
+		if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+			usage++;
+		}
+		else if (!strcmp(arg, "-k") || !strcmp(arg, "--keep")) {
+			conf_keep = 1;
+		}
+		else if (val == NULL) {
+			usage++;
+		}
+		else {
+			iarg++;
+			if (!strcmp(arg, "-s") || !strcmp(arg, "--server"))
+				conf_server = val;
+			else if (!strcmp(arg, "-c") || !strcmp(arg, "--clients"))
+				conf_clients = atoi(val);
+			else if (!strcmp(arg, "-d") || !strcmp(arg, "--duration"))
+				conf_duration = atoi(val);
+			else if (!strcmp(arg, "-n") || !strcmp(arg, "--ops"))
+				conf_ops = atoi(val);
+			else if (!strcmp(arg, "-f") || !strcmp(arg, "--files"))
+				conf_files = atoi(val);
+			else if (!strcmp(arg, "-z") || !strcmp(arg, "--file-size"))
+				conf_file_size = atoi(val);
+			else if (!strcmp(arg, "-r") || !strcmp(arg, "--read-size"))
+				conf_read_size = atoi(val);
+			else if (!strcmp(arg, "-w") || !strcmp(arg, "--write-size"))
+				conf_write_size = atoi(val);
+			else if (!strcmp(arg, "-R") || !strcmp(arg, "--read-pct"))
+				conf_read_pct = atoi(val);
+			else if (!strcmp(arg, "-M") || !strcmp(arg, "--meta-pct"))
+				conf_meta_pct = atoi(val);
+			else if (!strcmp(arg, "-T") || !strcmp(arg, "--think"))
+				conf_think_us = atoi(val);
+			else if (!strcmp(arg, "-p") || !strcmp(arg, "--replay"))
+				conf_trace = val;
+			else if (!strcmp(arg, "-x") || !strcmp(arg, "--speed"))
+				conf_speed = atof(val);
+			else if (!strcmp(arg, "-o") || !strcmp(arg, "--output"))
+				conf_json = val;
+			else {
+				printf("Unknown option: %s, try %s --help\n", arg, argv[0]);
+				return -1;
+			}
+		}
+	}
+
+	if (conf_clients < 1 || conf_clients > MAX_CLIENTS || conf_files < 1 || conf_files > MAX_FILES ||
+		conf_file_size < 1 || conf_read_size < 1 || conf_write_size < 1 ||
+		conf_read_pct < 0 || conf_read_pct > 100 || conf_meta_pct < 0 || conf_meta_pct > 100 ||
+		conf_think_us < 0 || conf_duration < 1 || conf_ops < 0 || conf_speed < 0)
+		usage++;
+
+	if (usage) {
+		printf("Usage: %s [options]\n", argv[0]);
+		printf("  -h  --help                  show usage\n");
+		printf("  -s  --server     <addr>     server address, or 'shm', default=%s\n", DEFAULT_SERVER);
+		printf("  -o  --output     <file>     JSON result file\n");
+		printf("mix mode:\n");
+		printf("  -c  --clients    <n>        client threads, default=%d\n", DEFAULT_CLIENTS);
+		printf("  -d  --duration   <sec>      run time, default=%d\n", DEFAULT_DURATION);
+		printf("  -n  --ops        <n>        calls per client, instead of run time\n");
+		printf("  -f  --files      <n>        files per client, default=%d\n", DEFAULT_FILES);
+		printf("  -z  --file-size  <n>        file size, default=%d\n", DEFAULT_FILE_SIZE);
+		printf("  -r  --read-size  <n>        pread size, default=%d\n", DEFAULT_READ_SIZE);
+		printf("  -w  --write-size <n>        pwrite size, default=%d\n", DEFAULT_WRITE_SIZE);
+		printf("  -R  --read-pct   <n>        reads in data calls (%%), default=%d\n", DEFAULT_READ_PCT);
+		printf("  -M  --meta-pct   <n>        metadata calls (%%), default=%d\n", DEFAULT_META_PCT);
+		printf("  -T  --think      <us>       think time between calls, default=0\n");
+		printf("  -k  --keep                  keep files when finished\n");
+		printf("replay mode:\n");
+		printf("  -p  --replay     <file>     replay trace recorded by 'apitrace'\n");
+		printf("  -x  --speed      <factor>   replay speed, 0: as fast as possible, default=1\n");
+		printf("\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, ret = 0;
+
+	if (parse_options(argc, argv) < 0)
+		return -1;
+
+	if (api_client_init(conf_server) < 0) {
+		printf("Init API client failed.\n");
+		return -1;
+	}
+
+	m_clients = (struct client *)calloc(conf_trace ? MAX_TRACE_CONNS : conf_clients, sizeof(struct client));
+	if (m_clients == NULL)
+		return -1;
+
+	if (conf_trace) {
+		if (replay_load(conf_trace) < 0) {
+			free_clients();
+			return -1;
+		}
+	}
+	else {
+		m_n_clients = conf_clients;
+		for (i = 0; i < m_n_clients; i++) {
+			m_clients[i].id = i;
+			m_clients[i].seed = i + 1;
+		}
+	}
+
+	pthread_barrier_init(&m_start_barrier, NULL, m_n_clients + 1);
+
+	for (i = 0; i < m_n_clients; i++) {
+		if (pthread_create(&m_clients[i].thread, NULL,
+							conf_trace ? replay_client_fn : mix_client_fn, &m_clients[i]) != 0) {
+			printf("Create client thread failed.\n");
+			exit(-1);
+		}
+	}
+
+	// mix clients create their files first
+	pthread_barrier_wait(&m_start_barrier);
+	m_start_time = now_us();
+	pthread_barrier_wait(&m_start_barrier);
+
+	for (i = 0; i < m_n_clients; i++) {
+		pthread_join(m_clients[i].thread, NULL);
+		if (m_clients[i].failed)
+			ret = -1;
+	}
+	m_elapsed = now_us() - m_start_time;
+	pthread_barrier_destroy(&m_start_barrier);
+
+	report();
+	free_clients();
+
+	return ret;
+}
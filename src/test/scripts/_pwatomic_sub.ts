@@ -0,0 +1,9 @@
+# $8 --- power cut point, the n-th program/erase operation
+
+t_plt_atomic /plt_atomic $8
+! abort --- atomic write power loss test failed at op $8 ---
+t_plt_atomic /plt_atomic $8 half
+! abort --- atomic write power loss test (half page) failed at op $8 ---
+
+evl $8 + 1
+set 8 $1
@@ -0,0 +1,11 @@
+# $8 --- power cut point, the n-th program/erase operation
+
+echo --- power cut at op $8 ---
+
+t_plt /plt $8
+! abort --- power loss test failed at op $8 ---
+t_plt /plt $8 half
+! abort --- power loss test (half page) failed at op $8 ---
+
+evl $8 + 1
+set 8 $1
@@ -0,0 +1,66 @@
+# test space preallocation
+
+rm /test_fa.bin
+
+t_free
+set 8 $1  # free space before test => $8
+
+t_open wc /test_fa.bin
+! abort ---- create file failed ----
+set 9 $1
+
+# reserve blocks for 128K data
+t_fallocate $9 131072
+! abort --- fallocate failed ---
+t_free
+set 7 $1  # free space after reserve => $7
+evl $8 - $7
+test $1 > 16384
+! abort --- free space not reduced by fallocate ---
+t_seek $9 0 e
+test $1 == 0
+! abort --- fallocate should not change file length ---
+
+# writes into reserved range don't take blocks from free space
+t_write_seq $9 131072
+! abort --- write file failed ---
+t_flush $9
+t_free
+test $1 == $7
+! abort --- write into reserved range should not allocate new blocks ---
+
+# reserve again for the same length does nothing
+t_fallocate $9 131072
+! abort --- fallocate again failed ---
+t_free
+test $1 == $7
+! abort --- fallocate within file length should not reserve blocks ---
+
+# can't reserve more than the free space
+t_fallocate $9 100000000
+test $? != 0
+! abort --- fallocate beyond free space should fail ---
+
+# reserved blocks are given back on close
+t_fallocate $9 262144
+! abort --- fallocate failed ---
+t_free
+set 6 $1
+t_close $9
+! abort --- close file failed ---
+t_free
+test $1 > $6
+! abort --- reserved blocks not released on close ---
+
+t_open r /test_fa.bin
+! abort --- open file failed ---
+set 9 $1
+t_check_seq $9 131072
+! abort --- check file failed ---
+t_close $9
+
+rm /test_fa.bin
+t_free
+test $1 == $8
+! abort --- free space not restored ---
+echo === test fallocate success ===
@@ -0,0 +1,61 @@
+# test file info cache is dropped on rename and delete
+
+rm /fic/
+mkdir /fic
+! abort --- mkdir failed ---
+mkfile /fic/a
+mkdir /fic/d1
+mkfile /fic/d1/x
+
+# load file info of all entries into the cache
+t_dirplus /fic/ 4
+test $1 == 2
+! abort --- should have 2 entries ---
+t_dirplus /fic/d1/ 4
+
+# rename file, old name should be gone
+mv /fic/a /fic/b
+! abort --- rename file failed ---
+t_open r /fic/a
+test $? != 0
+! abort --- old file name still found ---
+t_open r /fic/b
+! abort --- can't open renamed file ---
+t_close $1
+
+# rename dir, files under it move together
+mv /fic/d1/ /fic/d2/
+! abort --- rename dir failed ---
+t_open r /fic/d1/x
+test $? != 0
+! abort --- old dir name still found ---
+t_open r /fic/d2/x
+! abort --- can't open file under renamed dir ---
+t_close $1
+
+# delete then create, new object may take the same serial
+rm /fic/b
+! abort --- delete failed ---
+mkfile /fic/c
+t_open r /fic/b
+test $? != 0
+! abort --- deleted file still found ---
+t_open r /fic/c
+! abort --- can't open new file ---
+t_close $1
+
+# change modify time, readdirplus and uffs_stat should agree
+t_open w /fic/c
+set 9 $1
+t_write $9 hello
+t_close $9
+t_dirplus /fic/ 4
+test $1 == 2
+! abort --- should have 2 entries ---
+
+st
+rm /fic/d2/x
+rm /fic/d2/
+rm /fic/c
+rm /fic/
+echo === test file info cache success ===
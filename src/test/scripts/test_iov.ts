@@ -0,0 +1,35 @@
+rm /test_iov.bin
+
+# create a new file
+t_open wc /test_iov.bin
+
+! abort ---- create file failed ----
+set 9 $1  # opened fd => $9
+
+# write a record (header + payload + trailer) in one call
+t_writev $9 [hdr] hello-world [trl]
+! abort --- writev failed ---
+test $1 == 21
+! abort --- writev length not 21 ---
+
+# write records crossing page boundary
+t_seek $9 500 s
+t_writev $9 [hdr] 0123456789abcdefghijklmnopqrstuvwxyz [trl]
+! abort --- writev at 500 failed ---
+t_seek $9 0 e
+test $1 == 546
+! abort --- file length not 546 ---
+
+# read back with different element sizes
+t_seek $9 0 s
+t_readv $9 [hdr]hel lo-world[t rl]
+! abort --- readv at 0 failed ---
+t_seek $9 500 s
+t_readv $9 [hdr]0 1234567 89abcdefghijklmnopqrstuvwxyz[trl]
+! abort --- readv at 500 failed ---
+t_pread $9 505 0123
+! abort --- check file failed ---
+
+t_close $9
+! abort --- close file failed ---
+echo === test iov success ===
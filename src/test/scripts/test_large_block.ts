@@ -0,0 +1,43 @@
+# test page id beyond 64 pages per block,
+# run it with large block NAND, e.g. mkuffs -b 256 -t 128
+
+rm /test_lb.bin
+
+t_open wc /test_lb.bin
+! abort ---- create file failed ----
+set 9 $1
+
+# spans more than one block and more than 64 pages of each block
+t_write_seq $9 300000
+! abort --- write seq file failed ---
+t_close $9
+
+# remount, tags are rebuilt from flash
+t_pwrestore
+! abort --- remount failed ---
+
+t_open rw /test_lb.bin
+! abort ---- open file failed ----
+set 9 $1
+t_check_seq $9 300000
+! abort --- check seq file after remount failed ---
+
+# overwrite the tail pages of the first data block, the new
+# pages go to a recovered block and keep their page id
+t_seek $9 100000 s
+t_write_seq $9 60000
+! abort --- overwrite seq file failed ---
+t_close $9
+
+t_pwrestore
+! abort --- remount failed ---
+
+t_open r /test_lb.bin
+! abort ---- open file failed ----
+set 9 $1
+t_check_seq $9 300000
+! abort --- check seq file after overwrite failed ---
+t_close $9
+
+rm /test_lb.bin
+echo === test large block success ===
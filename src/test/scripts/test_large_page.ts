@@ -0,0 +1,50 @@
+# test page data length beyond 4095 bytes,
+# run it with large page NAND, e.g. mkuffs -p 8192 -s 256 -t 128
+
+rm /test_lp.bin
+
+t_open wc /test_lp.bin
+! abort ---- create file failed ----
+set 9 $1
+
+# last page is partial and holds more than 4095 bytes
+t_write_seq $9 30000
+! abort --- write seq file failed ---
+t_close $9
+
+# remount, file length is rebuilt from page tags
+t_pwrestore
+! abort --- remount failed ---
+
+t_open rw /test_lp.bin
+! abort ---- open file failed ----
+set 9 $1
+t_seek $9 0 e
+test $1 == 30000
+! abort --- file length is wrong after remount ---
+t_seek $9 0 s
+t_check_seq $9 30000
+! abort --- check seq file after remount failed ---
+
+# rewrite a partial page in the middle
+t_seek $9 5000 s
+t_write_seq $9 9000
+! abort --- overwrite seq file failed ---
+t_close $9
+
+t_pwrestore
+! abort --- remount failed ---
+
+t_open r /test_lp.bin
+! abort ---- open file failed ----
+set 9 $1
+t_seek $9 0 e
+test $1 == 30000
+! abort --- file length is wrong after overwrite ---
+t_seek $9 0 s
+t_check_seq $9 30000
+! abort --- check seq file after overwrite failed ---
+t_close $9
+
+rm /test_lp.bin
+echo === test large page success ===
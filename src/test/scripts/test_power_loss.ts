@@ -0,0 +1,7 @@
+# sweep power cut point through the first 200 program/erase operations,
+# increase the loop count for a longer run.
+
+set 8 1
+* 200 script _pwcut_sub.ts
+
+echo -- test succ --
@@ -0,0 +1,39 @@
+rm /test_pread.bin
+
+# create a new file
+t_open wc /test_pread.bin
+
+! abort ---- create file failed ----
+set 9 $1  # opened fd => $9
+
+t_write $9 hello-world
+! abort ---- write file failed ----
+
+# positional read/write don't move the file pointer
+t_pread $9 6 world
+! abort --- pread at 6 failed ---
+t_pwrite $9 5 &
+! abort --- pwrite '&' at 5 failed ---
+t_seek $9 0 c
+test $1 == 11
+! abort --- file pointer moved by pread/pwrite ---
+t_pread $9 0 hello&world
+! abort --- check file failed ---
+
+# pwrite passed over the end of file fill the gap with 0
+t_pwrite $9 20 end
+! abort --- pwrite at 20 failed ---
+t_seek $9 0 e
+test $1 == 23
+! abort --- file new length not filling the gap ---
+t_pread $9 20 end
+! abort --- pread at 20 failed ---
+
+# pread passed over the end of file returns nothing
+t_pread $9 30 x
+test $? != 0
+! abort --- pread passed over end of file should fail ---
+
+t_close $9
+! abort --- close file failed ---
+echo === test pread success ===
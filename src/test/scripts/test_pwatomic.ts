@@ -0,0 +1,32 @@
+# atomic write: pieces in one block are written all or nothing
+
+rm /test_pwatomic.bin
+
+t_open wc /test_pwatomic.bin
+! abort ---- create file failed ----
+set 9 $1  # opened fd => $9
+
+t_write $9 0123456789abcdefghij
+! abort ---- write file failed ----
+
+# pieces in the file head block, the last one extends the file
+t_pwatomic $9 0 A 10 BB 18 CCCC
+! abort --- atomic write failed ---
+t_pread $9 0 A123456789BBcdefghCCCC
+! abort --- check file after atomic write failed ---
+
+# piece leaves a gap after the end of file: can't be atomic, nothing written
+t_pwatomic $9 1 x 100 gap
+test $? != 0
+! abort --- atomic write with a gap should fail ---
+t_pread $9 0 A123456789BBcdefghCCCC
+! abort --- file changed by failed atomic write ---
+
+t_close $9
+! abort --- close file failed ---
+
+# atomic write survives power loss: sweep power cut point through the flush
+set 8 1
+* 40 script _pwatomic_sub.ts
+
+echo === test pwatomic success ===
@@ -0,0 +1,51 @@
+# test directory listing with attributes (readdirplus)
+
+rm /test_rdp/
+mkdir /test_rdp
+! abort --- mkdir failed ---
+mkdir /test_rdp/sub
+mkfile /test_rdp/empty.txt
+
+t_open wc /test_rdp/a.bin
+set 9 $1
+t_write $9 hello
+t_close $9
+
+t_open wc /test_rdp/b.bin
+set 9 $1
+t_write_seq $9 40000
+t_close $9
+
+mkfile /test_rdp/sub/f1
+mkfile /test_rdp/sub/f2
+mkfile /test_rdp/sub/f3
+mkdir /test_rdp/sub/d1
+mkdir /test_rdp/sub/d2
+
+# list with different batch sizes, all give the same entries as uffs_stat()
+t_dirplus /test_rdp/ 1
+! abort --- readdirplus failed ---
+test $1 == 4
+! abort --- should have 4 entries ---
+t_dirplus /test_rdp/ 3
+test $1 == 4
+! abort --- should have 4 entries (3 per call) ---
+t_dirplus /test_rdp/ 16
+test $1 == 4
+! abort --- should have 4 entries (16 per call) ---
+t_dirplus /test_rdp/sub/ 2
+test $1 == 5
+! abort --- sub dir should have 5 entries ---
+
+ls /test_rdp/
+rm /test_rdp/sub/d2/
+rm /test_rdp/sub/d1/
+rm /test_rdp/sub/f3
+rm /test_rdp/sub/f2
+rm /test_rdp/sub/f1
+rm /test_rdp/sub/
+rm /test_rdp/b.bin
+rm /test_rdp/a.bin
+rm /test_rdp/empty.txt
+rm /test_rdp/
+echo === test readdirplus success ===
@@ -0,0 +1,96 @@
+# test uffs_skip() and sparse file, needs CONFIG_SPARSE_FILE
+
+rm /test_sparse.bin
+
+t_free
+set 8 $1  # free space before test => $8
+
+t_open wc /test_sparse.bin
+! abort ---- create file failed ----
+set 9 $1
+
+t_write $9 hello
+! abort ---- write file failed ----
+
+# skip over the end of file extends the file
+t_skip $9 1000000
+! abort --- skip failed ---
+test $1 == 1000000
+! abort --- bytes skipped should be 1000000 ---
+t_write $9 world
+! abort --- write after skip failed ---
+t_seek $9 0 e
+test $1 == 1000010
+! abort --- file length should be 1000010 ---
+
+# whole data blocks in the gap are holes, don't take free space
+t_free
+evl $8 - $1
+test $1 < 65536
+! abort --- skipped data blocks should not be written ---
+
+# gap reads as '\0'
+t_pread $9 0 hello
+! abort --- check file head failed ---
+t_check_zero $9 5 1000000
+! abort --- gap should read as zero ---
+t_pread $9 1000005 world
+! abort --- check file tail failed ---
+
+# write into a hole
+t_pwrite $9 500000 middle
+! abort --- write to hole failed ---
+t_pread $9 500000 middle
+! abort --- read back from hole failed ---
+t_check_zero $9 490000 10000
+! abort --- data before the written hole should be zero ---
+t_check_zero $9 500006 10000
+! abort --- data after the written hole should be zero ---
+t_close $9
+
+# remount, file length and holes should be kept
+umount /
+mount /
+t_open r /test_sparse.bin
+! abort --- open file after remount failed ---
+set 9 $1
+t_seek $9 0 e
+test $1 == 1000010
+! abort --- file length changed after remount ---
+t_pread $9 500000 middle
+! abort --- check data after remount failed ---
+t_check_zero $9 600000 100000
+! abort --- hole should read as zero after remount ---
+
+# skip on read only file stops at the end of file
+t_seek $9 1000000 s
+t_skip $9 100
+test $1 == 10
+! abort --- skip on read only file should stop at end of file ---
+t_close $9
+
+# truncate into a hole
+t_open w /test_sparse.bin
+! abort --- open file for truncate failed ---
+set 9 $1
+t_truncate $9 700000
+! abort --- truncate to a hole failed ---
+t_check_zero $9 690000 10000
+! abort --- truncated tail should be zero ---
+t_close $9
+umount /
+mount /
+t_open r /test_sparse.bin
+set 9 $1
+t_seek $9 0 e
+test $1 == 700000
+! abort --- truncated file length changed after remount ---
+t_pread $9 500000 middle
+! abort --- check data after truncate failed ---
+t_close $9
+
+rm /test_sparse.bin
+t_free
+test $1 == $8
+! abort --- free space not restored ---
+echo === test sparse success ===
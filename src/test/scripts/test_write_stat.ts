@@ -0,0 +1,40 @@
+# test write statistic (write amplification) of opened file
+
+rm /test_ws.bin
+
+# create a file with 64K sequence data
+t_open wc /test_ws.bin
+! abort ---- create file failed ----
+set 9 $1
+t_write_seq $9 65536
+! abort ---- write file failed ----
+t_flush $9
+t_wstat $9
+! abort ---- get write statistic failed ----
+test $1 == 65536
+! abort ---- bytes written should be 65536 ----
+test $2 > 0
+! abort ---- no page programmed ? ----
+t_close $9
+
+# overwrite one byte in the middle of the file
+t_open w /test_ws.bin
+! abort ---- open file failed ----
+set 9 $1
+t_wstat $9
+test $1 == 0
+! abort ---- write statistic should be cleared on open ----
+t_seek $9 20000 s
+t_write $9 x
+t_flush $9
+t_wstat $9
+test $1 == 1
+! abort ---- bytes written should be 1 ----
+test $3 > 0
+! abort ---- overwrite a full block should copy pages ----
+test $4 > 0
+! abort ---- overwrite a full block should erase the old block ----
+t_close $9
+
+rm /test_ws.bin
+echo -- test succ --
@@ -307,10 +307,6 @@ int os_posix_fallocate(int fd, long offset, long len);
 #define os_pread64 os_pread
 #define os_pwrite64 os_pwrite
 
-#if defined(USE_PREAD) || defined(USE_PREAD64)
-#error UFFS_TEST does not support PREAD/PREAD64
-#endif
-
 #else
 
 #error UFFS_TEST NOT DEFINED ???
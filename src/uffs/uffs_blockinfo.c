@@ -62,6 +62,7 @@ URET uffs_BlockInfoInitCache(uffs_Device *dev, int maxCachedBlocks)
 {
 	uffs_BlockInfo * blockInfos = NULL;
 	uffs_PageSpare * pageSpares = NULL;
+	u32 * expiredMaps = NULL;
 	void * buf = NULL;
 	uffs_BlockInfo *work = NULL;
 	int size, i, j;
@@ -75,7 +76,8 @@ URET uffs_BlockInfoInitCache(uffs_Device *dev, int maxCachedBlocks)
 
 	size = ( 
 			sizeof(uffs_BlockInfo) +
-			sizeof(uffs_PageSpare) * dev->attr->pages_per_block
+			sizeof(uffs_PageSpare) * dev->attr->pages_per_block +
+			sizeof(u32) * BC_EXPIRED_MAP_WORDS(dev->attr->pages_per_block)
 			) * maxCachedBlocks;
 
 	if (dev->mem.blockinfo_pool_size == 0) {
@@ -105,6 +107,9 @@ URET uffs_BlockInfoInitCache(uffs_Device *dev, int maxCachedBlocks)
 	size += sizeof(uffs_BlockInfo) * maxCachedBlocks;
 
 	pageSpares = (uffs_PageSpare *)((char *)buf + size);
+	size += sizeof(uffs_PageSpare) * dev->attr->pages_per_block * maxCachedBlocks;
+
+	expiredMaps = (u32 *)((char *)buf + size);
 
 	//initialize block info
 	work = &(blockInfos[0]);
@@ -133,8 +138,9 @@ URET uffs_BlockInfoInitCache(uffs_Device *dev, int maxCachedBlocks)
 	work = dev->bc.head;
 	for (i = 0; i < maxCachedBlocks; i++) {
 		work->spares = &(pageSpares[i*dev->attr->pages_per_block]);
+		work->expired_map = &(expiredMaps[i*BC_EXPIRED_MAP_WORDS(dev->attr->pages_per_block)]);
 		for (j = 0; j < dev->attr->pages_per_block; j++) {
-			work->spares[j].expired = 1;
+			BC_SET_PAGE_EXPIRED(work, j);
 		}
 		work->expired_count = dev->attr->pages_per_block;
 		work = work->next;
@@ -223,8 +229,12 @@ URET uffs_BlockInfoLoad(uffs_Device *dev, uffs_BlockInfo *work, int page)
 		nfailed = 0;
 		for (i = 0; i < dev->attr->pages_per_block; i++) {
 			spare = &(work->spares[i]);
-			if (spare->expired == 0)
+			if (!BC_PAGE_EXPIRED(work, i)) {
+				dev->cache_st.tag_load_avoided++;
 				continue;
+			}
+
+			dev->cache_st.tag_load++;
 
 			ret = uffs_FlashReadPageTag(dev, work->block, i,
 											&(spare->tag));
@@ -245,7 +255,7 @@ URET uffs_BlockInfoLoad(uffs_Device *dev, uffs_BlockInfo *work, int page)
 				nfailed++;	
 			}
 
-			spare->expired = 0;
+			BC_CLR_PAGE_EXPIRED(work, i);
 			work->expired_count--;
 		}
 		if (nfailed > 0)
@@ -257,7 +267,11 @@ URET uffs_BlockInfoLoad(uffs_Device *dev, uffs_BlockInfo *work, int page)
 			return U_FAIL;
 		}
 		spare = &(work->spares[page]);
-		if (spare->expired != 0) {
+		if (!BC_PAGE_EXPIRED(work, page)) {
+			dev->cache_st.tag_load_avoided++;
+		}
+		else {
+			dev->cache_st.tag_load++;
 			ret = uffs_FlashReadPageTag(dev, work->block, page,
 											&(spare->tag));
 #ifdef CONFIG_UFFS_REFRESH_BLOCK
@@ -274,7 +288,7 @@ URET uffs_BlockInfoLoad(uffs_Device *dev, uffs_BlockInfo *work, int page)
 							work->block, page);
 				return U_FAIL;
 			}
-			spare->expired = 0;
+			BC_CLR_PAGE_EXPIRED(work, page);
 			work->expired_count--;
 		}
 	}
@@ -324,8 +338,10 @@ uffs_BlockInfo * uffs_BlockInfoGet(uffs_Device *dev, int block)
 	//search cached block
 	if ((work = uffs_BlockInfoFindInCache(dev, block)) != NULL) {
 		_MoveBcToTail(dev, work);
+		dev->cache_st.bc_hit++;
 		return work;
 	}
+	dev->cache_st.bc_miss++;
 
 	//can't find block from cache, need to find a free(unlocked) cache
 	for (work = dev->bc.head; work != NULL; work = work->next) {
@@ -333,6 +349,7 @@ uffs_BlockInfo * uffs_BlockInfoGet(uffs_Device *dev, int block)
 	}
 	if (work == NULL) {
 		//caches used out !
+		dev->cache_st.bc_insufficient++;
 		uffs_Perror(UFFS_MSG_SERIOUS,  "insufficient block info cache");
 		return NULL;
 	}
@@ -340,7 +357,7 @@ uffs_BlockInfo * uffs_BlockInfoGet(uffs_Device *dev, int block)
 	work->block = block;
 	work->expired_count = dev->attr->pages_per_block;
 	for (i = 0; i < dev->attr->pages_per_block; i++) {
-		work->spares[i].expired = 1;
+		BC_SET_PAGE_EXPIRED(work, i);
 
 		// TODO: init tag
 	}
@@ -383,22 +400,19 @@ void uffs_BlockInfoPut(uffs_Device *dev, uffs_BlockInfo *p)
 void uffs_BlockInfoExpire(uffs_Device *dev, uffs_BlockInfo *p, int page)
 {
 	int i;
-	uffs_PageSpare *spare;
 
 	if (page == UFFS_ALL_PAGES) {
 		for (i = 0; i < dev->attr->pages_per_block; i++) {
-			spare = &(p->spares[i]);
-			if (spare->expired == 0) {
-				spare->expired = 1;
+			if (!BC_PAGE_EXPIRED(p, i)) {
+				BC_SET_PAGE_EXPIRED(p, i);
 				p->expired_count++;
 			}
 		}
 	}
 	else {
 		if (page >= 0 && page < dev->attr->pages_per_block) {
-			spare = &(p->spares[page]);
-			if (spare->expired == 0) {
-				spare->expired = 1;
+			if (!BC_PAGE_EXPIRED(p, page)) {
+				BC_SET_PAGE_EXPIRED(p, page);
 				p->expired_count++;
 			}
 		}
@@ -442,9 +456,9 @@ void uffs_BlockInfoInitErased(uffs_Device *dev, uffs_BlockInfo *p)
 
 	for (i = 0; i < dev->attr->pages_per_block; i++) {
 		spare = &(p->spares[i]);
-		spare->expired = 0;
 		memset(&(spare->tag), 0xFF, sizeof(struct uffs_TagsSt));
 	}
+	memset(p->expired_map, 0, sizeof(u32) * BC_EXPIRED_MAP_WORDS(dev->attr->pages_per_block));
 	p->expired_count = 0;
 }
 
@@ -44,10 +44,24 @@
 #include "uffs/uffs_pool.h"
 #include "uffs/uffs_ecc.h"
 #include "uffs/uffs_badblock.h"
+#include "uffs/uffs_timing.h"
+#include "uffs/uffs_fileinfo.h"
 #include <string.h>
 
 #define PFX "pbuf: "
 
+#ifdef CONFIG_USE_PER_DEVICE_LOCK
+/* cached buffers can be referenced by readers holding the shared device lock */
+#define BUF_REF_GET(buf)	uffs_AtomicGet16(&(buf)->ref_count)
+#define BUF_REF_INC(buf)	uffs_AtomicInc16(&(buf)->ref_count)
+#define BUF_REF_DEC(buf)	uffs_AtomicDec16(&(buf)->ref_count)
+#define CACHE_ST_INC(x)		uffs_AtomicAdd(&(x), 1)
+#else
+#define BUF_REF_GET(buf)	((buf)->ref_count)
+#define BUF_REF_INC(buf)	((buf)->ref_count++)
+#define BUF_REF_DEC(buf)	((buf)->ref_count--)
+#define CACHE_ST_INC(x)		((x)++)
+#endif
 
 URET _BufFlush(struct uffs_DeviceSt *dev, UBOOL force_block_recover, int slot);
 
@@ -127,7 +141,6 @@ static void _LinkToBufListHead(uffs_Device *dev, uffs_Buf *buf)
 	dev->buf.head = buf;
 }
 
-#if 0
 /**
  * \brief put a buf in buffer pool list tail
  * \param[in] dev uffs device
@@ -149,7 +162,6 @@ static void _LinkToBufListTail(uffs_Device *dev, uffs_Buf *buf)
 
 	dev->buf.tail = buf;
 }
-#endif
 
 /**
  * \brief move a buf up to the head of buffer pool list
@@ -405,8 +417,11 @@ static uffs_Buf * _FindFreeBuf(uffs_Device *dev)
 	while (buf) {
 
 		if(buf->ref_count == 0 &&
-			buf->mark != UFFS_BUF_DIRTY) 
+			buf->mark != UFFS_BUF_DIRTY) {
+			if (buf->mark == UFFS_BUF_VALID)
+				dev->cache_st.buf_evict++;
 			return buf;
+		}
 
 		buf = buf->prev;
 	}
@@ -525,6 +540,12 @@ static u16 _GetDirOrFileNameSum(uffs_Device *dev, uffs_Buf *buf)
 }
 
 
+/** serial number of file (or dir) who owns the page */
+static u16 _GetOwnerSerial(u8 type, u16 parent, u16 serial)
+{
+	return (type == UFFS_TYPE_DATA ? parent : serial);
+}
+
 static URET _CheckDirtyList(uffs_Buf *dirty)
 {
 	u16 parent;
@@ -605,14 +626,16 @@ static URET uffs_BufFlush_Exist_With_BlockRecover(
 	TreeNode *newNode;
 	uffs_BlockInfo *newBc;
 	uffs_Tags *tag, *oldTag;
-	u16 newBlock;
+	uffs_BlockNum newBlock;
 	UBOOL succRecover;			// U_TRUE: recover successful, erase old block,
 								// U_FALSE: fail to recover, erase new block
 	int flash_op_new;			// flash operation (write) result for new block
 	int flash_op_old;			// flash operation (read) result for old block
 	u16 data_sum = 0xFFFF;
+	int n_prog = 0, n_copy = 0, n_erase = 0;	// for write statistic
 
 	UBOOL useCloneBuf;
+	UFFS_TIMING_BEGIN(t);
 
 	type = dev->buf.dirtyGroup[slot].dirty->type;
 	parent = dev->buf.dirtyGroup[slot].dirty->parent;
@@ -625,7 +648,7 @@ retry:
 	flash_op_old = UFFS_FLASH_NO_ERR;
 	succRecover = U_FALSE;
 
-	newNode = uffs_TreeGetErasedNode(dev);
+	newNode = uffs_TreeGetErasedNodeFor(dev, type, parent, serial);
 	if (newNode == NULL) {
 		uffs_Perror(UFFS_MSG_NOISY, "no enough erased block!");
 		goto ext;
@@ -634,8 +657,7 @@ retry:
 	newBc = uffs_BlockInfoGet(dev, newBlock);
 	if (newBc == NULL) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "get block info fail!");
-		uffs_InsertToErasedListHead(dev, newNode);  //put node back to erased list
-											//because it doesn't use, so put to head
+		uffs_TreePutErasedNodeFor(dev, type, parent, serial, newNode);  //put node back
 		goto ext;
 	}
 
@@ -664,8 +686,7 @@ retry:
 		TAG_PARENT(tag) = parent;
 		TAG_SERIAL(tag) = serial;
 		TAG_TYPE(tag) = type;
-		TAG_PAGE_ID(tag) = (u8)(i & 0xFF);	// now, page_id = page.
-									// FIX ME!! if more than 256 pages in a block
+		TAG_SET_PAGE_ID(dev, tag, i);	// now, page_id = page.
 
 		SEAL_TAG(tag);
 		
@@ -674,7 +695,7 @@ retry:
 			if (i == 0)
 				data_sum = _GetDirOrFileNameSum(dev, buf);
 
-			TAG_DATA_LEN(tag) = buf->data_len;
+			TAG_SET_DATA_LEN(tag, buf->data_len);
 
 			if (buf->data_len == 0 || (buf->ext_mark & UFFS_BUF_EXT_MARK_TRUNC_TAIL)) { // this only happen when truncating a file
 
@@ -691,6 +712,7 @@ retry:
 
 				if (buf->data_len > 0) {
 					flash_op_new = uffs_FlashWritePageCombine(dev, newBlock, i, buf, tag);
+					n_prog++;
 				}
 				else {
 					// data_len == 0, no I/O needed.
@@ -701,6 +723,7 @@ retry:
 			}
 			else {
 				flash_op_new = uffs_FlashWritePageCombine(dev, newBlock, i, buf, tag);
+				n_prog++;
 			}
 		}
 		else {
@@ -772,12 +795,14 @@ retry:
 				// this could be some error on flash ? we can't do more about it for now ...
 			}
 
-			TAG_DATA_LEN(tag) = buf->data_len;
+			TAG_SET_DATA_LEN(tag, buf->data_len);
 
 			if (i == 0)
 				data_sum = _GetDirOrFileNameSum(dev, buf);
 
 			flash_op_new = uffs_FlashWritePageCombine(dev, newBlock, i, buf, tag);
+			n_prog++;
+			n_copy++;
 
 			if (buf) {
 				if (useCloneBuf)
@@ -837,6 +862,7 @@ retry:
 		// need refresh ? there is no valid data at this point so just erase and retry.
 		uffs_TreeEraseNode(dev, newNode);				// erase the block
 		uffs_TreeInsertToErasedListTail(dev, newNode);	// and put it to erased list
+		n_erase++;
 		uffs_BlockInfoPut(dev, newBc);
 		uffs_Perror(UFFS_MSG_NORMAL, "Retry block recover because of refresh...");
 		goto retry;
@@ -894,8 +920,9 @@ retry:
 			if (uffs_IsThisBlockUsed(dev, bc)) {
 				// erase recovered block
 				uffs_TreeEraseNode(dev, newNode);
+				n_erase++;
 			}
-			uffs_TreeInsertToErasedListTail(dev, newNode);
+			uffs_TreePutErasedNodeFor(dev, type, parent, serial, newNode);
 		}
 	}
 	else {
@@ -908,7 +935,8 @@ retry:
 
 		newNode->u.list.block = newBlock;	// just in case the newNode was changed
 		uffs_TreeEraseNode(dev, newNode);
-		uffs_TreeInsertToErasedListTail(dev, newNode);
+		uffs_TreePutErasedNodeFor(dev, type, parent, serial, newNode);
+		n_erase++;
 	}
 
 	if (dev->buf.dirtyGroup[slot].dirty != NULL ||
@@ -919,6 +947,10 @@ retry:
 	uffs_BlockInfoPut(dev, newBc);
 
 ext:
+	if (n_prog > 0 || n_erase > 0)
+		uffs_ObjectWriteStatAdd(dev, _GetOwnerSerial(type, parent, serial), n_prog, n_copy, n_erase);
+
+	UFFS_TIMING_END(UFFS_TM_BUF_FLUSH_RECOVER, t);
 	return (succRecover == U_TRUE ? U_SUCC : U_FAIL);
 
 }
@@ -936,13 +968,18 @@ ext:
 static URET _BufFlush_NewBlock(uffs_Device *dev, int slot)
 {
 	u8 type;
+	u16 parent, serial;
 	TreeNode *node;
 	uffs_BlockInfo *bc;
 	URET ret;
 
 	ret = U_FAIL;
 
-	node = uffs_TreeGetErasedNode(dev);
+	type = dev->buf.dirtyGroup[slot].dirty->type;
+	parent = dev->buf.dirtyGroup[slot].dirty->parent;
+	serial = dev->buf.dirtyGroup[slot].dirty->serial;
+
+	node = uffs_TreeGetErasedNodeFor(dev, type, parent, serial);
 	if (node == NULL) {
 		uffs_Perror(UFFS_MSG_NOISY, "no erased block!");
 		goto ext;
@@ -950,11 +987,9 @@ static URET _BufFlush_NewBlock(uffs_Device *dev, int slot)
 	bc = uffs_BlockInfoGet(dev, node->u.list.block);
 	if (bc == NULL) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "get block info fail!");
-		uffs_InsertToErasedListHead(dev, node); //put node back to erased list
+		uffs_TreePutErasedNodeFor(dev, type, parent, serial, node); //put node back
 		goto ext;
 	}
-
-	type = dev->buf.dirtyGroup[slot].dirty->type;
 	
 	ret = uffs_BufFlush_Exist_With_BlockRecover(dev, slot, node, bc, U_FALSE);
 
@@ -992,11 +1027,16 @@ URET
 	uffs_Tags *tag;
 	URET ret = U_FAIL;
 	int x;
+	int n_prog = 0;
+	u16 owner;
 
 //	uffs_Perror(UFFS_MSG_NOISY,
 //					"Flush buffers with Enough Free Page to block %d",
 //					bc->block);
 
+	buf = dev->buf.dirtyGroup[slot].dirty;
+	owner = _GetOwnerSerial(buf->type, buf->parent, buf->serial);
+
 	for (page = 1;	// page 0 won't be a free page, so we start from 1.
 			page < dev->attr->pages_per_block &&
 			dev->buf.dirtyGroup[slot].count > 0;		//still has dirty pages?
@@ -1023,15 +1063,16 @@ URET
 		TAG_DIRTY_BIT(tag) = TAG_DIRTY;
 		TAG_VALID_BIT(tag) = TAG_VALID;
 		TAG_BLOCK_TS(tag) = uffs_GetBlockTimeStamp(dev, bc);
-		TAG_DATA_LEN(tag) = buf->data_len;
+		TAG_SET_DATA_LEN(tag, buf->data_len);
 		TAG_TYPE(tag) = buf->type;
 		TAG_PARENT(tag) = buf->parent;
 		TAG_SERIAL(tag) = buf->serial;
-		TAG_PAGE_ID(tag) = (u8)(buf->page_id);
+		TAG_SET_PAGE_ID(dev, tag, buf->page_id);
 
 		SEAL_TAG(tag);
 
 		x = uffs_FlashWritePageCombine(dev, bc->block, page, buf, tag);
+		n_prog++;
 		if (x == UFFS_FLASH_IO_ERR) {
 			uffs_Perror(UFFS_MSG_NORMAL, "I/O error <1>?");
 			goto ext;
@@ -1059,11 +1100,14 @@ URET
 	}
 
 ext:
+	if (n_prog > 0)
+		uffs_ObjectWriteStatAdd(dev, owner, n_prog, 0, 0);
+
 	return ret;
 }
 
 
-URET _BufFlush(struct uffs_DeviceSt *dev,
+static URET _BufFlushSlot(struct uffs_DeviceSt *dev,
 			   UBOOL force_block_recover, int slot)
 {
 	uffs_Buf *dirty;
@@ -1076,10 +1120,6 @@ URET _BufFlush(struct uffs_DeviceSt *dev,
 	u16 serial;
 	int block;
 	
-	if (dev->buf.dirtyGroup[slot].count == 0) {
-		return U_SUCC;
-	}
-
 	dirty = dev->buf.dirtyGroup[slot].dirty;
 
 	if (_CheckDirtyList(dirty) == U_FAIL)
@@ -1166,6 +1206,23 @@ static int _FindMostDirtyGroup(struct uffs_DeviceSt *dev)
 	return slot;
 }
 
+/** flush dirty group #slot to flash */
+URET _BufFlush(struct uffs_DeviceSt *dev,
+			   UBOOL force_block_recover, int slot)
+{
+	URET ret;
+	UFFS_TIMING_BEGIN(t);
+
+	if (dev->buf.dirtyGroup[slot].count == 0) {
+		return U_SUCC;
+	}
+
+	ret = _BufFlushSlot(dev, force_block_recover, slot);
+	UFFS_TIMING_END(UFFS_TM_BUF_FLUSH, t);
+
+	return ret;
+}
+
 /** lock dirty group */
 URET uffs_BufLockGroup(struct uffs_DeviceSt *dev, int slot)
 {
@@ -1193,6 +1250,28 @@ URET uffs_BufUnLockGroup(struct uffs_DeviceSt *dev, int slot)
 	return ret;
 }
 
+/**
+ * discard all dirty buffers in group #slot, the data on flash is not changed.
+ * \note buffers in the group should not be referenced by anyone.
+ */
+URET uffs_BufDiscardGroup(struct uffs_DeviceSt *dev, int slot)
+{
+	uffs_Buf *buf;
+
+	if (slot < 0 || slot >= dev->cfg.dirty_groups)
+		return U_FAIL;
+
+	while ((buf = dev->buf.dirtyGroup[slot].dirty) != NULL) {
+		if (buf->ref_count > 0) {
+			uffs_Perror(UFFS_MSG_SERIOUS, "discard a referenced buffer ?");
+			return U_FAIL;
+		}
+		uffs_BufMarkEmpty(dev, buf);
+	}
+
+	return U_SUCC;
+}
+
 
 /** 
  * flush buffers to flash.
@@ -1220,6 +1299,7 @@ URET uffs_BufFlushMostDirtyGroup(struct uffs_DeviceSt *dev)
 
 	slot = _FindMostDirtyGroup(dev);
 	if (slot >= 0) {
+		dev->cache_st.buf_forced_flush++;
 		return _BufFlush(dev, U_FALSE, slot);
 	}
 	return U_SUCC;
@@ -1405,9 +1485,11 @@ uffs_Buf *uffs_BufNew(struct uffs_DeviceSt *dev,
 			buf->data_len = 0;
 		}
 		_MoveNodeToHead(dev, buf);
+		dev->cache_st.buf_new_hit++;
 		return buf;
 	}
 
+	dev->cache_st.buf_new_miss++;
 	buf = _FindFreeBuf(dev);
 	if (buf == NULL) {
 		uffs_BufFlushMostDirtyGroup(dev);
@@ -1434,6 +1516,50 @@ uffs_Buf *uffs_BufNew(struct uffs_DeviceSt *dev,
 
 
 
+/** 
+ * get a page buffer only if it's already in buffer list.
+ * it never loads from flash nor touches the buffer list, so it's safe to
+ * call with shared device lock (see uffs_DeviceLockShared()).
+ * \param[in] dev uffs device
+ * \param[in] type file or data ?
+ * \param[in] node node on the tree
+ * \param[in] page_id page_id
+ * \return return the buffer if found, otherwise NULL.
+ */
+uffs_Buf *uffs_BufGetCached(struct uffs_DeviceSt *dev,
+							u8 type, TreeNode *node, u16 page_id)
+{
+	uffs_Buf *buf;
+	u16 parent, serial;
+	UFFS_TIMING_BEGIN(t);
+
+	switch (type) {
+	case UFFS_TYPE_DIR:
+		parent = node->u.dir.parent;
+		serial = node->u.dir.serial;
+		break;
+	case UFFS_TYPE_FILE:
+		parent = node->u.file.parent;
+		serial = node->u.file.serial;
+		break;
+	case UFFS_TYPE_DATA:
+		parent = node->u.data.parent;
+		serial = node->u.data.serial;
+		break;
+	default:
+		return NULL;
+	}
+
+	buf = uffs_BufFind(dev, parent, serial, page_id);
+	if (buf) {
+		BUF_REF_INC(buf);
+		CACHE_ST_INC(dev->cache_st.buf_get_hit);
+		UFFS_TIMING_END(UFFS_TM_BUF_GET_HIT, t);
+	}
+
+	return buf;
+}
+
 /** 
  * get a page buffer
  * \param[in] dev uffs device
@@ -1449,9 +1575,11 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 						u8 type, TreeNode *node, u16 page_id, int oflag)
 {
 	uffs_Buf *buf;
-	u16 parent, serial, block, page;
+	u16 parent, serial, page;
+	uffs_BlockNum block;
 	uffs_BlockInfo *bc;
 	int ret;
+	UFFS_TIMING_BEGIN(t);
 
 	switch (type) {
 	case UFFS_TYPE_DIR:
@@ -1476,10 +1604,14 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 
 	buf = uffs_BufFind(dev, parent, serial, page_id);
 	if (buf) {
-		buf->ref_count++;
+		BUF_REF_INC(buf);
+		CACHE_ST_INC(dev->cache_st.buf_get_hit);
+		UFFS_TIMING_END(UFFS_TM_BUF_GET_HIT, t);
 		return buf;
 	}
 
+	dev->cache_st.buf_get_miss++;
+
 	buf = _FindFreeBuf(dev);
 	if (buf == NULL) {
 		uffs_BufFlushMostDirtyGroup(dev);
@@ -1552,6 +1684,7 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 	buf->ref_count++;
 
 	_MoveNodeToHead(dev, buf);
+	UFFS_TIMING_END(UFFS_TM_BUF_GET_MISS, t);
 	
 	return buf;
 
@@ -1565,25 +1698,46 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 URET uffs_BufPut(uffs_Device *dev, uffs_Buf *buf)
 {
 	URET ret = U_FAIL;
+	u16 ref_count = (buf ? BUF_REF_GET(buf) : 0);
 
 	if (buf == NULL) {
 		uffs_Perror(UFFS_MSG_NORMAL,  "Can't put an NULL buffer!");
 	}
-	else if (buf->ref_count == 0) {
+	else if (ref_count == 0) {
 		uffs_Perror(UFFS_MSG_NORMAL,  "Putting an unused page buffer ? ");
 	}
-	else if (buf->ref_count == CLONE_BUF_MARK) {
+	else if (ref_count == CLONE_BUF_MARK) {
 		uffs_Perror(UFFS_MSG_NORMAL, "Putting an cloned page buffer ? ");
 		ret = uffs_BufFreeClone(dev, buf);
 	}
 	else {
-		buf->ref_count--;
+		BUF_REF_DEC(buf);
 		ret = U_SUCC;
 	}
 
 	return ret;
 }
 
+/** 
+ * \brief Put back a page buffer and make it the first one to be reused
+ *		if no one else is using it. For pages loaded only once in a while
+ *		(e.g. file info page), so they don't push frequently used pages out.
+ * \param[in] dev uffs device
+ * \param[in] buf buffer to be put back
+ */
+URET uffs_BufPutCold(uffs_Device *dev, uffs_Buf *buf)
+{
+	URET ret;
+
+	ret = uffs_BufPut(dev, buf);
+	if (ret == U_SUCC && BUF_REF_GET(buf) == 0 && buf->mark == UFFS_BUF_VALID) {
+		_BreakFromBufList(dev, buf);
+		_LinkToBufListTail(dev, buf);
+	}
+
+	return ret;
+}
+
 
 /** 
  * \brief clone from an exist buffer.
@@ -1729,8 +1883,87 @@ static UBOOL _IsBufInDirtyList(struct uffs_DeviceSt *dev, uffs_Buf *buf)
 }
 #endif
 
+void uffs_IoCursorInit(uffs_IoCursor *cur, const struct uffs_iovec *iov, int iovcnt)
+{
+	cur->iov = iov;
+	cur->iovcnt = iovcnt;
+	cur->idx = 0;
+	cur->ofs = 0;
+}
+
+void uffs_IoCursorZero(uffs_IoCursor *cur, u32 len)
+{
+	const struct uffs_iovec *v;
+	u32 n;
+
+	while (cur->iov && len > 0 && cur->idx < cur->iovcnt) {
+		v = &cur->iov[cur->idx];
+		n = (u32)v->iov_len - cur->ofs;
+		if (n > len)
+			n = len;
+
+		memset((u8 *)v->iov_base + cur->ofs, 0, n);
+
+		len -= n;
+		cur->ofs += n;
+		if (cur->ofs >= (u32)v->iov_len) {
+			cur->idx++;
+			cur->ofs = 0;
+		}
+	}
+}
+
+/**
+ * copy 'len' bytes between 'p' and I/O cursor, advance the cursor.
+ * if to_iov is U_FALSE and cur->iov is NULL, fill 'p' with '\0'.
+ */
+static void _IoCursorCopy(uffs_IoCursor *cur, u8 *p, u32 len, UBOOL to_iov)
+{
+	const struct uffs_iovec *v;
+	u32 n;
+
+	if (cur->iov == NULL) {
+		if (to_iov == U_FALSE)
+			memset(p, 0, len);
+		return;
+	}
+
+	while (len > 0 && cur->idx < cur->iovcnt) {
+		v = &cur->iov[cur->idx];
+		n = (u32)v->iov_len - cur->ofs;
+		if (n > len)
+			n = len;
+
+		if (to_iov)
+			memcpy((u8 *)v->iov_base + cur->ofs, p, n);
+		else
+			memcpy(p, (u8 *)v->iov_base + cur->ofs, n);
+
+		p += n;
+		len -= n;
+		cur->ofs += n;
+		if (cur->ofs >= (u32)v->iov_len) {
+			cur->idx++;
+			cur->ofs = 0;
+		}
+	}
+}
+
 URET uffs_BufWrite(struct uffs_DeviceSt *dev,
 				   uffs_Buf *buf, void *data, u32 ofs, u32 len)
+{
+	struct uffs_iovec iov;
+	uffs_IoCursor src;
+
+	iov.iov_base = data;
+	iov.iov_len = len;
+	uffs_IoCursorInit(&src, data ? &iov : NULL, 1);	// if data == NULL, then fill all '\0'.
+
+	return uffs_BufWriteV(dev, buf, &src, ofs, len);
+}
+
+URET uffs_BufWriteV(struct uffs_DeviceSt *dev,
+				   uffs_Buf *buf, uffs_IoCursor *src, u32 ofs, u32 len)
 {
 	int slot;
 
@@ -1759,10 +1992,10 @@ URET uffs_BufWrite(struct uffs_DeviceSt *dev,
 		}
 	}
 
-	if (data)
-		memcpy(buf->data + ofs, data, len);
-	else
-		memset(buf->data + ofs, 0, len);	// if data == NULL, then fill all '\0'.
+	_IoCursorCopy(src, buf->data + ofs, len, U_FALSE);
+
+	if (buf->page_id == 0 && buf->type != UFFS_TYPE_DATA)
+		uffs_FileInfoExpire(dev, buf->serial);	// dir/file info changed
 
 	if (ofs + len > buf->data_len) 
 		buf->data_len = ofs + len;
@@ -1796,6 +2029,22 @@ URET uffs_BufRead(struct uffs_DeviceSt *dev,
 	return U_SUCC;
 }
 
+URET uffs_BufReadV(struct uffs_DeviceSt *dev,
+				  uffs_Buf *buf, uffs_IoCursor *dst, u32 ofs, u32 len)
+{
+	u32 readSize;
+	u32 pg_data_size = dev->com.pg_data_size;
+
+	readSize = (ofs >= pg_data_size ? 
+					0 : (ofs + len >= pg_data_size ? pg_data_size - ofs : len)
+				);
+
+	if (readSize > 0) 
+		_IoCursorCopy(dst, buf->data + ofs, readSize, U_TRUE);
+
+	return U_SUCC;
+}
+
 
 
 
@@ -48,19 +48,19 @@
 #ifdef CONFIG_USE_PER_DEVICE_LOCK
 void uffs_DeviceInitLock(uffs_Device *dev)
 {
-	uffs_SemCreate(&dev->lock.sem);
+	uffs_RwLockCreate(&dev->lock.rwlock);
 	dev->lock.task_id = UFFS_TASK_ID_NOT_EXIST;
 	dev->lock.counter = 0;
 }
 
 void uffs_DeviceReleaseLock(uffs_Device *dev)
 {
-	uffs_SemDelete(&dev->lock.sem);
+	uffs_RwLockDelete(&dev->lock.rwlock);
 }
 
 void uffs_DeviceLock(uffs_Device *dev)
 {
-	uffs_SemWait(dev->lock.sem);
+	uffs_RwLockWrite(dev->lock.rwlock);
 	
 	if (dev->lock.counter != 0) {
 		uffs_Perror(UFFS_MSG_NORMAL,
@@ -79,7 +79,22 @@ void uffs_DeviceUnLock(uffs_Device *dev)
 					"Unlock device, counter %d NOT zero?!", dev->lock.counter);
 	}
 	
-	uffs_SemSignal(dev->lock.sem);
+	uffs_RwUnlockWrite(dev->lock.rwlock);
+}
+
+/**
+ * Shared lock: the holder may only look up the tree and the page buffers
+ * and copy data out of valid buffers. Buffer reference counts are the only
+ * thing changed under this lock, they are updated atomically.
+ */
+void uffs_DeviceLockShared(uffs_Device *dev)
+{
+	uffs_RwLockRead(dev->lock.rwlock);
+}
+
+void uffs_DeviceUnLockShared(uffs_Device *dev)
+{
+	uffs_RwUnlockRead(dev->lock.rwlock);
 }
 
 #else
@@ -89,5 +104,7 @@ void uffs_DeviceInitLock(uffs_Device *dev) {}
 void uffs_DeviceReleaseLock(uffs_Device *dev) {}
 void uffs_DeviceLock(uffs_Device *dev) {}
 void uffs_DeviceUnLock(uffs_Device *dev) {}
+void uffs_DeviceLockShared(uffs_Device *dev) {}
+void uffs_DeviceUnLockShared(uffs_Device *dev) {}
 
 #endif
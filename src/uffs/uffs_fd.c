@@ -45,15 +45,18 @@
 #include "uffs/uffs_mtb.h"
 #include "uffs/uffs_public.h"
 #include "uffs/uffs_find.h"
+#include "uffs/uffs_timing.h"
 
 #define PFX "fd  : "
 
 /**
  * \brief POSIX DIR
+ * \note 'obj' must not be the first member: a free entry of a locked pool
+ *		 keeps the free list link there, and NULL 'obj' marks a free entry.
  */
 struct uffs_dirSt {
-    struct uffs_ObjectSt   *obj;		/* dir object */
     struct uffs_FindInfoSt f;			/* find info */
+    struct uffs_ObjectSt   *obj;		/* dir object */
     struct uffs_ObjectInfoSt info;		/* object info */
     struct uffs_dirent dirent;			/* dir entry */
 };
@@ -61,11 +64,20 @@ struct uffs_dirSt {
 
 #define FD_OFFSET		3	//!< just make file handler more like POSIX (0, 1, 2 for stdin/stdout/stderr)
 
+#ifdef CONFIG_USE_PER_DEVICE_LOCK
+/* fd signature is checked without holding any lock */
+#define FD_SIGNATURE()			uffs_AtomicGet(&_fd_signature)
+#define FD_SIGNATURE_SET(sig)	uffs_AtomicSet(&_fd_signature, sig)
+#else
+#define FD_SIGNATURE()			(_fd_signature)
+#define FD_SIGNATURE_SET(sig)	(_fd_signature = (sig))
+#endif
+
 #define OBJ2FD(obj)	\
 	( \
 		( \
 			uffs_PoolGetIndex(uffs_GetObjectPool(), obj) | \
-			(_fd_signature << FD_SIGNATURE_SHIFT) \
+			(FD_SIGNATURE() << FD_SIGNATURE_SHIFT) \
 		) \
 		+ FD_OFFSET \
 	)
@@ -73,15 +85,20 @@ struct uffs_dirSt {
 /**
  * check #fd signature, convert #fd to #obj
  * if success, hold global file system lock, otherwise return with #ret
+ *
+ * \note a handle is valid if it's in the pool
+ *       and opened (a free object is never 'open_succ', a free dir entry
+ *       has NULL 'obj'). with CONFIG_USE_PER_DEVICE_LOCK no global lock
+ *       is taken here, flash operations are protected by device lock.
  */
 #define CHK_OBJ_LOCK(fd, obj, ret)	\
 	do { \
 		uffs_GlobalFsLockLock(); \
 		fd -= FD_OFFSET; \
-		if ( (fd >> FD_SIGNATURE_SHIFT) != _fd_signature ) { \
+		if ( (fd >> FD_SIGNATURE_SHIFT) != FD_SIGNATURE() ) { \
 			uffs_set_error(-UEBADF); \
 			uffs_Perror(UFFS_MSG_NOISY, "invalid fd: %d (sig: %d, expect: %d)", \
-					fd + FD_OFFSET, fd >> FD_SIGNATURE_SHIFT, _fd_signature); \
+					fd + FD_OFFSET, fd >> FD_SIGNATURE_SHIFT, FD_SIGNATURE()); \
 			uffs_GlobalFsLockUnlock(); \
 			return (ret); \
 		} \
@@ -89,7 +106,7 @@ struct uffs_dirSt {
 		obj = (uffs_Object *)uffs_PoolGetBufByIndex(uffs_GetObjectPool(), fd); \
 		if ((obj) == NULL || \
 				uffs_PoolVerify(uffs_GetObjectPool(), (obj)) == U_FALSE || \
-				uffs_PoolCheckFreeList(uffs_GetObjectPool(), (obj)) == U_TRUE) { \
+				(obj)->open_succ != U_TRUE) { \
 			uffs_set_error(-UEBADF); \
 			uffs_Perror(UFFS_MSG_NOISY, "invalid obj"); \
 			uffs_GlobalFsLockUnlock(); \
@@ -107,7 +124,7 @@ struct uffs_dirSt {
 		uffs_GlobalFsLockLock(); \
 		if ((dirp) == NULL || \
 				uffs_PoolVerify(&_dir_pool, (dirp)) == U_FALSE || \
-				uffs_PoolCheckFreeList(&_dir_pool, (dirp)) == U_TRUE) { \
+				(dirp)->obj == NULL) { \
 			uffs_set_error(-UEBADF); \
 			uffs_Perror(UFFS_MSG_NOISY, "invalid dirp"); \
 			uffs_GlobalFsLockUnlock(); \
@@ -125,7 +142,7 @@ struct uffs_dirSt {
 		uffs_GlobalFsLockLock(); \
 		if ((dirp) == NULL || \
 				uffs_PoolVerify(&_dir_pool, (dirp)) == U_FALSE || \
-				uffs_PoolCheckFreeList(&_dir_pool, (dirp)) == U_TRUE) { \
+				(dirp)->obj == NULL) { \
 			uffs_set_error(-UEBADF); \
 			uffs_Perror(UFFS_MSG_NOISY, "invalid dirp"); \
 			uffs_GlobalFsLockUnlock(); \
@@ -136,7 +153,7 @@ struct uffs_dirSt {
 
 static int _dir_pool_data[sizeof(uffs_DIR) * MAX_DIR_HANDLE / sizeof(int)];
 static uffs_Pool _dir_pool;
-static int _uffs_errno = 0;
+static int _uffs_errno = 0;		// used when platform has no per-task error slot
 
 
 //
@@ -146,15 +163,16 @@ static int _uffs_errno = 0;
 //   A thread ...sleep()...read() --> Opps, fd signature changed ! read() return error(expected).
 //
 #define MAX_FD_SIGNATURE_ROUND  (100)
-static int _fd_signature = 0;
+static volatile int _fd_signature = 0;
 
 //
 // only get called when formating UFFS partition
 //
 void uffs_FdSignatureIncrease(void)
 {
-	if (_fd_signature++ > MAX_FD_SIGNATURE_ROUND)
-		_fd_signature = 0;
+	int sig = FD_SIGNATURE();
+
+	FD_SIGNATURE_SET(sig > MAX_FD_SIGNATURE_ROUND ? 0 : sig + 1);
 }
 
 /**
@@ -162,9 +180,9 @@ void uffs_FdSignatureIncrease(void)
  */
 URET uffs_DirEntryBufInit(void)
 {
-	return uffs_PoolInit(&_dir_pool, _dir_pool_data,
+	return uffs_HandlePoolInit(&_dir_pool, _dir_pool_data,
 							sizeof(_dir_pool_data),
-							sizeof(uffs_DIR), MAX_DIR_HANDLE, U_FALSE);
+							sizeof(uffs_DIR), MAX_DIR_HANDLE);
 }
 
 /**
@@ -172,25 +190,35 @@ URET uffs_DirEntryBufInit(void)
  */
 URET uffs_DirEntryBufRelease(void)
 {
-	return uffs_PoolRelease(&_dir_pool);
+	return uffs_HandlePoolRelease(&_dir_pool);
 }
 
 /**
  * Put all dir entry buf match dev
+ * \note caller should hold the global table lock,
+ *		and call this before uffs_PutAllObjectBuf().
+ * \note others may get/put dir entries of other devices meanwhile, so
+ *		don't walk the free list (see uffs_PoolFindNextAllocated()), check
+ *		every entry instead: a free entry has NULL 'obj', an entry of this
+ *		device can't be opened or closed since caller holds the device lock.
  */
 int uffs_DirEntryBufPutAll(uffs_Device *dev)
 {
 	int count = 0;
-	uffs_DIR *dirp = NULL;
+	uffs_Pool *pool = &_dir_pool;
+	uffs_DIR *dirp;
+	u32 i, n;
 
-	do {
-		dirp = (uffs_DIR *) uffs_PoolFindNextAllocated(&_dir_pool, dirp);
-		if (dirp && dirp->obj && dirp->obj->dev &&
+	n = uffs_PoolGetBufCount(pool);
+	for (i = 0; i < n; i++) {
+		dirp = (uffs_DIR *) uffs_PoolGetBufByIndex(pool, i);
+		if (dirp && dirp->obj && dirp->obj->open_succ && dirp->obj->dev &&
 				dirp->obj->dev->dev_num == dev->dev_num) {
-			uffs_PoolPut(&_dir_pool, dirp);
+			dirp->obj = NULL;
+			uffs_PoolPutLocked(pool, dirp);
 			count++;
 		}
-	} while (dirp);
+	}
 
 	return count;
 }
@@ -203,7 +231,9 @@ uffs_Pool * uffs_DirEntryBufGetPool(void)
 
 static uffs_DIR * GetDirEntry(void)
 {
-	uffs_DIR *dirp = (uffs_DIR *) uffs_PoolGet(&_dir_pool);
+	uffs_DIR *dirp;
+
+	dirp = (uffs_DIR *) uffs_HandlePoolGet(&_dir_pool);
 
 	if (dirp)
 		memset(dirp, 0, sizeof(uffs_DIR));
@@ -213,22 +243,34 @@ static uffs_DIR * GetDirEntry(void)
 
 static void PutDirEntry(uffs_DIR *p)
 {
-	uffs_PoolPut(&_dir_pool, p);
+	p->obj = NULL;	// mark it as free, see CHK_DIR_LOCK()
+	uffs_PoolPutLocked(&_dir_pool, p);
 }
 
 
-/** get global errno
+static int * GetErrnoSlot(void)
+{
+#ifdef CONFIG_USE_PER_TASK_ERRNO
+	int *slot = uffs_OSGetErrnoSlot();
+
+	return slot ? slot : &_uffs_errno;
+#else
+	return &_uffs_errno;
+#endif
+}
+
+/** get errno of current task
  */
 int uffs_get_error(void)
 {
-	return _uffs_errno;
+	return *GetErrnoSlot();
 }
 
-/** set global errno
+/** set errno of current task
  */
 int uffs_set_error(int err)
 {
-	return (_uffs_errno = err);
+	return (*GetErrnoSlot() = err);
 }
 
 /* POSIX compliant file system APIs */
@@ -237,6 +279,7 @@ int uffs_open(const char *name, int oflag, ...)
 {
 	uffs_Object *obj;
 	int ret = 0;
+	UFFS_TIMING_BEGIN(t);
 
 	uffs_GlobalFsLockLock();
 
@@ -256,6 +299,7 @@ int uffs_open(const char *name, int oflag, ...)
 		}
 	}
 
+	UFFS_TIMING_END(UFFS_TM_OPEN, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -265,6 +309,7 @@ int uffs_close(int fd)
 {
 	int ret = 0;
 	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
 
 	CHK_OBJ_LOCK(fd, obj, -1);
 
@@ -278,6 +323,7 @@ int uffs_close(int fd)
 		ret = 0;
 	}
 
+	UFFS_TIMING_END(UFFS_TM_CLOSE, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -287,12 +333,14 @@ int uffs_read(int fd, void *data, int len)
 {
 	int ret;
 	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
 
 	CHK_OBJ_LOCK(fd, obj, -1);
 	uffs_ClearObjectErr(obj);
 	ret = uffs_ReadObject(obj, data, len);
 	uffs_set_error(-uffs_GetObjectErr(obj));
 
+	UFFS_TIMING_END(UFFS_TM_READ, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -302,12 +350,106 @@ int uffs_write(int fd, const void *data, int len)
 {
 	int ret;
 	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
 
 	CHK_OBJ_LOCK(fd, obj, -1);
 	uffs_ClearObjectErr(obj);
 	ret = uffs_WriteObject(obj, data, len);
 	uffs_set_error(-uffs_GetObjectErr(obj));
 
+	UFFS_TIMING_END(UFFS_TM_WRITE, t);
+	uffs_GlobalFsLockUnlock();
+
+	return ret;
+}
+
+int uffs_pread(int fd, void *data, int len, long offset)
+{
+	int ret = -1;
+	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
+
+	CHK_OBJ_LOCK(fd, obj, -1);
+	uffs_ClearObjectErr(obj);
+	if (offset < 0)
+		obj->err = UEINVAL;
+	else
+		ret = uffs_ReadObjectAt(obj, data, len, (u32)offset);
+	uffs_set_error(-uffs_GetObjectErr(obj));
+
+	UFFS_TIMING_END(UFFS_TM_READ, t);
+	uffs_GlobalFsLockUnlock();
+
+	return ret;
+}
+
+int uffs_pwrite(int fd, const void *data, int len, long offset)
+{
+	int ret = -1;
+	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
+
+	CHK_OBJ_LOCK(fd, obj, -1);
+	uffs_ClearObjectErr(obj);
+	if (offset < 0)
+		obj->err = UEINVAL;
+	else
+		ret = uffs_WriteObjectAt(obj, data, len, (u32)offset);
+	uffs_set_error(-uffs_GetObjectErr(obj));
+
+	UFFS_TIMING_END(UFFS_TM_WRITE, t);
+	uffs_GlobalFsLockUnlock();
+
+	return ret;
+}
+
+int uffs_readv(int fd, const struct uffs_iovec *iov, int iovcnt)
+{
+	int ret;
+	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
+
+	CHK_OBJ_LOCK(fd, obj, -1);
+	uffs_ClearObjectErr(obj);
+	ret = uffs_ReadObjectV(obj, iov, iovcnt);
+	uffs_set_error(-uffs_GetObjectErr(obj));
+
+	UFFS_TIMING_END(UFFS_TM_READ, t);
+	uffs_GlobalFsLockUnlock();
+
+	return uffs_GetObjectErr(obj) == UEINVAL ? -1 : ret;
+}
+
+int uffs_writev(int fd, const struct uffs_iovec *iov, int iovcnt)
+{
+	int ret;
+	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
+
+	CHK_OBJ_LOCK(fd, obj, -1);
+	uffs_ClearObjectErr(obj);
+	ret = uffs_WriteObjectV(obj, iov, iovcnt);
+	uffs_set_error(-uffs_GetObjectErr(obj));
+
+	UFFS_TIMING_END(UFFS_TM_WRITE, t);
+	uffs_GlobalFsLockUnlock();
+
+	return uffs_GetObjectErr(obj) == UEINVAL ? -1 : ret;
+}
+
+int uffs_pwrite_atomic(int fd, const struct uffs_iovec *iov, const long *offset, int n)
+{
+	int ret = -1;
+	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
+
+	CHK_OBJ_LOCK(fd, obj, -1);
+	uffs_ClearObjectErr(obj);
+	if (uffs_WriteObjectAtomic(obj, iov, offset, n) == U_SUCC)
+		ret = 0;
+	uffs_set_error(-uffs_GetObjectErr(obj));
+
+	UFFS_TIMING_END(UFFS_TM_WRITE, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -317,12 +459,31 @@ long uffs_seek(int fd, long offset, int origin)
 {
 	int ret;
 	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
 
 	CHK_OBJ_LOCK(fd, obj, -1);
 	uffs_ClearObjectErr(obj);
 	ret = uffs_SeekObject(obj, offset, origin);
 	uffs_set_error(-uffs_GetObjectErr(obj));
 	
+	UFFS_TIMING_END(UFFS_TM_SEEK, t);
+	uffs_GlobalFsLockUnlock();
+
+	return ret;
+}
+
+int uffs_skip(int fd, int size)
+{
+	int ret;
+	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
+
+	CHK_OBJ_LOCK(fd, obj, -1);
+	uffs_ClearObjectErr(obj);
+	ret = uffs_SkipObject(obj, size);
+	uffs_set_error(-uffs_GetObjectErr(obj));
+
+	UFFS_TIMING_END(UFFS_TM_SEEK, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -362,12 +523,14 @@ int uffs_flush(int fd)
 {
 	int ret;
 	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
 
 	CHK_OBJ_LOCK(fd, obj, -1);
 	uffs_ClearObjectErr(obj);
 	ret = (uffs_FlushObject(obj) == U_SUCC) ? 0 : -1;
 	uffs_set_error(-uffs_GetObjectErr(obj));
 	
+	UFFS_TIMING_END(UFFS_TM_FLUSH, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -377,10 +540,12 @@ int uffs_rename(const char *old_name, const char *new_name)
 {
 	int err = 0;
 	int ret = 0;
+	UFFS_TIMING_BEGIN(t);
 
 	uffs_GlobalFsLockLock();
 	ret = (uffs_RenameObject(old_name, new_name, &err) == U_SUCC) ? 0 : -1;
 	uffs_set_error(-err);
+	UFFS_TIMING_END(UFFS_TM_RENAME, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -391,6 +556,7 @@ int uffs_remove(const char *name)
 	int err = 0;
 	int ret = 0;
 	struct uffs_stat st;
+	UFFS_TIMING_BEGIN(t);
 
 	if (uffs_stat(name, &st) < 0) {
 		err = UENOENT;
@@ -408,6 +574,7 @@ int uffs_remove(const char *name)
 		else {
 			ret = -1;
 		}
+		UFFS_TIMING_END(UFFS_TM_REMOVE, t);
 		uffs_GlobalFsLockUnlock();
 	}
 
@@ -419,16 +586,56 @@ int uffs_ftruncate(int fd, long remain)
 {
 	int ret;
 	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
 
 	CHK_OBJ_LOCK(fd, obj, -1);
 	uffs_ClearObjectErr(obj);
 	ret = (uffs_TruncateObject(obj, remain) == U_SUCC) ? 0 : -1;
 	uffs_set_error(-uffs_GetObjectErr(obj));
+	UFFS_TIMING_END(UFFS_TM_FTRUNCATE, t);
 	uffs_GlobalFsLockUnlock();
 	
 	return ret;
 }
 
+int uffs_fallocate(int fd, long len)
+{
+	int ret = -1;
+	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
+
+	CHK_OBJ_LOCK(fd, obj, -1);
+	uffs_ClearObjectErr(obj);
+	if (len < 0)
+		obj->err = UEINVAL;
+	else
+		ret = (uffs_FallocateObject(obj, (u32)len) == U_SUCC) ? 0 : -1;
+	uffs_set_error(-uffs_GetObjectErr(obj));
+	UFFS_TIMING_END(UFFS_TM_FALLOCATE, t);
+	uffs_GlobalFsLockUnlock();
+
+	return ret;
+}
+
+static void do_info2stat(uffs_Device *dev, const uffs_ObjectInfo *info, struct uffs_stat *buf)
+{
+	buf->st_dev = dev->dev_num;
+	buf->st_ino = info->serial;
+	buf->st_nlink = 0;
+	buf->st_uid = 0;
+	buf->st_gid = 0;
+	buf->st_rdev = 0;
+	buf->st_size = info->len;
+	buf->st_blksize = dev->com.pg_data_size;
+	buf->st_blocks = 0;
+	buf->st_atime = info->info.last_modify;
+	buf->st_mtime = info->info.last_modify;
+	buf->st_ctime = info->info.create_time;
+	buf->st_mode = (info->info.attr & FILE_ATTR_DIR ? US_IFDIR : US_IFREG);
+	if (info->info.attr & FILE_ATTR_WRITE)
+		buf->st_mode |= US_IRWXU;
+}
+
 static int do_stat(uffs_Object *obj, struct uffs_stat *buf)
 {
 	uffs_ObjectInfo info;
@@ -439,21 +646,7 @@ static int do_stat(uffs_Object *obj, struct uffs_stat *buf)
 		ret = -1;
 	}
 	else {
-		buf->st_dev = obj->dev->dev_num;
-		buf->st_ino = info.serial;
-		buf->st_nlink = 0;
-		buf->st_uid = 0;
-		buf->st_gid = 0;
-		buf->st_rdev = 0;
-		buf->st_size = info.len;
-		buf->st_blksize = obj->dev->com.pg_data_size;
-		buf->st_blocks = 0;
-		buf->st_atime = info.info.last_modify;
-		buf->st_mtime = info.info.last_modify;
-		buf->st_ctime = info.info.create_time;
-		buf->st_mode = (info.info.attr & FILE_ATTR_DIR ? US_IFDIR : US_IFREG);
-		if (info.info.attr & FILE_ATTR_WRITE)
-			buf->st_mode |= US_IRWXU;
+		do_info2stat(obj->dev, &info, buf);
 	}
 
 	uffs_set_error(-err);
@@ -466,6 +659,7 @@ int uffs_stat(const char *name, struct uffs_stat *buf)
 	int ret = 0;
 	int err = 0;
 	URET result;
+	UFFS_TIMING_BEGIN(t);
 
 	uffs_GlobalFsLockLock();
 
@@ -494,6 +688,7 @@ int uffs_stat(const char *name, struct uffs_stat *buf)
 	}
 
 	uffs_set_error(-err);
+	UFFS_TIMING_END(UFFS_TM_STAT, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -508,15 +703,60 @@ int uffs_fstat(int fd, struct uffs_stat *buf)
 {
 	int ret;
 	uffs_Object *obj;
+	UFFS_TIMING_BEGIN(t);
 
 	CHK_OBJ_LOCK(fd, obj, -1);
 
 	ret = do_stat(obj, buf);
+	UFFS_TIMING_END(UFFS_TM_STAT, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
 }
 
+static void do_wstat(uffs_Device *dev, const uffs_WriteStat *ws, struct uffs_wstat *buf)
+{
+	buf->ws_bytes = ws->bytes_written;
+	buf->ws_programmed = ws->pages_programmed;
+	buf->ws_copied = ws->pages_copied;
+	buf->ws_erased = ws->blocks_erased;
+	buf->ws_page_size = dev->com.pg_data_size;
+}
+
+int uffs_fwstat(int fd, struct uffs_wstat *buf)
+{
+	uffs_Object *obj;
+
+	CHK_OBJ_LOCK(fd, obj, -1);
+
+	do_wstat(obj->dev, &obj->write_st, buf);
+	uffs_GlobalFsLockUnlock();
+
+	return 0;
+}
+
+int uffs_wstat(const char *mount_point, struct uffs_wstat *buf)
+{
+	uffs_Device *dev = NULL;
+	int ret = -1;
+
+	dev = uffs_GetDeviceFromMountPoint(mount_point);
+	if (dev) {
+		uffs_GlobalFsLockLock();
+		uffs_DeviceLock(dev);
+		do_wstat(dev, &dev->write_st, buf);
+		uffs_DeviceUnLock(dev);
+		uffs_PutDevice(dev);
+		uffs_GlobalFsLockUnlock();
+		ret = 0;
+	}
+	else {
+		uffs_set_error(-UENOENT);
+	}
+
+	return ret;
+}
+
 int uffs_closedir(uffs_DIR *dirp)
 {
 	CHK_DIR_LOCK(dirp, -1);
@@ -537,6 +777,7 @@ uffs_DIR * uffs_opendir(const char *path)
 	int err = 0;
 	uffs_DIR *ret = NULL;
 	uffs_DIR *dirp;
+	UFFS_TIMING_BEGIN(t);
 
 	uffs_GlobalFsLockLock();
 
@@ -570,32 +811,65 @@ uffs_DIR * uffs_opendir(const char *path)
 	}
 ext:
 	uffs_set_error(-err);
+	UFFS_TIMING_END(UFFS_TM_OPENDIR, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
 }
 
+static void do_info2dirent(uffs_DIR *dirp, struct uffs_dirent *ent)
+{
+	ent->d_ino = dirp->info.serial;
+	ent->d_namelen = dirp->info.info.name_len < (sizeof(ent->d_name) - 1) ? dirp->info.info.name_len : (sizeof(ent->d_name) - 1);
+	memcpy(ent->d_name, dirp->info.info.name, ent->d_namelen);
+	ent->d_name[ent->d_namelen] = '\0';
+	ent->d_off = dirp->f.pos;
+	ent->d_reclen = sizeof(struct uffs_dirent);
+	ent->d_type = dirp->info.info.attr;
+}
+
 struct uffs_dirent * uffs_readdir(uffs_DIR *dirp)
 {
 	struct uffs_dirent *ent = NULL;
+	UFFS_TIMING_BEGIN(t);
 
 	CHK_DIR_LOCK(dirp, NULL);
 
 	if (uffs_FindObjectNext(&dirp->info, &dirp->f) == U_SUCC) {
 		ent = &dirp->dirent;
-		ent->d_ino = dirp->info.serial;
-		ent->d_namelen = dirp->info.info.name_len < (sizeof(ent->d_name) - 1) ? dirp->info.info.name_len : (sizeof(ent->d_name) - 1);
-		memcpy(ent->d_name, dirp->info.info.name, ent->d_namelen);
-		ent->d_name[ent->d_namelen] = '\0';
-		ent->d_off = dirp->f.pos;
-		ent->d_reclen = sizeof(struct uffs_dirent);
-		ent->d_type = dirp->info.info.attr;
+		do_info2dirent(dirp, ent);
 	}
+	UFFS_TIMING_END(UFFS_TM_READDIR, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ent;
 }
 
+int uffs_readdirplus(uffs_DIR *dirp, struct uffs_direntplus *ents, int n)
+{
+	int count = 0;
+	UFFS_TIMING_BEGIN(t);
+
+	CHK_DIR_LOCK(dirp, -1);
+
+	if (ents == NULL || n < 0) {
+		uffs_set_error(-UEINVAL);
+		count = -1;
+	}
+	else {
+		// object info comes with the directory walk, no need to open each entry
+		while (count < n && uffs_FindObjectNext(&dirp->info, &dirp->f) == U_SUCC) {
+			do_info2dirent(dirp, &ents[count].d);
+			do_info2stat(dirp->obj->dev, &dirp->info, &ents[count].st);
+			count++;
+		}
+	}
+	UFFS_TIMING_END(UFFS_TM_READDIR, t);
+	uffs_GlobalFsLockUnlock();
+
+	return count;
+}
+
 void uffs_rewinddir(uffs_DIR *dirp)
 {
 	CHK_DIR_VOID_LOCK(dirp);
@@ -611,6 +885,7 @@ int uffs_mkdir(const char *name, ...)
 	uffs_Object *obj;
 	int ret = 0;
 	int err = 0;
+	UFFS_TIMING_BEGIN(t);
 
 	uffs_GlobalFsLockLock();
 
@@ -632,6 +907,7 @@ int uffs_mkdir(const char *name, ...)
 	}
 
 	uffs_set_error(-err);
+	UFFS_TIMING_END(UFFS_TM_MKDIR, t);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -642,6 +918,7 @@ int uffs_rmdir(const char *name)
 	int err = 0;
 	int ret = 0;
 	struct uffs_stat st;
+	UFFS_TIMING_BEGIN(t);
 
 	if (uffs_stat(name, &st) < 0) {
 		err = UENOENT;
@@ -659,6 +936,7 @@ int uffs_rmdir(const char *name)
 		else {
 			ret = -1;
 		}
+		UFFS_TIMING_END(UFFS_TM_RMDIR, t);
 		uffs_GlobalFsLockUnlock();
 	}
 	uffs_set_error(-err);
@@ -677,9 +955,9 @@ int uffs_format(const char *mount_point)
 
 	dev = uffs_GetDeviceFromMountPoint(mount_point);
 	if (dev) {
-		uffs_GlobalFsLockLock();
+		// uffs_FormatDevice() takes the lock by itself
 		ret = uffs_FormatDevice(dev, U_TRUE);
-		uffs_GlobalFsLockUnlock();
+		uffs_PutDevice(dev);
 	}
 
 	return ret == U_SUCC ? 0 : -1;
@@ -693,7 +971,10 @@ long uffs_space_total(const char *mount_point)
 	dev = uffs_GetDeviceFromMountPoint(mount_point);
 	if (dev) {
 		uffs_GlobalFsLockLock();
+		uffs_DeviceLock(dev);
 		ret = (long) uffs_GetDeviceTotal(dev);
+		uffs_DeviceUnLock(dev);
+		uffs_PutDevice(dev);
 		uffs_GlobalFsLockUnlock();
 	}
 
@@ -708,7 +989,10 @@ long uffs_space_used(const char *mount_point)
 	dev = uffs_GetDeviceFromMountPoint(mount_point);
 	if (dev) {
 		uffs_GlobalFsLockLock();
+		uffs_DeviceLock(dev);
 		ret = (long) uffs_GetDeviceUsed(dev);
+		uffs_DeviceUnLock(dev);
+		uffs_PutDevice(dev);
 		uffs_GlobalFsLockUnlock();
 	}
 
@@ -723,7 +1007,10 @@ long uffs_space_free(const char *mount_point)
 	dev = uffs_GetDeviceFromMountPoint(mount_point);
 	if (dev) {
 		uffs_GlobalFsLockLock();
+		uffs_DeviceLock(dev);
 		ret = (long) uffs_GetDeviceFree(dev);
+		uffs_DeviceUnLock(dev);
+		uffs_PutDevice(dev);
 		uffs_GlobalFsLockUnlock();
 	}
 
@@ -738,9 +1025,234 @@ void uffs_flush_all(const char *mount_point)
 	dev = uffs_GetDeviceFromMountPoint(mount_point);
 	if (dev) {
 		uffs_GlobalFsLockLock();
+		uffs_DeviceLock(dev);
 		uffs_BufFlushAll(dev);
+		uffs_DeviceUnLock(dev);
 		uffs_PutDevice(dev);
 		uffs_GlobalFsLockUnlock();
 	}
 }
 
+int uffs_fs_lock(void)
+{
+#ifdef CONFIG_USE_GLOBAL_FS_LOCK
+	// without a task id the lock can't nest, fd APIs would deadlock on it
+	if (uffs_OSGetTaskId() == 0) {
+		uffs_set_error(-UEINVAL);
+		return -1;
+	}
+#endif
+	uffs_GlobalFsLockLock();
+
+	return 0;
+}
+
+void uffs_fs_unlock(void)
+{
+	uffs_GlobalFsLockUnlock();
+}
+
+
+
+/*
+ * Reentrant variants: same as the APIs above, but also return the error
+ * number of this call through 'err' (if not NULL), so the caller don't
+ * need a uffs_get_error() afterwards. 'err' is UENOERR if no error.
+ */
+#define CALL_R(ret, call, err) \
+	do { \
+		int *slot_ = GetErrnoSlot(); \
+		*slot_ = UENOERR; \
+		ret = call; \
+		if (err) \
+			*(err) = *slot_; \
+	} while (0)
+
+int uffs_open_r(const char *name, int oflag, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_open(name, oflag), err);
+	return ret;
+}
+
+int uffs_close_r(int fd, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_close(fd), err);
+	return ret;
+}
+
+int uffs_read_r(int fd, void *data, int len, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_read(fd, data, len), err);
+	return ret;
+}
+
+int uffs_write_r(int fd, const void *data, int len, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_write(fd, data, len), err);
+	return ret;
+}
+
+int uffs_pread_r(int fd, void *data, int len, long offset, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_pread(fd, data, len, offset), err);
+	return ret;
+}
+
+int uffs_pwrite_r(int fd, const void *data, int len, long offset, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_pwrite(fd, data, len, offset), err);
+	return ret;
+}
+
+int uffs_readv_r(int fd, const struct uffs_iovec *iov, int iovcnt, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_readv(fd, iov, iovcnt), err);
+	return ret;
+}
+
+int uffs_writev_r(int fd, const struct uffs_iovec *iov, int iovcnt, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_writev(fd, iov, iovcnt), err);
+	return ret;
+}
+
+int uffs_pwrite_atomic_r(int fd, const struct uffs_iovec *iov, const long *offset, int n, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_pwrite_atomic(fd, iov, offset, n), err);
+	return ret;
+}
+
+long uffs_seek_r(int fd, long offset, int origin, int *err)
+{
+	long ret;
+	CALL_R(ret, uffs_seek(fd, offset, origin), err);
+	return ret;
+}
+
+int uffs_skip_r(int fd, int size, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_skip(fd, size), err);
+	return ret;
+}
+
+long uffs_tell_r(int fd, int *err)
+{
+	long ret;
+	CALL_R(ret, uffs_tell(fd), err);
+	return ret;
+}
+
+int uffs_eof_r(int fd, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_eof(fd), err);
+	return ret;
+}
+
+int uffs_flush_r(int fd, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_flush(fd), err);
+	return ret;
+}
+
+int uffs_rename_r(const char *old_name, const char *new_name, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_rename(old_name, new_name), err);
+	return ret;
+}
+
+int uffs_remove_r(const char *name, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_remove(name), err);
+	return ret;
+}
+
+int uffs_ftruncate_r(int fd, long remain, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_ftruncate(fd, remain), err);
+	return ret;
+}
+
+int uffs_fallocate_r(int fd, long len, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_fallocate(fd, len), err);
+	return ret;
+}
+
+int uffs_mkdir_r(const char *name, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_mkdir(name), err);
+	return ret;
+}
+
+int uffs_rmdir_r(const char *name, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_rmdir(name), err);
+	return ret;
+}
+
+int uffs_stat_r(const char *name, struct uffs_stat *buf, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_stat(name, buf), err);
+	return ret;
+}
+
+int uffs_lstat_r(const char *name, struct uffs_stat *buf, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_lstat(name, buf), err);
+	return ret;
+}
+
+int uffs_fstat_r(int fd, struct uffs_stat *buf, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_fstat(fd, buf), err);
+	return ret;
+}
+
+uffs_DIR * uffs_opendir_r(const char *path, int *err)
+{
+	uffs_DIR *ret;
+	CALL_R(ret, uffs_opendir(path), err);
+	return ret;
+}
+
+int uffs_closedir_r(uffs_DIR *dirp, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_closedir(dirp), err);
+	return ret;
+}
+
+struct uffs_dirent * uffs_readdir_r(uffs_DIR *dirp, int *err)
+{
+	struct uffs_dirent *ret;
+	CALL_R(ret, uffs_readdir(dirp), err);
+	return ret;
+}
+
+int uffs_readdirplus_r(uffs_DIR *dirp, struct uffs_direntplus *ents, int n, int *err)
+{
+	int ret;
+	CALL_R(ret, uffs_readdirplus(dirp, ents, n), err);
+	return ret;
+}
@@ -0,0 +1,308 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_fileinfo.c
+ * \brief file info cache, keep uffs_FileInfo of recently used dirs/files in RAM
+ * \author Ricky Zheng
+ */
+
+#include "uffs_config.h"
+#include "uffs/uffs_fileinfo.h"
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_buf.h"
+#include "uffs/uffs_os.h"
+
+#include <string.h>
+
+#define PFX "fi  : "
+
+/**
+ * \brief initialize file info cache
+ *
+ * \param[in] dev uffs device
+ * \param[in] max_entries maximum cache entries to be allocated,
+ *				the cache is disabled if max_entries <= 0
+ * \return result of initialization
+ *		\retval U_SUCC successful
+ *		\retval U_FAIL failed
+ */
+URET uffs_FileInfoInitCache(uffs_Device *dev, int max_entries)
+{
+	struct uffs_FileInfoEntrySt *entries;
+	int size, i;
+
+	if (dev->fc.mem_pool != NULL) {
+		uffs_Perror(UFFS_MSG_NOISY,
+					"file info cache has been inited already, "
+					"now release it first.");
+		uffs_FileInfoReleaseCache(dev);
+	}
+
+	memset(&dev->fc, 0, sizeof(dev->fc));
+
+	if (max_entries <= 0) {
+		uffs_Perror(UFFS_MSG_NOISY, "file info cache disabled.");
+		return U_SUCC;
+	}
+
+	size = sizeof(struct uffs_FileInfoEntrySt) * max_entries;
+
+	if (dev->mem.fileinfo_pool_size == 0) {
+		if (dev->mem.malloc) {
+			dev->mem.fileinfo_pool_buf = dev->mem.malloc(dev, size);
+			if (dev->mem.fileinfo_pool_buf)
+				dev->mem.fileinfo_pool_size = size;
+		}
+	}
+	if (size > dev->mem.fileinfo_pool_size) {
+		uffs_Perror(UFFS_MSG_DEAD,
+					"File info cache buffer require %d but only %d available.",
+					size, dev->mem.fileinfo_pool_size);
+		return U_FAIL;
+	}
+
+	uffs_Perror(UFFS_MSG_NOISY, "alloc file info cache %d bytes.", size);
+
+	entries = (struct uffs_FileInfoEntrySt *) dev->mem.fileinfo_pool_buf;
+	memset(entries, 0, size);
+
+	dev->fc.mem_pool = entries;
+
+	for (i = 0; i < max_entries; i++) {
+		entries[i].serial = INVALID_UFFS_SERIAL;
+		entries[i].prev = (i > 0 ? &entries[i - 1] : NULL);
+		entries[i].next = (i < max_entries - 1 ? &entries[i + 1] : NULL);
+	}
+
+	dev->fc.head = &entries[0];
+	dev->fc.tail = &entries[max_entries - 1];
+
+	return U_SUCC;
+}
+
+/**
+ * \brief release file info cache
+ * \param[in] dev uffs device
+ * \return U_SUCC
+ */
+URET uffs_FileInfoReleaseCache(uffs_Device *dev)
+{
+	if (dev->fc.mem_pool && dev->mem.free) {
+		dev->mem.free(dev, dev->fc.mem_pool);
+		dev->mem.fileinfo_pool_size = 0;
+	}
+
+	memset(&dev->fc, 0, sizeof(dev->fc));
+
+	return U_SUCC;
+}
+
+static void _BreakFromList(uffs_Device *dev, struct uffs_FileInfoEntrySt *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+
+	if (e->next)
+		e->next->prev = e->prev;
+
+	if (dev->fc.head == e)
+		dev->fc.head = e->next;
+
+	if (dev->fc.tail == e)
+		dev->fc.tail = e->prev;
+}
+
+static void _MoveToTail(uffs_Device *dev, struct uffs_FileInfoEntrySt *e)
+{
+	if (dev->fc.tail == e)
+		return;
+
+	_BreakFromList(dev, e);
+
+	e->next = NULL;
+	e->prev = dev->fc.tail;
+	e->prev->next = e;
+	dev->fc.tail = e;
+}
+
+static void _MoveToHead(uffs_Device *dev, struct uffs_FileInfoEntrySt *e)
+{
+	if (dev->fc.head == e)
+		return;
+
+	_BreakFromList(dev, e);
+
+	e->prev = NULL;
+	e->next = dev->fc.head;
+	e->next->prev = e;
+	dev->fc.head = e;
+}
+
+/** remove entry from the hash table, the entry must be in use */
+static void _BreakFromHash(uffs_Device *dev, struct uffs_FileInfoEntrySt *e)
+{
+	struct uffs_FileInfoEntrySt **p = &dev->fc.hash[FILE_INFO_HASH(e->serial)];
+
+	while (*p) {
+		if (*p == e) {
+			*p = e->hash_next;
+			break;
+		}
+		p = &((*p)->hash_next);
+	}
+
+	e->hash_next = NULL;
+	e->serial = INVALID_UFFS_SERIAL;
+}
+
+static struct uffs_FileInfoEntrySt * _FindEntry(uffs_Device *dev, u16 serial)
+{
+	struct uffs_FileInfoEntrySt *e = dev->fc.hash[FILE_INFO_HASH(serial)];
+
+	while (e) {
+		if (e->serial == serial)
+			return e;
+		e = e->hash_next;
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief load file info of a dir or file.
+ *
+ * \param[in] dev uffs device
+ * \param[in] type UFFS_TYPE_DIR or UFFS_TYPE_FILE
+ * \param[in] node dir/file node on the tree
+ * \param[out] fi file info, can be NULL if only 'sum' is wanted
+ * \param[out] sum sum of file name, can be NULL
+ *
+ * \return U_SUCC or U_FAIL (can't load file info page).
+ *
+ * \note on a cache miss, the page buffer the info page is loaded into
+ *		 is put back as the first one to be reused, so metadata lookups
+ *		 don't push data pages out of page buffers.
+ */
+URET uffs_FileInfoLoad(uffs_Device *dev, int type, TreeNode *node,
+					   uffs_FileInfo *fi, u16 *sum)
+{
+	struct uffs_FileInfoEntrySt *e;
+	uffs_FileInfo *info;
+	uffs_Buf *buf;
+	UBOOL loaded = U_FALSE;
+	u16 serial;
+
+	serial = (type == UFFS_TYPE_DIR ? node->u.dir.serial : node->u.file.serial);
+
+	e = _FindEntry(dev, serial);
+	if (e) {
+		dev->cache_st.fi_hit++;
+		_MoveToTail(dev, e);
+		if (fi)
+			memcpy(fi, &e->info, sizeof(uffs_FileInfo));
+		if (sum)
+			*sum = e->sum;
+		return U_SUCC;
+	}
+
+	dev->cache_st.fi_miss++;
+
+	buf = uffs_BufGetCached(dev, (u8)type, node, 0);
+	if (buf == NULL) {
+		buf = uffs_BufGetEx(dev, (u8)type, node, 0, 0);
+		loaded = U_TRUE;
+	}
+
+	if (buf == NULL) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "can't get file info page !");
+		return U_FAIL;
+	}
+
+	info = (uffs_FileInfo *)(buf->data);
+
+	if (fi)
+		memcpy(fi, info, sizeof(uffs_FileInfo));
+	if (sum)
+		*sum = uffs_MakeSum16(info->name, info->name_len);
+
+	e = dev->fc.head;
+	if (e) {
+		if (e->serial != INVALID_UFFS_SERIAL)
+			_BreakFromHash(dev, e);
+
+		memcpy(&e->info, info, sizeof(uffs_FileInfo));
+		e->sum = uffs_MakeSum16(info->name, info->name_len);
+		e->serial = serial;
+		e->hash_next = dev->fc.hash[FILE_INFO_HASH(serial)];
+		dev->fc.hash[FILE_INFO_HASH(serial)] = e;
+		_MoveToTail(dev, e);
+	}
+
+	if (loaded)
+		uffs_BufPutCold(dev, buf);
+	else
+		uffs_BufPut(dev, buf);
+
+	return U_SUCC;
+}
+
+/**
+ * \brief drop cached file info of dir/file 'serial'.
+ *			should be called when file info is changed or the object is deleted.
+ */
+void uffs_FileInfoExpire(uffs_Device *dev, u16 serial)
+{
+	struct uffs_FileInfoEntrySt *e;
+
+	e = _FindEntry(dev, serial);
+	if (e) {
+		_BreakFromHash(dev, e);
+		_MoveToHead(dev, e);
+	}
+}
+
+/**
+ * \brief drop all cached file info, e.g. when the device is formatted.
+ */
+void uffs_FileInfoExpireAll(uffs_Device *dev)
+{
+	struct uffs_FileInfoEntrySt *e;
+
+	for (e = dev->fc.head; e; e = e->next) {
+		e->serial = INVALID_UFFS_SERIAL;
+		e->hash_next = NULL;
+	}
+
+	memset(dev->fc.hash, 0, sizeof(dev->fc.hash));
+}
+
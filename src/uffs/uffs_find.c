@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include "uffs_config.h"
 #include "uffs/uffs_find.h"
+#include "uffs/uffs_fileinfo.h"
 
 #define TPOOL(dev) &((dev)->mem.tree_pool)
 
@@ -57,18 +58,12 @@ static URET _LoadObjectInfo(uffs_Device *dev,
 							int type,
 							int *err)
 {
-	uffs_Buf *buf;
-
-	buf = uffs_BufGetEx(dev, (u8)type, node, 0, 0);
-
-	if (buf == NULL) {
+	if (uffs_FileInfoLoad(dev, type, node, &(info->info), NULL) != U_SUCC) {
 		if (err)
 			*err = UENOMEM;
 		return U_FAIL;
 	}
 
-	memcpy(&(info->info), buf->data, sizeof(uffs_FileInfo));
-
 	if (type == UFFS_TYPE_DIR) {
 		info->len = 0;
 		info->serial = node->u.dir.serial;
@@ -78,8 +73,6 @@ static URET _LoadObjectInfo(uffs_Device *dev,
 		info->serial = node->u.file.serial;
 	}
 
-	uffs_BufPut(dev, buf);
-
 	return U_SUCC;
 }
 
@@ -164,7 +157,9 @@ URET uffs_FindObjectOpenEx(uffs_FindInfo *f, uffs_Device *dev, int dir)
 	if (f == NULL || dev == NULL)
 		return U_FAIL;
 
+	uffs_DeviceLock(dev);
 	node = uffs_TreeFindDirNode(dev, dir);
+	uffs_DeviceUnLock(dev);
 
 	if (node == NULL)
 		return U_FAIL;
@@ -177,7 +172,7 @@ URET uffs_FindObjectOpenEx(uffs_FindInfo *f, uffs_Device *dev, int dir)
 }
 
 
-static URET do_FindObject(uffs_FindInfo *f, uffs_ObjectInfo *info, u16 x)
+static URET do_FindObject(uffs_FindInfo *f, uffs_ObjectInfo *info, uffs_NodeIdx x)
 {
 	URET ret = U_SUCC;
 	TreeNode *node;
@@ -42,6 +42,7 @@
 #include "uffs/uffs_device.h"
 #include "uffs/uffs_badblock.h"
 #include "uffs/uffs_crc.h"
+#include "uffs/uffs_timing.h"
 #include <string.h>
 
 #define PFX "flsh: "
@@ -54,6 +55,24 @@
 
 #define TAG_STORE_SIZE	(sizeof(struct uffs_TagStoreSt))
 
+/* page data length over TAG_DATA_LEN_MAX needs one more byte after tag store in spare */
+#define TAG_EXT_SIZE(dev) \
+	((dev)->attr->page_data_size - sizeof(struct uffs_MiniHeaderSt) > TAG_DATA_LEN_MAX ? 1 : 0)
+#define TAG_SPARE_SIZE(dev)	(TAG_STORE_SIZE + TAG_EXT_SIZE(dev))
+
+/* tag ext byte: data_len_hi in low nibble, inverted in high nibble */
+#define TAG_EXT_ENCODE(hi)	((u8)(((hi) & 0xF) | ((~(hi) & 0xF) << 4)))
+#define TAG_EXT_DECODE(b)	((((b) ^ ((b) >> 4)) & 0xF) == 0xF ? (u8)((b) & 0xF) : TAG_DATA_LEN_HI_BAD)
+
+/* a spare pool buffer holds the spare, then ECC calculated and ECC stored of a page */
+#define ALIGN4(n)	(((n) + 3) & ~3)
+#define SPARE_BUF_ECC_SIZE(dev) \
+	ALIGN4(ECC_SIZE(dev) > UFFS_ECC_SIZE_OF((dev)->attr->page_data_size) ? \
+			ECC_SIZE(dev) : UFFS_ECC_SIZE_OF((dev)->attr->page_data_size))
+#define SPARE_BUF_SIZE(dev)	(ALIGN4((dev)->attr->spare_size) + 2 * SPARE_BUF_ECC_SIZE(dev))
+#define SPARE_BUF_ECC(dev, spare)	((spare) + ALIGN4((dev)->attr->spare_size))
+#define SPARE_BUF_ECC_STORE(dev, spare)	(SPARE_BUF_ECC(dev, spare) + SPARE_BUF_ECC_SIZE(dev))
+
 #define SEAL_BYTE(dev, spare)  spare[(dev)->mem.spare_data_size - 1]	// seal byte is the last byte of spare data
 
 #if defined(CONFIG_UFFS_AUTO_LAYOUT_USE_MTD_SCHEME)
@@ -85,15 +104,38 @@ static int TagEccCorrect(struct uffs_TagStoreSt *ts)
 
 }
 
+/**
+ * append a spare layout segment, split it if it's longer than 255 bytes
+ * or next segment would start beyond 0xFE (0xFF is the end mark).
+ * \return new layout pointer
+ */
+static u8 * AppendLayoutSegment(u8 *p, int ofs, int len)
+{
+	int n;
+
+	while (len > 0) {
+		n = (len > 0xFF ? 0xFF : len);
+		if (len > n && ofs + n > 0xFE)
+			n = 0xFE - ofs;
+		*p++ = ofs;
+		*p++ = n;
+		ofs += n;
+		len -= n;
+	}
+
+	return p;
+}
+
 /** setup UFFS spare data & ecc layout */
 static void InitSpareLayout(uffs_Device *dev)
 {
 	u8 s; // status byte offset
 	u8 *p;
+	int ts_size = TAG_SPARE_SIZE(dev);
 
 	s = dev->attr->block_status_offs;
 
-	if (s < TAG_STORE_SIZE) {	/* status byte is within 0 ~ TAG_STORE_SIZE-1 */
+	if (s < ts_size) {	/* status byte is within 0 ~ ts_size-1 */
 
 		/* spare data layout */
 		p = dev->attr->_uffs_data_layout;
@@ -102,42 +144,38 @@ static void InitSpareLayout(uffs_Device *dev)
 			*p++ = s;
 		}
 		*p++ = s + 1;
-		*p++ = TAG_STORE_SIZE - s;
+		*p++ = ts_size - s;
 		*p++ = 0xFF;
 		*p++ = 0;
 
 		/* spare ecc layout */
 		p = dev->attr->_uffs_ecc_layout;
-		if (dev->attr->ecc_opt != UFFS_ECC_NONE) {
-			*p++ = TAG_STORE_SIZE + 1;
-			*p++ = ECC_SIZE(dev);
-		}
+		if (dev->attr->ecc_opt != UFFS_ECC_NONE)
+			p = AppendLayoutSegment(p, ts_size + 1, ECC_SIZE(dev));
 		*p++ = 0xFF;
 		*p++ = 0;
 	}
-	else {	/* status byte > TAG_STORE_SIZE-1 */
+	else {	/* status byte > ts_size-1 */
 
 		/* spare data layout */
 		p = dev->attr->_uffs_data_layout;
 		*p++ = 0;
-		*p++ = TAG_STORE_SIZE;
+		*p++ = ts_size;
 		*p++ = 0xFF;
 		*p++ = 0;
 
 		/* spare ecc layout */
 		p = dev->attr->_uffs_ecc_layout;
 		if (dev->attr->ecc_opt != UFFS_ECC_NONE) {
-			if (s < TAG_STORE_SIZE + ECC_SIZE(dev)) {
-				if (s > TAG_STORE_SIZE) {
-					*p++ = TAG_STORE_SIZE;
-					*p++ = s - TAG_STORE_SIZE;
+			if (s < ts_size + ECC_SIZE(dev)) {
+				if (s > ts_size) {
+					*p++ = ts_size;
+					*p++ = s - ts_size;
 				}
-				*p++ = s + 1;
-				*p++ = TAG_STORE_SIZE + ECC_SIZE(dev) - s;
+				p = AppendLayoutSegment(p, s + 1, ts_size + ECC_SIZE(dev) - s);
 			}
 			else {
-				*p++ = TAG_STORE_SIZE;
-				*p++ = ECC_SIZE(dev);
+				p = AppendLayoutSegment(p, ts_size, ECC_SIZE(dev));
 			}
 		}
 		*p++ = 0xFF;
@@ -167,7 +205,7 @@ static int CalculateSpareDataSize(uffs_Device *dev)
 		}
 	}
 
-	tag_size = TAG_STORE_SIZE;
+	tag_size = TAG_SPARE_SIZE(dev);
 	p = dev->attr->data_layout;
 	if (p) {
 		while (*p != 0xFF && tag_size > 0) {
@@ -176,6 +214,12 @@ static int CalculateSpareDataSize(uffs_Device *dev)
 			tag_size -= n;
 			p += 2;
 		}
+
+		if (tag_size > 0) {
+			uffs_Perror(UFFS_MSG_SERIOUS, "spare data layout can't hold %d bytes tag",
+						TAG_SPARE_SIZE(dev));
+			return -1;
+		}
 	}
 
 	n = (ecc_last > tag_last ? ecc_last : tag_last);
@@ -194,30 +238,16 @@ URET uffs_FlashInterfaceInit(uffs_Device *dev)
 	URET ret = U_FAIL;
 	struct uffs_StorageAttrSt *attr = dev->attr;
 	uffs_Pool *pool = SPOOL(dev);
+	int size;
 
-	if (dev->mem.spare_pool_size == 0) {
-		if (dev->mem.malloc) {
-			dev->mem.spare_pool_buf = dev->mem.malloc(dev, UFFS_SPARE_BUFFER_SIZE);
-			if (dev->mem.spare_pool_buf)
-				dev->mem.spare_pool_size = UFFS_SPARE_BUFFER_SIZE;
-		}
-	}
+	memset(pool, 0, sizeof(uffs_Pool));
 
-	if (UFFS_SPARE_BUFFER_SIZE > dev->mem.spare_pool_size) {
-		uffs_Perror(UFFS_MSG_DEAD,
-					"Spare buffer require %d but only %d available.",
-					UFFS_SPARE_BUFFER_SIZE, dev->mem.spare_pool_size);
-		memset(pool, 0, sizeof(uffs_Pool));
+	if (attr->page_data_size > UFFS_MAX_PAGE_SIZE || attr->spare_size > UFFS_MAX_SPARE_SIZE) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "Page size %d (spare %d) exceeds %d (spare %d) !",
+					attr->page_data_size, attr->spare_size, UFFS_MAX_PAGE_SIZE, UFFS_MAX_SPARE_SIZE);
 		goto ext;
 	}
 
-	uffs_Perror(UFFS_MSG_NOISY,
-					"alloc spare buffers %d bytes.",
-					UFFS_SPARE_BUFFER_SIZE);
-	uffs_PoolInit(pool, dev->mem.spare_pool_buf,
-					dev->mem.spare_pool_size,
-					UFFS_MAX_SPARE_SIZE, MAX_SPARE_BUFFERS, U_FALSE);
-
 	// init flash driver
 	if (dev->ops->InitFlash) {
 		if (dev->ops->InitFlash(dev) < 0)
@@ -289,6 +319,8 @@ URET uffs_FlashInterfaceInit(uffs_Device *dev)
 	}
 
 	dev->mem.spare_data_size = CalculateSpareDataSize(dev);
+	if (dev->mem.spare_data_size < 0)
+		goto ext;
 	uffs_Perror(UFFS_MSG_NORMAL, "UFFS consume spare data size %d", dev->mem.spare_data_size);
 
 	if (dev->mem.spare_data_size > dev->attr->spare_size) {
@@ -297,6 +329,45 @@ URET uffs_FlashInterfaceInit(uffs_Device *dev)
 		goto ext;
 	}
 
+	if (dev->attr->pages_per_block > UFFS_MAX_PAGES_PER_BLOCK) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "Pages per block (%d) exceeds %d !",
+						dev->attr->pages_per_block, UFFS_MAX_PAGES_PER_BLOCK);
+		goto ext;
+	}
+
+	// more than 64 pages per block needs 8-bit page id in tag.
+	// the layout found on media (when build tree) overrides this.
+	if (dev->attr->pages_per_block > UFFS_NARROW_ID_MAX_PAGES || dev->cfg.wide_page_id)
+		dev->com.id_layout = TAG_ID_LAYOUT_WIDE;
+	else
+		dev->com.id_layout = TAG_ID_LAYOUT_NARROW;
+	uffs_Perror(UFFS_MSG_NORMAL, "Page id layout: %s",
+				dev->com.id_layout == TAG_ID_LAYOUT_WIDE ? "wide" : "narrow");
+
+	// spare buffers are sized by the page geometry and ECC size, which are
+	// settled now (flash driver may adjust ECC size in InitFlash()).
+	size = SPARE_BUF_SIZE(dev) * MAX_SPARE_BUFFERS;
+	if (dev->mem.spare_pool_size == 0) {
+		if (dev->mem.malloc) {
+			dev->mem.spare_pool_buf = dev->mem.malloc(dev, size);
+			if (dev->mem.spare_pool_buf)
+				dev->mem.spare_pool_size = size;
+		}
+	}
+
+	if (size > dev->mem.spare_pool_size) {
+		uffs_Perror(UFFS_MSG_DEAD,
+					"Spare buffer require %d but only %d available.",
+					size, dev->mem.spare_pool_size);
+		goto ext;
+	}
+
+	uffs_Perror(UFFS_MSG_NOISY,
+					"alloc spare buffers %d bytes.", size);
+	uffs_PoolInit(pool, dev->mem.spare_pool_buf,
+					dev->mem.spare_pool_size,
+					SPARE_BUF_SIZE(dev), MAX_SPARE_BUFFERS, U_FALSE);
+
 	ret = U_SUCC;
 ext:
 	return ret;
@@ -329,12 +400,16 @@ URET uffs_FlashInterfaceRelease(uffs_Device *dev)
 
 /**
  * unload spare to tag and ecc.
+ *
+ * \note if page data size > #TAG_DATA_LEN_MAX, ts must be the store
+ *		 of a uffs_Tags, for loading uffs_TagsSt.data_len_hi.
  */
 void uffs_FlashUnloadSpare(uffs_Device *dev,
 						const u8 *spare, struct uffs_TagStoreSt *ts, u8 *ecc)
 {
-	u8 *p_tag = (u8 *)ts;
-	int tag_size = TAG_STORE_SIZE;
+	u8 tag_buf[TAG_STORE_SIZE + 1];
+	u8 *p_tag = tag_buf;
+	int tag_size = TAG_SPARE_SIZE(dev);
 	int ecc_size = dev->attr->ecc_size;
 	int n;
 	const u8 *p;
@@ -361,6 +436,9 @@ void uffs_FlashUnloadSpare(uffs_Device *dev,
 			p_tag += n;
 			p += 2;
 		}
+		memcpy(ts, tag_buf, TAG_STORE_SIZE);
+		if (TAG_EXT_SIZE(dev))
+			((uffs_Tags *)ts)->data_len_hi = TAG_EXT_DECODE(tag_buf[TAG_STORE_SIZE]);
 	}
 }
 
@@ -392,6 +470,9 @@ int uffs_FlashReadPageTag(uffs_Device *dev,
 	if (spare_buf == NULL)
 		goto ext;
 
+	if (tag)
+		tag->data_len_hi = 0;	// loaded from spare only when page data size > TAG_DATA_LEN_MAX
+
 	if (ops->ReadPageWithLayout) {
 		ret = ops->ReadPageWithLayout(dev, block, page, NULL, 0, NULL, tag ? &tag->s : NULL, NULL);
 		if (tag)
@@ -431,6 +512,10 @@ int uffs_FlashReadPageTag(uffs_Device *dev,
 				ret = ret_tmp;
 			}
 		}
+
+		// tag ext byte is not covered by tag ECC, but it has a self check
+		if (tag->data_len_hi == TAG_DATA_LEN_HI_BAD && !UFFS_FLASH_HAVE_ERR(ret))
+			ret = UFFS_FLASH_ECC_FAIL;
 	}
 
 ext:
@@ -473,8 +558,8 @@ int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBO
 	uffs_FlashOps *ops = dev->ops;
 	struct uffs_StorageAttrSt *attr = dev->attr;
 	int size = dev->com.pg_size;
-	u8 ecc_buf[UFFS_MAX_ECC_SIZE];
-	u8 ecc_store[UFFS_MAX_ECC_SIZE];
+	u8 *ecc_buf;
+	u8 *ecc_store;
 #ifdef CONFIG_ENABLE_PAGE_DATA_CRC
 	UBOOL crc_ok = U_TRUE;
 #endif
@@ -482,10 +567,13 @@ int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBO
 
 	int ret = UFFS_FLASH_UNKNOWN_ERR;
 	int ret2 = UFFS_FLASH_UNKNOWN_ERR;
+	UFFS_TIMING_BEGIN(t);
 
 	spare = (u8 *) uffs_PoolGet(SPOOL(dev));
 	if (spare == NULL)
 		goto ext;
+	ecc_buf = SPARE_BUF_ECC(dev, spare);
+	ecc_store = SPARE_BUF_ECC_STORE(dev, spare);
 
 	if (ops->ReadPageWithLayout) {
 		if (skip_ecc)
@@ -586,6 +674,8 @@ ext:
 	if (spare)
 		uffs_PoolPut(SPOOL(dev), spare);
 
+	UFFS_TIMING_END(UFFS_TM_FLASH_READ_PAGE, t);
+
 	return ret;
 }
 
@@ -598,12 +688,15 @@ ext:
  * \param[out] spare output buffer
  * \note spare buffer size: dev->mem.spare_data_size,
  *		 all unpacked bytes will be inited 0xFF
+ * \note if page data size > #TAG_DATA_LEN_MAX, ts must be the store
+ *		 of a uffs_Tags, uffs_TagsSt.data_len_hi is packed after the store.
  */
 void uffs_FlashMakeSpare(uffs_Device *dev,
 						 const uffs_TagStore *ts, const u8 *ecc, u8* spare)
 {
-	u8 *p_ts = (u8 *)ts;
-	int ts_size = TAG_STORE_SIZE;
+	u8 tag_buf[TAG_STORE_SIZE + 1];
+	u8 *p_ts = tag_buf;
+	int ts_size = TAG_SPARE_SIZE(dev);
 	int ecc_size = ECC_SIZE(dev);
 	int n;
 	const u8 *p;
@@ -626,13 +719,19 @@ void uffs_FlashMakeSpare(uffs_Device *dev,
 		}
 	}
 
-	p = dev->attr->data_layout;
-	while (*p != 0xFF && ts_size > 0) {
-		n = (p[1] > ts_size ? ts_size : p[1]);
-		memcpy(spare + p[0], p_ts, n);
-		ts_size -= n;
-		p_ts += n;
-		p += 2;
+	if (ts) {
+		memcpy(tag_buf, ts, TAG_STORE_SIZE);
+		if (TAG_EXT_SIZE(dev))
+			tag_buf[TAG_STORE_SIZE] = TAG_EXT_ENCODE(((const uffs_Tags *)ts)->data_len_hi);
+
+		p = dev->attr->data_layout;
+		while (*p != 0xFF && ts_size > 0) {
+			n = (p[1] > ts_size ? ts_size : p[1]);
+			memcpy(spare + p[0], p_ts, n);
+			ts_size -= n;
+			p_ts += n;
+			p += 2;
+		}
 	}
 
 	uffs_Assert(SEAL_BYTE(dev, spare) == 0, "Make spare fail!");
@@ -657,7 +756,7 @@ int uffs_FlashWritePageCombine(uffs_Device *dev,
 {
 	uffs_FlashOps *ops = dev->ops;
 	int size = dev->com.pg_size;
-	u8 ecc_buf[UFFS_MAX_ECC_SIZE];
+	u8 *ecc_buf;
 	u8 *ecc = NULL;
 	u8 *spare;
 	struct uffs_MiniHeaderSt *header;
@@ -667,10 +766,12 @@ int uffs_FlashWritePageCombine(uffs_Device *dev,
 #ifdef CONFIG_PAGE_WRITE_VERIFY
 	uffs_Tags chk_tag;
 #endif
+	UFFS_TIMING_BEGIN(t);
 	
 	spare = (u8 *) uffs_PoolGet(SPOOL(dev));
 	if (spare == NULL)
 		goto ext;
+	ecc_buf = SPARE_BUF_ECC(dev, spare);
 
 	// setup header
 	header = HEADER(buf);
@@ -766,6 +867,8 @@ ext:
 	if (spare)
 		uffs_PoolPut(SPOOL(dev), spare);
 
+	UFFS_TIMING_END(UFFS_TM_FLASH_WRITE_PAGE, t);
+
 	return ret;
 }
 
@@ -851,6 +954,7 @@ int uffs_FlashEraseBlock(uffs_Device *dev, int block)
 {
 	int ret;
 	uffs_BlockInfo *bc;
+	UFFS_TIMING_BEGIN(t);
 
 	// this block is about to be erased, so remove it from pending list if it's added before
 	uffs_BadBlockPendingRemove(dev, block);
@@ -863,6 +967,8 @@ int uffs_FlashEraseBlock(uffs_Device *dev, int block)
 		uffs_BlockInfoPut(dev, bc);
 	}
 
+	UFFS_TIMING_END(UFFS_TM_FLASH_ERASE_BLOCK, t);
+
 	return ret;
 }
 
@@ -879,8 +985,8 @@ URET uffs_FlashCheckErasedBlock(uffs_Device *dev, int block)
 	int ret = U_SUCC;
 	int page;
 	int flash_ret;
-	u8 ecc_store[UFFS_MAX_ECC_SIZE];
-	uffs_TagStore ts;
+	u8 *ecc_store;
+	uffs_Tags tag;
 	uffs_Buf *buf = NULL;
 	int size = dev->com.pg_size;
 	int i;
@@ -895,6 +1001,7 @@ URET uffs_FlashCheckErasedBlock(uffs_Device *dev, int block)
 		uffs_Perror(UFFS_MSG_SERIOUS, "Can't allocate spare buf.");
 		goto ext;
 	}
+	ecc_store = SPARE_BUF_ECC_STORE(dev, spare);
 	
 	buf = uffs_BufClone(dev, NULL);
 	
@@ -906,11 +1013,11 @@ URET uffs_FlashCheckErasedBlock(uffs_Device *dev, int block)
 	for (page = 0; page < dev->attr->pages_per_block; page++) {
 		if (ops->ReadPageWithLayout) {
 			
-			flash_ret = ops->ReadPageWithLayout(dev, block, page, buf->header, size, NULL, &ts, ecc_store);
+			flash_ret = ops->ReadPageWithLayout(dev, block, page, buf->header, size, NULL, &tag.s, ecc_store);
 			
 			if (flash_ret != UFFS_FLASH_IO_ERR) {
 				// check page tag, should be all 0xFF
-				for (i = 0, p = (u8 *)(&ts); i < sizeof(ts); i++, p++) {
+				for (i = 0, p = (u8 *)(&tag.s); i < sizeof(tag.s); i++, p++) {
 					if (*p != 0xFF) {
 						ret = U_FAIL;
 						goto ext;
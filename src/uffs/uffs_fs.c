@@ -43,6 +43,7 @@
 #include "uffs/uffs_os.h"
 #include "uffs/uffs_mtb.h"
 #include "uffs/uffs_utils.h"
+#include "uffs/uffs_fileinfo.h"
 #include <string.h> 
 #include <stdio.h>
 
@@ -87,6 +88,85 @@ static int _object_data[(sizeof(struct uffs_ObjectSt) * MAX_OBJECT_HANDLE) / siz
 
 static uffs_Pool _object_pool;
 
+#if defined(CONFIG_USE_LOCK_FREE_POOL) && \
+	CONFIG_USE_SYSTEM_MEMORY_ALLOCATOR > 0 && CONFIG_HANDLE_POOL_SEGMENTS > 1
+#define HANDLE_POOL_GROWABLE
+static uffs_MemAllocator _handle_allocator;	//!< for growing handle pools
+#endif
+
+/*
+ * Open table: all opened objects, hashed by tree node, so that we know
+ * whether a file/dir is opened without walking through the object pool.
+ * Objects opened without a tree node (root dir) are in slot 0.
+ * Protected by the global table lock.
+ */
+#define OPEN_TABLE_LEN		32
+#define OPEN_TABLE_SLOT(dev, node) \
+			((node) ? TO_IDX(node, &(dev)->mem.tree_pool) % OPEN_TABLE_LEN : 0)
+
+static uffs_Object * _open_table[OPEN_TABLE_LEN];
+
+
+/**
+ * initialise a handle pool. with #CONFIG_USE_LOCK_FREE_POOL it's a lock free
+ * pool which grows up to #CONFIG_HANDLE_POOL_SEGMENTS times if system memory
+ * allocator is used, otherwise it's a locked pool.
+ */
+URET uffs_HandlePoolInit(uffs_Pool *pool, void *mem, u32 mem_size, u32 buf_size, u32 num_bufs)
+{
+#if defined(HANDLE_POOL_GROWABLE)
+	uffs_MemSetupSystemAllocator(&_handle_allocator);
+	return uffs_PoolInitLockFree(pool, mem, mem_size, buf_size, num_bufs,
+									CONFIG_HANDLE_POOL_SEGMENTS);
+#elif defined(CONFIG_USE_LOCK_FREE_POOL)
+	return uffs_PoolInitLockFree(pool, mem, mem_size, buf_size, num_bufs, 1);
+#else
+	return uffs_PoolInit(pool, mem, mem_size, buf_size, num_bufs, U_TRUE);
+#endif
+}
+
+/**
+ * release handle pool, free memory of grown segments
+ */
+URET uffs_HandlePoolRelease(uffs_Pool *pool)
+{
+#ifdef HANDLE_POOL_GROWABLE
+	int i;
+
+	for (i = 1; i < pool->num_segs; i++)
+		_handle_allocator.free(NULL, pool->seg[i]);
+#endif
+
+	return uffs_PoolRelease(pool);
+}
+
+/**
+ * get a handle from handle pool, grow the pool if all handles are in use.
+ * \return the handle, or NULL if no more handle.
+ */
+void * uffs_HandlePoolGet(uffs_Pool *pool)
+{
+	void *p = uffs_PoolGetLocked(pool);
+#ifdef HANDLE_POOL_GROWABLE
+	u32 size = pool->num_bufs * pool->buf_size;
+	void *mem;
+
+	while (p == NULL && uffs_AtomicGet(&pool->num_segs) < pool->max_segs) {
+		mem = _handle_allocator.malloc(NULL, size);
+		if (mem == NULL)
+			break;
+		// free handles are told by 'open_succ'/'obj', they must start zeroed
+		memset(mem, 0, size);
+		// others may grow the pool at the same time, then we lose the race
+		// for the last segment. that's fine, take what we can get.
+		if (uffs_PoolGrow(pool, mem, size) != U_SUCC)
+			_handle_allocator.free(NULL, mem);
+		p = uffs_PoolGetLocked(pool);
+	}
+#endif
+
+	return p;
+}
 
 uffs_Pool * uffs_GetObjectPool(void)
 {
@@ -98,8 +178,10 @@ uffs_Pool * uffs_GetObjectPool(void)
  */
 URET uffs_InitObjectBuf(void)
 {
-	return uffs_PoolInit(&_object_pool, _object_data, sizeof(_object_data),
-			sizeof(uffs_Object), MAX_OBJECT_HANDLE, U_FALSE);
+	memset(_open_table, 0, sizeof(_open_table));
+
+	return uffs_HandlePoolInit(&_object_pool, _object_data, sizeof(_object_data),
+			sizeof(uffs_Object), MAX_OBJECT_HANDLE);
 }
 
 /**
@@ -107,7 +189,7 @@ URET uffs_InitObjectBuf(void)
  */
 URET uffs_ReleaseObjectBuf(void)
 {
-	return uffs_PoolRelease(&_object_pool);
+	return uffs_HandlePoolRelease(&_object_pool);
 }
 
 /**
@@ -115,34 +197,122 @@ URET uffs_ReleaseObjectBuf(void)
  */
 int uffs_GetFreeObjectHandlers(void)
 {
-	int count = 0;
+	return uffs_PoolGetFreeCount(&_object_pool);
+}
 
-	uffs_GlobalFsLockLock();
-	count = uffs_PoolGetFreeCount(&_object_pool);
-	uffs_GlobalFsLockUnlock();
+/** add opened object to open table, caller should hold the device lock */
+static void OpenTableAdd(uffs_Object *obj)
+{
+	int slot = OPEN_TABLE_SLOT(obj->dev, obj->node);
 
-	return count;
+	uffs_GlobalTableLock();
+	obj->open_next = _open_table[slot];
+	_open_table[slot] = obj;
+	uffs_GlobalTableUnlock();
+}
+
+/** remove object from open table, if it's there */
+static void OpenTableRemove(uffs_Object *obj)
+{
+	int slot = OPEN_TABLE_SLOT(obj->dev, obj->node);
+	uffs_Object **p;
+
+	uffs_GlobalTableLock();
+	for (p = &_open_table[slot]; *p; p = &(*p)->open_next) {
+		if (*p == obj) {
+			*p = obj->open_next;
+			obj->open_next = NULL;
+			break;
+		}
+	}
+	uffs_GlobalTableUnlock();
+}
+
+/**
+ * find an opened object of the tree node
+ * \param[in] dev uffs device
+ * \param[in] node the tree node of file or dir
+ * \param[in] except skip this object, can be NULL
+ * \return the opened object or NULL if the node is not opened.
+ * \note caller should hold the global table lock
+ */
+static uffs_Object * OpenTableFind(uffs_Device *dev, TreeNode *node, uffs_Object *except)
+{
+	uffs_Object *obj;
+
+	for (obj = _open_table[OPEN_TABLE_SLOT(dev, node)]; obj; obj = obj->open_next) {
+		if (obj != except && obj->dev == dev && obj->node == node)
+			break;
+	}
+
+	return obj;
 }
 
 /**
  * Put all object which match dev
+ * \note caller should hold the global table lock
  */
 int uffs_PutAllObjectBuf(uffs_Device *dev)
 {
 	int count = 0;
-	uffs_Object * obj = NULL;
-
-	do {
-		obj = (uffs_Object *) uffs_PoolFindNextAllocated(&_object_pool, (void *)obj);
-		if (obj && obj->dev && obj->dev->dev_num == dev->dev_num) {
-			uffs_PutObject(obj);
-			count++;
+	int slot;
+	uffs_Object **p, *obj;
+
+	for (slot = 0; slot < OPEN_TABLE_LEN; slot++) {
+		p = &_open_table[slot];
+		while ((obj = *p) != NULL) {
+			if (obj->dev && obj->dev->dev_num == dev->dev_num) {
+				uffs_TreeReserveRelease(dev, &obj->resv);
+				*p = obj->open_next;
+				obj->open_next = NULL;
+				obj->open_succ = U_FALSE;
+				uffs_PoolPutLocked(&_object_pool, obj);
+				count++;
+			}
+			else {
+				p = &obj->open_next;
+			}
 		}
-	} while (obj);
+	}
 
 	return count;
 }
 
+/**
+ * add write statistic to device and all opened objects of the file.
+ * \param[in] dev uffs device
+ * \param[in] serial serial number of file (or dir) who causes the writes
+ * \param[in] programmed pages programmed
+ * \param[in] copied pages copied by block recover
+ * \param[in] erased blocks erased
+ */
+void uffs_ObjectWriteStatAdd(uffs_Device *dev, u16 serial,
+							 int programmed, int copied, int erased)
+{
+	uffs_Object * obj;
+	TreeNode *node;
+
+	dev->write_st.pages_programmed += programmed;
+	dev->write_st.pages_copied += copied;
+	dev->write_st.blocks_erased += erased;
+
+	node = uffs_TreeFindFileNode(dev, serial);
+	if (node == NULL)
+		node = uffs_TreeFindDirNode(dev, serial);
+	if (node == NULL)
+		return;
+
+	uffs_GlobalTableLock();
+	for (obj = _open_table[OPEN_TABLE_SLOT(dev, node)]; obj; obj = obj->open_next) {
+		if (obj->dev == dev && obj->node == node) {
+			obj->write_st.pages_programmed += programmed;
+			obj->write_st.pages_copied += copied;
+			obj->write_st.blocks_erased += erased;
+		}
+	}
+	uffs_GlobalTableUnlock();
+}
+
 /**
  * alloc a new object structure
  * \return the new object
@@ -151,7 +321,8 @@ uffs_Object * uffs_GetObject(void)
 {
 	uffs_Object * obj;
 
-	obj = (uffs_Object *) uffs_PoolGet(&_object_pool);
+	obj = (uffs_Object *) uffs_HandlePoolGet(&_object_pool);
+
 	if (obj) {
 		memset(obj, 0, sizeof(uffs_Object));
 		obj->attr_loaded = U_FALSE;
@@ -186,8 +357,9 @@ URET uffs_ReInitObject(uffs_Object *obj)
  */
 void uffs_PutObject(uffs_Object *obj)
 {
-	if (obj)
-		uffs_PoolPut(&_object_pool, obj);
+	if (obj) {
+		uffs_PoolPutLocked(&_object_pool, obj);
+	}
 }
 
 /**
@@ -206,7 +378,7 @@ uffs_Object * uffs_GetObjectByIndex(int idx)
 	return (uffs_Object *) uffs_PoolGetBufByIndex(&_object_pool, idx);
 }
 
-#ifdef CONFIG_PER_DEVICE_LOCK
+#ifdef CONFIG_USE_PER_DEVICE_LOCK
 static void uffs_ObjectDevLock(uffs_Object *obj)
 {
 	if (obj) {
@@ -433,6 +605,8 @@ URET uffs_CreateObjectEx(uffs_Object *obj, uffs_Device *dev,
 	obj->open_succ = U_TRUE;
 
 ext_1:
+	if (obj->err == UENOERR)
+		OpenTableAdd(obj);
 	uffs_ObjectDevUnLock(obj);
 ext:
 	return (obj->err == UENOERR ? U_SUCC : U_FAIL);
@@ -495,6 +669,7 @@ URET uffs_OpenObjectEx(uffs_Object *obj, uffs_Device *dev,
 			}
 			else {
 				obj->serial = ROOT_DIR_SERIAL;
+				OpenTableAdd(obj);
 			}
 			goto ext;
 		}
@@ -549,6 +724,9 @@ URET uffs_OpenObjectEx(uffs_Object *obj, uffs_Device *dev,
 			do_TruncateObject(obj, 0, eREAL_RUN);
 		}
 
+	if (obj->err == UENOERR)
+		OpenTableAdd(obj);
+
 ext_1:
 	uffs_ObjectDevUnLock(obj);
 ext:
@@ -602,6 +780,7 @@ URET uffs_ParseObject(uffs_Object *obj, const char *name)
 		else {
 			dir = ROOT_DIR_SERIAL;
 			dname = start;
+			uffs_ObjectDevLock(obj);
 			while (p - start < d_len) {
 				while (*p != '/') p++;
 				sum = uffs_MakeSum16(dname, p - dname);
@@ -616,6 +795,7 @@ URET uffs_ParseObject(uffs_Object *obj, const char *name)
 					dname = p;
 				}
 			}
+			uffs_ObjectDevUnLock(obj);
 			obj->parent = dir;
 			obj->name = start + (d_len > 0 ? d_len + 1 : 0);
 			obj->name_len = len - (d_len > 0 ? d_len + 1 : 0) - m_len;
@@ -638,6 +818,10 @@ static void do_ReleaseObjectResource(uffs_Object *obj)
 {
 	if (obj) {
 		if (obj->dev) {
+			OpenTableRemove(obj);
+			if (obj->dev_lock_count == 0)
+				uffs_ObjectDevLock(obj);
+			uffs_TreeReserveRelease(obj->dev, &obj->resv);
 			if (HAVE_BADBLOCK(obj->dev))
 				uffs_BadBlockRecover(obj->dev);
 			if (obj->dev_lock_count > 0) {
@@ -808,8 +992,95 @@ static u32 GetStartOfDataBlock(uffs_Object *obj, u16 fdn)
 }
 
 
+/**
+ * \def IS_HOLE
+ * a data block before the last one but not on flash is a hole of sparse file.
+ * without CONFIG_SPARSE_FILE there are no holes, a missing data block
+ * is reported as an error instead of being read as '\0'.
+ */
+#ifdef CONFIG_SPARSE_FILE
+#define IS_HOLE(fdn, fdn_last, dnode)	((fdn) > 0 && (dnode) == NULL && (fdn) < (fdn_last))
+#else
+#define IS_HOLE(fdn, fdn_last, dnode)	((void)(fdn_last), U_FALSE)
+#endif
+
+/**
+ * check whether data block 'fdn' is a hole of sparse file
+ */
+static UBOOL IsHoleBlock(uffs_Object *obj, u16 fdn, TreeNode *dnode)
+{
+	u32 flen = obj->node->u.file.len;
+
+	if (flen > 0 && IS_HOLE(fdn, GetFdnByOfs(obj, flen - 1), dnode)) {
+		uffs_Perror(UFFS_MSG_NOISY, "serial %d data block %d is a hole",
+					obj->node->u.file.serial, fdn);
+		return U_TRUE;
+	}
+
+	return U_FALSE;
+}
+
+/**
+ * write a hole data block 'fdn' out to flash: 'len' bytes from I/O cursor
+ * at 'blockOfs', the rest of the first 'size' bytes of the block are '\0'.
+ * file length is not changed.
+ *
+ * \return bytes from I/O cursor have been written.
+ */
+static int do_WriteHoleBlock(uffs_Object *obj, u16 fdn,
+							 uffs_IoCursor *src, u32 len, u32 blockOfs, u32 size)
+{
+	uffs_Device *dev = obj->dev;
+	u16 serial = obj->node->u.file.serial;
+	u32 pg_size = dev->com.pg_data_size;
+	u32 start, end, ofs, a, b, n;
+	u16 page_id;
+	uffs_IoCursor zero;
+	uffs_Buf *buf;
+	URET ret = U_SUCC;
+
+	start = (blockOfs > size ? size : blockOfs);
+	end = (start + len > size ? size : start + len);
+	uffs_IoCursorInit(&zero, NULL, 0);
+
+	for (page_id = 0, ofs = 0; ofs < size && ret == U_SUCC; page_id++, ofs += pg_size) {
+		// page data: '\0' in [0, a), data in [a, b), '\0' in [b, n)
+		n = (size - ofs > pg_size ? pg_size : size - ofs);
+		a = (start > ofs ? start - ofs : 0);
+		if (a > n)
+			a = n;
+		b = (end > ofs ? end - ofs : 0);
+		if (b > n)
+			b = n;
+
+		buf = uffs_BufNew(dev, UFFS_TYPE_DATA, serial, fdn, page_id);
+		if (buf == NULL) {
+			uffs_Perror(UFFS_MSG_SERIOUS, "can't create a new page ?");
+			ret = U_FAIL;
+			break;
+		}
+		if (a > 0)
+			ret = uffs_BufWriteV(dev, buf, &zero, 0, a);
+		if (ret == U_SUCC && b > a)
+			ret = uffs_BufWriteV(dev, buf, src, a, b - a);
+		if (ret == U_SUCC && n > b)
+			ret = uffs_BufWriteV(dev, buf, &zero, b, n - b);
+		uffs_BufPut(dev, buf);
+	}
+
+	if (ret == U_SUCC)
+		ret = uffs_BufFlushGroup(dev, serial, fdn);
+
+	if (ret != U_SUCC) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "write hole block fail!");
+		return 0;
+	}
+
+	return end - start;
+}
+
 static int do_WriteNewBlock(uffs_Object *obj,
-						  const void *data, u32 len,
+						  uffs_IoCursor *src, u32 len,
 						  u16 parent,
 						  u16 serial)
 {
@@ -831,8 +1102,8 @@ static int do_WriteNewBlock(uffs_Object *obj,
 			uffs_Perror(UFFS_MSG_SERIOUS, "can't create a new page ?");
 			break;
 		}
-		// Note: if data == NULL, we will fill '\0'
-		ret = uffs_BufWrite(dev, buf, data == NULL ? NULL : (u8 *)data + wroteSize, 0, size);
+		// Note: if src->iov == NULL, we will fill '\0'
+		ret = uffs_BufWriteV(dev, buf, src, 0, size);
 		uffs_BufPut(dev, buf);
 
 		if (ret != U_SUCC) {
@@ -849,7 +1120,7 @@ static int do_WriteNewBlock(uffs_Object *obj,
 static int do_WriteInternalBlock(uffs_Object *obj,
 							   TreeNode *node,
 							   u16 fdn,
-							   const void *data,
+							   uffs_IoCursor *src,
 							   u32 len,
 							   u32 blockOfs)
 {
@@ -913,8 +1184,8 @@ static int do_WriteInternalBlock(uffs_Object *obj,
 			}
 		}
 
-		// Note: if data == NULL, then we will fill '\0'
-		ret = uffs_BufWrite(dev, buf, data == NULL ? NULL : (u8 *)data + wroteSize, pageOfs, size);
+		// Note: if src->iov == NULL, then we will fill '\0'
+		ret = uffs_BufWriteV(dev, buf, src, pageOfs, size);
 
 		uffs_BufPut(dev, buf);
 
@@ -936,9 +1207,10 @@ static int do_WriteInternalBlock(uffs_Object *obj,
 
 
 /**
- * write data to obj, return remain data (0 if all data been written).
+ * write 'len' bytes from I/O cursor to obj at file offset 'pos',
+ * return remain data (0 if all data been written).
  */
-static int do_WriteObject(uffs_Object *obj, const void *data, int len)
+static int do_WriteObject(uffs_Object *obj, u32 pos, uffs_IoCursor *src, int len)
 {
 	uffs_Device *dev = obj->dev;
 	TreeNode *fnode = obj->node;
@@ -949,7 +1221,7 @@ static int do_WriteObject(uffs_Object *obj, const void *data, int len)
 	u32 size;
 
 	while (remain > 0) {
-		write_start = obj->pos + len - remain;
+		write_start = pos + len - remain;
 		if (write_start > fnode->u.file.len) {
 			uffs_Perror(UFFS_MSG_SERIOUS, "write point out of file ?");
 			break;
@@ -959,12 +1231,12 @@ static int do_WriteObject(uffs_Object *obj, const void *data, int len)
 
 		if (write_start == fnode->u.file.len && fdn > 0 &&
 			write_start == GetStartOfDataBlock(obj, fdn)) {
-			if (dev->tree.erased_count < dev->cfg.reserved_free_blocks) {
+			if (obj->resv.count == 0 &&
+				dev->tree.erased_count < dev->cfg.reserved_free_blocks) {
 				uffs_Perror(UFFS_MSG_NOISY, "insufficient block in write obj, new block");
 				break;
 			}
-			size = do_WriteNewBlock(obj, data ? (u8 *)data + len - remain : NULL,
-										remain, fnode->u.file.serial, fdn);
+			size = do_WriteNewBlock(obj, src, remain, fnode->u.file.serial, fdn);
 
 			//
 			// Flush the new block buffers immediately, so that the new data node will be
@@ -994,13 +1266,29 @@ static int do_WriteObject(uffs_Object *obj, const void *data, int len)
 			else
 				dnode = uffs_TreeFindDataNode(dev, fnode->u.file.serial, fdn);
 
+			if (IsHoleBlock(obj, fdn, dnode)) {
+				// write to a hole of sparse file, the whole block is written out
+				if (obj->resv.count == 0 &&
+					dev->tree.erased_count < dev->cfg.reserved_free_blocks) {
+					uffs_Perror(UFFS_MSG_NOISY, "insufficient block in write obj, hole block");
+					break;
+				}
+				size = do_WriteHoleBlock(obj, fdn, src, remain,
+										write_start - GetStartOfDataBlock(obj, fdn),
+										dev->com.pg_data_size * dev->attr->pages_per_block);
+				if (size == 0)
+					break;
+
+				remain -= size;
+				continue;
+			}
+
 			if(dnode == NULL) {
 				uffs_Perror(UFFS_MSG_SERIOUS, "can't find data node in tree ?");
 				obj->err = UEUNKNOWN_ERR;
 				break;
 			}
-			size = do_WriteInternalBlock(obj, dnode, fdn,
-									data ? (u8 *)data + len - remain : NULL, remain,
+			size = do_WriteInternalBlock(obj, dnode, fdn, src, remain,
 									write_start - GetStartOfDataBlock(obj, fdn));
 #ifdef CONFIG_FLUSH_BUF_AFTER_WRITE
 			if (fdn == 0)
@@ -1022,25 +1310,74 @@ static int do_WriteObject(uffs_Object *obj, const void *data, int len)
 
 
 /**
- * write data to obj, from obj->pos
+ * extend file to 'len' bytes, the gap reads as '\0'.
+ * with CONFIG_SPARSE_FILE, whole data blocks in the gap are left as holes,
+ * only the block at the end of file and the new last block are written.
  *
- * \param[in] obj file obj
- * \param[in] data data pointer
- * \param[in] len length of data to be write
- *
- * \return bytes wrote to obj
+ * \return U_SUCC if file is extended to 'len', otherwise U_FAIL.
  */
-int uffs_WriteObject(uffs_Object *obj, const void *data, int len)
+static URET do_ExtendObject(uffs_Object *obj, u32 len)
+{
+	TreeNode *fnode = obj->node;
+	uffs_IoCursor zero;
+	u32 flen = fnode->u.file.len;
+#ifdef CONFIG_SPARSE_FILE
+	uffs_Device *dev = obj->dev;
+	u16 fdn, fdn_last;
+	u32 fill_end, last_start;
+#endif
+
+	if (len <= flen)
+		return U_SUCC;
+
+	uffs_IoCursorInit(&zero, NULL, 0);
+
+#ifdef CONFIG_SPARSE_FILE
+	// the block at 'flen' is filled up to its end, unless it's not yet exist
+	fdn = GetFdnByOfs(obj, flen);
+	fill_end = (fdn > 0 && flen == GetStartOfDataBlock(obj, fdn) ?
+					flen : GetStartOfDataBlock(obj, fdn + 1));
+
+	// the new last block should be on flash, to keep the file length
+	fdn_last = GetFdnByOfs(obj, len - 1);
+	last_start = GetStartOfDataBlock(obj, fdn_last);
+
+	if (last_start > fill_end) {
+		if (fill_end > flen) {
+			if (do_WriteObject(obj, flen, &zero, fill_end - flen) > 0)
+				return U_FAIL;
+			if (fdn == 0)
+				uffs_BufFlushGroup(dev, fnode->u.file.parent, fnode->u.file.serial);
+			else
+				uffs_BufFlushGroup(dev, fnode->u.file.serial, fdn);
+		}
+
+		// blocks in [fill_end, last_start) are holes
+		fnode->u.file.len = last_start;
+		do_WriteObject(obj, last_start, &zero, len - last_start);
+		if (fnode->u.file.len == last_start) {
+			// failed to create the last block, no holes then.
+			fnode->u.file.len = fill_end;
+		}
+
+		return (fnode->u.file.len == len ? U_SUCC : U_FAIL);
+	}
+#endif
+
+	return (do_WriteObject(obj, flen, &zero, len - flen) == 0 ? U_SUCC : U_FAIL);
+}
+
+/**
+ * write data from I/O cursor to obj at *pos, *pos is moved to the end of written data.
+ * if obj is opened with UO_APPEND, data is always appended to the end of file.
+ */
+static int WriteObjectAt(uffs_Object *obj, uffs_IoCursor *src, int len, u32 *pos)
 {
 	uffs_Device *dev = obj->dev;
 	TreeNode *fnode = NULL;
 	int remain;
-	u32 pos;
 	int wrote = 0;
 
-	if (obj == NULL) 
-		return 0;
-
 	if (obj->dev == NULL || obj->open_succ != U_TRUE) {
 		obj->err = UEBADF;
 		return 0;
@@ -1062,22 +1399,23 @@ int uffs_WriteObject(uffs_Object *obj, const void *data, int len)
 	uffs_ObjectDevLock(obj);
 
 	if (obj->oflag & UO_APPEND)
-		obj->pos = fnode->u.file.len;
+		*pos = fnode->u.file.len;
 	else {
-		if (obj->pos > fnode->u.file.len) {
-			// current pos pass over the end of file, need to fill the gap with '\0'
-			pos = obj->pos;	// save desired pos
-			obj->pos = fnode->u.file.len; // filling gap from the end of the file.
-			remain = do_WriteObject(obj, NULL, pos - fnode->u.file.len);  // Write filling bytes. Note: the filling data does not count as 'wrote' in this write operation.
-			obj->pos = pos - remain;
-			if (remain > 0)	// fail to fill the gap ? stop.
-				goto ext;
+		if (*pos > fnode->u.file.len) {
+			// pos pass over the end of file, need to fill the gap with '\0'
+			// filling gap from the end of the file. Note: the filling data does not count as 'wrote' in this write operation.
+			if (do_ExtendObject(obj, *pos) != U_SUCC) {
+				*pos = fnode->u.file.len;
+				goto ext;	// fail to fill the gap ? stop.
+			}
 		}
 	}
 
-	remain = do_WriteObject(obj, data, len);
+	remain = do_WriteObject(obj, *pos, src, len);
 	wrote = len - remain;
-	obj->pos += wrote;
+	*pos += wrote;
+	obj->write_st.bytes_written += wrote;
+	dev->write_st.bytes_written += wrote;
 
 ext:
 	if (HAVE_BADBLOCK(dev))
@@ -1091,58 +1429,356 @@ ext:
 }
 
 /**
- * read data from obj
+ * write data to obj, from obj->pos
  *
- * \param[in] obj uffs object
- * \param[out] data output data buffer
- * \param[in] len required length of data to be read from object->pos
+ * \param[in] obj file obj
+ * \param[in] data data pointer
+ * \param[in] len length of data to be write
  *
- * \return return bytes of data have been read
+ * \return bytes wrote to obj
  */
-int uffs_ReadObject(uffs_Object *obj, void *data, int len)
+int uffs_WriteObject(uffs_Object *obj, const void *data, int len)
+{
+	struct uffs_iovec iov;
+
+	iov.iov_base = (void *)data;
+	iov.iov_len = len;
+
+	return uffs_WriteObjectV(obj, &iov, 1);
+}
+
+/**
+ * reserve erased blocks for writing obj up to 'len' bytes.
+ *
+ * blocks needed for growing the file from current length to 'len'
+ * (plus one spare block for block recover) are taken from erased list,
+ * verified and held by the object until it is closed or truncated.
+ * the file length is not changed. if there are no enough erased blocks,
+ * all blocks reserved by the object are given back.
+ *
+ * \param[in] obj file obj
+ * \param[in] len file length to be reserved for
+ *
+ * \return U_SUCC or U_FAIL (error code in obj->err)
+ */
+URET uffs_FallocateObject(uffs_Object *obj, u32 len)
 {
 	uffs_Device *dev = obj->dev;
-	TreeNode *fnode = NULL;
-	u32 remain = len;
-	u16 fdn;
-	u32 read_start;
-	TreeNode *dnode;
-	u32 size;
-	uffs_Buf *buf;
-	u32 blockOfs;
-	u16 page_id;
-	u8 type;
-	u32 pageOfs;
+	TreeNode *fnode;
+	u16 fdn_have, fdn_need;
+	int count;
 
-	if (obj == NULL)
-		return 0;
+	if (obj->dev == NULL || obj->open_succ != U_TRUE) {
+		obj->err = UEBADF;
+		goto ext;
+	}
+
+	if (obj->type == UFFS_TYPE_DIR || obj->oflag == UO_RDONLY) {
+		obj->err = UEACCES;
+		goto ext;
+	}
 
 	fnode = obj->node;
 
-	if (obj->dev == NULL || obj->open_succ == U_FALSE) {
-		obj->err = UEBADF;
-		return 0;
+	uffs_ObjectDevLock(obj);
+
+	if (len > fnode->u.file.len) {
+		fdn_have = (fnode->u.file.len > 0 ? GetFdnByOfs(obj, fnode->u.file.len - 1) : 0);
+		fdn_need = GetFdnByOfs(obj, len - 1);
+		count = fdn_need - fdn_have;
+		if (count > 0)
+			count++;	// one more for block recover
+		count -= obj->resv.count;
+
+		if (count > 0) {
+			obj->resv.serial = fnode->u.file.serial;
+			if (uffs_TreeReserveAdd(dev, &obj->resv, count) != U_SUCC) {
+				uffs_Perror(UFFS_MSG_NOISY, "no enough erased blocks to reserve %d blocks", count);
+				uffs_TreeReserveRelease(dev, &obj->resv);
+				obj->err = UENOSPC;
+			}
+		}
 	}
 
-	if (obj->type == UFFS_TYPE_DIR) {
-		uffs_Perror(UFFS_MSG_NOISY, "Can't read data from a dir object!");
-		obj->err = UEBADF;
+	if (HAVE_BADBLOCK(dev))
+		uffs_BadBlockRecover(dev);
+
+	uffs_ObjectDevUnLock(obj);
+
+ext:
+	return (obj->err == UENOERR ? U_SUCC : U_FAIL);
+}
+
+/** total length of I/O vector, -1 if invalid */
+static int GetIoVecLength(const struct uffs_iovec *iov, int iovcnt)
+{
+	int i, len = 0;
+
+	if (iovcnt < 0 || (iov == NULL && iovcnt > 0))
+		return -1;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len < 0 || len + iov[i].iov_len < len)
+			return -1;
+		len += iov[i].iov_len;
+	}
+
+	return len;
+}
+
+/**
+ * write data gathered from I/O vector to obj, from obj->pos.
+ * all the data are written in one pass, each page buffer is
+ * filled from multiple vector elements if needed.
+ *
+ * \param[in] obj file obj
+ * \param[in] iov I/O vector
+ * \param[in] iovcnt elements of iov
+ *
+ * \return bytes wrote to obj
+ */
+int uffs_WriteObjectV(uffs_Object *obj, const struct uffs_iovec *iov, int iovcnt)
+{
+	uffs_IoCursor src;
+	u32 pos;
+	int len, wrote;
+
+	if (obj == NULL)
+		return 0;
+
+	len = GetIoVecLength(iov, iovcnt);
+	if (len < 0) {
+		obj->err = UEINVAL;
 		return 0;
 	}
 
-	if (obj->pos > fnode->u.file.len) {
-		return 0; //can't read file out of range
+	uffs_IoCursorInit(&src, iov, iovcnt);
+	pos = obj->pos;
+	wrote = WriteObjectAt(obj, &src, len, &pos);
+	obj->pos = pos;
+
+	return wrote;
+}
+
+/**
+ * write data to obj at file offset 'ofs', obj->pos is not changed.
+ *
+ * \param[in] obj file obj
+ * \param[in] data data pointer
+ * \param[in] len length of data to be write
+ * \param[in] ofs file offset, ignored if obj is opened with UO_APPEND
+ *
+ * \return bytes wrote to obj
+ */
+int uffs_WriteObjectAt(uffs_Object *obj, const void *data, int len, u32 ofs)
+{
+	struct uffs_iovec iov;
+	uffs_IoCursor src;
+
+	if (obj == NULL)
+		return 0;
+
+	iov.iov_base = (void *)data;
+	iov.iov_len = len;
+	uffs_IoCursorInit(&src, &iov, 1);
+
+	return WriteObjectAt(obj, &src, len, &ofs);
+}
+
+/** page id of file offset 'ofs' in data block 'fdn' */
+static int GetPageIdByOfs(uffs_Object *obj, u16 fdn, u32 ofs)
+{
+	int page_id = (ofs - GetStartOfDataBlock(obj, fdn)) / obj->dev->com.pg_data_size;
+
+	return (fdn == 0 ? page_id + 1 : page_id);
+}
+
+/**
+ * write 'n' pieces of data to obj atomically: after a power loss,
+ * either all of them or none of them are on flash. obj->pos is not changed.
+ *
+ * the pieces are written to the dirty group of one block, which is then
+ * flushed by a single block recover (an interrupted block recover is rolled
+ * back on mount). so all pieces must fall in one existing block of the file,
+ * must not leave a gap after the end of file, and must take less pages than
+ * a dirty group holds.
+ *
+ * \param[in] obj file obj
+ * \param[in] iov data of each piece
+ * \param[in] ofs file offset of each piece
+ * \param[in] n number of pieces
+ *
+ * \return U_SUCC or U_FAIL (error code in obj->err).
+ *		obj->err is UEINVAL if the pieces can't be written atomically,
+ *		nothing is written in this case.
+ */
+URET uffs_WriteObjectAtomic(uffs_Object *obj, const struct uffs_iovec *iov, const long *ofs, int n)
+{
+	uffs_Device *dev = obj->dev;
+	TreeNode *fnode, *dnode;
+	uffs_IoCursor src;
+	uffs_Buf *buf;
+	u32 len, start, end, old_len;
+	u16 fdn = 0, parent, serial;
+	int i, slot, pages, page_lo, page_hi;
+	int wrote = 0;
+	u8 type;
+
+	if (obj->dev == NULL || obj->open_succ != U_TRUE) {
+		obj->err = UEBADF;
+		goto ext;
 	}
 
-	if (obj->oflag & UO_WRONLY) {
+	if (obj->type == UFFS_TYPE_DIR || obj->oflag == UO_RDONLY) {
 		obj->err = UEACCES;
-		return 0;
+		goto ext;
+	}
+
+	if (n <= 0 || iov == NULL || ofs == NULL || (obj->oflag & UO_APPEND)) {
+		obj->err = UEINVAL;
+		goto ext;
 	}
 
+#ifdef CONFIG_FLUSH_BUF_AFTER_WRITE
+	// every write is flushed immediately, can't hold them in one group.
+	obj->err = UEINVAL;
+	goto ext;
+#endif
+
+	fnode = obj->node;
+
 	uffs_ObjectDevLock(obj);
 
+	// check all pieces before writing anything
+	len = fnode->u.file.len;
+	page_lo = dev->attr->pages_per_block;
+	page_hi = 0;
+	for (i = 0; i < n; i++) {
+		if (ofs[i] < 0 || iov[i].iov_len <= 0 || (u32)ofs[i] > len)
+			break;
+		start = (u32)ofs[i];
+		end = start + iov[i].iov_len;
+		if (end < start)
+			break;
+		if (i == 0)
+			fdn = GetFdnByOfs(obj, start);
+		if (GetFdnByOfs(obj, start) != fdn || GetFdnByOfs(obj, end - 1) != fdn)
+			break;
+		if (GetPageIdByOfs(obj, fdn, start) < page_lo)
+			page_lo = GetPageIdByOfs(obj, fdn, start);
+		if (GetPageIdByOfs(obj, fdn, end - 1) > page_hi)
+			page_hi = GetPageIdByOfs(obj, fdn, end - 1);
+		if (end > len)
+			len = end;
+	}
+
+	// page 0 is also made dirty for holding the group
+	pages = page_hi - page_lo + 1 + (page_lo > 0 ? 1 : 0);
+
+	if (fdn == 0) {
+		dnode = fnode;
+		type = UFFS_TYPE_FILE;
+		parent = fnode->u.file.parent;
+		serial = fnode->u.file.serial;
+	}
+	else {
+		dnode = uffs_TreeFindDataNode(dev, fnode->u.file.serial, fdn);
+		type = UFFS_TYPE_DATA;
+		parent = fnode->u.file.serial;
+		serial = fdn;
+	}
+
+	if (i < n || pages >= dev->buf.dirty_buf_max || dnode == NULL) {
+		obj->err = UEINVAL;
+		goto unlock;
+	}
+
+	if (obj->resv.count == 0 && dev->tree.erased_count == 0) {
+		obj->err = UENOSPC;	// no erased block for block recover
+		goto unlock;
+	}
+
+	// flush pending data of the file first, so that the group holds this batch only
+	if (do_FlushObject(obj) != U_SUCC) {
+		obj->err = UEIOERR;
+		goto unlock;
+	}
+
+	buf = uffs_BufGetEx(dev, type, dnode, 0, obj->oflag);
+	if (buf == NULL) {
+		obj->err = UENOMEM;
+		uffs_Perror(UFFS_MSG_SERIOUS, "Can't get buf");
+		goto unlock;
+	}
+	uffs_BufWrite(dev, buf, NULL, 0, 0); // just make this buf dirty
+	uffs_BufPut(dev, buf);
+
+	// lock the group, so it won't be flushed before all pieces are written
+	slot = uffs_BufFindGroupSlot(dev, parent, serial);
+	uffs_BufLockGroup(dev, slot);
+
+	old_len = fnode->u.file.len;
+	for (i = 0; i < n; i++) {
+		uffs_IoCursorInit(&src, &iov[i], 1);
+		if (do_WriteObject(obj, (u32)ofs[i], &src, iov[i].iov_len) != 0)
+			break;
+		wrote += iov[i].iov_len;
+	}
+
+	uffs_BufUnLockGroup(dev, slot);
+
+	if (i < n) {
+		// give up the whole batch
+		uffs_Perror(UFFS_MSG_NORMAL, "atomic write fail, discard %d bytes", wrote);
+		uffs_BufDiscardGroup(dev, slot);
+		fnode->u.file.len = old_len;
+		obj->err = UEIOERR;
+	}
+	else if (uffs_BufFlushGroupEx(dev, parent, serial, U_TRUE) != U_SUCC) {
+		obj->err = UEIOERR;
+	}
+	else {
+		obj->write_st.bytes_written += wrote;
+		dev->write_st.bytes_written += wrote;
+	}
+
+	if (HAVE_BADBLOCK(dev))
+		uffs_BadBlockRecover(dev);
+
+unlock:
+	uffs_ObjectDevUnLock(obj);
+
+ext:
+	return (obj->err == UENOERR ? U_SUCC : U_FAIL);
+}
+
+/**
+ * read data from file offset 'pos', the caller should lock the device.
+ *
+ * \param[in] cached_only if U_TRUE, only read from page buffers and
+ *			give up on the first page not in buffers. the caller may
+ *			hold shared device lock in this case.
+ *
+ * \return return bytes of data have been read,
+ *		or -1 if cached_only and a page is not in buffers.
+ */
+static int do_ReadObject(uffs_Object *obj, u32 pos, uffs_IoCursor *dst, int len, UBOOL cached_only)
+{
+	uffs_Device *dev = obj->dev;
+	TreeNode *fnode = obj->node;
+	u32 remain = len;
+	u16 fdn;
+	u32 read_start;
+	TreeNode *dnode;
+	u32 size;
+	uffs_Buf *buf;
+	u32 blockOfs;
+	u16 page_id;
+	u8 type;
+	u32 pageOfs;
+
 	while (remain > 0) {
-		read_start = obj->pos + len - remain;
+		read_start = pos + len - remain;
 		if (read_start >= fnode->u.file.len) {
 			//uffs_Perror(UFFS_MSG_NOISY, "read point out of file ?");
 			break;
@@ -1156,6 +1792,15 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 		else {
 			type = UFFS_TYPE_DATA;
 			dnode = uffs_TreeFindDataNode(dev, fnode->u.file.serial, fdn);
+			if (IsHoleBlock(obj, fdn, dnode)) {
+				// hole of sparse file, read as '\0'
+				size = GetStartOfDataBlock(obj, fdn + 1) - read_start;
+				if (size > remain)
+					size = remain;
+				uffs_IoCursorZero(dst, size);
+				remain -= size;
+				continue;
+			}
 			if (dnode == NULL) {
 				uffs_Perror(UFFS_MSG_SERIOUS, "can't get data node in entry!");
 				obj->err = UEUNKNOWN_ERR;
@@ -1174,11 +1819,18 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 			page_id++;
 		}
 
-		buf = uffs_BufGetEx(dev, type, dnode, (u16)page_id, obj->oflag);
-		if (buf == NULL) {
-			uffs_Perror(UFFS_MSG_SERIOUS, "can't get buffer when read obj.");
-			obj->err = UEIOERR;
-			break;
+		if (cached_only) {
+			buf = uffs_BufGetCached(dev, type, dnode, (u16)page_id);
+			if (buf == NULL)
+				return -1;
+		}
+		else {
+			buf = uffs_BufGetEx(dev, type, dnode, (u16)page_id, obj->oflag);
+			if (buf == NULL) {
+				uffs_Perror(UFFS_MSG_SERIOUS, "can't get buffer when read obj.");
+				obj->err = UEIOERR;
+				break;
+			}
 		}
 
 		pageOfs = read_start % dev->com.pg_data_size;
@@ -1189,13 +1841,67 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 		}
 		size = (remain + pageOfs > buf->data_len ? buf->data_len - pageOfs : remain);
 
-		uffs_BufRead(dev, buf, (u8 *)data + len - remain, pageOfs, size);
+		uffs_BufReadV(dev, buf, dst, pageOfs, size);
 		uffs_BufPut(dev, buf);
 
 		remain -= size;
 	}
 
-	obj->pos += (len - remain);
+	return len - remain;
+}
+
+/**
+ * read data from obj at file offset 'pos' to I/O cursor
+ */
+static int ReadObjectAt(uffs_Object *obj, uffs_IoCursor *dst, int len, u32 pos)
+{
+	uffs_Device *dev;
+	TreeNode *fnode = NULL;
+	int size;
+#ifdef CONFIG_USE_PER_DEVICE_LOCK
+	uffs_IoCursor start = *dst;
+#endif
+
+	dev = obj->dev;
+	fnode = obj->node;
+
+	if (obj->dev == NULL || obj->open_succ == U_FALSE) {
+		obj->err = UEBADF;
+		return 0;
+	}
+
+	if (obj->type == UFFS_TYPE_DIR) {
+		uffs_Perror(UFFS_MSG_NOISY, "Can't read data from a dir object!");
+		obj->err = UEBADF;
+		return 0;
+	}
+
+	if (pos > fnode->u.file.len) {
+		return 0; //can't read file out of range
+	}
+
+	if (obj->oflag & UO_WRONLY) {
+		obj->err = UEACCES;
+		return 0;
+	}
+
+#ifdef CONFIG_USE_PER_DEVICE_LOCK
+	// try page buffers first with shared lock, so that readers of cached
+	// data don't block each other. if any page is missing, read it all
+	// again with exclusive lock: a read never sees a half-done write.
+	uffs_DeviceLockShared(dev);
+	size = do_ReadObject(obj, pos, dst, len, U_TRUE);
+	uffs_DeviceUnLockShared(dev);
+
+	if (size >= 0)
+		return size;
+
+	*dst = start;
+#endif
+
+	uffs_ObjectDevLock(obj);
+
+	size = do_ReadObject(obj, pos, dst, len, U_FALSE);
 
 	if (HAVE_BADBLOCK(dev)) 
 		uffs_BadBlockRecover(dev);
@@ -1204,7 +1910,144 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 
 	uffs_Assert(fnode == obj->node, "obj->node change!\n");
 
-	return len - remain;
+	return size;
+}
+
+/**
+ * read data from obj
+ *
+ * \param[in] obj uffs object
+ * \param[out] data output data buffer
+ * \param[in] len required length of data to be read from object->pos
+ *
+ * \return return bytes of data have been read
+ */
+int uffs_ReadObject(uffs_Object *obj, void *data, int len)
+{
+	struct uffs_iovec iov;
+
+	iov.iov_base = data;
+	iov.iov_len = len;
+
+	return uffs_ReadObjectV(obj, &iov, 1);
+}
+
+/**
+ * read data from obj->pos and scatter to I/O vector
+ *
+ * \param[in] obj uffs object
+ * \param[in] iov I/O vector
+ * \param[in] iovcnt elements of iov
+ *
+ * \return return bytes of data have been read
+ */
+int uffs_ReadObjectV(uffs_Object *obj, const struct uffs_iovec *iov, int iovcnt)
+{
+	uffs_IoCursor dst;
+	int len, size;
+
+	if (obj == NULL)
+		return 0;
+
+	len = GetIoVecLength(iov, iovcnt);
+	if (len < 0) {
+		obj->err = UEINVAL;
+		return 0;
+	}
+
+	uffs_IoCursorInit(&dst, iov, iovcnt);
+	size = ReadObjectAt(obj, &dst, len, obj->pos);
+	obj->pos += size;
+
+	return size;
+}
+
+/**
+ * read data from obj at file offset 'ofs', obj->pos is not changed.
+ *
+ * \param[in] obj uffs object
+ * \param[out] data output data buffer
+ * \param[in] len required length of data to be read
+ * \param[in] ofs file offset
+ *
+ * \return return bytes of data have been read
+ */
+int uffs_ReadObjectAt(uffs_Object *obj, void *data, int len, u32 ofs)
+{
+	struct uffs_iovec iov;
+	uffs_IoCursor dst;
+
+	if (obj == NULL)
+		return 0;
+
+	iov.iov_base = data;
+	iov.iov_len = len;
+	uffs_IoCursorInit(&dst, &iov, 1);
+
+	return ReadObjectAt(obj, &dst, len, ofs);
+}
+
+/**
+ * skip 'size' bytes from the file pointer, no data is read or written.
+ *
+ * if the object is opened for writing and the new position passes the
+ * end of file, the file is extended and the gap reads as '\0'. with
+ * CONFIG_SPARSE_FILE, whole data blocks in the gap are not written.
+ * otherwise the file pointer stops at the end of file.
+ *
+ * \param[in] obj uffs object
+ * \param[in] size bytes to skip
+ *
+ * \return bytes skipped, or -1 if error (error code in obj->err)
+ */
+int uffs_SkipObject(uffs_Object *obj, int size)
+{
+	uffs_Device *dev = obj->dev;
+	TreeNode *fnode;
+	u32 pos;
+	int skipped;
+
+	if (obj->dev == NULL || obj->open_succ != U_TRUE) {
+		obj->err = UEBADF;
+		return -1;
+	}
+
+	if (obj->type == UFFS_TYPE_DIR) {
+		uffs_Perror(UFFS_MSG_NOISY, "Can't skip a dir object!");
+		obj->err = UEACCES;
+		return -1;
+	}
+
+	if (size < 0 || obj->pos + (u32)size < obj->pos) {
+		obj->err = UEINVAL;
+		return -1;
+	}
+
+	fnode = obj->node;
+
+	uffs_ObjectDevLock(obj);
+
+	pos = obj->pos + size;
+	if (pos > fnode->u.file.len) {
+		if (obj->oflag == UO_RDONLY) {
+			pos = (obj->pos > fnode->u.file.len ? obj->pos : fnode->u.file.len);
+		}
+		else if (do_ExtendObject(obj, pos) != U_SUCC) {
+			uffs_Perror(UFFS_MSG_NOISY, "fail to extend file to %d", pos);
+			obj->err = UEIOERR;
+			pos = (obj->pos > fnode->u.file.len ? obj->pos : fnode->u.file.len);
+		}
+	}
+
+	skipped = pos - obj->pos;
+	obj->pos = pos;
+
+	if (HAVE_BADBLOCK(dev))
+		uffs_BadBlockRecover(dev);
+
+	uffs_ObjectDevUnLock(obj);
+
+	return skipped;
 }
 
 /**
@@ -1225,7 +2068,8 @@ long uffs_SeekObject(uffs_Object *obj, long offset, int origin)
 		obj->err = UEACCES;
 	}
 	else {
-		uffs_ObjectDevLock(obj);
+		// only obj->pos changes, the file length is safe to read with shared lock
+		uffs_DeviceLockShared(obj->dev);
 		switch (origin) {
 			case USEEK_CUR:
 				if ((long)obj->pos + offset < 0) {
@@ -1252,7 +2096,7 @@ long uffs_SeekObject(uffs_Object *obj, long offset, int origin)
 				}
 				break;
 		}
-		uffs_ObjectDevUnLock(obj);
+		uffs_DeviceUnLockShared(obj->dev);
 	}
 
 	return (obj->err == UENOERR ? (long)obj->pos : -1);
@@ -1443,6 +2287,8 @@ URET uffs_TruncateObject(uffs_Object *obj, u32 remain)
 	uffs_ObjectDevLock(obj);
 	if (do_TruncateObject(obj, remain, eDRY_RUN) == U_SUCC)
 		do_TruncateObject(obj, remain, eREAL_RUN);
+	if (obj->dev)
+		uffs_TreeReserveRelease(obj->dev, &obj->resv);
 	uffs_ObjectDevUnLock(obj);
 
 	uffs_FlushObject(obj);
@@ -1455,13 +2301,14 @@ static URET do_TruncateObject(uffs_Object *obj, u32 remain, RunOptionE run_opt)
 {
 	uffs_Device *dev = obj->dev;
 	TreeNode *fnode = obj->node;
-	u16 fdn;
+	u16 fdn, fdn_last;
 	u32 flen;
 	u32 block_start;
 	TreeNode *node;
 	uffs_BlockInfo *bc;
 	uffs_Buf *buf;
 	u16 page;
+	uffs_IoCursor zero;
 	int pos;
 
 	pos = obj->pos;   // save current file position
@@ -1484,7 +2331,7 @@ static URET do_TruncateObject(uffs_Object *obj, u32 remain, RunOptionE run_opt)
 		// file is shorter than 'reamin', fill the gap with '\0'
 		if (run_opt == eREAL_RUN) {
 			obj->pos = flen;  // move file pointer to the end
-			if (do_WriteObject(obj, NULL, remain - flen) > 0) {	// fill '\0' ...
+			if (do_ExtendObject(obj, remain) != U_SUCC) {	// fill '\0' ...
 				uffs_Perror(UFFS_MSG_SERIOUS, "Write object not finished. expect %d but only %d wrote.",
 												remain - flen, fnode->u.file.len - flen);
 				obj->err = UEIOERR;   // likely be an I/O error.
@@ -1493,14 +2340,30 @@ static URET do_TruncateObject(uffs_Object *obj, u32 remain, RunOptionE run_opt)
 		}
 	}
 	else {
+		fdn_last = (flen > 0 ? GetFdnByOfs(obj, flen - 1) : 0);
 		while (flen > remain) {
 			fdn = GetFdnByOfs(obj, flen - 1);
 
 			//uffs_BufFlushGroup(dev, obj->serial, fdn);	//!< flush the buffer
 
 			block_start = GetStartOfDataBlock(obj, fdn);
-			if (remain <= block_start && fdn > 0) {
-				node = uffs_TreeFindDataNode(dev, obj->serial, fdn);
+			node = (fdn > 0 ? uffs_TreeFindDataNode(dev, obj->serial, fdn) : NULL);
+			if (IS_HOLE(fdn, fdn_last, node)) {
+				// a hole of sparse file
+				if (remain > block_start && run_opt == eREAL_RUN) {
+					// this hole will be the last block, write it out
+					uffs_IoCursorInit(&zero, NULL, 0);
+					do_WriteHoleBlock(obj, fdn, &zero, 0, 0, remain - block_start);
+					if (uffs_TreeFindDataNode(dev, obj->serial, fdn) == NULL) {
+						obj->err = UEIOERR;
+						goto ext;
+					}
+				}
+				flen = (remain > block_start ? remain : block_start);
+				if (run_opt == eREAL_RUN)
+					fnode->u.file.len = flen;
+			}
+			else if (remain <= block_start && fdn > 0) {
 				if (node == NULL) {
 					uffs_Perror(UFFS_MSG_SERIOUS,
 								"can't find data node when trancate obj.");
@@ -1535,6 +2398,7 @@ static URET do_TruncateObject(uffs_Object *obj, u32 remain, RunOptionE run_opt)
 					node->u.list.block = bc->block;
 					uffs_TreeEraseNode(dev, node);
 					uffs_TreeInsertToErasedListTail(dev, node);
+					uffs_ObjectWriteStatAdd(dev, obj->serial, 0, 0, 1);
 
 					fnode->u.file.len = block_start;
 				}
@@ -1641,7 +2505,7 @@ URET uffs_DeleteObject(const char * name, int *err)
 	uffs_Object *obj, *work;
 	TreeNode *node, *d_node;
 	uffs_Device *dev = NULL;
-	u16 block;
+	uffs_BlockNum block;
 	u16 serial, parent, last_serial;
 	URET ret = U_FAIL;
 
@@ -1662,20 +2526,17 @@ URET uffs_DeleteObject(const char * name, int *err)
 
 	dev = obj->dev;
 
-	// working throught object pool see if the object is opened ...
+	// see if the object is opened by others ...
 	uffs_ObjectDevLock(obj);
-	work = NULL;
-	while ((work = (uffs_Object *)uffs_PoolFindNextAllocated(&_object_pool, work)) != NULL) {
-		if (work != obj && 
-			work->dev &&
-			work->dev == obj->dev &&
-			work->node &&
-			work->node == obj->node) {
-			// this object is opened, can't delete it.
-			if (err)
-				*err = UEACCES;
-			goto ext_lock;
-		}
+	uffs_GlobalTableLock();
+	work = OpenTableFind(dev, obj->node, obj);
+	uffs_GlobalTableUnlock();
+
+	if (work != NULL) {
+		// this object is opened, can't delete it.
+		if (err)
+			*err = UEACCES;
+		goto ext_lock;
 	}
 
 	if (obj->type == UFFS_TYPE_DIR) {
@@ -1714,6 +2575,7 @@ URET uffs_DeleteObject(const char * name, int *err)
 	uffs_BreakFromEntry(dev, obj->type, node);
 	node->u.list.block = block;
 	uffs_TreeEraseNode(dev, node);
+	uffs_FileInfoExpire(dev, obj->serial);
 
 	// From now on, the object is gone physically,
 	// but we need to 'suspend' this node so that no one will re-use
@@ -1730,6 +2592,8 @@ URET uffs_DeleteObject(const char * name, int *err)
 			uffs_ObjectDevLock(obj);
 
 			d_node = uffs_TreeFindDataNode(dev, parent, serial);
+			if (IS_HOLE(serial, last_serial, d_node))
+				continue;	// a hole of sparse file
 			if (uffs_Assert(d_node != NULL, "Can't find DATA node parent = %d, serial = %d\n", parent, serial)) {
 				uffs_BreakFromEntry(dev, UFFS_TYPE_DATA, d_node);
 				block = d_node->u.data.block;
@@ -43,6 +43,7 @@
 #include "uffs/uffs_fs.h"
 #include "uffs/uffs_badblock.h"
 #include "uffs/uffs_utils.h"
+#include "uffs/uffs_fileinfo.h"
 #include <string.h>
 
 #define PFX "init: "
@@ -61,6 +62,7 @@ static URET uffs_InitDeviceConfig(uffs_Device *dev)
 	dev->cfg.page_buffers = MAX_PAGE_BUFFERS;
 	dev->cfg.dirty_pages = MAX_DIRTY_PAGES_IN_A_BLOCK;
 	dev->cfg.reserved_free_blocks = MINIMUN_ERASED_BLOCK;
+	dev->cfg.fi_caches = MAX_CACHED_FILE_INFO;
 #else
 	if (dev->cfg.bc_caches == 0)
 		dev->cfg.bc_caches = MAX_CACHED_BLOCK_INFO;
@@ -70,6 +72,8 @@ static URET uffs_InitDeviceConfig(uffs_Device *dev)
 		dev->cfg.dirty_pages = MAX_DIRTY_PAGES_IN_A_BLOCK;
 	if (dev->cfg.reserved_free_blocks == 0)
 		dev->cfg.reserved_free_blocks = MINIMUN_ERASED_BLOCK;
+	if (dev->cfg.fi_caches == 0)
+		dev->cfg.fi_caches = MAX_CACHED_FILE_INFO;
 
 	if (!uffs_Assert(dev->cfg.page_buffers - CLONE_BUFFERS_THRESHOLD >= 3, "invalid config: page_buffers = %d\n", dev->cfg.page_buffers))
 		return U_FAIL;
@@ -94,6 +98,8 @@ URET uffs_InitDevice(uffs_Device *dev)
 	}
 
 	memset(&(dev->st), 0, sizeof(uffs_FlashStat));
+	memset(&(dev->cache_st), 0, sizeof(uffs_CacheStat));
+	memset(&(dev->write_st), 0, sizeof(uffs_WriteStat));
 
 	uffs_DeviceInitLock(dev);
 	uffs_BadBlockInit(dev);
@@ -116,6 +122,12 @@ URET uffs_InitDevice(uffs_Device *dev)
 		uffs_Perror(UFFS_MSG_DEAD, "Initialize block info fail");
 		goto fail;
 	}
+	uffs_Perror(UFFS_MSG_NOISY, "init file info cache");
+	ret = uffs_FileInfoInitCache(dev, dev->cfg.fi_caches);
+	if (ret != U_SUCC) {
+		uffs_Perror(UFFS_MSG_DEAD, "Initialize file info cache fail");
+		goto fail;
+	}
 
 	ret = uffs_TreeInit(dev);
 	if (ret != U_SUCC) {
@@ -147,6 +159,8 @@ URET uffs_ReleaseDevice(uffs_Device *dev)
 		goto ext;
 	}
 
+	uffs_FileInfoReleaseCache(dev);
+
 	ret = uffs_BufReleaseAll(dev);
 	if (ret != U_SUCC) {
 		uffs_Perror(UFFS_MSG_SERIOUS,  "fail to release page buffers");
@@ -74,17 +74,23 @@ int uffs_RegisterMountTable(uffs_MountTable *mtb)
 	uffs_MountTable *work = NULL;
 	static int dev_num = 0;
 
+	int ret = 0;
+
 	if (mtb == NULL) 
 		return -1;
 
+	uffs_GlobalTableLock();
+
 	for (work = m_head; work; work = work->next) {
-		if (work == mtb)
-			return -1; // already mounted ?
+		if (work == mtb) {
+			ret = -1; // already mounted ?
+			goto ext;
+		}
 	}
 
 	for (work = m_free_head; work; work = work->next) {
 		if (work == mtb)
-			return 0; // already registered.
+			goto ext; // already registered.
 	}
 
 	/* replace the free head */
@@ -96,7 +102,10 @@ int uffs_RegisterMountTable(uffs_MountTable *mtb)
 	
 	mtb->dev->dev_num = ++dev_num;
 
-	return 0;
+ext:
+	uffs_GlobalTableUnlock();
+
+	return ret;
 }
 
 /**
@@ -112,9 +121,13 @@ int uffs_UnRegisterMountTable(uffs_MountTable *mtb)
 	if (mtb == NULL)
 		return -1;
 
+	uffs_GlobalTableLock();
+
 	for (work = m_head; work; work = work->next) {
-		if (work == mtb)
+		if (work == mtb) {
+			uffs_GlobalTableUnlock();
 			return -1;	// in the mounted list ? busy, return
+		}
 	}
 
 	for (work = m_free_head; work; work = work->next) {
@@ -131,6 +144,8 @@ int uffs_UnRegisterMountTable(uffs_MountTable *mtb)
 		}
 	}
 
+	uffs_GlobalTableUnlock();
+
 	return work ? 0 : -1;
 }
 
@@ -157,31 +172,46 @@ static uffs_MountTable * uffs_GetMountTableByMountPoint(const char *mount, uffs_
 int uffs_Mount(const char *mount)
 {
 	uffs_MountTable *mtb;
+	u32 end;
 
+	uffs_GlobalTableLock();
 	if (uffs_GetMountTableByMountPoint(mount, m_head) != NULL) {
+		uffs_GlobalTableUnlock();
 		uffs_Perror(UFFS_MSG_NOISY,	"'%s' already mounted", mount);
 		return -1; // already mounted ?
 	}
 	
 	mtb = uffs_GetMountTableByMountPoint(mount, m_free_head);
+	uffs_GlobalTableUnlock();
 	if (mtb == NULL) {
 		uffs_Perror(UFFS_MSG_NOISY,	"'%s' not registered", mount);
 		return -1;	// not registered ?
 	}
 
+	// device is not reachable from mount table until it's linked
+	// to mounted list, no device lock is needed during initialization.
+
 	uffs_Perror(UFFS_MSG_NOISY,
 				"init device for mount point %s ...",
 				mtb->mount);
 
-	mtb->dev->par.start = mtb->start_block;
 	if (mtb->end_block < 0) {
-		mtb->dev->par.end = 
-			mtb->dev->attr->total_blocks + mtb->end_block;
+		end = mtb->dev->attr->total_blocks + mtb->end_block;
 	}
 	else {
-		mtb->dev->par.end = mtb->end_block;
+		end = mtb->end_block;
+	}
+
+	if (end >= (u32)UFFS_INVALID_BLOCK) {
+		uffs_Perror(UFFS_MSG_SERIOUS,
+					"partition end block %u is out of block number range, "
+					"enable CONFIG_UFFS_WIDE_BLOCK_ADDRESS ?", end);
+		return -1;
 	}
 
+	mtb->dev->par.start = mtb->start_block;
+	mtb->dev->par.end = end;
+
 	if (mtb->dev->Init(mtb->dev) == U_FAIL) {
 		uffs_Perror(UFFS_MSG_SERIOUS,
 					"init device for mount point %s fail",
@@ -197,6 +227,8 @@ int uffs_Mount(const char *mount)
 		return -1;
 	}
 
+	uffs_GlobalTableLock();
+
 	/* now break it from unmounted list */
 	if (mtb->prev)
 		mtb->prev->next = mtb->next;
@@ -212,6 +244,8 @@ int uffs_Mount(const char *mount)
 		m_head->prev = mtb;
 	m_head = mtb;
 
+	uffs_GlobalTableUnlock();
+
 	return 0;
 }
 
@@ -223,34 +257,30 @@ int uffs_Mount(const char *mount)
  */
 int uffs_UnMount(const char *mount)
 {
-	uffs_MountTable *mtb = uffs_GetMountTableByMountPoint(mount, m_head);
+	uffs_MountTable *mtb;
+
+	uffs_GlobalTableLock();
 
+	mtb = uffs_GetMountTableByMountPoint(mount, m_head);
 	if (mtb == NULL) {
+		uffs_GlobalTableUnlock();
 		uffs_Perror(UFFS_MSG_NOISY,	"'%s' not mounted ?", mount);
 		return -1;  // not mounted ?
 	}
 
 	if (uffs_GetMountTableByMountPoint(mount, m_free_head) != NULL) {
+		uffs_GlobalTableUnlock();
 		uffs_Perror(UFFS_MSG_NOISY,	"'%s' already unmounted ?", mount);
 		return -1;  // already unmounted ?
 	}
 
-	if (HAVE_BADBLOCK(mtb->dev))
-		uffs_BadBlockRecover(mtb->dev);
-
 	if (mtb->dev->ref_count != 0) {
+		uffs_GlobalTableUnlock();
 		uffs_Perror(UFFS_MSG_NORMAL, "Can't unmount '%s' - busy", mount);
 		return -1;
 	}
 
-	if (uffs_ReleaseDevice(mtb->dev) == U_FAIL) {
-		uffs_Perror(UFFS_MSG_NORMAL, "Can't release device for mount point '%s'", mount);
-		return -1;
-	}
-
-	mtb->dev->Release(mtb->dev);
-
-	// break from mounted list
+	// break from mounted list, so that no one can get the device any more
 	if (mtb->prev)
 		mtb->prev->next = mtb->next;
 	if (mtb->next)
@@ -258,12 +288,36 @@ int uffs_UnMount(const char *mount)
 	if (mtb == m_head)
 		m_head = mtb->next;
 
+	uffs_GlobalTableUnlock();
+
+	if (HAVE_BADBLOCK(mtb->dev))
+		uffs_BadBlockRecover(mtb->dev);
+
+	if (uffs_ReleaseDevice(mtb->dev) == U_FAIL) {
+		uffs_Perror(UFFS_MSG_NORMAL, "Can't release device for mount point '%s'", mount);
+
+		// put it back to mounted list
+		uffs_GlobalTableLock();
+		mtb->prev = NULL;
+		mtb->next = m_head;
+		if (m_head)
+			m_head->prev = mtb;
+		m_head = mtb;
+		uffs_GlobalTableUnlock();
+
+		return -1;
+	}
+
+	mtb->dev->Release(mtb->dev);
+
 	// put to unmounted list
+	uffs_GlobalTableLock();
 	mtb->prev = NULL;
 	mtb->next = m_free_head;
 	if (m_free_head)
 		m_free_head->prev = mtb;
 	m_free_head = mtb;
+	uffs_GlobalTableUnlock();
 
 	return 0;
 }
@@ -309,14 +363,18 @@ int uffs_GetMatchedMountPointSize(const char *path)
  */
 uffs_Device * uffs_GetDeviceFromMountPoint(const char *mount)
 {
-	uffs_MountTable *mtb = uffs_GetMountTableByMountPoint(mount, m_head);
+	uffs_MountTable *mtb;
+	uffs_Device *dev = NULL;
 
+	uffs_GlobalTableLock();
+	mtb = uffs_GetMountTableByMountPoint(mount, m_head);
 	if (mtb) {
 		mtb->dev->ref_count++;
-		return mtb->dev;
+		dev = mtb->dev;
 	}
+	uffs_GlobalTableUnlock();
 
-	return NULL;
+	return dev;
 }
 
 /**
@@ -329,16 +387,20 @@ uffs_Device * uffs_GetDeviceFromMountPoint(const char *mount)
 uffs_Device * uffs_GetDeviceFromMountPointEx(const char *mount, int len)
 {
 	uffs_MountTable *work = NULL;
+	uffs_Device *dev = NULL;
 
+	uffs_GlobalTableLock();
 	for (work = m_head; work; work = work->next) {
 		if (strlen(work->mount) == len &&
 				strncmp(mount, work->mount, len) == 0) {
 			work->dev->ref_count++;
-			return work->dev;
+			dev = work->dev;
+			break;
 		}
 	}
+	uffs_GlobalTableUnlock();
 
-	return NULL;
+	return dev;
 }
 
 
@@ -352,19 +414,25 @@ uffs_Device * uffs_GetDeviceFromMountPointEx(const char *mount, int len)
 const char * uffs_GetDeviceMountPoint(uffs_Device *dev)
 {
 	uffs_MountTable *work = NULL;
+	const char *mount = NULL;
 
+	uffs_GlobalTableLock();
 	for (work = m_head; work; work = work->next) {
 		if (work->dev == dev) {
-			return work->mount;
+			mount = work->mount;
+			break;
 		}
 	}
+	uffs_GlobalTableUnlock();
 
-	return NULL;	
+	return mount;
 }
 
 void uffs_PutDevice(uffs_Device *dev)
 {
+	uffs_GlobalTableLock();
 	dev->ref_count--;
+	uffs_GlobalTableUnlock();
 }
 
 
@@ -64,8 +64,115 @@
 	uffs_PoolInit will assert when NUM_BUFS is not at least 1, or BUF_SIZE is
 	not	aligned to the platforms pointer size.
 
+	lock free pool (CONFIG_USE_LOCK_FREE_POOL):
+
+	uffs_PoolInitLockFree(&pool, pool_mem, sizeof(pool_mem), BUF_SIZE, NUM_BUFS);
+
+	uffs_PoolGet()/uffs_PoolPut() on a lock free pool are thread safe without
+	taking any lock. The free list is a Treiber stack linked by buffer index,
+	the head carries an ABA tag so that a pop racing with pop/put fails the
+	CAS instead of corrupting the list. The link is kept in the last word of
+	a free buffer, so the head of the buffer survives uffs_PoolPut().
+
+	uffs_PoolGrow() adds a memory segment of NUM_BUFS buffers at run time,
+	buffers never move so pointers and indexes stay valid.
+
+	uffs_PoolCheckFreeList(), uffs_PoolFindNextAllocated() and
+	uffs_PoolPutAll() walk the free list, there is no lock to stop others
+	from changing it on a lock free pool: call them only when the pool is
+	quiescent.
+
 */
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+
+/* lock free pool helpers */
+#define LF_LINK(pool, p)		((volatile int *)((u8 *)(p) + (pool)->buf_size - sizeof(int)))
+#define LF_INDEX_MASK			0xFFFF
+#define LF_NEW_HEAD(head, idx1)	((int)((((u32)(head) & ~LF_INDEX_MASK) + (LF_INDEX_MASK + 1)) | (u32)(idx1)))
+
+static void * LockFreeBuf(uffs_Pool *pool, u32 index)
+{
+	return pool->seg[index / pool->num_bufs] + (index % pool->num_bufs) * pool->buf_size;
+}
+
+static u32 LockFreeTotalBufs(uffs_Pool *pool)
+{
+	return pool->num_bufs * uffs_AtomicGet(&pool->num_segs);
+}
+
+static void * LockFreePop(uffs_Pool *pool)
+{
+	int head, next;
+	void *p;
+
+	do {
+		head = uffs_AtomicGet(&pool->lf_head);
+		if ((head & LF_INDEX_MASK) == 0)
+			return NULL;
+		p = LockFreeBuf(pool, (head & LF_INDEX_MASK) - 1);
+		// if p is taken by others at this moment the link is garbage,
+		// but the tag of head has changed so the CAS will fail.
+		next = uffs_AtomicGet(LF_LINK(pool, p));
+	} while (!uffs_AtomicCas(&pool->lf_head, head, LF_NEW_HEAD(head, next & LF_INDEX_MASK)));
+
+	uffs_AtomicAdd(&pool->lf_free, -1);
+
+	return p;
+}
+
+/* push chain of buffers (first ... last, linked already) to free list */
+static void LockFreePush(uffs_Pool *pool, u32 first, void *last, int count)
+{
+	int head;
+
+	uffs_AtomicAdd(&pool->lf_free, count);
+	do {
+		head = uffs_AtomicGet(&pool->lf_head);
+		uffs_AtomicSet(LF_LINK(pool, last), head & LF_INDEX_MASK);
+	} while (!uffs_AtomicCas(&pool->lf_head, head, LF_NEW_HEAD(head, first + 1)));
+}
+
+static void LockFreeAddSegment(uffs_Pool *pool, u8 *mem)
+{
+	u32 base = pool->num_bufs * pool->num_segs;
+	u32 i;
+
+	for (i = 0; i + 1 < pool->num_bufs; i++)
+		uffs_AtomicSet(LF_LINK(pool, mem + i * pool->buf_size), base + i + 2);
+
+	pool->seg[pool->num_segs] = mem;
+	uffs_AtomicAdd(&pool->num_segs, 1);
+
+	LockFreePush(pool, base, mem + (pool->num_bufs - 1) * pool->buf_size, pool->num_bufs);
+}
+
+/**
+ * walk through free list, only when no one else gets/puts at the same time.
+ * a link out of range means the list is broken (or changed under us),
+ * stop there instead of following it.
+ */
+static UBOOL LockFreeIsFree(uffs_Pool *pool, void *p)
+{
+	u32 x = uffs_AtomicGet(&pool->lf_head) & LF_INDEX_MASK;
+	u32 total = LockFreeTotalBufs(pool);
+	u32 n = total;
+	void *e;
+
+	while (x != 0 && n-- > 0) {
+		if (!uffs_Assert(x <= total, "free list index %d out of range (max %d)", x - 1, total))
+			break;
+		e = LockFreeBuf(pool, x - 1);
+		if (e == p)
+			return U_TRUE;
+		x = uffs_AtomicGet(LF_LINK(pool, e)) & LF_INDEX_MASK;
+	}
+
+	return U_FALSE;
+}
+
+#endif
+
 
 /**
  * \brief Initializes the memory pool.
@@ -98,6 +205,15 @@ URET uffs_PoolInit(uffs_Pool *pool,
 	pool->buf_size = buf_size;
 	pool->num_bufs = num_bufs;
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	pool->lock_free = U_FALSE;
+	pool->lf_head = 0;
+	pool->lf_free = 0;
+	pool->num_segs = 1;
+	pool->max_segs = 1;
+	pool->seg[0] = pool->mem;
+#endif
+
 	pool->sem = OSSEM_NOT_INITED;
 	if (lock) {
 		uffs_SemCreate(&pool->sem);
@@ -119,15 +235,96 @@ URET uffs_PoolInit(uffs_Pool *pool,
 	return U_SUCC;
 }
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+/**
+ * \brief Initializes a lock free memory pool.
+ * \param[in] pool memory pool
+ * \param[in] mem pool memory (the first segment)
+ * \param[in] mem_size size of pool memory
+ * \param[in] buf_size size of a single buffer
+ * \param[in] num_bufs number of buffers in a segment
+ * \param[in] max_segs max segments the pool can grow to, 1 ~ #UFFS_POOL_MAX_SEGS
+ * \return Returns U_SUCC if successful.
+ */
+URET uffs_PoolInitLockFree(uffs_Pool *pool,
+				   void *mem, u32 mem_size, u32 buf_size, u32 num_bufs, int max_segs)
+{
+	if (!uffs_Assert(max_segs >= 1 && max_segs <= UFFS_POOL_MAX_SEGS,
+					"invalid max segments %d", max_segs) ||
+		!uffs_Assert(num_bufs * max_segs <= LF_INDEX_MASK,
+					"too many buffers for lock free pool") ||
+		!uffs_Assert(buf_size >= sizeof(int), "buffer size too small"))
+	{
+		return U_FAIL;
+	}
+
+	// the semaphore is for serializing uffs_PoolGrow()
+	if (uffs_PoolInit(pool, mem, mem_size, buf_size, num_bufs, U_TRUE) != U_SUCC)
+		return U_FAIL;
+
+	pool->free_list = NULL;
+	pool->lock_free = U_TRUE;
+	pool->num_segs = 0;
+	pool->max_segs = max_segs;
+	LockFreeAddSegment(pool, pool->mem);
+
+	return U_SUCC;
+}
+
+/**
+ * \brief Add a memory segment to a lock free pool.
+ * \param[in] pool lock free memory pool
+ * \param[in] mem memory of new segment, owned by caller.
+ * \param[in] mem_size size of memory, should be the same as the first segment.
+ * \return Returns U_SUCC if successful, U_FAIL if pool has max segments already.
+ */
+URET uffs_PoolGrow(uffs_Pool *pool, void *mem, u32 mem_size)
+{
+	URET ret = U_FAIL;
+
+	if (!uffs_Assert(pool != NULL && pool->lock_free, "not a lock free pool") ||
+		!uffs_Assert(mem != NULL, "pool memory missing") ||
+		!uffs_Assert(mem_size == pool->num_bufs * pool->buf_size,
+					"pool memory size is wrong"))
+	{
+		return U_FAIL;
+	}
+
+	uffs_SemWait(pool->sem);
+	if (pool->num_segs < pool->max_segs) {
+		LockFreeAddSegment(pool, (u8 *)mem);
+		ret = U_SUCC;
+	}
+	uffs_SemSignal(pool->sem);
+
+	return ret;
+}
+#endif
+
 /**
  * \brief verify pointer validity aganist memory pool
  * \return U_TRUE if valid, U_FALSE if invalid.
  */
 UBOOL uffs_PoolVerify(uffs_Pool *pool, void *p)
 {
+	u32 seg_size = pool->buf_size * pool->num_bufs;
+
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	int i, n;
+
+	if (pool->lock_free) {
+		n = uffs_AtomicGet(&pool->num_segs);
+		for (i = 0; p && i < n; i++) {
+			if ((u8 *)p >= pool->seg[i] && (u8 *)p < pool->seg[i] + seg_size)
+				return (((u8 *)p - pool->seg[i]) % pool->buf_size) == 0 ? U_TRUE : U_FALSE;
+		}
+		return U_FALSE;
+	}
+#endif
+
 	return p &&
 		(u8 *)p >= pool->mem &&
-		(u8 *)p < pool->mem + (pool->buf_size * pool->num_bufs) &&
+		(u8 *)p < pool->mem + seg_size &&
 		(((u8 *)p - pool->mem) % pool->buf_size) == 0 ? U_TRUE : U_FALSE;
 }
 
@@ -135,6 +332,8 @@ UBOOL uffs_PoolVerify(uffs_Pool *pool, void *p)
  * \brief Releases the memory pool.
  * \param[in] pool memory pool
  * \return Returns U_SUCC if successful.
+ * \note memory segments added by uffs_PoolGrow() to a lock free pool are
+ *		not freed here, caller should free pool->seg[1 .. num_segs - 1].
  */
 URET uffs_PoolRelease(uffs_Pool *pool)
 {
@@ -161,6 +360,11 @@ void *uffs_PoolGet(uffs_Pool *pool)
 	if (!uffs_Assert(pool != NULL, "pool missing"))
 		return NULL;
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	if (pool->lock_free)
+		return LockFreePop(pool);
+#endif
+
 	e = pool->free_list;
 	if (e)
 		pool->free_list = e->next;
@@ -182,6 +386,11 @@ void *uffs_PoolGetLocked(uffs_Pool *pool)
 	if (!uffs_Assert(pool != NULL, "pool missing"))
 		return NULL;
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	if (pool->lock_free)
+		return LockFreePop(pool);
+#endif
+
 	if (!uffs_Assert(pool->sem != OSSEM_NOT_INITED, "pool semaphore not initialized"))
 		return NULL;
 
@@ -209,6 +418,13 @@ int uffs_PoolPut(uffs_Pool *pool, void *p)
 	if (!uffs_Assert(pool != NULL, "pool missing"))
 		return -1;
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	if (e && pool->lock_free) {
+		LockFreePush(pool, uffs_PoolGetIndex(pool, e), e, 1);
+		return 0;
+	}
+#endif
+
 	if (e) {
 		e->next = pool->free_list;
 		pool->free_list = e;
@@ -233,6 +449,11 @@ int uffs_PoolPutLocked(uffs_Pool *pool, void *p)
 	if (!uffs_Assert(pool != NULL, "pool missing"))
 		return -1;
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	if (pool->lock_free)
+		return uffs_PoolPut(pool, p);
+#endif
+
 	if (!uffs_Assert(pool->sem != OSSEM_NOT_INITED, "pool semaphore not initialized"))
 		return -1;
 
@@ -247,6 +468,21 @@ int uffs_PoolPutLocked(uffs_Pool *pool, void *p)
 	return -1;
 }
 
+/**
+ * \brief Gets the total number of buffers, valid indexes are 0 ~ count - 1.
+ * \param[in] pool memory pool
+ * \return Returns the buffer count, all segments for lock free pool.
+ */
+u32 uffs_PoolGetBufCount(uffs_Pool *pool)
+{
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	if (pool->lock_free)
+		return LockFreeTotalBufs(pool);
+#endif
+
+	return pool->num_bufs;
+}
+
 /**
  * \brief Gets a buffer by index (offset).
  * This method returns a buffer from the memory pool by index.
@@ -256,13 +492,23 @@ int uffs_PoolPutLocked(uffs_Pool *pool, void *p)
  */
 void *uffs_PoolGetBufByIndex(uffs_Pool *pool, u32 index)
 {
-	if (!uffs_Assert(pool != NULL, "pool missing") ||
-		!uffs_Assert(index < pool->num_bufs,
-				"index(%d) out of range(max %d)", index, pool->num_bufs))
+	u32 num_bufs;
+
+	if (!uffs_Assert(pool != NULL, "pool missing"))
+		return NULL;
+
+	num_bufs = uffs_PoolGetBufCount(pool);
+	if (!uffs_Assert(index < num_bufs,
+				"index(%d) out of range(max %d)", index, num_bufs))
 	{
 		return NULL;
 	}
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	if (pool->lock_free)
+		return LockFreeBuf(pool, index);
+#endif
+
 	return (u8 *) pool->mem + index * pool->buf_size;
 }
 
@@ -275,6 +521,24 @@ void *uffs_PoolGetBufByIndex(uffs_Pool *pool, u32 index)
  */
 u32 uffs_PoolGetIndex(uffs_Pool *pool, void *p)
 {
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	u32 seg_size;
+	int i, n;
+
+	if (pool && pool->lock_free) {
+		seg_size = pool->num_bufs * pool->buf_size;
+		n = uffs_AtomicGet(&pool->num_segs);
+		for (i = 0; i < n; i++) {
+			if ((u8 *)p >= pool->seg[i] && (u8 *)p < pool->seg[i] + seg_size)
+				break;
+		}
+		if (!uffs_Assert(i < n, "pointer out of range"))
+			uffs_Panic();
+
+		return i * pool->num_bufs + ((u8 *)p - pool->seg[i]) / pool->buf_size;
+	}
+#endif
+
 	if (!uffs_Assert(pool != NULL, "pool missing") ||
 		!uffs_Assert(p >= (void *) pool->mem &&
 			p < (void *) (pool->mem + pool->num_bufs * pool->buf_size),
@@ -289,10 +553,18 @@ u32 uffs_PoolGetIndex(uffs_Pool *pool, void *p)
 /**
  * \brief Check given buffer in free list
  * \return U_TRUE if it's in free list, U_FALSE if not.
+ * \note caller should hold the pool lock, or make sure no one else
+ *		 gets/puts at the same time.
  */
 UBOOL uffs_PoolCheckFreeList(uffs_Pool *pool, void *p)
 {
 	uffs_PoolEntry *e;
+
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	if (pool->lock_free)
+		return LockFreeIsFree(pool, p);
+#endif
+
 	for (e = pool->free_list; e; e = e->next) {
 		if ((void *)e == p)
 			return U_TRUE;
@@ -313,7 +585,7 @@ static void * FindNextAllocatedInSmallPool(uffs_Pool *pool, void *from)
 		map |= (1 << uffs_PoolGetIndex(pool, e));
 
 	for (i = uffs_PoolGetIndex(pool, from);
-			(map & (1 << i)) && i < 32 && i < pool->num_bufs;
+			i < 32 && i < pool->num_bufs && (map & (1 << i));
 				i++);
 
 	return i < 32 && i < pool->num_bufs ?
@@ -330,17 +602,36 @@ static void * FindNextAllocatedInSmallPool(uffs_Pool *pool, void *from)
  * \return next allocated memory block, NULL if not found.
  *
  * \note This is NOT efficient, don't do it on a pool with large free nodes !
+ *		 Caller should hold the pool lock, or make sure no one else
+ *		 gets/puts at the same time (always the case for a lock free pool).
  */
 void * uffs_PoolFindNextAllocated(uffs_Pool *pool, void *from)
 {
 	uffs_PoolEntry *e = NULL;
 	u8 *p = (u8 *)from;
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	u32 i, n;
+
+	if (pool->lock_free) {
+		n = LockFreeTotalBufs(pool);
+		for (i = (from ? uffs_PoolGetIndex(pool, from) + 1 : 0); i < n; i++) {
+			p = (u8 *)LockFreeBuf(pool, i);
+			if (LockFreeIsFree(pool, p) == U_FALSE)
+				return p;
+		}
+		return NULL;
+	}
+#endif
+
 	if (p == NULL)
 		p = pool->mem;
 	else
 		p += pool->buf_size;
 
+	if (!uffs_PoolVerify(pool, p))
+		return NULL;	// 'from' was the last one
+
 	if (pool->num_bufs < 32)
 		return FindNextAllocatedInSmallPool(pool, p);
 
@@ -373,6 +664,11 @@ int uffs_PoolGetFreeCount(uffs_Pool *pool)
 	int count = 0;
 	uffs_PoolEntry *e;
 
+#ifdef CONFIG_USE_LOCK_FREE_POOL
+	if (pool->lock_free)
+		return uffs_AtomicGet(&pool->lf_free);
+#endif
+
 	e = pool->free_list;
 	while (e) {
 		count++;
@@ -384,6 +680,7 @@ int uffs_PoolGetFreeCount(uffs_Pool *pool)
 
 /**
  * \brief put all memory block back, return how many memory blocks were put back
+ * \note same as uffs_PoolFindNextAllocated(), the pool must be quiescent.
  */
 int uffs_PoolPutAll(uffs_Pool *pool)
 {
@@ -277,7 +277,7 @@ URET uffs_CreateNewFile(uffs_Device *dev,
 	tag = GET_TAG(bc, 0);
 	TAG_PARENT(tag) = parent;
 	TAG_SERIAL(tag) = serial;
-	TAG_DATA_LEN(tag) = sizeof(uffs_FileInfo);
+	TAG_SET_DATA_LEN(tag, sizeof(uffs_FileInfo));
 
 	buf = uffs_BufGet(dev, parent, serial, 0);
 	if (buf == NULL) {
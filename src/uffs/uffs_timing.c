@@ -0,0 +1,192 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_timing.c
+ * \brief latency histograms for fd APIs and internal stages
+ * \author Ricky Zheng
+ */
+
+#include "uffs_config.h"
+#include "uffs/uffs_timing.h"
+
+#ifdef CONFIG_ENABLE_TIMING_STAT
+
+/* with the global file system lock all samples are recorded while it's held.
+ * with per-device lock, samples come from tasks working on different devices
+ * and from readers sharing a device lock, so counters are updated atomically.
+ */
+#ifdef CONFIG_USE_PER_DEVICE_LOCK
+#define TM_GET(x)			((u32)uffs_AtomicGet((volatile int *)&(x)))
+#define TM_SET(x, v)		uffs_AtomicSet((volatile int *)&(x), (int)(v))
+#define TM_ADD(x, n)		uffs_AtomicAdd((volatile int *)&(x), (int)(n))
+#define TM_CAS(x, o, v)		uffs_AtomicCas((volatile int *)&(x), (int)(o), (int)(v))
+#else
+#define TM_GET(x)			(x)
+#define TM_SET(x, v)		((x) = (v))
+#define TM_ADD(x, n)		((x) += (n))
+#define TM_CAS(x, o, v)		((x) = (v), 1)
+#endif
+
+static uffs_TimingHist _timing[UFFS_TM_MAX];
+
+static const char *_timing_names[UFFS_TM_MAX] = {
+	"open",
+	"close",
+	"read",
+	"write",
+	"seek",
+	"flush",
+	"ftruncate",
+	"fallocate",
+	"rename",
+	"remove",
+	"stat",
+	"mkdir",
+	"rmdir",
+	"opendir",
+	"readdir",
+	"BufGet (hit)",
+	"BufGet (miss)",
+	"BufFlush",
+	"BufFlush recover",
+	"FlashReadPage",
+	"FlashWritePage",
+	"FlashEraseBlock",
+};
+
+static int _BucketIndex(u32 us)
+{
+	int n = 0;
+
+	while (us > 0 && n < UFFS_TIMING_BUCKETS - 1) {
+		us >>= 1;
+		n++;
+	}
+
+	return n;
+}
+
+/**
+ * put a sample to histogram
+ * \param[in] id measure point, UFFS_TM_xxx
+ * \param[in] us elapsed time in micro seconds
+ */
+void uffs_TimingRecord(int id, u32 us)
+{
+	uffs_TimingHist *h;
+	u32 max;
+
+	if (id < 0 || id >= UFFS_TM_MAX)
+		return;
+
+	h = &_timing[id];
+	TM_ADD(h->count, 1);
+	TM_ADD(h->total, us);
+	do {
+		max = TM_GET(h->max);
+	} while (us > max && !TM_CAS(h->max, max, us));
+	TM_ADD(h->bucket[_BucketIndex(us)], 1);
+}
+
+/**
+ * get a copy of histogram
+ * \param[in] id measure point, UFFS_TM_xxx
+ * \param[out] hist histogram
+ * \return U_SUCC if #id is valid
+ */
+URET uffs_TimingGet(int id, uffs_TimingHist *hist)
+{
+	uffs_TimingHist *h;
+	int i;
+
+	if (id < 0 || id >= UFFS_TM_MAX)
+		return U_FAIL;
+
+	h = &_timing[id];
+	hist->count = TM_GET(h->count);
+	hist->total = TM_GET(h->total);
+	hist->max = TM_GET(h->max);
+	for (i = 0; i < UFFS_TIMING_BUCKETS; i++)
+		hist->bucket[i] = TM_GET(h->bucket[i]);
+
+	return U_SUCC;
+}
+
+/** clear all histograms */
+void uffs_TimingReset(void)
+{
+	uffs_TimingHist *h;
+	int id, i;
+
+	for (id = 0; id < UFFS_TM_MAX; id++) {
+		h = &_timing[id];
+		TM_SET(h->count, 0);
+		TM_SET(h->total, 0);
+		TM_SET(h->max, 0);
+		for (i = 0; i < UFFS_TIMING_BUCKETS; i++)
+			TM_SET(h->bucket[i], 0);
+	}
+}
+
+/** get the name of measure point */
+const char * uffs_TimingName(int id)
+{
+	return (id >= 0 && id < UFFS_TM_MAX) ? _timing_names[id] : "unknown";
+}
+
+/**
+ * estimate percentile from histogram
+ * \return upper bound (us) of the bucket where #pct percent of samples fall in
+ */
+u32 uffs_TimingPercentile(const uffs_TimingHist *hist, int pct)
+{
+	u32 target, bound, sum = 0;
+	int i;
+
+	if (hist->count == 0)
+		return 0;
+
+	target = hist->count / 100 * pct + (hist->count % 100 * pct + 99) / 100;
+
+	for (i = 0; i < UFFS_TIMING_BUCKETS - 1; i++) {
+		sum += hist->bucket[i];
+		if (sum >= target) {
+			bound = (i == 0 ? 0 : (1U << i) - 1);
+			return (bound < hist->max ? bound : hist->max);
+		}
+	}
+
+	return hist->max;
+}
+
+#endif
@@ -42,6 +42,7 @@
 #include "uffs/uffs_pool.h"
 #include "uffs/uffs_flash.h"
 #include "uffs/uffs_badblock.h"
+#include "uffs/uffs_fileinfo.h"
 
 #include <string.h>
 
@@ -102,6 +103,7 @@ URET uffs_TreeInit(uffs_Device *dev)
 	dev->tree.erased_count = 0;
 	dev->tree.bad = NULL;
 	dev->tree.bad_count = 0;
+	dev->tree.reserve = NULL;
 
 	for (i = 0; i < DIR_NODE_ENTRY_LEN; i++) {
 		dev->tree.dir_entry[i] = EMPTY_NODE;
@@ -139,7 +141,7 @@ URET uffs_TreeRelease(uffs_Device *dev)
 	return U_SUCC;
 }
 
-static u16 _GetBlockFromNode(u8 type, TreeNode *node)
+static uffs_BlockNum _GetBlockFromNode(u8 type, TreeNode *node)
 {
 	switch (type) {
 	case UFFS_TYPE_DIR:
@@ -241,7 +243,8 @@ static URET _BuildValidTreeNode(uffs_Device *dev,
 {
 	uffs_Tags *tag;
 	TreeNode *node_alt;
-	u16 block, parent, serial, block_alt;
+	uffs_BlockNum block, block_alt;
+	u16 parent, serial;
 	uffs_BlockInfo *bc_alt;
 	u8 type;
 	int page;
@@ -270,6 +273,14 @@ static URET _BuildValidTreeNode(uffs_Device *dev,
 		goto process_invalid_block;		
 	}
 
+	// tags are self-describing, one written with 8-bit page id tells
+	// the media was formatted with wide page id layout.
+	if (tag->s.id_layout == TAG_ID_LAYOUT_WIDE &&
+		dev->com.id_layout != TAG_ID_LAYOUT_WIDE) {
+		uffs_Perror(UFFS_MSG_NORMAL, "wide page id layout found on block %d", bc->block);
+		dev->com.id_layout = TAG_ID_LAYOUT_WIDE;
+	}
+
 	block = bc->block;
 	parent = TAG_PARENT(tag);
 	serial = TAG_SERIAL(tag);
@@ -497,6 +508,7 @@ static URET _BuildTreeStepOne(uffs_Device *dev)
 	tree->erased = NULL;
 	tree->erased_tail = NULL;
 	tree->erased_count = 0;
+	tree->reserve = NULL;
 
 	uffs_Perror(UFFS_MSG_NOISY, "build tree step one");
 
@@ -603,7 +615,7 @@ static URET _BuildTreeStepTwo(uffs_Device *dev)
 TreeNode * uffs_TreeFindFileNode(uffs_Device *dev, u16 serial)
 {
 	int hash;
-	u16 x;
+	uffs_NodeIdx x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 
@@ -660,7 +672,7 @@ void uffs_TreeRemoveSuspendNode(uffs_Device *dev, TreeNode *node)
 TreeNode * uffs_TreeFindFileNodeWithParent(uffs_Device *dev, u16 parent)
 {
 	int hash;
-	u16 x;
+	uffs_NodeIdx x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 
@@ -683,7 +695,7 @@ TreeNode * uffs_TreeFindFileNodeWithParent(uffs_Device *dev, u16 parent)
 TreeNode * uffs_TreeFindDirNode(uffs_Device *dev, u16 serial)
 {
 	int hash;
-	u16 x;
+	uffs_NodeIdx x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 
@@ -704,7 +716,7 @@ TreeNode * uffs_TreeFindDirNode(uffs_Device *dev, u16 serial)
 TreeNode * uffs_TreeFindDirNodeWithParent(uffs_Device *dev, u16 parent)
 {
 	int hash;
-	u16 x;
+	uffs_NodeIdx x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 
@@ -730,7 +742,7 @@ TreeNode * uffs_TreeFindFileNodeByName(uffs_Device *dev,
 										u16 sum, u16 parent)
 {
 	int i;
-	u16 x;
+	uffs_NodeIdx x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 	
@@ -758,7 +770,7 @@ TreeNode * uffs_TreeFindDataNode(uffs_Device *dev, u16 parent, u16 serial)
 	int hash;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
-	u16 x;
+	uffs_NodeIdx x;
 
 	hash = GET_DATA_HASH(parent, serial);
 	x = tree->data_entry[hash];
@@ -775,12 +787,12 @@ TreeNode * uffs_TreeFindDataNode(uffs_Device *dev, u16 parent, u16 serial)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, uffs_BlockNum block)
 {
 	int hash;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
-	u16 x;
+	uffs_NodeIdx x;
 
 	for (hash = 0; hash < DIR_NODE_ENTRY_LEN; hash++) {
 		x = tree->dir_entry[hash];
@@ -795,7 +807,7 @@ TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, u16 block)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, uffs_BlockNum block)
 {
 	TreeNode *node;
 	node = dev->tree.erased;
@@ -809,7 +821,7 @@ TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, u16 block)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, uffs_BlockNum block)
 {
 	TreeNode *node;
 	node = dev->tree.bad;
@@ -823,12 +835,12 @@ TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, u16 block)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, uffs_BlockNum block)
 {
 	int hash;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
-	u16 x;
+	uffs_NodeIdx x;
 
 	for (hash = 0; hash < FILE_NODE_ENTRY_LEN; hash++) {
 		x = tree->file_entry[hash];
@@ -843,12 +855,12 @@ TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, u16 block)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, uffs_BlockNum block)
 {
 	int hash;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
-	u16 x;
+	uffs_NodeIdx x;
 
 	for (hash = 0; hash < DATA_NODE_ENTRY_LEN; hash++) {
 		x = tree->data_entry[hash];
@@ -863,7 +875,7 @@ TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, u16 block)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, u16 block, int *region)
+TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, uffs_BlockNum block, int *region)
 {
 	TreeNode *node = NULL;
 
@@ -911,7 +923,7 @@ TreeNode * uffs_TreeFindDirNodeByName(uffs_Device *dev,
 									  u16 sum, u16 parent)
 {
 	int i;
-	u16 x;
+	uffs_NodeIdx x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 	
@@ -947,23 +959,19 @@ UBOOL uffs_CompareFileName(const char *src, int src_len, const char *des)
 }
 
 /** compare [name] with tree [node] represented object name by loading
-	uffs_FileInfo from storage */
+	uffs_FileInfo from file info cache or storage */
 UBOOL uffs_TreeCompareFileName(uffs_Device *dev,
 							   const char *name, u32 len, u16 sum,
 							   TreeNode *node, int type)
 {
 	UBOOL matched = U_FALSE;
-	uffs_FileInfo *fi;
-	uffs_Buf *buf;
+	uffs_FileInfo fi;
 	u16 data_sum;
 
-	buf = uffs_BufGetEx(dev, type, node, 0, 0);
-	if (buf == NULL) {
-		uffs_Perror(UFFS_MSG_SERIOUS, "can't get buf !\n ");
+	if (uffs_FileInfoLoad(dev, type, node, &fi, &data_sum) != U_SUCC) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "can't load file info !");
 		goto ext;
 	}
-	fi = (uffs_FileInfo *)(buf->data);
-	data_sum = uffs_MakeSum16(fi->name, fi->name_len);
 
 	if (data_sum != sum) {
 		uffs_Perror(UFFS_MSG_NORMAL,
@@ -971,15 +979,12 @@ UBOOL uffs_TreeCompareFileName(uffs_Device *dev,
 		goto ext;
 	}
 
-	if (fi->name_len == len) {
-		if(uffs_CompareFileName(fi->name, fi->name_len, name) == U_TRUE) {
+	if (fi.name_len == len) {
+		if(uffs_CompareFileName(fi.name, fi.name_len, name) == U_TRUE) {
 			matched = U_TRUE;
 		}
 	}
 ext:
-	if (buf)
-		uffs_BufPut(dev, buf);
-
 	return matched;
 }
 
@@ -988,13 +993,14 @@ ext:
 static URET _BuildTreeStepThree(uffs_Device *dev)
 {
 	int i;
-	u16 x;
+	uffs_NodeIdx x;
 	TreeNode *work;
 	TreeNode *node;
 	struct uffs_TreeSt *tree;
 	uffs_Pool *pool;
-	u16 blockSave;
+	uffs_BlockNum blockSave;
 	int ret;
+	u32 len;
 
 	TreeNode *cache = NULL;
 	u16 cacheSerial = INVALID_UFFS_SERIAL;
@@ -1036,7 +1042,13 @@ static URET _BuildTreeStepThree(uffs_Device *dev)
 					uffs_TreeInsertToErasedListTail(dev, work);
 			}
 			else {
-				node->u.file.len += work->u.data.len;
+				// data blocks before the last one are full, except holes of
+				// sparse file, so file length is the end of the last data block.
+				len = (dev->attr->pages_per_block - 1) * dev->com.pg_data_size +
+						(work->u.data.serial - 1) * dev->attr->pages_per_block * dev->com.pg_data_size +
+						work->u.data.len;
+				if (len > node->u.file.len)
+					node->u.file.len = len;
 				x = work->hash_next;
 			}
 		}
@@ -1139,7 +1151,7 @@ static TreeNode * uffs_TreeGetErasedNodeNoCheck(uffs_Device *dev)
 TreeNode * uffs_TreeGetErasedNode(uffs_Device *dev)
 {
 	TreeNode *node = uffs_TreeGetErasedNodeNoCheck(dev);
-	u16 block;
+	uffs_BlockNum block;
 	uffs_BlockInfo *bc;
 	
 	if (node) {
@@ -1163,6 +1175,144 @@ TreeNode * uffs_TreeGetErasedNode(uffs_Device *dev)
 	return node;
 }
 
+/** find the reservation which the block group (type, parent, serial) belongs to */
+static struct uffs_BlockReserveSt * _FindReserve(uffs_Device *dev, u8 type, u16 parent, u16 serial)
+{
+	struct uffs_BlockReserveSt *resv;
+	u16 owner;
+
+	// file header block belongs to 'serial', data blocks belong to 'parent'
+	owner = (type == UFFS_TYPE_DATA ? parent : serial);
+	for (resv = dev->tree.reserve; resv; resv = resv->next) {
+		if (resv->serial == owner && type != UFFS_TYPE_DIR)
+			return resv;
+	}
+
+	return NULL;
+}
+
+/**
+ * get an erased node for block group (type, parent, serial).
+ * if the file has reserved blocks, take one from its reservation,
+ * otherwise take one from erased list.
+ */
+TreeNode * uffs_TreeGetErasedNodeFor(uffs_Device *dev, u8 type, u16 parent, u16 serial)
+{
+	struct uffs_BlockReserveSt *resv;
+	TreeNode *node;
+	uffs_BlockInfo *bc;
+
+	resv = _FindReserve(dev, type, parent, serial);
+	if (resv == NULL || resv->head == NULL)
+		return uffs_TreeGetErasedNode(dev);
+
+	node = resv->head;
+	resv->head = node->u.list.next;
+	resv->count--;
+
+	// reserved block was verified already, just prepare block info cache
+	bc = uffs_BlockInfoGet(dev, node->u.list.block);
+	if (bc) {
+		uffs_BlockInfoInitErased(dev, bc);
+		uffs_BlockInfoPut(dev, bc);
+	}
+
+	return node;
+}
+
+/**
+ * put an erased node released by block group (type, parent, serial).
+ * if the file has a reservation, the node goes to the reservation so that
+ * the reserved range never run out of blocks because of block recover.
+ */
+void uffs_TreePutErasedNodeFor(uffs_Device *dev, u8 type, u16 parent, u16 serial, TreeNode *node)
+{
+	struct uffs_BlockReserveSt *resv;
+
+	resv = _FindReserve(dev, type, parent, serial);
+	if (resv == NULL) {
+		uffs_TreeInsertToErasedListTail(dev, node);
+	}
+	else {
+		node->u.list.u.need_check = 0;
+		node->u.list.next = resv->head;
+		resv->head = node;
+		resv->count++;
+	}
+}
+
+/**
+ * take 'count' more erased blocks from erased list to reservation 'resv',
+ * each block is verified to be erased. 'resv' is linked to the device
+ * if it's not yet.
+ *
+ * \return U_SUCC, or U_FAIL if no enough erased blocks.
+ */
+URET uffs_TreeReserveAdd(uffs_Device *dev, struct uffs_BlockReserveSt *resv, int count)
+{
+	struct uffs_BlockReserveSt *p;
+	TreeNode *node;
+
+	for (p = dev->tree.reserve; p && p != resv; p = p->next)
+		;
+	if (p == NULL) {
+		resv->next = dev->tree.reserve;
+		dev->tree.reserve = resv;
+	}
+
+	if (count > dev->tree.erased_count - dev->cfg.reserved_free_blocks)
+		return U_FAIL;	// don't bother to verify blocks
+
+	while (count > 0) {
+		if (dev->tree.erased_count <= dev->cfg.reserved_free_blocks)
+			return U_FAIL;	// keep free blocks for block recover
+
+		node = uffs_TreeGetErasedNodeNoCheck(dev);
+		if (node == NULL)
+			return U_FAIL;
+
+		if (uffs_FlashCheckErasedBlock(dev, node->u.list.block) != U_SUCC) {
+			// not fully erased ? erase it now.
+			if (uffs_TreeEraseNode(dev, node) != U_SUCC) {
+				uffs_TreeInsertToErasedListTailEx(dev, node, 1);
+				return U_FAIL;
+			}
+		}
+		node->u.list.u.need_check = 0;
+		node->u.list.next = resv->head;
+		resv->head = node;
+		resv->count++;
+		count--;
+	}
+
+	return U_SUCC;
+}
+
+/**
+ * return all reserved blocks of 'resv' to erased list,
+ * and unlink 'resv' from the device.
+ */
+void uffs_TreeReserveRelease(uffs_Device *dev, struct uffs_BlockReserveSt *resv)
+{
+	struct uffs_BlockReserveSt **pp;
+	TreeNode *node;
+
+	for (pp = &dev->tree.reserve; *pp; pp = &(*pp)->next) {
+		if (*pp == resv) {
+			*pp = resv->next;
+			break;
+		}
+	}
+
+	while (resv->head) {
+		node = resv->head;
+		resv->head = node->u.list.next;
+		uffs_TreeInsertToErasedListTail(dev, node);
+	}
+	resv->count = 0;
+	resv->next = NULL;
+}
+
 /**
  * Erase a flash block and check the bad block.
  * If the block is 'bad', then swap it with a good block and put the bad block into bad block list.
@@ -1200,7 +1350,7 @@ URET uffs_TreeEraseNode(uffs_Device *dev, TreeNode *node)
 	}
 }
 
-static void _InsertToEntry(uffs_Device *dev, u16 *entry,
+static void _InsertToEntry(uffs_Device *dev, uffs_NodeIdx *entry,
 						   int hash, TreeNode *node)
 {
 	node->hash_next = entry[hash];
@@ -1217,7 +1367,7 @@ static void _InsertToEntry(uffs_Device *dev, u16 *entry,
  */
 void uffs_BreakFromEntry(uffs_Device *dev, u8 type, TreeNode *node)
 {
-	u16 *entry;
+	uffs_NodeIdx *entry;
 	int hash;
 	TreeNode *work;
 
@@ -1345,7 +1495,7 @@ void uffs_TreeInsertToBadBlockList(uffs_Device *dev, TreeNode *node)
 /** 
  * set tree node block value
  */
-void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, u16 block)
+void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, uffs_BlockNum block)
 {
 	switch (type) {
 	case UFFS_TYPE_FILE:
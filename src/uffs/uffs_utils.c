@@ -44,6 +44,7 @@
 #include "uffs/uffs_badblock.h"
 #include "uffs/uffs_fd.h"
 #include "uffs/uffs_fs.h"
+#include "uffs/uffs_fileinfo.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -52,10 +53,9 @@
 
 #define SPOOL(dev) &((dev)->mem.spare_pool)
 
-#ifdef CONFIG_USE_GLOBAL_FS_LOCK
+#if defined(CONFIG_USE_GLOBAL_FS_LOCK) || defined(CONFIG_USE_PER_DEVICE_LOCK)
 static OSSEM _global_lock = OSSEM_NOT_INITED;
 
-/* global file system lock */
 void uffs_InitGlobalFsLock(void)
 {
 	uffs_SemCreate(&_global_lock);
@@ -65,23 +65,82 @@ void uffs_ReleaseGlobalFsLock(void)
 {
 	uffs_SemDelete(&_global_lock);
 }
+#else
+void uffs_InitGlobalFsLock(void) {}
+void uffs_ReleaseGlobalFsLock(void) {}
+#endif
+
+#if defined(CONFIG_USE_GLOBAL_FS_LOCK)
 
+// task id of the lock holder, 0 if not held. others may read it while it's
+// changed, but only the holder can ever see its own id there.
+static volatile int _global_lock_owner = 0;
+static int _global_lock_depth = 0;			// only changed by the holder
+
+/**
+ * global file system lock, held for the whole fd API call.
+ * the lock nests: a task already holding it (see uffs_fs_lock())
+ * may call fd APIs, only the outermost unlock releases it.
+ * \note nesting needs a non-zero task id, ports returning 0 from
+ *       uffs_OSGetTaskId() always wait on the semaphore.
+ */
 void uffs_GlobalFsLockLock(void)
 {
+	int self = uffs_OSGetTaskId();
+
+	if (self != 0 && _global_lock_owner == self) {
+		_global_lock_depth++;
+		return;
+	}
+
 	uffs_SemWait(_global_lock);
+	_global_lock_owner = self;
+	_global_lock_depth = 1;
 }
 
 void uffs_GlobalFsLockUnlock(void)
 {
-	uffs_SemSignal(_global_lock);
+	if (--_global_lock_depth == 0) {
+		_global_lock_owner = 0;
+		uffs_SemSignal(_global_lock);
+	}
+}
+
+/* shared tables are already protected by the global file system lock */
+void uffs_GlobalTableLock(void) {}
+void uffs_GlobalTableUnlock(void) {}
+
+#elif defined(CONFIG_USE_PER_DEVICE_LOCK)
+
+/* file system operations are protected by per-device lock */
+void uffs_GlobalFsLockLock(void) {}
+void uffs_GlobalFsLockUnlock(void) {}
+
+/**
+ * lock shared tables: object/dir handle pools, fd signature and mount table.
+ * \note hold it only for short table operations, never call flash
+ *       operations or acquire device lock while holding it.
+ * \note mount table may be set up before uffs_InitFileSystemObjects(),
+ *       the lock is skipped until it's created.
+ */
+void uffs_GlobalTableLock(void)
+{
+	if (_global_lock != OSSEM_NOT_INITED)
+		uffs_SemWait(_global_lock);
+}
+
+void uffs_GlobalTableUnlock(void)
+{
+	if (_global_lock != OSSEM_NOT_INITED)
+		uffs_SemSignal(_global_lock);
 }
 
 #else
 
-void uffs_InitGlobalFsLock(void) {}
-void uffs_ReleaseGlobalFsLock(void) {}
 void uffs_GlobalFsLockLock(void) {}
 void uffs_GlobalFsLockUnlock(void) {}
+void uffs_GlobalTableLock(void) {}
+void uffs_GlobalTableUnlock(void) {}
 
 #endif
 
@@ -94,7 +153,7 @@ static void _ForceFormatAndCheckBlock(uffs_Device *dev, int block)
 	UBOOL bad = U_TRUE;
 	URET ret;
 	struct uffs_FlashOpsSt *ops = dev->ops;
-	struct uffs_TagStoreSt ts;
+	uffs_Tags tag;	// a whole tag, flash layout may carry uffs_TagsSt.data_len_hi
 	u8 *spare = NULL;
 
 	buf = uffs_BufClone(dev, NULL);
@@ -114,12 +173,12 @@ static void _ForceFormatAndCheckBlock(uffs_Device *dev, int block)
 		goto bad_out;
 
 	memset(buf->header, 0, dev->com.pg_size);
-	memset(&ts, 0, sizeof(ts));
+	memset(&tag, 0, sizeof(tag));
 	memset(spare, 0, dev->attr->spare_size);
 
 	for (i = 0; i < dev->attr->pages_per_block; i++) {
 		if (ops->WritePageWithLayout)
-			ret = ops->WritePageWithLayout(dev, block, i, buf->header, dev->com.pg_size, NULL, &ts);
+			ret = ops->WritePageWithLayout(dev, block, i, buf->header, dev->com.pg_size, NULL, &tag.s);
 		else
 			ret = ops->WritePage(dev, block, i, buf->header, dev->com.pg_size, spare, dev->attr->spare_size);
 
@@ -128,18 +187,18 @@ static void _ForceFormatAndCheckBlock(uffs_Device *dev, int block)
 	}
 	for (i = 0; i < dev->attr->pages_per_block; i++) {
 		memset(buf->header, 0xFF, dev->com.pg_size);
-		memset(&ts, 0xFF, sizeof(ts));
+		memset(&tag, 0xFF, sizeof(tag));
 		memset(spare, 0xFF, dev->attr->spare_size);
 
 		if (ops->ReadPageWithLayout) {
-			ret = ops->ReadPageWithLayout(dev, block, i, buf->header, dev->com.pg_size, NULL, &ts, NULL);
+			ret = ops->ReadPageWithLayout(dev, block, i, buf->header, dev->com.pg_size, NULL, &tag.s, NULL);
 			if (UFFS_FLASH_IS_BAD_BLOCK(ret))
 				goto bad_out;
 			for (j = 0; j < dev->com.pg_size; j++)
 				if (buf->header[j] != 0)
 					goto bad_out;
-			for (j = 0; j < sizeof(ts); j++)
-				if (((u8 *)&ts)[j] != 0)
+			for (j = 0; j < sizeof(tag.s); j++)
+				if (((u8 *)&tag.s)[j] != 0)
 					goto bad_out;
 		}
 		else {
@@ -162,18 +221,18 @@ static void _ForceFormatAndCheckBlock(uffs_Device *dev, int block)
 
 	for (i = 0; i < dev->attr->pages_per_block; i++) {
 		memset(buf->header, 0, dev->com.pg_size);
-		memset(&ts, 0, sizeof(ts));
+		memset(&tag, 0, sizeof(tag));
 		memset(spare, 0, dev->attr->spare_size);
 
 		if (ops->ReadPageWithLayout) {
-			ret = ops->ReadPageWithLayout(dev, block, i, buf->header, dev->com.pg_size, NULL, &ts, NULL);
+			ret = ops->ReadPageWithLayout(dev, block, i, buf->header, dev->com.pg_size, NULL, &tag.s, NULL);
 			if (UFFS_FLASH_IS_BAD_BLOCK(ret))
 				goto bad_out;
 			for (j = 0; j < dev->com.pg_size; j++)
 				if (buf->header[j] != 0xFF)
 					goto bad_out;
-			for (j = 0; j < sizeof(ts); j++)
-				if (((u8 *)&ts)[j] != 0xFF)
+			for (j = 0; j < sizeof(tag.s); j++)
+				if (((u8 *)&tag.s)[j] != 0xFF)
 					goto bad_out;
 		}
 		else {
@@ -211,7 +270,8 @@ ext:
 
 URET uffs_FormatDevice(uffs_Device *dev, UBOOL force)
 {
-	u16 i, slot;
+	uffs_BlockNum i;
+	u16 slot;
 	URET ret = U_SUCC;
 	
 	if (dev == NULL)
@@ -221,6 +281,7 @@ URET uffs_FormatDevice(uffs_Device *dev, UBOOL force)
 		return U_FAIL;
 
 	uffs_GlobalFsLockLock();
+	uffs_DeviceLock(dev);
 
 	ret = uffs_BufFlushAll(dev);
 
@@ -232,9 +293,11 @@ URET uffs_FormatDevice(uffs_Device *dev, UBOOL force)
 	}
 
 	if (ret == U_SUCC && force) {
+		uffs_GlobalTableLock();
 		uffs_DirEntryBufPutAll(dev);
 		uffs_PutAllObjectBuf(dev);
 		uffs_FdSignatureIncrease();
+		uffs_GlobalTableUnlock();
 	}
 
 	if (ret == U_SUCC &&
@@ -264,8 +327,16 @@ URET uffs_FormatDevice(uffs_Device *dev, UBOOL force)
 		ret = U_FAIL;
 	}
 
-	if (ret == U_SUCC)
+	if (ret == U_SUCC) {
 		uffs_BlockInfoExpireAll(dev);
+		uffs_FileInfoExpireAll(dev);
+
+		// page id layout is picked again, ignore what was found on old media
+		if (dev->attr->pages_per_block > UFFS_NARROW_ID_MAX_PAGES || dev->cfg.wide_page_id)
+			dev->com.id_layout = TAG_ID_LAYOUT_WIDE;
+		else
+			dev->com.id_layout = TAG_ID_LAYOUT_NARROW;
+	}
 
 	for (i = dev->par.start; ret == U_SUCC && i <= dev->par.end; i++) {
 		if (uffs_FlashIsBadBlock(dev, i) == U_FALSE) {
@@ -292,6 +363,7 @@ URET uffs_FormatDevice(uffs_Device *dev, UBOOL force)
 		ret = U_FAIL;
 	}
 
+	uffs_DeviceUnLock(dev);
 	uffs_GlobalFsLockUnlock();
 
 	return ret;
@@ -345,7 +417,7 @@ static int DumpTag(struct uffs_DeviceSt *dev, int block, int page, uffs_Tags *ta
 		return -1;
 	}
 	
-	dump(dev, " - page %2d/%2d %s %d/%d len%4d\n", page, s->page_id, GetTagName(s), s->serial, s->parent, s->data_len);
+	dump(dev, " - page %2d/%2d %s %d/%d len%4d\n", page, TAG_PAGE_ID(tag), GetTagName(s), s->serial, s->parent, s->data_len);
 	
 	return 0;
 }
@@ -96,6 +96,7 @@ static int conf_status_byte_offset = STATUS_BYTE_OFFSET_DEFAULT;
 static int conf_total_blocks = TOTAL_BLOCKS_DEFAULT;
 static int conf_ecc_option = ECC_OPTION_DEFAULT;
 static int conf_ecc_size = 0; // 0 - Let UFFS choose the size
+static int conf_wide_page_id = 0;
 
 static const char *g_ecc_option_strings[] = UFFS_ECC_OPTION_STRING;
 
@@ -122,6 +123,7 @@ static void setup_device(uffs_Device *dev)
 	dev->Init = femu_InitDevice;
 	dev->Release = femu_ReleaseDevice;
 	dev->attr = femu_GetStorage();
+	dev->cfg.wide_page_id = conf_wide_page_id;
 }
 
 static void setup_emu_private(uffs_FileEmu *emu)
@@ -140,6 +142,7 @@ static int init_uffs_fs(void)
 		0,			// dirty_pages - default
 		0,			// dirty_groups - default
 		0,			// reserved_free_blocks - default
+		0,			// fi_caches - default
 	};
 
 	if (bIsFileSystemInited)
@@ -285,7 +288,7 @@ static int parse_options(int argc, char *argv[])
 					usage++;
                 else if (sscanf(argv[iarg], "%i", &conf_pages_per_block) < 1)
 					usage++;
-				if (conf_pages_per_block < 2)
+				if (conf_pages_per_block < 2 || conf_pages_per_block > UFFS_MAX_PAGES_PER_BLOCK)
 					usage++;
             }
             else if (!strcmp(arg, "-t") || !strcmp(arg, "--total-blocks")) {
@@ -293,12 +296,15 @@ static int parse_options(int argc, char *argv[])
 					usage++;
                 else if (sscanf(argv[iarg], "%i", &conf_total_blocks) < 1)
 					usage++;
-				if (conf_total_blocks < 2)
+				if (conf_total_blocks < 2 || conf_total_blocks > UFFS_FEMU_MAX_BLOCKS)
 					usage++;
             }
             else if (!strcmp(arg, "-v") || !strcmp(arg, "--verbose")) {
 				conf_verbose_mode++;
             }
+            else if (!strcmp(arg, "-w") || !strcmp(arg, "--wide-page-id")) {
+				conf_wide_page_id = 1;
+            }
             else if (!strcmp(arg, "-m") || !strcmp(arg, "--mount")) {
 				if (++iarg > argc)
 					usage++;
@@ -362,6 +368,7 @@ static int parse_options(int argc, char *argv[])
 		MSGLN("  -o  --status-offset  <n>                  status byte offset, default=%d", STATUS_BYTE_OFFSET_DEFAULT);
         MSGLN("  -b  --block-pages    <n>                  pages per block, default=%d", PAGES_PER_BLOCK_DEFAULT);
         MSGLN("  -t  --total-blocks   <n>                  total blocks");
+        MSGLN("  -w  --wide-page-id                        format with 8-bit page id tags (auto when pages per block > %d)", UFFS_NARROW_ID_MAX_PAGES);
         MSGLN("  -m  --mount          <mount_point,start,end> , for example: -m /,0,-1");
 		MSGLN("  -x  --ecc-option     <none|soft|hw|auto>  ECC option, default=%s", g_ecc_option_strings[ECC_OPTION_DEFAULT]);
 		MSGLN("  -z  --ecc-size       <n>                  ECC size, default=0 (auto)");
@@ -398,6 +405,7 @@ static void print_params(void)
 	MSGLN("  page size: %d", conf_page_data_size);
 	MSGLN("  page spare size: %d", conf_page_spare_size);
 	MSGLN("  pages per block: %d", conf_pages_per_block);
+	MSGLN("  wide page id: %s", conf_wide_page_id || conf_pages_per_block > UFFS_NARROW_ID_MAX_PAGES ? "yes" : "no");
 	MSGLN("  total blocks: %d", conf_total_blocks);
 	MSGLN("  ecc option: %d (%s)", conf_ecc_option, g_ecc_option_strings[conf_ecc_option]);
 	MSGLN("  ecc size: %d%s", conf_ecc_size, conf_ecc_size == 0 ? " (auto)" : "");
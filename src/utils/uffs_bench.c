@@ -0,0 +1,1341 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_bench.c
+ * \brief uffs benchmark suite, runs a fixed set of workloads on
+ *        file emulator and reports results as JSON.
+ * \author Ricky Zheng
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "uffs_config.h"
+#include "uffs/uffs_os.h"
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_fs.h"
+#include "uffs/uffs_fd.h"
+#include "uffs/uffs_utils.h"
+#include "uffs/uffs_core.h"
+#include "uffs/uffs_mtb.h"
+#include "uffs/uffs_timing.h"
+
+#include "uffs_fileem.h"
+
+#if !defined(WIN32) && (defined(CONFIG_USE_GLOBAL_FS_LOCK) || defined(CONFIG_USE_PER_DEVICE_LOCK))
+#define BENCH_MULTI_THREAD
+#include <pthread.h>
+#endif
+
+#define PFX "bnch: "
+#define MSG(msg,...) uffs_PerrorRaw(UFFS_MSG_SERIOUS, msg, ## __VA_ARGS__)
+#define MSGLN(msg,...) uffs_Perror(UFFS_MSG_SERIOUS, msg, ## __VA_ARGS__)
+
+#if CONFIG_USE_STATIC_MEMORY_ALLOCATOR > 0
+int main()
+{
+	MSGLN("Static memory allocator is not supported.");
+	return 0;
+}
+#else
+
+#define DEFAULT_EMU_FILENAME	"uffsbench.bin"
+#define DEFAULT_JSON_FILENAME	"uffs_bench.json"
+
+/* default geometry of the NAND device */
+#define PAGES_PER_BLOCK_DEFAULT			32
+#define PAGE_DATA_SIZE_DEFAULT			512
+#define PAGE_SPARE_SIZE_DEFAULT			16
+#define STATUS_BYTE_OFFSET_DEFAULT		5
+#define TOTAL_BLOCKS_DEFAULT			1024
+#define ECC_OPTION_DEFAULT				UFFS_ECC_SOFT
+
+/* workload parameters */
+#define SEQ_FILE_SIZE_DEFAULT	(2 * 1024 * 1024)
+#define IO_SIZE					4096
+#define RANDOM_OPS				500
+#define SMALL_FILES				200
+#define SMALL_FILE_SIZE			100
+#define DEEP_PATH_DEPTH			8
+#define DEEP_PATH_LOOKUPS		1000
+#define TRUNC_FILE_SIZE			(512 * 1024)
+#define TRUNC_STEP				(16 * 1024)
+#define FILL_FILE_SIZE			(256 * 1024)
+#define MOUNT_REPEAT			5
+#define MT_FILE_SIZE_DEFAULT	(1024 * 1024)
+#define MT_PARTS				2
+#define MT_SMALL_FILES			50
+#define MT_READERS_MAX			8
+#define MT_READ_OPS				20000
+
+static const char *conf_emu_filename = DEFAULT_EMU_FILENAME;
+static const char *conf_json_filename = DEFAULT_JSON_FILENAME;
+static int conf_pages_per_block = PAGES_PER_BLOCK_DEFAULT;
+static int conf_page_data_size = PAGE_DATA_SIZE_DEFAULT;
+static int conf_page_spare_size = PAGE_SPARE_SIZE_DEFAULT;
+static int conf_total_blocks = TOTAL_BLOCKS_DEFAULT;
+static int conf_ecc_option = ECC_OPTION_DEFAULT;
+static int conf_seq_file_size = SEQ_FILE_SIZE_DEFAULT;
+static int conf_mt_file_size = MT_FILE_SIZE_DEFAULT;
+
+static const char *g_ecc_option_strings[] = UFFS_ECC_OPTION_STRING;
+
+static struct uffs_MountTableEntrySt m_mount = {
+	NULL,
+	0,
+	-1,
+	"/",
+	NULL,
+	NULL,
+};
+static uffs_Device m_dev = {0};
+
+static FILE *m_json = NULL;
+static int m_result_count = 0;
+static u8 m_io_buf[IO_SIZE];
+static u32 m_seed = 1;
+
+/** one workload measurement */
+struct bench_st {
+	const char *name;
+	u32 ops;				//!< operations done
+	u32 bytes_read;			//!< logical bytes read
+	u32 bytes_written;		//!< logical bytes written
+	u32 t_start;			//!< workload start time
+	u32 t_op;				//!< current operation start time
+	u32 elapsed;			//!< workload elapsed time (us)
+	u32 *lat;				//!< per operation latency (us)
+	u32 lat_max;			//!< size of lat[]
+	uffs_FlashStat st0;		//!< flash statistic snapshot
+	uffs_FlashStat st;		//!< flash statistic delta
+	UBOOL failed;			//!< workload stopped by a failed operation
+	long failed_at;			//!< file offset or index of the failed operation
+};
+
+static u32 bench_rand(void)
+{
+	m_seed = m_seed * 1103515245 + 12345;
+	return (m_seed >> 16) & 0x7FFF;
+}
+
+static void bench_stat_snapshot(struct bench_st *b)
+{
+	memcpy(&b->st0, &m_dev.st, sizeof(uffs_FlashStat));
+}
+
+static void bench_stat_accumulate(struct bench_st *b)
+{
+	uffs_FlashStat *s = &m_dev.st;
+
+	b->st.block_erase_count += s->block_erase_count - b->st0.block_erase_count;
+	b->st.page_write_count += s->page_write_count - b->st0.page_write_count;
+	b->st.page_read_count += s->page_read_count - b->st0.page_read_count;
+	b->st.page_header_read_count += s->page_header_read_count - b->st0.page_header_read_count;
+	b->st.spare_write_count += s->spare_write_count - b->st0.spare_write_count;
+	b->st.spare_read_count += s->spare_read_count - b->st0.spare_read_count;
+	b->st.io_read += s->io_read - b->st0.io_read;
+	b->st.io_write += s->io_write - b->st0.io_write;
+
+	bench_stat_snapshot(b);
+}
+
+static int bench_begin(struct bench_st *b, const char *name, u32 max_ops)
+{
+	memset(b, 0, sizeof(struct bench_st));
+	b->name = name;
+	b->lat_max = max_ops;
+	b->lat = (u32 *) malloc(sizeof(u32) * max_ops);
+	if (b->lat == NULL) {
+		MSGLN("No memory for %s", name);
+		return -1;
+	}
+	bench_stat_snapshot(b);
+	b->t_start = uffs_GetCurTimeUs();
+
+	return 0;
+}
+
+static void bench_op_start(struct bench_st *b)
+{
+	b->t_op = uffs_GetCurTimeUs();
+}
+
+static void bench_op_end(struct bench_st *b)
+{
+	if (b->ops < b->lat_max)
+		b->lat[b->ops] = uffs_GetCurTimeUs() - b->t_op;
+	b->ops++;
+}
+
+/** mark workload failed at file offset or operation index <pos> */
+static void bench_fail(struct bench_st *b, long pos)
+{
+	MSGLN("%s: operation failed at %ld, error %d", b->name, pos, uffs_get_error());
+	b->failed = U_TRUE;
+	b->failed_at = pos;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a;
+	u32 y = *(const u32 *)b;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static u32 percentile(const u32 *lat, u32 n, int pct)
+{
+	return n > 0 ? lat[(n - 1) * pct / 100] : 0;
+}
+
+/** write result of workload <b> to JSON file and console */
+static void bench_report(struct bench_st *b)
+{
+	u32 n = (b->ops < b->lat_max ? b->ops : b->lat_max);
+	double sec;
+	double wa;
+
+	qsort(b->lat, n, sizeof(u32), cmp_u32);
+
+	sec = (b->elapsed > 0 ? b->elapsed / 1000000.0 : 1e-6);
+	wa = (b->bytes_written > 0 ?
+			(double)b->st.page_write_count * m_dev.attr->page_data_size / b->bytes_written : 0);
+
+	fprintf(m_json, "%s\n    {\n", m_result_count++ > 0 ? "," : "");
+	fprintf(m_json, "      \"name\": \"%s\",\n", b->name);
+	if (b->failed)
+		fprintf(m_json, "      \"failed_at\": %ld,\n", b->failed_at);
+	fprintf(m_json, "      \"ops\": %u,\n", b->ops);
+	fprintf(m_json, "      \"bytes_read\": %u,\n", b->bytes_read);
+	fprintf(m_json, "      \"bytes_written\": %u,\n", b->bytes_written);
+	fprintf(m_json, "      \"elapsed_us\": %u,\n", b->elapsed);
+	fprintf(m_json, "      \"ops_per_sec\": %.1f,\n", b->ops / sec);
+	fprintf(m_json, "      \"mb_per_sec\": %.3f,\n", (b->bytes_read + b->bytes_written) / sec / (1024 * 1024));
+	fprintf(m_json, "      \"latency_us\": { \"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u },\n",
+			percentile(b->lat, n, 50), percentile(b->lat, n, 90),
+			percentile(b->lat, n, 99), percentile(b->lat, n, 100));
+	fprintf(m_json, "      \"flash\": { \"page_read\": %d, \"header_read\": %d, \"spare_read\": %d, "
+			"\"page_write\": %d, \"spare_write\": %d, \"block_erase\": %d, "
+			"\"io_read\": %lu, \"io_write\": %lu, \"write_amp\": %.2f }\n",
+			b->st.page_read_count - b->st.page_header_read_count, b->st.page_header_read_count,
+			b->st.spare_read_count, b->st.page_write_count, b->st.spare_write_count,
+			b->st.block_erase_count, b->st.io_read, b->st.io_write, wa);
+	fprintf(m_json, "    }");
+
+	MSG("%-20s ops %8u  %10.1f ops/s  %8.3f MB/s  p50 %6u us  p99 %6u us" TENDSTR,
+			b->name, b->ops, b->ops / sec,
+			(b->bytes_read + b->bytes_written) / sec / (1024 * 1024),
+			percentile(b->lat, n, 50), percentile(b->lat, n, 99));
+
+	free(b->lat);
+	b->lat = NULL;
+}
+
+/** \return -1 if workload failed, partial result is reported with 'failed_at' */
+static int bench_end(struct bench_st *b)
+{
+	b->elapsed = uffs_GetCurTimeUs() - b->t_start;
+	bench_stat_accumulate(b);
+	bench_report(b);
+
+	return b->failed ? -1 : 0;
+}
+
+/** sequential write then read back a big file */
+static int bench_seq(void)
+{
+	struct bench_st b;
+	int fd, ret = -1;
+	int pos;
+
+	fd = uffs_open("/seq", UO_RDWR | UO_CREATE | UO_TRUNC);
+	if (fd < 0)
+		return -1;
+
+	if (bench_begin(&b, "seq_write", conf_seq_file_size / IO_SIZE + 1) < 0)
+		goto ext;
+	for (pos = 0; pos < conf_seq_file_size; pos += IO_SIZE) {
+		memset(m_io_buf, pos / IO_SIZE, IO_SIZE);
+		bench_op_start(&b);
+		if (uffs_write(fd, m_io_buf, IO_SIZE) != IO_SIZE) {
+			bench_fail(&b, pos);
+			break;
+		}
+		bench_op_end(&b);
+		b.bytes_written += IO_SIZE;
+	}
+	uffs_flush(fd);
+	if (bench_end(&b) < 0)
+		goto ext;
+
+	uffs_seek(fd, 0, USEEK_SET);
+	if (bench_begin(&b, "seq_read", conf_seq_file_size / IO_SIZE + 1) < 0)
+		goto ext;
+	for (pos = 0; pos < conf_seq_file_size; pos += IO_SIZE) {
+		bench_op_start(&b);
+		if (uffs_read(fd, m_io_buf, IO_SIZE) != IO_SIZE) {
+			bench_fail(&b, pos);
+			break;
+		}
+		bench_op_end(&b);
+		b.bytes_read += IO_SIZE;
+	}
+	ret = bench_end(&b);
+
+ext:
+	uffs_close(fd);
+	return ret;
+}
+
+/** random 4K read and overwrite on the big file */
+static int bench_random(void)
+{
+	struct bench_st b;
+	int fd, i, ret = -1;
+	long pos;
+	int chunks = conf_seq_file_size / IO_SIZE;
+
+	fd = uffs_open("/seq", UO_RDWR);
+	if (fd < 0 || chunks <= 0)
+		return -1;
+
+	if (bench_begin(&b, "rand_read_4k", RANDOM_OPS) < 0)
+		goto ext;
+	for (i = 0; i < RANDOM_OPS; i++) {
+		pos = (long)(bench_rand() % chunks) * IO_SIZE;
+		bench_op_start(&b);
+		uffs_seek(fd, pos, USEEK_SET);
+		if (uffs_read(fd, m_io_buf, IO_SIZE) != IO_SIZE) {
+			bench_fail(&b, pos);
+			break;
+		}
+		bench_op_end(&b);
+		b.bytes_read += IO_SIZE;
+	}
+	if (bench_end(&b) < 0)
+		goto ext;
+
+	if (bench_begin(&b, "rand_write_4k", RANDOM_OPS) < 0)
+		goto ext;
+	for (i = 0; i < RANDOM_OPS; i++) {
+		pos = (long)(bench_rand() % chunks) * IO_SIZE;
+		memset(m_io_buf, i, IO_SIZE);
+		bench_op_start(&b);
+		uffs_seek(fd, pos, USEEK_SET);
+		if (uffs_write(fd, m_io_buf, IO_SIZE) != IO_SIZE) {
+			bench_fail(&b, pos);
+			break;
+		}
+		bench_op_end(&b);
+		b.bytes_written += IO_SIZE;
+	}
+	uffs_flush(fd);
+	ret = bench_end(&b);
+
+ext:
+	uffs_close(fd);
+	uffs_remove("/seq");
+	return ret;
+}
+
+/** small files create, stat and delete */
+static int bench_small_files(void)
+{
+	struct bench_st b;
+	char name[32];
+	struct uffs_stat sb;
+	int fd, i, ret;
+
+	uffs_mkdir("/small/");
+
+	if (bench_begin(&b, "small_file_create", SMALL_FILES) < 0)
+		return -1;
+	memset(m_io_buf, 'x', SMALL_FILE_SIZE);
+	for (i = 0; i < SMALL_FILES; i++) {
+		sprintf(name, "/small/f%04d", i);
+		bench_op_start(&b);
+		fd = uffs_open(name, UO_RDWR | UO_CREATE | UO_TRUNC);
+		if (fd < 0) {
+			bench_fail(&b, i);
+			break;
+		}
+		ret = uffs_write(fd, m_io_buf, SMALL_FILE_SIZE);
+		uffs_close(fd);
+		if (ret != SMALL_FILE_SIZE) {
+			bench_fail(&b, i);
+			break;
+		}
+		bench_op_end(&b);
+		b.bytes_written += SMALL_FILE_SIZE;
+	}
+	if (bench_end(&b) < 0)
+		return -1;
+
+	if (bench_begin(&b, "small_file_stat", SMALL_FILES) < 0)
+		return -1;
+	for (i = 0; i < SMALL_FILES; i++) {
+		sprintf(name, "/small/f%04d", i);
+		bench_op_start(&b);
+		if (uffs_stat(name, &sb) < 0) {
+			bench_fail(&b, i);
+			break;
+		}
+		bench_op_end(&b);
+	}
+	if (bench_end(&b) < 0)
+		return -1;
+
+	if (bench_begin(&b, "small_file_delete", SMALL_FILES) < 0)
+		return -1;
+	for (i = 0; i < SMALL_FILES; i++) {
+		sprintf(name, "/small/f%04d", i);
+		bench_op_start(&b);
+		if (uffs_remove(name) < 0) {
+			bench_fail(&b, i);
+			break;
+		}
+		bench_op_end(&b);
+	}
+	if (bench_end(&b) < 0)
+		return -1;
+
+	uffs_rmdir("/small/");
+
+	return 0;
+}
+
+/** lookup a file at the bottom of a deep path */
+static int bench_deep_path(void)
+{
+	struct bench_st b;
+	char path[DEEP_PATH_DEPTH * 8 + 16];
+	char *p = path;
+	struct uffs_stat sb;
+	int i, fd, ret;
+
+	*p++ = '/';
+	for (i = 0; i < DEEP_PATH_DEPTH; i++) {
+		p += sprintf(p, "dir%d/", i);
+		*p = '\0';
+		uffs_mkdir(path);
+	}
+	strcpy(p, "file");
+	fd = uffs_open(path, UO_RDWR | UO_CREATE);
+	if (fd < 0)
+		return -1;
+	uffs_close(fd);
+
+	if (bench_begin(&b, "deep_path_lookup", DEEP_PATH_LOOKUPS) < 0)
+		return -1;
+	for (i = 0; i < DEEP_PATH_LOOKUPS; i++) {
+		bench_op_start(&b);
+		if (uffs_stat(path, &sb) < 0) {
+			bench_fail(&b, i);
+			break;
+		}
+		bench_op_end(&b);
+	}
+	ret = bench_end(&b);
+
+	uffs_remove(path);
+	for (i = DEEP_PATH_DEPTH - 1; i >= 0; i--) {
+		*p = '\0';
+		uffs_rmdir(path);
+		for (p--; p > path && *(p - 1) != '/'; p--);
+	}
+
+	return ret;
+}
+
+/** truncate a file step by step */
+static int bench_truncate(void)
+{
+	struct bench_st b;
+	int fd, pos, ret;
+	long remain;
+
+	fd = uffs_open("/trunc", UO_RDWR | UO_CREATE | UO_TRUNC);
+	if (fd < 0)
+		return -1;
+
+	memset(m_io_buf, 't', IO_SIZE);
+	for (pos = 0; pos < TRUNC_FILE_SIZE; pos += IO_SIZE) {
+		if (uffs_write(fd, m_io_buf, IO_SIZE) != IO_SIZE)
+			break;
+	}
+	uffs_flush(fd);
+
+	if (bench_begin(&b, "truncate", TRUNC_FILE_SIZE / TRUNC_STEP) < 0) {
+		uffs_close(fd);
+		uffs_remove("/trunc");
+		return -1;
+	}
+	if (pos < TRUNC_FILE_SIZE) {
+		bench_fail(&b, pos);	// file not fully written, nothing to measure
+	}
+	else {
+		for (remain = TRUNC_FILE_SIZE - TRUNC_STEP; remain >= 0; remain -= TRUNC_STEP) {
+			bench_op_start(&b);
+			if (uffs_ftruncate(fd, remain) < 0) {
+				bench_fail(&b, remain);
+				break;
+			}
+			bench_op_end(&b);
+		}
+	}
+	ret = bench_end(&b);
+
+	uffs_close(fd);
+	uffs_remove("/trunc");
+
+	return ret;
+}
+
+/** fill partition to <level> percent, then measure mount time */
+static int bench_mount_fill(int level, int *nfiles)
+{
+	struct bench_st b;
+	char name[32];
+	char bench_name[32];
+	int fd, pos, i;
+	int fill_failed = -1;	// index of the file which couldn't be filled
+
+	uffs_mkdir("/fill/");
+
+	memset(m_io_buf, 'f', IO_SIZE);
+	while (uffs_space_used("/") < uffs_space_total("/") / 100 * level) {
+		sprintf(name, "/fill/f%04d", *nfiles);
+		fd = uffs_open(name, UO_RDWR | UO_CREATE | UO_TRUNC);
+		if (fd < 0) {
+			fill_failed = *nfiles;
+			break;
+		}
+		for (pos = 0; pos < FILL_FILE_SIZE; pos += IO_SIZE) {
+			if (uffs_write(fd, m_io_buf, IO_SIZE) != IO_SIZE)
+				break;
+		}
+		uffs_close(fd);
+		(*nfiles)++;
+		if (pos < FILL_FILE_SIZE) {
+			fill_failed = *nfiles - 1;	// full before reaching <level> ?
+			break;
+		}
+	}
+
+	sprintf(bench_name, "mount_fill_%d", level);
+	if (bench_begin(&b, bench_name, MOUNT_REPEAT) < 0)
+		return -1;
+	if (fill_failed >= 0) {
+		bench_fail(&b, fill_failed);	// not filled to <level>, don't measure
+	}
+	else {
+		for (i = 0; i < MOUNT_REPEAT; i++) {
+			if (uffs_UnMount("/") < 0) {
+				bench_fail(&b, i);
+				break;
+			}
+			memset(&b.st0, 0, sizeof(uffs_FlashStat));	// statistic is reset by mount
+			bench_op_start(&b);
+			if (uffs_Mount("/") < 0) {
+				bench_fail(&b, i);
+				break;
+			}
+			bench_op_end(&b);
+			bench_stat_accumulate(&b);
+		}
+	}
+
+	return bench_end(&b);
+}
+
+static int bench_mount(void)
+{
+	int levels[] = { 0, 25, 50, 75 };
+	int nfiles = 0;
+	int i, ret = 0;
+	char name[32];
+
+	for (i = 0; ret == 0 && i < ARRAY_SIZE(levels); i++)
+		ret = bench_mount_fill(levels[i], &nfiles);
+
+	for (i = 0; i < nfiles; i++) {
+		sprintf(name, "/fill/f%04d", i);
+		uffs_remove(name);
+	}
+	uffs_rmdir("/fill/");
+
+	return ret;
+}
+
+static void setup_storage(struct uffs_StorageAttrSt *attr)
+{
+	attr->total_blocks = conf_total_blocks;
+	attr->page_data_size = conf_page_data_size;
+	attr->spare_size = conf_page_spare_size;
+	attr->pages_per_block = conf_pages_per_block;
+	attr->block_status_offs = STATUS_BYTE_OFFSET_DEFAULT;
+	attr->ecc_opt = conf_ecc_option;
+	attr->ecc_size = 0;
+	attr->layout_opt = UFFS_LAYOUT_UFFS;
+}
+
+#ifdef BENCH_MULTI_THREAD
+/*
+ * Multi-thread workload: two partitions, each on its own emulated chip
+ * (own host file and chip lock), one thread per partition. Flash operations
+ * of a chip are serialized by its chip lock, partitions on different chips
+ * can run in parallel if the file system allows it (CONFIG_USE_PER_DEVICE_LOCK).
+ */
+static struct uffs_MountTableEntrySt m_mt_mount[MT_PARTS] = {
+	{ NULL, 0, -1, "/p0/", NULL, NULL },
+	{ NULL, 0, -1, "/p1/", NULL, NULL },
+};
+static uffs_Device m_mt_dev[MT_PARTS];
+
+struct mt_chip_st {
+	struct uffs_StorageAttrSt attr;
+	uffs_FileEmu emu;
+	char filename[256];
+	pthread_mutex_t lock;
+	pthread_mutex_t *plock;	//!< lock in use, chips share one lock with hw auto ECC
+};
+static struct mt_chip_st m_mt_chip[MT_PARTS];
+
+static struct uffs_FlashOpsSt m_chip_ops_orig;
+
+static pthread_mutex_t * chip_lock_of(uffs_Device *dev)
+{
+	int i;
+
+	for (i = 0; i < MT_PARTS; i++) {
+		if (dev == &m_mt_dev[i])
+			return m_mt_chip[i].plock;
+	}
+
+	return NULL;
+}
+
+#define CHIP_LOCKED(dev, ret, call) \
+	do { \
+		pthread_mutex_t *lock = chip_lock_of(dev); \
+		if (lock) pthread_mutex_lock(lock); \
+		ret = call; \
+		if (lock) pthread_mutex_unlock(lock); \
+	} while (0)
+
+static int chip_ReadPage(uffs_Device *dev, u32 block, u32 page, u8 *data, int data_len, u8 *ecc,
+						u8 *spare, int spare_len)
+{
+	int ret;
+	CHIP_LOCKED(dev, ret, m_chip_ops_orig.ReadPage(dev, block, page, data, data_len, ecc, spare, spare_len));
+	return ret;
+}
+
+static int chip_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8* data, int data_len, u8 *ecc,
+						uffs_TagStore *ts, u8 *ecc_store)
+{
+	int ret;
+	CHIP_LOCKED(dev, ret, m_chip_ops_orig.ReadPageWithLayout(dev, block, page, data, data_len, ecc, ts, ecc_store));
+	return ret;
+}
+
+static int chip_WritePage(uffs_Device *dev, u32 block, u32 page,
+						const u8 *data, int data_len, const u8 *spare, int spare_len)
+{
+	int ret;
+	CHIP_LOCKED(dev, ret, m_chip_ops_orig.WritePage(dev, block, page, data, data_len, spare, spare_len));
+	return ret;
+}
+
+static int chip_WritePageWithLayout(uffs_Device *dev, u32 block, u32 page,
+						const u8 *data, int data_len, const u8 *ecc, const uffs_TagStore *ts)
+{
+	int ret;
+	CHIP_LOCKED(dev, ret, m_chip_ops_orig.WritePageWithLayout(dev, block, page, data, data_len, ecc, ts));
+	return ret;
+}
+
+static int chip_IsBadBlock(uffs_Device *dev, u32 block)
+{
+	int ret;
+	CHIP_LOCKED(dev, ret, m_chip_ops_orig.IsBadBlock(dev, block));
+	return ret;
+}
+
+static int chip_MarkBadBlock(uffs_Device *dev, u32 block)
+{
+	int ret;
+	CHIP_LOCKED(dev, ret, m_chip_ops_orig.MarkBadBlock(dev, block));
+	return ret;
+}
+
+static int chip_EraseBlock(uffs_Device *dev, u32 block)
+{
+	int ret;
+	CHIP_LOCKED(dev, ret, m_chip_ops_orig.EraseBlock(dev, block));
+	return ret;
+}
+
+/** serialize flash operations on each chip */
+static void chip_lock_setup(struct uffs_FlashOpsSt *ops)
+{
+	memcpy(&m_chip_ops_orig, ops, sizeof(struct uffs_FlashOpsSt));
+
+	if (ops->ReadPage)
+		ops->ReadPage = chip_ReadPage;
+	if (ops->ReadPageWithLayout)
+		ops->ReadPageWithLayout = chip_ReadPageWithLayout;
+	if (ops->WritePage)
+		ops->WritePage = chip_WritePage;
+	if (ops->WritePageWithLayout)
+		ops->WritePageWithLayout = chip_WritePageWithLayout;
+	if (ops->IsBadBlock)
+		ops->IsBadBlock = chip_IsBadBlock;
+	if (ops->MarkBadBlock)
+		ops->MarkBadBlock = chip_MarkBadBlock;
+	if (ops->EraseBlock)
+		ops->EraseBlock = chip_EraseBlock;
+}
+
+static void chip_lock_restore(struct uffs_FlashOpsSt *ops)
+{
+	memcpy(ops, &m_chip_ops_orig, sizeof(struct uffs_FlashOpsSt));
+}
+
+static URET mt_InitDevice(uffs_Device *dev)
+{
+	struct mt_chip_st *chip = &m_mt_chip[dev - m_mt_dev];
+
+	femu_SetupDevice(dev, &chip->attr, &chip->emu);
+
+	return U_SUCC;
+}
+
+struct mt_worker_st {
+	int part;				//!< partition index (reader index for mt_reader)
+	pthread_t tid;
+	struct bench_st b;		//!< only ops, bytes and lat[] are used
+	int ret;
+};
+
+static void * mt_worker(void *arg)
+{
+	struct mt_worker_st *w = (struct mt_worker_st *) arg;
+	struct bench_st *b = &w->b;
+	const char *mount = m_mt_mount[w->part].mount;
+	char name[64];
+	struct uffs_stat sb;
+	u8 buf[IO_SIZE];
+	int fd, pos, i;
+
+	w->ret = -1;
+
+	sprintf(name, "%smt.bin", mount);
+	fd = uffs_open(name, UO_RDWR | UO_CREATE | UO_TRUNC);
+	if (fd < 0)
+		return NULL;
+	for (pos = 0; pos < conf_mt_file_size; pos += IO_SIZE) {
+		memset(buf, pos / IO_SIZE + w->part, IO_SIZE);
+		bench_op_start(b);
+		if (uffs_write(fd, buf, IO_SIZE) != IO_SIZE)
+			break;
+		bench_op_end(b);
+		b->bytes_written += IO_SIZE;
+	}
+	uffs_seek(fd, 0, USEEK_SET);
+	for (pos = 0; pos < conf_mt_file_size; pos += IO_SIZE) {
+		bench_op_start(b);
+		if (uffs_read(fd, buf, IO_SIZE) != IO_SIZE)
+			break;
+		bench_op_end(b);
+		b->bytes_read += IO_SIZE;
+		if (buf[0] != (u8)(pos / IO_SIZE + w->part)) {
+			MSGLN("%s: data mismatch at %d", name, pos);
+			break;
+		}
+	}
+	uffs_close(fd);
+	uffs_remove(name);
+	if (pos < conf_mt_file_size)
+		return NULL;
+
+	memset(buf, 'm', SMALL_FILE_SIZE);
+	for (i = 0; i < MT_SMALL_FILES; i++) {
+		sprintf(name, "%sf%04d", mount, i);
+		bench_op_start(b);
+		fd = uffs_open(name, UO_RDWR | UO_CREATE | UO_TRUNC);
+		if (fd < 0)
+			return NULL;
+		if (uffs_write(fd, buf, SMALL_FILE_SIZE) != SMALL_FILE_SIZE) {
+			MSGLN("%s: write failed, error %d", name, uffs_get_error());
+			uffs_close(fd);
+			return NULL;
+		}
+		uffs_close(fd);
+		bench_op_end(b);
+		b->bytes_written += SMALL_FILE_SIZE;
+	}
+	for (i = 0; i < MT_SMALL_FILES; i++) {
+		sprintf(name, "%sf%04d", mount, i);
+		bench_op_start(b);
+		if (uffs_stat(name, &sb) < 0)
+			return NULL;
+		bench_op_end(b);
+	}
+	for (i = 0; i < MT_SMALL_FILES; i++) {
+		sprintf(name, "%sf%04d", mount, i);
+		bench_op_start(b);
+		if (uffs_remove(name) < 0)
+			return NULL;
+		bench_op_end(b);
+	}
+
+	w->ret = 0;
+
+	return NULL;
+}
+
+/** run worker on all partitions, one after another or in parallel */
+static int bench_mt_run(const char *bench_name, UBOOL parallel)
+{
+	struct mt_worker_st w[MT_PARTS];
+	struct bench_st b;
+	uffs_FlashStat st0[MT_PARTS];
+	u32 lat_max = (conf_mt_file_size / IO_SIZE + 1) * 2 + MT_SMALL_FILES * 3;
+	u32 n;
+	int i, ret = 0;
+
+	memset(&b, 0, sizeof(struct bench_st));
+	b.name = bench_name;
+	b.lat_max = lat_max * MT_PARTS;
+	b.lat = (u32 *) malloc(sizeof(u32) * b.lat_max);
+	if (b.lat == NULL)
+		return -1;
+
+	memset(w, 0, sizeof(w));
+	for (i = 0; i < MT_PARTS; i++) {
+		w[i].part = i;
+		w[i].b.lat_max = lat_max;
+		w[i].b.lat = b.lat + lat_max * i;
+		memcpy(&st0[i], &m_mt_dev[i].st, sizeof(uffs_FlashStat));
+	}
+
+	b.t_start = uffs_GetCurTimeUs();
+	for (i = 0; i < MT_PARTS; i++) {
+		if (!parallel)
+			mt_worker(&w[i]);
+		else if (pthread_create(&w[i].tid, NULL, mt_worker, &w[i]) != 0) {
+			w[i].ret = -1;
+			w[i].tid = 0;
+		}
+	}
+	if (parallel) {
+		for (i = 0; i < MT_PARTS; i++) {
+			if (w[i].tid)
+				pthread_join(w[i].tid, NULL);
+		}
+	}
+	b.elapsed = uffs_GetCurTimeUs() - b.t_start;
+
+	// merge results, compact latencies to the head of b.lat
+	for (i = 0, n = 0; i < MT_PARTS; i++) {
+		uffs_FlashStat *s = &m_mt_dev[i].st;
+
+		if (w[i].ret != 0) {
+			ret = -1;
+			b.failed = U_TRUE;
+			b.failed_at = i;	// the worker
+		}
+		memmove(b.lat + n, w[i].b.lat, sizeof(u32) *
+				(w[i].b.ops < lat_max ? w[i].b.ops : lat_max));
+		n += (w[i].b.ops < lat_max ? w[i].b.ops : lat_max);
+		b.ops += w[i].b.ops;
+		b.bytes_read += w[i].b.bytes_read;
+		b.bytes_written += w[i].b.bytes_written;
+
+		b.st.block_erase_count += s->block_erase_count - st0[i].block_erase_count;
+		b.st.page_write_count += s->page_write_count - st0[i].page_write_count;
+		b.st.page_read_count += s->page_read_count - st0[i].page_read_count;
+		b.st.page_header_read_count += s->page_header_read_count - st0[i].page_header_read_count;
+		b.st.spare_write_count += s->spare_write_count - st0[i].spare_write_count;
+		b.st.spare_read_count += s->spare_read_count - st0[i].spare_read_count;
+		b.st.io_read += s->io_read - st0[i].io_read;
+		b.st.io_write += s->io_write - st0[i].io_write;
+	}
+	b.lat_max = n;
+
+	bench_report(&b);
+
+	return ret;
+}
+
+/*
+ * Concurrent readers of a small, hot file which stays in page buffers.
+ * With CONFIG_USE_PER_DEVICE_LOCK readers only take shared device lock
+ * on cache hits, so throughput should scale with reader threads.
+ */
+static int m_hot_size;
+
+static void * mt_reader(void *arg)
+{
+	struct mt_worker_st *w = (struct mt_worker_st *) arg;
+	struct bench_st *b = &w->b;
+	int io_size = m_dev.attr->page_data_size;
+	u8 *buf;
+	u32 seed = w->part + 1;
+	int fd, pos, i;
+
+	w->ret = -1;
+
+	buf = (u8 *) malloc(io_size);	// pages can be large, keep it off the thread stack
+	if (buf == NULL)
+		return NULL;
+
+	fd = uffs_open("/hot.bin", UO_RDONLY);
+	if (fd < 0) {
+		free(buf);
+		return NULL;
+	}
+	for (i = 0; i < MT_READ_OPS; i++) {
+		seed = seed * 1103515245 + 12345;
+		pos = ((seed >> 16) % (m_hot_size / io_size)) * io_size;
+		bench_op_start(b);
+		if (uffs_seek(fd, pos, USEEK_SET) != pos || uffs_read(fd, buf, io_size) != io_size)
+			break;
+		bench_op_end(b);
+		b->bytes_read += io_size;
+		if (buf[0] != (u8)(pos / io_size)) {
+			MSGLN("/hot.bin: data mismatch at %d", pos);
+			break;
+		}
+	}
+	uffs_close(fd);
+	free(buf);
+
+	if (i == MT_READ_OPS)
+		w->ret = 0;
+
+	return NULL;
+}
+
+static int bench_mt_read_run(const char *bench_name, int readers)
+{
+	struct mt_worker_st w[MT_READERS_MAX];
+	struct bench_st b;
+	u32 n;
+	int i, ret = 0;
+
+	if (bench_begin(&b, bench_name, MT_READ_OPS * readers) < 0)
+		return -1;
+
+	memset(w, 0, sizeof(w));
+	for (i = 0; i < readers; i++) {
+		w[i].part = i;
+		w[i].b.lat_max = MT_READ_OPS;
+		w[i].b.lat = b.lat + MT_READ_OPS * i;
+		if (pthread_create(&w[i].tid, NULL, mt_reader, &w[i]) != 0) {
+			w[i].ret = -1;
+			w[i].tid = 0;
+		}
+	}
+	for (i = 0; i < readers; i++) {
+		if (w[i].tid)
+			pthread_join(w[i].tid, NULL);
+	}
+	b.elapsed = uffs_GetCurTimeUs() - b.t_start;
+	bench_stat_accumulate(&b);
+
+	for (i = 0, n = 0; i < readers; i++) {
+		if (w[i].ret != 0) {
+			ret = -1;
+			b.failed = U_TRUE;
+			b.failed_at = i;	// the worker
+		}
+		memmove(b.lat + n, w[i].b.lat, sizeof(u32) * w[i].b.ops);
+		n += w[i].b.ops;
+		b.ops += w[i].b.ops;
+		b.bytes_read += w[i].b.bytes_read;
+	}
+	b.lat_max = n;
+
+	bench_report(&b);
+
+	return ret;
+}
+
+/** 1, 4 and 8 readers on a cached file */
+static int bench_mt_read(void)
+{
+	int io_size = m_dev.attr->page_data_size;
+	u8 *buf;
+	int fd, pos, ret = -1;
+
+	// half of page buffers, so the whole file stays cached
+	m_hot_size = m_dev.cfg.page_buffers / 2 * io_size;
+
+	buf = (u8 *) malloc(io_size);
+	if (buf == NULL)
+		return -1;
+
+	fd = uffs_open("/hot.bin", UO_RDWR | UO_CREATE | UO_TRUNC);
+	if (fd < 0) {
+		free(buf);
+		return -1;
+	}
+	for (pos = 0; pos < m_hot_size; pos += io_size) {
+		memset(buf, pos / io_size, io_size);
+		if (uffs_write(fd, buf, io_size) != io_size)
+			break;
+	}
+	uffs_flush(fd);
+	// warm up page buffers
+	uffs_seek(fd, 0, USEEK_SET);
+	while (uffs_read(fd, buf, io_size) > 0)
+		;
+	uffs_close(fd);
+	free(buf);
+
+	if (pos == m_hot_size) {
+		ret = bench_mt_read_run("mt_hot_read_1t", 1);
+		if (ret == 0)
+			ret = bench_mt_read_run("mt_hot_read_4t", 4);
+		if (ret == 0)
+			ret = bench_mt_read_run("mt_hot_read_8t", 8);
+	}
+
+	uffs_remove("/hot.bin");
+
+	return ret;
+}
+
+/** same workload on two partitions, serial vs. parallel */
+static int bench_mt(void)
+{
+	int i, n = 0, ret = -1;
+	struct uffs_FlashOpsSt *ops = m_dev.ops;
+
+	// the whole chip is not used during this test
+	if (uffs_UnMount("/") < 0)
+		return -1;
+
+	// one chip per partition, each half the size of the main chip
+	for (i = 0; i < MT_PARTS; i++) {
+		struct mt_chip_st *chip = &m_mt_chip[i];
+
+		memset(&chip->emu, 0, sizeof(uffs_FileEmu));
+		sprintf(chip->filename, "%.240s.p%d", conf_emu_filename, i);
+		remove(chip->filename);
+		chip->emu.emu_filename = chip->filename;
+#ifdef UFFS_FEMU_ENABLE_INJECTION
+		chip->emu.wrap_inited = U_TRUE;
+#endif
+		setup_storage(&chip->attr);
+		chip->attr.total_blocks = conf_total_blocks / MT_PARTS;
+
+		// hw auto ECC emulates one serial data buffer for all chips
+		pthread_mutex_init(&chip->lock, NULL);
+		chip->plock = (conf_ecc_option == UFFS_ECC_HW_AUTO ? &m_mt_chip[0].lock : &chip->lock);
+
+		memset(&m_mt_dev[i], 0, sizeof(uffs_Device));
+#if CONFIG_USE_SYSTEM_MEMORY_ALLOCATOR > 0
+		uffs_MemSetupSystemAllocator(&m_mt_dev[i].mem);
+#endif
+		m_mt_dev[i].Init = mt_InitDevice;
+		m_mt_dev[i].Release = femu_ReleaseDevice;
+		m_mt_dev[i].attr = &chip->attr;
+		m_mt_mount[i].dev = &m_mt_dev[i];
+	}
+
+	chip_lock_setup(ops);
+
+	for (n = 0; n < MT_PARTS; n++) {
+		uffs_RegisterMountTable(&m_mt_mount[n]);
+		if (uffs_Mount(m_mt_mount[n].mount) < 0) {
+			MSGLN("Can't mount %s", m_mt_mount[n].mount);
+			uffs_UnRegisterMountTable(&m_mt_mount[n]);
+			goto ext;
+		}
+	}
+
+	ret = bench_mt_run("mt_2part_serial", U_FALSE);
+	if (ret == 0)
+		ret = bench_mt_run("mt_2part_parallel", U_TRUE);
+
+ext:
+	for (i = 0; i < n; i++) {
+		uffs_UnMount(m_mt_mount[i].mount);
+		uffs_UnRegisterMountTable(&m_mt_mount[i]);
+	}
+
+	chip_lock_restore(ops);
+
+	for (i = 0; i < MT_PARTS; i++) {
+		pthread_mutex_destroy(&m_mt_chip[i].lock);
+		remove(m_mt_chip[i].filename);
+	}
+
+	if (uffs_Mount("/") < 0)
+		ret = -1;
+
+	return ret;
+}
+#endif
+
+#ifdef CONFIG_ENABLE_TIMING_STAT
+/** dump timing histograms collected over the whole run */
+static void print_timing(void)
+{
+	uffs_TimingHist hist;
+	int i, n = 0;
+
+	fprintf(m_json, "  \"timing_us\": [");
+	for (i = 0; i < UFFS_TM_MAX; i++) {
+		if (uffs_TimingGet(i, &hist) == U_FAIL || hist.count == 0)
+			continue;
+		fprintf(m_json, "%s\n    { \"name\": \"%s\", \"count\": %u, \"avg\": %u, "
+				"\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u }",
+				n++ > 0 ? "," : "", uffs_TimingName(i), hist.count, hist.total / hist.count,
+				uffs_TimingPercentile(&hist, 50), uffs_TimingPercentile(&hist, 90),
+				uffs_TimingPercentile(&hist, 99), hist.max);
+	}
+	fprintf(m_json, "\n  ],\n");
+}
+#endif
+
+static int init_uffs_fs(void)
+{
+	uffs_FileEmu *emu = femu_GetPrivate();
+
+	memset(emu, 0, sizeof(uffs_FileEmu));
+	emu->emu_filename = conf_emu_filename;
+	remove(conf_emu_filename);	// always start from a blank flash
+#ifdef UFFS_FEMU_ENABLE_INJECTION
+	emu->wrap_inited = U_TRUE;	// no fault injection, keep results comparable
+#endif
+
+	setup_storage(femu_GetStorage());
+
+	m_mount.dev = &m_dev;
+#if CONFIG_USE_SYSTEM_MEMORY_ALLOCATOR > 0
+	uffs_MemSetupSystemAllocator(&m_dev.mem);
+#endif
+	m_dev.Init = femu_InitDevice;
+	m_dev.Release = femu_ReleaseDevice;
+	m_dev.attr = femu_GetStorage();
+
+	uffs_RegisterMountTable(&m_mount);
+	if (uffs_Mount("/") < 0)
+		return -1;
+
+	return uffs_InitFileSystemObjects() == U_SUCC ? 0 : -1;
+}
+
+static void release_uffs_fs(void)
+{
+	uffs_UnMount("/");
+	uffs_ReleaseFileSystemObjects();
+}
+
+static int parse_options(int argc, char *argv[])
+{
+	int iarg;
+	int usage = 0;
+	int i;
+
+	for (iarg = 1; iarg < argc && !usage; iarg++) {
+		const char *arg = argv[iarg];
+
+		if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+			usage++;
+		}
+		else if (!strcmp(arg, "-f") || !strcmp(arg, "--file")) {
+			if (++iarg >= argc)
+				usage++;
+			else
+				conf_emu_filename = argv[iarg];
+		}
+		else if (!strcmp(arg, "-o") || !strcmp(arg, "--output")) {
+			if (++iarg >= argc)
+				usage++;
+			else
+				conf_json_filename = argv[iarg];
+		}
+		else if (!strcmp(arg, "-p") || !strcmp(arg, "--page-size")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_page_data_size) < 1)
+				usage++;
+			else if (conf_page_data_size <= 0 || conf_page_data_size > UFFS_MAX_PAGE_SIZE)
+				usage++;
+		}
+		else if (!strcmp(arg, "-s") || !strcmp(arg, "--spare-size")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_page_spare_size) < 1)
+				usage++;
+			else if (conf_page_spare_size < sizeof(struct uffs_TagStoreSt) + 1 ||
+				(conf_page_spare_size % 4) != 0 || conf_page_spare_size > UFFS_MAX_SPARE_SIZE)
+				usage++;
+		}
+		else if (!strcmp(arg, "-b") || !strcmp(arg, "--block-pages")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_pages_per_block) < 1)
+				usage++;
+			else if (conf_pages_per_block < 2 || conf_pages_per_block > UFFS_MAX_PAGES_PER_BLOCK)
+				usage++;
+		}
+		else if (!strcmp(arg, "-t") || !strcmp(arg, "--total-blocks")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_total_blocks) < 1)
+				usage++;
+			else if (conf_total_blocks < 2 || conf_total_blocks > UFFS_FEMU_MAX_BLOCKS)
+				usage++;
+		}
+		else if (!strcmp(arg, "-n") || !strcmp(arg, "--seq-size")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_seq_file_size) < 1)
+				usage++;
+			else if (conf_seq_file_size < IO_SIZE)
+				usage++;
+		}
+		else if (!strcmp(arg, "-m") || !strcmp(arg, "--mt-size")) {
+			if (++iarg >= argc || sscanf(argv[iarg], "%i", &conf_mt_file_size) < 1)
+				usage++;
+			else if (conf_mt_file_size < 0)
+				usage++;
+		}
+		else if (!strcmp(arg, "-x") || !strcmp(arg, "--ecc-option")) {
+			if (++iarg >= argc)
+				usage++;
+			else {
+				for (i = 0; i < ARRAY_SIZE(g_ecc_option_strings); i++) {
+					if (!strcmp(argv[iarg], g_ecc_option_strings[i])) {
+						conf_ecc_option = i;
+						break;
+					}
+				}
+				if (i == ARRAY_SIZE(g_ecc_option_strings))
+					usage++;
+			}
+		}
+		else {
+			MSGLN("Unknown option: %s, try %s --help", arg, argv[0]);
+			return -1;
+		}
+	}
+
+	if (usage) {
+		MSGLN("Usage: %s [options]", argv[0]);
+		MSGLN("  -h  --help                                show usage");
+		MSGLN("  -f  --file           <file>               uffs image file, default=%s", DEFAULT_EMU_FILENAME);
+		MSGLN("  -o  --output         <file>               JSON result file, default=%s", DEFAULT_JSON_FILENAME);
+		MSGLN("  -p  --page-size      <n>                  page data size, default=%d", PAGE_DATA_SIZE_DEFAULT);
+		MSGLN("  -s  --spare-size     <n>                  page spare size, default=%d", PAGE_SPARE_SIZE_DEFAULT);
+		MSGLN("  -b  --block-pages    <n>                  pages per block, default=%d", PAGES_PER_BLOCK_DEFAULT);
+		MSGLN("  -t  --total-blocks   <n>                  total blocks, default=%d", TOTAL_BLOCKS_DEFAULT);
+		MSGLN("  -n  --seq-size       <n>                  sequential file size, default=%d", SEQ_FILE_SIZE_DEFAULT);
+		MSGLN("  -m  --mt-size        <n>                  file size per thread for multi-thread tests, 0 to skip them, default=%d", MT_FILE_SIZE_DEFAULT);
+		MSGLN("  -x  --ecc-option     <none|soft|hw|auto>  ECC option, default=%s", g_ecc_option_strings[ECC_OPTION_DEFAULT]);
+		MSGLN("");
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+
+	uffs_SetupDebugOutput();
+	uffs_DebugSetMessageLevel(UFFS_MSG_SERIOUS);
+
+	if (parse_options(argc, argv) < 0)
+		return -1;
+
+	if (init_uffs_fs() < 0) {
+		MSGLN("Init file system fail.");
+		return -1;
+	}
+
+	m_json = fopen(conf_json_filename, "w");
+	if (m_json == NULL) {
+		MSGLN("Can't create %s", conf_json_filename);
+		release_uffs_fs();
+		return -1;
+	}
+
+	fprintf(m_json, "{\n");
+	fprintf(m_json, "  \"version\": \"%x\",\n", uffs_version());
+	fprintf(m_json, "  \"geometry\": { \"page_size\": %d, \"spare_size\": %d, \"pages_per_block\": %d, "
+			"\"total_blocks\": %d, \"ecc\": \"%s\" },\n",
+			conf_page_data_size, conf_page_spare_size, conf_pages_per_block,
+			conf_total_blocks, g_ecc_option_strings[conf_ecc_option]);
+	fprintf(m_json, "  \"config\": { \"page_buffers\": %d, \"block_info_caches\": %d, "
+			"\"file_info_caches\": %d, "
+			"\"dirty_pages\": %d, \"dirty_groups\": %d, \"lock\": \"%s\" },\n",
+			m_dev.cfg.page_buffers, m_dev.cfg.bc_caches, m_dev.cfg.fi_caches,
+			m_dev.cfg.dirty_pages, m_dev.cfg.dirty_groups,
+#if defined(CONFIG_USE_GLOBAL_FS_LOCK)
+			"global"
+#elif defined(CONFIG_USE_PER_DEVICE_LOCK)
+			"per_device"
+#else
+			"none"
+#endif
+			);
+	fprintf(m_json, "  \"results\": [");
+
+#ifdef CONFIG_ENABLE_TIMING_STAT
+	uffs_TimingReset();
+#endif
+
+	if (ret == 0) ret = bench_seq();
+	if (ret == 0) ret = bench_random();
+	if (ret == 0) ret = bench_small_files();
+	if (ret == 0) ret = bench_deep_path();
+	if (ret == 0) ret = bench_truncate();
+	if (ret == 0) ret = bench_mount();
+#ifdef BENCH_MULTI_THREAD
+	if (ret == 0 && conf_mt_file_size > 0) ret = bench_mt_read();
+	if (ret == 0 && conf_mt_file_size > 0) ret = bench_mt();
+#endif
+
+	fprintf(m_json, "\n  ],\n");
+#ifdef CONFIG_ENABLE_TIMING_STAT
+	print_timing();
+#endif
+	fprintf(m_json, "  \"status\": \"%s\"\n}\n", ret == 0 ? "succ" : "failed");
+	fclose(m_json);
+
+	if (ret != 0)
+		MSGLN("Benchmark failed, results are incomplete.");
+
+	release_uffs_fs();
+
+	return ret == 0 ? 0 : -1;
+}
+#endif